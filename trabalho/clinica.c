@@ -1,17 +1,213 @@
+#define _GNU_SOURCE // open_memstream, sysconf e demais funções POSIX
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <termios.h>
+
+// Assinatura do arquivo compacto (nomes com codificação de prefixo e datas em delta)
+// A versão 1 não tinha como guardar as datas que não são dias do calendário; ainda é lida
+#define ASSINATURA_COMPACTO "PCZ2"
+#define ASSINATURA_COMPACTO_V1 "PCZ1"
+
+// Maior nome aceito na leitura dos arquivos compactos: acima disso o arquivo está corrompido
+#define MAIOR_NOME_COMPACTO (1 << 24)
+
+// Arquivo do histórico de consultas e sua assinatura (mesma codificação do arquivo compacto)
+#define ARQUIVO_HISTORICO "historico_consultas.hcz"
+#define ASSINATURA_HISTORICO "HCZ1"
+
+// Recarga automática: intervalo entre as consultas ao stat do arquivo quando não há inotify
+#define INTERVALO_RECARGA_MS 1000
+
+// Carga dos arquivos: pacientes intercalados entregues aos cadastros de cada vez, e bytes lidos por
+// vez de um arquivo Z-A, que é lido do fim para o início
+#define LOTE_CARGA 65536
+#define BLOCO_LEITURA_REVERSA (1 << 16)
+
+// Datas por bloco do histórico: o bloco inteiro ocupa 64 bytes (uma linha de cache)
+#define CONSULTAS_POR_BLOCO 13
+
+// Pacientes guardados lado a lado em cada bloco da lista desenrolada (motor "blocos")
+#define PACIENTES_POR_BLOCO 16
+
+// Arena de nomes: bytes de cada pedaço (um nome maior ganha um pedaço só seu) e menor tabela
+// usada para guardar uma vez só os nomes repetidos durante uma importação
+#define TAMANHO_PEDACO_NOMES (1 << 16)
+#define TAMANHO_MINIMO_INTERNACAO 1024
+
+// Faixas de idade do relatório de estatísticas: 0-9, 10-19, ..., 90-99 e 100 ou mais
+#define FAIXAS_IDADE 11
+
+// Maior número de dias desde a última consulta no histograma dos percentis (valores acima ficam na última posição)
+#define LIMITE_DIAS_CONSULTA 36525
+
+// Pacientes convertidos por vez para os vetores de datas do relatório
+#define BLOCO_ESTATISTICA 1024
+
+// Menor pedaço de um cadastro processado por uma thread nos relatórios sobre todos os pacientes
+#define PEDACO_MINIMO_PARALELO 65536
+
+// Ordenação das listagens por campo: chaves de 22 bits (datas em dias até o ano 9999, com o maior
+// valor reservado para datas inválidas, que ficam no fim), ordenadas em 2 passadas de 11 bits
+#define BITS_DIGITO_RADIX 11
+#define BALDES_RADIX (1 << BITS_DIGITO_RADIX)
+#define PASSADAS_RADIX 2
+#define CHAVE_ORDENACAO_INVALIDA ((1u << (BITS_DIGITO_RADIX * PASSADAS_RADIX)) - 1)
+
+// Buscas em um índice congelado desatualizado (feitas pela estrutura) até ele ser refeito: rajadas de
+// alterações não pagam uma reconstrução a cada busca
+#define BUSCAS_PARA_RECONGELAR 16
+
+// Maior altura de árvore que um cursor acompanha (uma AVL com 2^32 pacientes tem altura menor que 47)
+#define ALTURA_MAXIMA_CURSOR 64
+
+// Versões guardadas para desfazer alterações em cada cadastro persistente
+#define LIMITE_DESFAZER 32
+
+// Buscas recentes guardadas no cache de cada médico; os baldes da tabela são potência de 2
+#define TAMANHO_CACHE_BUSCAS 64
+#define BALDES_CACHE_BUSCAS 128
+
+// Filtro de nomes de cada médico: contadores por nome esperado, sondas por nome e menor tamanho
+// (com 12 contadores e 5 sondas, cerca de 0,5% das buscas de nomes ausentes passam pelo filtro)
+#define CONTADORES_POR_NOME 12
+#define SONDAS_FILTRO 5
+#define TAMANHO_MINIMO_FILTRO 1024
+
+// Ids entre dois saltos das listas de postagens do índice de termos (a interseção galopa pelos saltos)
+#define IDS_POR_SALTO 64
+
+// Maior número de termos em uma busca por partes do nome e de pacientes exibidos no resultado
+#define MAXIMO_TERMOS_BUSCA 8
+#define MAXIMO_RESULTADOS_EXIBIDOS 100
+
+// Busca interativa: maior texto digitado (em bytes) e linhas da tela que não são resultados
+// (a linha da busca, o cabeçalho das colunas e a linha de situação)
+#define TAMANHO_CONSULTA_INTERATIVA 256
+#define LINHAS_FIXAS_INTERATIVA 3
+
+// Cadastro em memória compartilhada: espaço de endereços reservado para o segmento (ele cresce dentro
+// da reserva, então os deslocamentos valem em todos os processos), tamanho inicial, mudanças de nomes
+// guardadas para os outros processos atualizarem cache, filtro e índice, assinatura ("CLN4"), processos
+// anexados ao mesmo tempo e segundos sem avanço na carga de quem criou o segmento antes de recriá-lo
+#define RESERVA_SEGMENTO (1ULL << 36)
+#define TAMANHO_INICIAL_SEGMENTO (1 << 20)
+#define MUDANCAS_COMPARTILHADAS 256
+#define ASSINATURA_SEGMENTO 0x434C4E34u
+#define MAXIMO_PROCESSOS_SEGMENTO 64
+#define ESPERA_CARGA_SEGMENTO 60
+
+// Cadastro em disco (árvore B+ em um arquivo de páginas): tamanho da página, assinatura ("BPT2"; a
+// "BPT1" tem as chaves da ordem antiga dos nomes fora do Latin-1), maior nome aceito (um registro
+// ocupa no máximo um quarto da página, então um nó dividido sempre cabe nas duas metades), quadros
+// mínimos do buffer de cada árvore e memória padrão dos buffers de todos os cadastros em disco
+// juntos (--memoria-disco)
+#define TAMANHO_PAGINA_DISCO 4096
+#define ASSINATURA_DISCO 0x32545042u
+#define ASSINATURA_DISCO_V1 0x31545042u
+#define MAIOR_NOME_DISCO 960
+#define QUADROS_MINIMOS_DISCO 16
+#define MEMORIA_DISCO_PADRAO_MB 16
+
+// Pacientes entregues às buscas que cada árvore em disco mantém em memória (residentes); passando
+// do limite, sai o usado há mais tempo
+#define RESIDENTES_DISCO 1024
+
+// Ocupação das folhas e dos nós montados pela carga em lote (em porcentagem): a folga recebe as
+// inserções seguintes sem dividir os nós logo de cara
+#define OCUPACAO_CARGA_DISCO 90
+
+// Bytes de um registro antes do nome, na folha e no nó interno (ver CabecalhoPagina)
+#define CABECALHO_FOLHA_DISCO 33
+#define CABECALHO_INTERNO_DISCO 14
+
+// Auditoria: vagas da fila de eventos (potência de 2), intervalo da thread de gravação quando a
+// fila está vazia e de quantos em quantos eventos o custo na thread que registra é medido
+#define TAMANHO_FILA_AUDITORIA 4096
+#define INTERVALO_AUDITORIA_MS 5
+#define AMOSTRAGEM_AUDITORIA 64
+
+// Pré-busca de memória para as descidas na árvore (sem efeito em outros compiladores)
+#ifdef __GNUC__
+    #define PREFETCH(endereco) __builtin_prefetch(endereco)
+#else
+    #define PREFETCH(endereco) ((void)(endereco))
+#endif
+
+typedef struct HistoricoConsultas HistoricoConsultas;
 
 // Estrutura para armazenar os dados de um paciente
 typedef struct {
-    char nome[100];
+    const char* nome; // Na arena de nomes (ou no segmento, no cadastro compartilhado); nunca é liberado
     char sexo;
     char nascimento[11]; // Formato: dd/mm/aaaa
     char ultima_consulta[11]; // Formato: dd/mm/aaaa
+    uint64_t chave; // Prefixo do nome sem acentos e em maiúsculas, usado na ordenação
+    HistoricoConsultas* historico; // Todas as consultas; NULL enquanto só houver a última consulta
 } Paciente;
 
+// Pedaço da arena de nomes: os nomes ficam um depois do outro, cada um terminado em '\0'
+typedef struct PedacoNomes {
+    struct PedacoNomes* anterior;
+    size_t usado;
+    size_t tamanho;
+    char dados[];
+} PedacoNomes;
+
+// Nome já guardado, na tabela de internação da arena
+typedef struct {
+    uint64_t hash; // 0 indica posição vazia
+    const char* nome;
+} NomeInternado;
+
+// Arena dos nomes dos pacientes: só cresce, e um nome guardado nunca muda de endereço, então o
+// paciente aponta direto para ele (o tamanho vem do '\0' e o prefixo para comparar já está na chave)
+// A tabela de internação só existe durante as importações, para os nomes repetidos dos arquivos
+typedef struct {
+    PedacoNomes* atual;
+    NomeInternado* internados;
+    size_t capacidade_internacao; // Potência de 2
+    size_t quantidade_internacao;
+    int importacoes;              // Importações em andamento (a tabela é liberada quando chega a 0)
+    size_t bytes;                 // Bytes de nomes guardados
+    unsigned long nomes;
+    unsigned long reaproveitados; // Nomes repetidos que ficaram com o endereço do já guardado
+    pthread_mutex_t trava;
+} ArenaNomes;
+
+// Bloco do histórico de consultas: datas em dias (data_para_dias), em ordem crescente
+typedef struct BlocoConsultas {
+    struct BlocoConsultas* proximo;
+    int quantidade;
+    int datas[CONSULTAS_POR_BLOCO];
+} BlocoConsultas;
+
+// Histórico de consultas de um paciente: lista de blocos ordenados
+// Cada nó de cadastro que aponta para o histórico tem uma referência; no motor persistente
+// várias versões do mesmo paciente podem compartilhá-lo, por isso ele nunca é alterado ali
+struct HistoricoConsultas {
+    BlocoConsultas* primeiro;
+    BlocoConsultas* ultimo;
+    int total;
+    atomic_int referencias;
+};
+
 // Estrutura de um nó da lista duplamente encadeada
 typedef struct NoLista {
     Paciente paciente;
@@ -25,69 +221,1432 @@ typedef struct {
     NoLista* fim;
 } ListaDupla;
 
+// Bloco da lista desenrolada: vários pacientes contíguos, na mesma ordem Z-A da lista
+typedef struct BlocoPacientes {
+    struct BlocoPacientes* proximo;  // Bloco com os nomes seguintes (menores)
+    struct BlocoPacientes* anterior;
+    int quantidade;
+    Paciente pacientes[PACIENTES_POR_BLOCO];
+} BlocoPacientes;
+
+// Estrutura da lista desenrolada: percorrê-la segue um ponteiro por bloco, não por paciente
+typedef struct {
+    BlocoPacientes* inicio;
+    BlocoPacientes* fim;
+} ListaBlocos;
+
 // Estrutura de um nó da árvore AVL
 typedef struct NoAVL {
     Paciente paciente;
     struct NoAVL* esquerda;
     struct NoAVL* direita;
     int altura;
+    atomic_int referencias; // Versões e nós pais que apontam para este nó (só no motor persistente)
 } NoAVL;
 
+// Estrutura de um nome consultado na busca em lote
+typedef struct {
+    const char* nome;
+    uint64_t chave;
+    Paciente* encontrado; // Nome idêntico
+    Paciente* aproximado; // Mesmo nome sem acentos e caixa
+} ConsultaLote;
+
+// Linha de um arquivo de pacientes já lida, guardada para a recarga comparar as versões do arquivo
+typedef struct {
+    uint64_t hash;     // hash_linha do texto da linha (0 = posição livre)
+    uint64_t conteudo; // hash_linha_paciente dos dados lidos da linha (0 se ela estava mal formatada)
+    const char* nome;  // Nome do paciente, na arena (NULL se a linha estava mal formatada)
+} LinhaCarregada;
+
+// Tabela de hash (endereçamento aberto) das linhas distintas de um arquivo de pacientes
+typedef struct {
+    LinhaCarregada* linhas;
+    uint64_t* vistas;  // Um bit por posição: a linha apareceu na leitura atual do arquivo
+    size_t capacidade; // Potência de 2
+    size_t quantidade;
+    int texto;         // 0 se a última leitura encontrou um arquivo compacto, que a recarga não acompanha
+} TabelaLinhas;
+
+// Estrutura de um lote de pacientes lidos de um arquivo ou a serem inseridos de uma vez
+typedef struct {
+    Paciente* pacientes;
+    int quantidade;
+    int capacidade;
+    TabelaLinhas* linhas; // Se não for NULL, só as linhas que não estão na tabela entram no lote (e na tabela)
+} LotePacientes;
+
+// Estrutura para acumular os nomes rejeitados em uma inserção em lote
+typedef struct {
+    char** nomes;
+    int quantidade;
+    int capacidade;
+} RelatorioConflitos;
+
+// Estrutura de um arquivo na intercalação de vários arquivos (um "run" ordenado)
+// Um arquivo de texto já em ordem (A-Z, ou Z-A como os salvos do Moisés) é lido uma linha por vez,
+// do início ou do fim; os demais são lidos inteiros para o lote e ordenados
+typedef struct {
+    FILE* arquivo;        // NULL quando o arquivo foi lido para o lote
+    int reverso;          // Arquivo Z-A, lido do fim para o início
+    TabelaLinhas* linhas; // Se não for NULL, as linhas lidas vão para a tabela (como em LotePacientes)
+    char* linha;          // Buffer das linhas; no reverso, guarda também o trecho lido e ainda não entregue
+    size_t capacidade;
+    size_t pendentes;     // No reverso: bytes no início do buffer ainda não entregues
+    long restante;        // No reverso: bytes do início do arquivo ainda não lidos (-1 depois da primeira linha)
+    int primeira;         // Na leitura direta: nenhuma linha com conteúdo foi lida ainda (BOM)
+    LotePacientes lote;
+    int posicao;          // Próximo paciente do lote
+    Paciente atual;       // Paciente do arquivo a ser intercalado
+} FluxoPacientes;
+
+// Entrada do cache de buscas: o nome pesquisado e o paciente que a busca encontrou
+typedef struct {
+    char nome[100];
+    uint64_t hash;     // hash_nome_dobrado do nome
+    Paciente* paciente;
+    int proximo_balde; // Próxima entrada do mesmo balde (-1 no fim)
+    int anterior;      // Vizinhas na ordem de uso, da mais recente à menos recente
+    int posterior;
+} EntradaCache;
+
+// Cache LRU das últimas buscas de um médico: tabela hash para achar o nome e lista
+// na ordem de uso para descartar o menos recente; guarda só buscas que encontraram alguém
+typedef struct {
+    EntradaCache entradas[TAMANHO_CACHE_BUSCAS];
+    int baldes[BALDES_CACHE_BUSCAS];
+    int quantidade;
+    int mais_recente;
+    int menos_recente;
+    unsigned long acertos;
+    unsigned long falhas;
+} CacheBuscas;
+
+// Filtro de Bloom com contadores dos nomes (dobrados) de um médico: responde "com certeza não está"
+// sem percorrer o cadastro; os contadores permitem remover nomes (um contador que chega a 255 fica
+// preso, o que só aumenta os falsos positivos)
+typedef struct {
+    uint8_t* contadores;
+    size_t tamanho;    // Sempre potência de 2
+    size_t elementos;  // Nomes contados no filtro
+    size_t limite;     // Acima desta quantidade o filtro está saturado e é refeito maior
+    unsigned long descartes; // Buscas respondidas só pelo filtro
+} FiltroNomes;
+
+// Salto de uma lista de postagens: o id na posição k * IDS_POR_SALTO (k >= 1, em saltos[k - 1])
+// e o byte onde a lista continua; listas curtas não têm saltos
+typedef struct {
+    uint32_t id;
+    uint32_t deslocamento;
+} SaltoPostagens;
+
+// Lista de postagens de um termo: ids em ordem crescente, gravados como diferenças em varint
+// Um id removido fica na lista até a próxima compactação; quem lê confere se o nome dele ainda existe
+typedef struct {
+    uint8_t* dados;
+    uint32_t tamanho;    // Bytes usados
+    uint32_t capacidade;
+    uint32_t quantidade; // Ids na lista, contando os removidos
+    uint32_t removidos;  // Ids removidos ainda na lista
+    uint32_t ultimo;     // Maior id, para acrescentar no fim sem decodificar a lista
+    SaltoPostagens* saltos;
+    uint32_t num_saltos;
+    uint32_t capacidade_saltos;
+} ListaPostagens;
+
+// Termo do índice: uma palavra do nome, sem acentos e em maiúsculas
+typedef struct {
+    char* termo; // NULL em posição vazia da tabela
+    uint64_t hash;
+    ListaPostagens postagens;
+} EntradaTermo;
+
+// Posição da tabela nome -> id do índice de termos
+typedef struct {
+    uint64_t hash;
+    uint32_t id; // UINT32_MAX em posição vazia
+} EntradaIdNome;
+
+// Índice invertido dos nomes de um médico: cada termo aponta para os ids dos pacientes que o têm
+// Os ids são dados na inserção, em ordem crescente (as listas só crescem no fim), e não são reaproveitados
+typedef struct {
+    EntradaTermo* termos;     // Tabela hash com endereçamento aberto
+    size_t capacidade_termos; // Sempre potência de 2
+    size_t num_termos;
+    const char** nomes;       // Nome de cada id, o guardado do paciente (NULL se ele saiu do cadastro)
+    uint32_t num_ids;
+    uint32_t capacidade_nomes;
+    EntradaIdNome* ids;       // Tabela hash nome -> id, para remover pelo nome
+    size_t capacidade_ids;    // Sempre potência de 2
+    size_t pacientes;         // Ids em uso
+} IndiceTermos;
+
+// Prefixo de 16 caracteres de um nome dobrado: a chave do paciente e os 8 caracteres seguintes
+typedef struct {
+    uint64_t chave;
+    uint64_t resto;
+} PrefixoNome;
+
+// Paciente de uma posição do índice congelado e a sua posição no vetor em ordem A-Z
+typedef struct {
+    Paciente* paciente;
+    uint32_t posicao;
+} EntradaCongelada;
+
+// Índice congelado de um médico, para sessões quase só de leitura: os prefixos dos nomes em um vetor
+// contíguo na ordem de Eytzinger (a raiz na posição 1 e os filhos de k em 2k e 2k + 1), descido sem
+// desvios; os 8 bisnetos de uma posição ocupam duas linhas de cache, pedidas antes de chegar lá
+typedef struct {
+    PrefixoNome* prefixos; // Prefixo de cada posição (a posição 0 não é usada)
+    EntradaCongelada* entradas; // Paciente de cada posição, lido só no fim da descida
+    PrefixoNome* ordem;    // Os mesmos prefixos em ordem A-Z, para achar o fim dos prefixos iguais
+    Paciente** pacientes;  // Pacientes em ordem A-Z
+    int quantidade;
+    int desatualizado;    // Houve escrita no cadastro depois de congelar
+    int buscas_desatualizado; // Buscas feitas pela estrutura desde a última escrita
+} IndiceCongelado;
+
+// Posição de leitura em uma lista de postagens
+typedef struct {
+    const ListaPostagens* lista;
+    uint32_t indice;     // Posição do id atual na lista
+    uint32_t deslocamento; // Byte logo depois do id atual
+    uint32_t atual;
+    int fim;
+} CursorPostagens;
+
+// Nó da árvore do cadastro compartilhado: os filhos e o nome são deslocamentos a partir do início do
+// segmento (0 indica nenhum filho), pois cada processo o mapeia em um endereço diferente; quem lê
+// um nó recebe a vista deste processo (paciente_compartilhado), com o nome já resolvido
+typedef struct {
+    Paciente paciente; // nome e historico sempre NULL: o histórico fica fora do segmento, no processo que o criou
+    uint64_t nome;     // Deslocamento do nome no segmento
+    uint32_t tamanho_nome; // Sem contar o '\0'
+    uint64_t esquerda;
+    uint64_t direita;
+    int altura;
+} NoCompartilhado;
+
+// Inserção ou remoção de um nome no cadastro compartilhado, para os outros processos
+typedef struct {
+    unsigned long geracao;
+    int removido;
+    uint64_t nome; // Deslocamento no segmento (um nome guardado lá nunca é sobrescrito)
+    uint32_t tamanho_nome;
+} MudancaCompartilhada;
+
+// Processo anexado a um segmento compartilhado; 'lendo' fica em 1 enquanto alguma thread dele tem a
+// trava de leitura, para que quem escreve espere por ele (ou libere a vaga, se ele morreu)
+typedef struct {
+    atomic_int pid;   // 0 em vaga livre
+    atomic_int lendo;
+} ProcessoSegmento;
+
+// Início do segmento compartilhado de um médico; os nós e os nomes vêm depois, no espaço entregue por 'usado'
+// A trava entre os processos guarda quem a tem (o pid de quem escreve e as vagas de quem lê), então um
+// processo que termina com ela não prende os outros: eles veem que ele não existe mais e a liberam
+typedef struct {
+    uint32_t assinatura;
+    atomic_int pronto;       // 1 depois que o processo que criou o segmento iniciou o cabeçalho
+    int criador;             // Processo que criou o segmento e carrega os arquivos nele
+    atomic_int escritor;     // Processo com a trava de escrita (0 se nenhum)
+    uint64_t tamanho;        // Bytes do objeto de memória compartilhada
+    uint64_t usado;          // Bytes já entregues a nós e nomes
+    uint64_t livres;         // Nós removidos, encadeados pelo campo esquerda
+    uint64_t raiz;
+    long pacientes;
+    ProcessoSegmento processos[MAXIMO_PROCESSOS_SEGMENTO]; // Processos anexados
+    atomic_int carregado;    // O processo que criou o segmento terminou de carregar os arquivos nele
+    unsigned long geracao;   // Aumenta a cada inserção ou remoção
+    MudancaCompartilhada mudancas[MUDANCAS_COMPARTILHADAS];
+} CabecalhoCompartilhado;
+
+// Segmento compartilhado visto por este processo
+typedef struct {
+    char nome[160];
+    int descritor;
+    CabecalhoCompartilhado* cabecalho; // Início do mapeamento
+    char* vistas; // Reserva privada do tamanho do segmento: a vista de um nó fica no mesmo deslocamento dele
+    ProcessoSegmento* vaga; // Vaga deste processo no cabeçalho
+    pthread_mutex_t trava_leitores; // Protege 'leitores'
+    int leitores;     // Threads deste processo com a trava de leitura
+    unsigned long geracao_vista; // Última mudança já aplicada ao cache, ao filtro e ao índice locais
+    int em_escrita;   // Este processo tem a trava de escrita (entre iniciar_escrita e terminar_escrita)
+    int ja_carregado; // Criado por outro processo, que carrega os arquivos: aqui o carregamento não se repete
+} SegmentoCompartilhado;
+
+// Primeira página do arquivo da árvore B+ (a página 0); as demais são nós da árvore
+typedef struct {
+    uint32_t assinatura;
+    uint32_t tamanho_pagina;
+    uint32_t raiz;
+    uint32_t altura;         // Níveis da árvore (1 quando a raiz é uma folha)
+    uint32_t paginas;        // Páginas do arquivo, contando esta
+    uint32_t primeira_folha; // Extremos da lista de folhas, de onde os cursores partem
+    uint32_t ultima_folha;
+    uint32_t aberta;         // 1 enquanto um processo usa o arquivo: se ficou 1, ele não foi fechado direito
+    uint64_t pacientes;
+} MetaArvore;
+
+// Cabeçalho de um nó da árvore: logo depois vêm os deslocamentos dos registros, em ordem A-Z, e os
+// registros ficam no fim da página, crescendo para trás (uma remoção deixa um buraco que só some
+// quando a página é compactada para receber um registro)
+// Folha: chave (8 bytes), sexo, nascimento e última consulta (11 bytes cada, com o '\0'), tamanho do
+// nome (2 bytes) e o nome com o '\0'. Nó interno: filho (4 bytes), chave, tamanho e nome do separador,
+// o primeiro nome do filho; 'esquerda' é o filho dos nomes que vêm antes do primeiro separador
+typedef struct {
+    uint8_t folha;
+    uint8_t reservado;
+    uint16_t quantidade;   // Registros no nó
+    uint16_t inicio_dados; // Início do registro mais baixo na página
+    uint16_t usados;       // Bytes dos registros presentes (sem os buracos)
+    uint32_t esquerda;     // Folha: folha anterior (0 = nenhuma; a página 0 nunca é um nó)
+    uint32_t direita;      // Folha: próxima folha
+} CabecalhoPagina;
+
+// Quadro do buffer: uma página do arquivo em memória
+typedef struct {
+    uint32_t pagina;    // UINT32_MAX em quadro livre
+    int fixacoes;       // Usos em andamento: um quadro fixado não sai do buffer
+    int proximo;        // Próximo quadro do mesmo balde da tabela de páginas (-1 no fim)
+    uint8_t referencia; // Bit do relógio: a página foi usada desde a última passagem do ponteiro
+    uint8_t sujo;       // Alterada desde a última gravação no arquivo
+} QuadroBuffer;
+
+// Paciente de uma árvore em disco entregue a uma busca: uma cópia com o nome junto, ligada na ordem de uso
+typedef struct ResidenteDisco {
+    Paciente paciente;               // Primeiro campo: o endereço entregue às buscas é o do residente
+    struct ResidenteDisco* anterior; // Usado mais recentemente
+    struct ResidenteDisco* proximo;  // Usado há mais tempo
+    char nome[];
+} ResidenteDisco;
+
+// Cadastro em disco de um médico: árvore B+ em um arquivo de páginas, lidas e gravadas por um buffer de
+// tamanho fixo que escolhe a página a descartar pelo relógio (CLOCK); uma página alterada só vai para o
+// arquivo quando sai do buffer ou quando a árvore é gravada
+// As páginas mudam de quadro a qualquer momento, então as buscas entregam "residentes": cópias que ficam
+// no mesmo endereço enquanto o paciente estiver no cadastro e entre os RESIDENTES_DISCO usados por último
+// (quem guarda um deles por mais tempo o procura de novo pelo nome, ver revalidar_paciente)
+typedef struct {
+    char arquivo[128];
+    int descritor;
+    MetaArvore meta;
+    pthread_mutex_t trava;      // Uma operação por vez na árvore e no buffer
+    uint8_t* dados;             // Páginas dos quadros, lado a lado
+    QuadroBuffer* quadros;
+    int num_quadros;
+    int* baldes;                // Tabela página -> quadro, encadeada pelos quadros
+    int num_baldes;             // Potência de 2
+    int ponteiro;               // Ponteiro do relógio
+    unsigned long modificacoes; // Inserções e remoções: um cursor parado antes de uma delas se reposiciona
+    unsigned long acertos;      // Páginas achadas no buffer
+    unsigned long leituras;     // Páginas lidas do arquivo
+    unsigned long gravacoes;    // Páginas gravadas no arquivo
+    ResidenteDisco** residentes; // Tabela hash (nome exato) dos residentes, com o dobro de RESIDENTES_DISCO posições
+    size_t num_residentes;
+    ResidenteDisco* mais_recente; // Ordem de uso dos residentes
+    ResidenteDisco* menos_recente;
+    PedacoNomes* copias;        // Pacientes copiados para as coletas (valem até a próxima coleta deste cadastro)
+    int em_carga;               // Até concluir_carregamento: um nome que já está na árvore recebe os dados do arquivo
+} ArvoreDisco;
+
+// Posição de um paciente na lista de folhas da árvore (folha 0 quando fora dos pacientes)
+typedef struct {
+    uint32_t folha;
+    int posicao;
+} PosicaoDisco;
+
+// Página de um nível da carga em lote e o seu primeiro nome, que vira separador no nível de cima
+typedef struct {
+    uint32_t pagina;
+    uint64_t chave;
+    const char* nome;
+} EntradaCargaDisco;
+
+// Estrutura usada por cada médico para guardar seus pacientes
+typedef enum {
+    MOTOR_LISTA,       // Lista duplamente encadeada em ordem Z-A (como a do Moisés)
+    MOTOR_BLOCOS,      // Lista desenrolada em ordem Z-A: blocos de pacientes contíguos
+    MOTOR_AVL,         // Árvore AVL em ordem A-Z (como a da Liz)
+    MOTOR_PERSISTENTE, // Árvore AVL que copia o caminho alterado: versões antigas continuam válidas
+    MOTOR_COMPARTILHADO, // Árvore AVL em memória compartilhada, vista e alterada por vários processos
+    MOTOR_DISCO        // Árvore B+ em um arquivo de páginas, com um buffer de tamanho fixo na memória
+} MotorRegistro;
+
+// Regra usada para decidir qual médico atende cada paciente
+typedef enum {
+    ROTA_SEXO,    // Pelo sexo do paciente (padrão: homens com o Moisés, mulheres com a Liz)
+    ROTA_INICIAL, // Pela inicial do nome, em faixas (ex.: A-M)
+    ROTA_HASH     // Pelo hash do nome, dividindo os pacientes por igual
+} RegraRoteamento;
+
+// Estrutura do cadastro de um médico (um "shard" da clínica)
+typedef struct {
+    char medico[50];
+    MotorRegistro motor;
+    ListaDupla* lista; // Usada quando motor == MOTOR_LISTA
+    ListaBlocos* blocos; // Usada quando motor == MOTOR_BLOCOS
+    NoAVL* raiz;       // Usada quando motor == MOTOR_AVL ou MOTOR_PERSISTENTE
+    SegmentoCompartilhado* compartilhado; // Usado quando motor == MOTOR_COMPARTILHADO
+    ArvoreDisco* disco; // Usada quando motor == MOTOR_DISCO
+    NoAVL* versoes[LIMITE_DESFAZER]; // Raízes anteriores às últimas escritas (motor persistente)
+    unsigned long escritas[LIMITE_DESFAZER]; // Versão da clínica produzida por cada uma das últimas escritas
+                                             // que mudaram o cadastro, em qualquer motor (para desfazer)
+    int num_escritas;  // No motor persistente, versoes[i] é a raiz anterior a escritas[i]
+    NoAVL* raiz_escrita; // Raiz no início da escrita em andamento
+    int alterado;      // O cadastro mudou na escrita em andamento
+    CacheBuscas* cache;  // Últimas buscas, esvaziado a cada inserção ou remoção
+    FiltroNomes* filtro; // Nomes presentes, consultado antes do cache e da estrutura
+    IndiceTermos* termos; // Índice das partes do nome (sobrenomes, nomes do meio)
+    IndiceCongelado* congelado; // NULL se o cadastro não foi congelado
+    char sexo;         // Critério da ROTA_SEXO ('M', 'F' ou '*' para qualquer)
+    char inicial_de;   // Critério da ROTA_INICIAL (letras já sem acento, em maiúsculas)
+    char inicial_ate;
+    char arquivo[128]; // Arquivo onde os pacientes do médico são salvos
+} Registro;
+
+// Cursor sobre os pacientes de um cadastro, em ordem A-Z em qualquer motor
+// Nas listas (Z-A) ele anda pelos anteriores a partir do fim; nas árvores guarda o caminho da raiz até
+// o paciente atual, com os nós como endereços (NoAVL) ou deslocamentos no segmento compartilhado
+// Com o motor compartilhado, quem usa o cursor precisa ter a trava de leitura do segmento
+// Na árvore em disco o paciente atual é uma cópia guardada no próprio cursor, que vale até ele andar
+typedef struct {
+    MotorRegistro motor;
+    ListaDupla* lista;
+    ListaBlocos* blocos;
+    SegmentoCompartilhado* compartilhado;
+    ArvoreDisco* disco;
+    uint64_t raiz;
+    uint64_t caminho[ALTURA_MAXIMA_CURSOR];
+    int profundidade; // 0 quando o cursor está fora dos pacientes
+    NoLista* no;      // Paciente atual na lista (NULL fora dos pacientes)
+    BlocoPacientes* bloco; // Bloco do paciente atual na lista desenrolada (NULL fora dos pacientes)
+    int posicao;           // Posição do paciente atual no bloco
+    PosicaoDisco posicao_disco;  // Paciente atual na árvore em disco (folha 0 fora dos pacientes)
+    unsigned long modificacoes;  // Modificações da árvore quando a cópia foi lida
+    Paciente copia;
+    char nome_copia[MAIOR_NOME_DISCO + 1];
+} CursorRegistro;
+
+// Estrutura de uma tarefa do pool de threads
+typedef struct {
+    void (*funcao)(void*);
+    void* argumento;
+} TarefaPool;
+
+// Estrutura do pool de threads usado nas operações paralelas por médico
+typedef struct {
+    pthread_t* threads;
+    int num_threads;
+    TarefaPool* fila; // Fila circular de tarefas
+    int capacidade;
+    int inicio;
+    int quantidade;
+    int pendentes;    // Tarefas enviadas e ainda não concluídas
+    int encerrando;
+    pthread_mutex_t trava;
+    pthread_cond_t tem_tarefa;
+    pthread_cond_t concluido;
+} PoolThreads;
+
+typedef struct SalvamentoAutomatico SalvamentoAutomatico;
+typedef struct RecargaArquivo RecargaArquivo;
+
+// Tipos de evento da auditoria
+typedef enum {
+    EVENTO_LEITURA,    // Dados de um paciente exibidos
+    EVENTO_LISTAGEM,   // Todos os pacientes de um médico exibidos
+    EVENTO_CADASTRO,
+    EVENTO_ALTERACAO,
+    EVENTO_CONSULTA,   // Nova consulta registrada
+    EVENTO_DESFAZER,
+    EVENTO_IMPORTACAO  // Lote importado de um arquivo (o nome do arquivo vai no lugar do paciente)
+} TipoEvento;
+
+// O que fazer quando a fila da auditoria está cheia
+typedef enum {
+    AUDITORIA_DESCARTAR, // O evento é perdido (e contado): o atendimento nunca espera
+    AUDITORIA_ESPERAR    // Quem registra espera a thread de gravação abrir espaço
+} PoliticaAuditoria;
+
+// Evento da auditoria: tamanho fixo, copiado para a fila sem alocação
+// Um nome que não cabe em 'paciente' vai inteiro em 'paciente_longo', liberado pela thread de gravação
+typedef struct {
+    struct timespec instante;
+    TipoEvento tipo;
+    char medico[50];
+    char paciente[100];
+    char* paciente_longo;
+} EventoAuditoria;
+
+// Vaga da fila: 'sequencia' diz se a vaga está livre para a posição de escrita ou pronta para a leitura
+typedef struct {
+    atomic_size_t sequencia;
+    EventoAuditoria evento;
+} VagaAuditoria;
+
+// Estrutura da auditoria: fila circular sem travas (várias threads registram, uma thread grava)
+// A thread de gravação junta os eventos disponíveis e os acrescenta ao arquivo de uma vez
+typedef struct {
+    VagaAuditoria* vagas;
+    atomic_size_t escrita; // Próxima posição reservada por quem registra
+    size_t leitura;        // Próxima posição lida (só a thread de gravação usa)
+    PoliticaAuditoria politica;
+    FILE* arquivo;         // Aberto para acrescentar: o registro nunca é reescrito
+    char nome_arquivo[256];
+    char operador[32];
+    int pid;
+    pthread_t thread;
+    atomic_int encerrando;
+    atomic_ulong registrados;  // Eventos que passaram por auditar
+    atomic_ulong descartados;  // Perdidos com a fila cheia (AUDITORIA_DESCARTAR)
+    atomic_ulong esperas;      // Eventos que esperaram espaço (AUDITORIA_ESPERAR)
+    atomic_ulong amostras;     // Eventos com o custo medido
+    atomic_ulong nanossegundos; // Soma do custo medido
+    unsigned long gravados;    // Só a thread de gravação usa
+} Auditoria;
+
+// Entrada do índice do modo preguiçoso: onde está a linha de um paciente no arquivo mapeado
+typedef struct {
+    uint64_t hash;         // FNV-1a do nome dobrado (0 indica posição livre)
+    size_t deslocamento;   // Início da linha no arquivo
+    int arquivo;           // Índice do arquivo mapeado
+    Paciente* paciente;    // Paciente já interpretado, ou NULL se a linha ainda não foi lida
+} EntradaIndice;
+
+// Estrutura do modo preguiçoso: os arquivos ficam mapeados e só um índice de nomes é montado
+// na abertura; cada paciente é interpretado na primeira vez em que é consultado
+typedef struct {
+    char** nomes_arquivos;
+    int num_arquivos;
+    char** dados;          // Conteúdo mapeado de cada arquivo
+    size_t* tamanhos;
+    EntradaIndice* tabela; // Tabela hash com endereçamento aberto
+    size_t capacidade;     // Sempre potência de 2
+    size_t quantidade;
+    int materializados;
+} IndicePreguicoso;
+
+// Estrutura da clínica: os cadastros de todos os médicos e a regra de roteamento
+typedef struct {
+    Registro* registros;
+    int quantidade;
+    int capacidade;
+    RegraRoteamento regra;
+    PoolThreads* pool;
+    pthread_mutex_t trava; // Protege os cadastros durante escritas e cópias para o salvamento
+    unsigned long versao;  // Aumenta a cada escrita nos cadastros
+    SalvamentoAutomatico* salvamento; // NULL se o salvamento automático estiver desligado
+    RecargaArquivo* recarga;          // NULL se a recarga automática do arquivo estiver desligada
+    IndicePreguicoso* preguicoso;     // Índice do modo preguiçoso, até a clínica ser carregada por completo
+    Auditoria* auditoria;             // NULL se a auditoria estiver desligada
+} Clinica;
+
+// Iterador sobre os pacientes de todos os médicos em uma única ordem A-Z, sem cópia: um cursor por
+// médico, e a cada passo sai o menor paciente entre os atuais (empates ficam com o primeiro médico)
+typedef struct {
+    Clinica* clinica;
+    CursorRegistro* cursores;
+    int atual; // Médico do paciente atual (-1 no fim)
+} IteradorClinica;
+
+// Busca interativa: os pacientes de todos os médicos em ordem A-Z, coletados ao abrir a busca (e de
+// novo quando algum cadastro muda), e a faixa deles cujo nome começa com o texto digitado; a cada
+// tecla a faixa sai de duas buscas binárias e só as linhas visíveis são formatadas
+// Com um cadastro em disco os pacientes não são coletados (modo janela): a cada tela o iterador da
+// clínica percorre a faixa a partir da consulta, contando-a e copiando só as linhas visíveis
+typedef struct {
+    Clinica* clinica;
+    Paciente** pacientes;
+    int quantidade;
+    int em_janela;
+    Paciente** janela;     // Cópias das linhas visíveis, a partir de topo (modo janela)
+    PedacoNomes* copias;
+    unsigned long geracao; // geracao_cadastros na coleta dos pacientes
+    char consulta[TAMANHO_CONSULTA_INTERATIVA]; // Texto digitado, em UTF-8
+    size_t tamanho_consulta;
+    int inicio, fim;       // Faixa [inicio, fim) dos pacientes cujo nome começa com a consulta
+    int selecionado;       // Posição na faixa da linha destacada
+    int topo;              // Posição na faixa da primeira linha visível
+    int visiveis;          // Linhas de resultados que cabem no terminal
+} BuscaInterativa;
+
+// Estrutura do salvamento automático em segundo plano
+// A thread copia os pacientes para a memória (com a clínica travada só durante a cópia)
+// e grava o arquivo a partir da cópia, sem bloquear o menu
+struct SalvamentoAutomatico {
+    Clinica* clinica;
+    int intervalo; // Segundos entre salvamentos
+    char arquivo[256];
+    pthread_t thread;
+    pthread_mutex_t trava; // Protege os campos abaixo
+    pthread_cond_t acordar;
+    int encerrando;
+    Paciente* copia;       // Arena reaproveitada entre os salvamentos
+    int capacidade_copia;
+    int* copiados;         // Pacientes de cada médico na arena
+    NoAVL** instantaneos;  // Versão de cada cadastro persistente no momento da cópia
+    unsigned long versao_salva;
+    int salvamentos;
+    int ultimos_pacientes;
+    double ultima_copia_ms;
+    double ultima_gravacao_ms;
+    time_t ultimo_horario;
+};
+
+// Identificação de uma versão de um arquivo no disco: muda quando ele é regravado ou substituído
+typedef struct {
+    dev_t dispositivo;
+    ino_t inode;
+    off_t tamanho;
+    struct timespec modificacao;
+} AssinaturaArquivo;
+
+// Diferenças entre uma versão do arquivo de pacientes e a seguinte, à espera do menu
+typedef struct MudancasRecarga {
+    LotePacientes novos;       // Pacientes das linhas que entraram no arquivo (inclusões e alterações)
+    LinhaCarregada* removidas; // Linhas que saíram do arquivo
+    int num_removidas;
+    struct MudancasRecarga* proxima;
+} MudancasRecarga;
+
+// Estrutura da recarga automática do arquivo de pacientes
+// A thread vigia o arquivo (inotify, ou o stat a cada INTERVALO_RECARGA_MS) e, quando ele muda,
+// compara o hash de cada linha com as linhas da versão anterior: só as linhas novas são interpretadas,
+// e as diferenças ficam na fila até o menu aplicá-las nos cadastros, entre uma operação e outra
+struct RecargaArquivo {
+    Clinica* clinica;
+    char arquivo[256];
+    pthread_t thread;
+    int vigiando;         // A thread foi criada
+    int encerrar[2];      // Pipe que acorda a thread no encerramento
+    int aviso[2];         // Pipe escrito pela thread quando há mudanças na fila (a busca interativa o vigia)
+    TabelaLinhas base;    // Linhas da última versão comparada (só a thread mexe depois da carga)
+    AssinaturaArquivo assinatura; // Versão do arquivo que está na base
+    pthread_mutex_t trava; // Protege os campos abaixo
+    MudancasRecarga* fila;
+    MudancasRecarga* fim_fila;
+    TabelaLinhas* base_salva;     // Linhas gravadas pelo salvamento automático no próprio arquivo
+    AssinaturaArquivo assinatura_salva;
+    int recargas;
+    double ultima_comparacao_ms;
+};
+
+// Tarefas paralelas executadas no cadastro de cada médico
+typedef struct {
+    Registro* registro;
+    LotePacientes lote;
+    RelatorioConflitos conflitos;
+} TarefaLote;
+
+typedef struct {
+    Registro* registro;
+    char* texto;   // Pacientes formatados na memória (open_memstream)
+    size_t tamanho;
+    int sucesso;
+} TarefaSalvamento;
+
+typedef struct {
+    Registro* registro;
+    const char* nome;
+    uint64_t hash; // hash_nome_dobrado do nome
+    Paciente* resultado;
+} TarefaBusca;
+
+// Estrutura com os agregados do relatório de estatísticas (de um pedaço, de um médico ou da clínica)
+typedef struct {
+    long long pacientes;
+    long long homens;
+    long long mulheres;
+    long long faixas_idade[FAIXAS_IDADE];
+    long long sem_nascimento;
+    long long com_consulta;
+    long long soma_dias; // Soma dos dias desde a última consulta
+    int* dias;           // Histograma dos dias desde a última consulta (LIMITE_DIAS_CONSULTA + 1 posições)
+} ResumoEstatistico;
+
+// Estrutura de um bloco de pacientes do relatório, com as datas já convertidas para dias
+typedef struct {
+    int nascimentos[BLOCO_ESTATISTICA];
+    int consultas[BLOCO_ESTATISTICA];
+    char sexos[BLOCO_ESTATISTICA];
+    int quantidade;
+} BlocoEstatistica;
+
+// Estrutura de uma tarefa do relatório: um pedaço do vetor de pacientes de um médico, ou um cadastro
+// em disco inteiro, percorrido pelo cursor sem ir para o vetor
+typedef struct {
+    Paciente** pacientes;
+    int inicio;
+    int fim;
+    Registro* registro; // Cadastro em disco (NULL nos pedaços do vetor)
+    int medico;
+    int hoje; // Data atual em dias (data_para_dias)
+    BlocoEstatistica bloco;
+    ResumoEstatistico resumo;
+} TarefaEstatistica;
+
+// Estrutura do relatório de estatísticas completo
+typedef struct {
+    char data[11];
+    int medicos;
+    ResumoEstatistico* por_medico;
+    ResumoEstatistico total;
+    double tempo_ms;
+} RelatorioEstatisticas;
+
+// Estrutura de um paciente no heap dos mais atrasados
+typedef struct {
+    int consulta; // Data da última consulta em dias (data_para_dias)
+    int medico;
+    Paciente* paciente;
+} PacienteAtrasado;
+
+// Estrutura do heap limitado dos K pacientes mais atrasados
+// É um heap de máximo pela data: na raiz fica o menos atrasado entre os guardados, o primeiro a sair
+typedef struct {
+    PacienteAtrasado* itens;
+    int quantidade;
+    int limite; // K
+} HeapAtrasados;
+
+// Estrutura de uma tarefa da busca dos mais atrasados: um pedaço do vetor de pacientes de um médico, ou
+// um cadastro em disco inteiro, percorrido pelo cursor (o heap guarda cópias, ver duplicar_paciente)
+typedef struct {
+    Paciente** pacientes;
+    int inicio;
+    int fim;
+    Registro* registro; // Cadastro em disco (NULL nos pedaços do vetor)
+    int medico;
+    HeapAtrasados heap;
+} TarefaAtrasados;
+
+// Estrutura de uma tarefa de coleta dos pacientes de um médico
+typedef struct {
+    Registro* registro;
+    Paciente** destino;
+} TarefaColeta;
+
+// Estrutura da busca por termos em um cadastro em disco, que é percorrido por não ter índice de termos
+typedef struct {
+    Registro* registro;
+    char termos[MAXIMO_TERMOS_BUSCA][100];
+    int num_termos;
+    Paciente** encontrados; // Cópias (ver copiar_paciente_disco)
+    int quantidade;
+    int capacidade;
+} BuscaTermosDisco;
+
+// Campos pelos quais as listagens e as exportações podem ser ordenadas
+typedef enum {
+    ORDEM_NOME,
+    ORDEM_NASCIMENTO, // Do nascimento mais antigo para o mais recente
+    ORDEM_CONSULTA,   // Da última consulta mais antiga para a mais recente
+    ORDEM_IDADE       // Da menor idade em anos para a maior
+} CampoOrdenacao;
+
+// Estrutura de uma tarefa da ordenação por campo: um pedaço do vetor de chaves
+// Cada chave leva o valor do campo nos 32 bits altos e a posição do paciente no vetor nos 32 baixos
+typedef struct {
+    Paciente** pacientes;
+    uint64_t* entrada;
+    uint64_t* saida;
+    int inicio;
+    int fim;
+    CampoOrdenacao campo;
+    int hoje;          // Data atual em dias, para a idade
+    int deslocamento;  // Primeiro bit do dígito da passada
+    size_t contagem[BALDES_RADIX]; // Histograma do dígito no pedaço, depois as posições de escrita
+} TarefaRadix;
+
+// Estrutura de um paciente na ordenação externa: a chave, como na ordenação por radix mas com a ordem
+// de chegada nos 32 bits baixos, e a cópia do paciente
+typedef struct {
+    uint64_t chave;
+    Paciente* paciente;
+} EntradaOrdenacao;
+
+// Estrutura de uma sequência ordenada que a ordenação externa gravou em um arquivo temporário, com o
+// paciente da sequência que está na vez da intercalação
+typedef struct {
+    FILE* arquivo;
+    uint64_t restantes;
+    uint64_t chave;
+    Paciente paciente;
+    char* nome;
+    size_t capacidade; // Do nome
+} SequenciaOrdenada;
+
+// Estrutura da ordenação externa por campo, usada quando há cadastros em disco: os pacientes chegam em
+// ordem de nome e vão para a memória até o limite; cada vez que ele é atingido, o que está na memória
+// é ordenado e gravado como uma sequência, e no fim as sequências são intercaladas
+typedef struct {
+    CampoOrdenacao campo;
+    int hoje;                   // Data atual em dias, para a idade
+    uint32_t recebidos;
+    EntradaOrdenacao* entradas;
+    int quantidade;
+    int capacidade;
+    PedacoNomes* copias;
+    size_t bytes;               // Memória das entradas e das cópias que estão na memória
+    size_t limite;
+    SequenciaOrdenada* sequencias;
+    int num_sequencias;
+    int falhou;                 // Um arquivo temporário não pôde ser gravado
+} OrdenacaoExterna;
+
+// Estrutura de uma tarefa de busca dos pacientes com muitas consultas em um período
+typedef struct {
+    Registro* registro;
+    int de;
+    int ate;
+    int minimo;
+    Paciente** encontrados;
+    int quantidade;
+    int capacidade;
+} TarefaFrequentes;
+
+// Opções do menu principal que vêm depois da lista de médicos
+typedef enum {
+    OPCAO_BUSCAR = 1,
+    OPCAO_BUSCAR_TERMOS,
+    OPCAO_INTERVALO,
+    OPCAO_BUSCA_INTERATIVA,
+    OPCAO_ESTATISTICAS,
+    OPCAO_FREQUENTES,
+    OPCAO_ATRASADOS,
+    OPCAO_CONCILIAR,
+    OPCAO_IMPORTAR,
+    OPCAO_EXPORTAR,
+    OPCAO_AUTOSALVAMENTO,
+    OPCAO_FINALIZAR
+} OpcaoMenuPrincipal;
+
 //cabeçalho de funções
+void obter_data_atual(char *data_atual);
+int converter_data_string_para_tm(const char *data_str, struct tm *data_tm);
+int calcular_diferenca_dias(const char *data1, const char *data2);
+int data_para_dias(const char* data);
+void dias_para_data(int dias, char* data);
+void dias_para_calendario(int dias, int* dia, int* mes, int* ano);
+int idade_em_anos(int nascimento, int hoje);
+int decodificar_utf8(const unsigned char* s, int* codigo);
+int dobrar_caractere(const unsigned char** p);
+uint64_t juntar_dobrados(const unsigned char** p, int* cheio);
+uint64_t calcular_chave(const char* nome);
+int comparar_dobrado(const char* a, const char* b);
+int comparar_busca(uint64_t chave, const char* nome, const Paciente* paciente);
+int comparar_pacientes(const Paciente* a, const Paciente* b);
+uint64_t hash_nome_exato(const char* nome, size_t tamanho);
+void crescer_internacao(ArenaNomes* arena);
+const char* guardar_nome(const char* nome);
+void iniciar_internacao_nomes();
+void terminar_internacao_nomes();
+void liberar_arena_nomes();
 ListaDupla* criar_lista();
+ListaBlocos* criar_lista_blocos();
+BlocoPacientes* criar_bloco_pacientes(ListaBlocos* lista, BlocoPacientes* anterior);
+void liberar_bloco_pacientes(ListaBlocos* lista, BlocoPacientes* bloco);
 NoAVL* criar_no_avl(Paciente paciente);
 int altura_avl(NoAVL* no);
 int fator_balanceamento(NoAVL* no);
 NoAVL* rotacionar_direita(NoAVL* y);
 NoAVL* rotacionar_esquerda(NoAVL* x);
 NoAVL* inserir_avl(NoAVL* raiz, Paciente paciente);
+NoAVL* inserir_avl_no(NoAVL* raiz, const Paciente* paciente);
+NoAVL* remover_avl(NoAVL* raiz, const Paciente* paciente);
+NoAVL* reter_no(NoAVL* no);
+void liberar_no(NoAVL* no);
+NoAVL* tornar_unico(NoAVL* no);
+NoAVL* rotacionar_direita_persistente(NoAVL* y);
+NoAVL* rotacionar_esquerda_persistente(NoAVL* x);
+NoAVL* balancear_persistente(NoAVL* no);
+NoAVL* inserir_persistente(NoAVL* raiz, const Paciente* paciente, int* inserido);
+NoAVL* remover_persistente(NoAVL* raiz, const Paciente* paciente);
+NoAVL* substituir_persistente(NoAVL* raiz, const Paciente* atual, Paciente alterado, Paciente** resultado);
+int processo_vivo(int pid);
+int esperar_trava_segmento(int* esperas);
+int descartar_segmento(const char* nome, int descritor);
+int processos_vivos_segmento(CabecalhoCompartilhado* cabecalho);
+SegmentoCompartilhado* anexar_segmento(const char* nome);
+void desanexar_segmento(SegmentoCompartilhado* segmento);
+void fechar_segmento(SegmentoCompartilhado* segmento);
+void liberar_escritor_morto(SegmentoCompartilhado* segmento, int escritor);
+void travar_escrita_segmento(SegmentoCompartilhado* segmento);
+void destravar_escrita_segmento(SegmentoCompartilhado* segmento);
+void travar_leitura_segmento(SegmentoCompartilhado* segmento);
+void destravar_segmento(SegmentoCompartilhado* segmento);
+NoCompartilhado* no_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+const char* nome_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+Paciente ler_no_compartilhado(SegmentoCompartilhado* segmento, const NoCompartilhado* no);
+Paciente* paciente_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+uint64_t deslocamento_vista(SegmentoCompartilhado* segmento, const Paciente* vista);
+Paciente* atualizar_compartilhado(SegmentoCompartilhado* segmento, Paciente* vista, Paciente alterado);
+int altura_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+void atualizar_altura_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+uint64_t rotacionar_direita_compartilhado(SegmentoCompartilhado* segmento, uint64_t y);
+uint64_t rotacionar_esquerda_compartilhado(SegmentoCompartilhado* segmento, uint64_t x);
+uint64_t balancear_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+void preparar_paciente_compartilhado(Paciente* paciente);
+uint64_t reservar_compartilhado(SegmentoCompartilhado* segmento, uint64_t bytes);
+uint64_t alocar_no_compartilhado(SegmentoCompartilhado* segmento, const Paciente* paciente);
+void liberar_no_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento);
+uint64_t inserir_compartilhado(SegmentoCompartilhado* segmento, uint64_t raiz, const Paciente* paciente, uint64_t* inserido);
+uint64_t remover_compartilhado(SegmentoCompartilhado* segmento, uint64_t raiz, const Paciente* paciente);
+Paciente* buscar_compartilhado(SegmentoCompartilhado* segmento, const char* nome);
+void registrar_mudanca(SegmentoCompartilhado* segmento, int removido, uint64_t deslocamento);
+ArvoreDisco* abrir_arvore_disco(const char* arquivo);
+void fechar_arvore_disco(ArvoreDisco* arvore);
+void ler_pagina_disco(ArvoreDisco* arvore, uint32_t pagina, uint8_t* destino);
+void gravar_pagina_disco(ArvoreDisco* arvore, uint32_t pagina, const uint8_t* origem);
+void gravar_meta_disco(ArvoreDisco* arvore);
+int gravar_arvore_disco(ArvoreDisco* arvore);
+void dimensionar_buffer_disco(ArvoreDisco* arvore, int quadros);
+uint8_t* pagina_quadro(ArvoreDisco* arvore, int quadro);
+void gravar_quadro_disco(ArvoreDisco* arvore, int quadro);
+int liberar_quadro_disco(ArvoreDisco* arvore);
+void ocupar_quadro_disco(ArvoreDisco* arvore, int quadro, uint32_t pagina);
+int fixar_pagina(ArvoreDisco* arvore, uint32_t pagina);
+int nova_pagina(ArvoreDisco* arvore, int folha, uint32_t* pagina);
+void soltar_pagina(ArvoreDisco* arvore, int quadro, int sujo);
+CabecalhoPagina* cabecalho_pagina(uint8_t* pagina);
+uint16_t* deslocamentos_pagina(uint8_t* pagina);
+uint8_t* registro_pagina(uint8_t* pagina, int posicao);
+const char* nome_registro_disco(const uint8_t* registro, int folha);
+uint64_t chave_registro_disco(const uint8_t* registro, int folha);
+uint32_t filho_registro_disco(const uint8_t* registro);
+int tamanho_registro_disco(const uint8_t* registro, int folha);
+int montar_registro_folha(uint8_t* destino, const Paciente* paciente);
+int montar_registro_interno(uint8_t* destino, uint32_t filho, uint64_t chave, const char* nome);
+void ler_registro_folha(const uint8_t* registro, Paciente* destino, char* nome);
+int comparar_registro_disco(uint64_t chave, const char* nome, const uint8_t* registro, int folha, int exato);
+int limite_pagina(uint8_t* pagina, uint64_t chave, const char* nome, int exato, int estrito);
+uint32_t filho_disco(uint8_t* pagina, uint64_t chave, const char* nome, int exato);
+int espaco_pagina(uint8_t* pagina);
+void iniciar_pagina(uint8_t* pagina, int folha);
+void compactar_pagina(uint8_t* pagina);
+void colocar_registro(uint8_t* pagina, int posicao, const uint8_t* registro, int tamanho);
+void retirar_registro(uint8_t* pagina, int posicao);
+void dividir_no_disco(ArvoreDisco* arvore, int quadro, int posicao, const uint8_t* registro, uint8_t* separador);
+PosicaoDisco localizar_disco(ArvoreDisco* arvore, uint64_t chave, const char* nome, int exato);
+void andar_posicao_disco(ArvoreDisco* arvore, PosicaoDisco* posicao, int direita);
+PosicaoDisco extremo_disco(ArvoreDisco* arvore, int ultimo);
+int comparar_posicao_disco(ArvoreDisco* arvore, PosicaoDisco posicao, uint64_t chave, const char* nome, int exato);
+void ler_posicao_disco(ArvoreDisco* arvore, PosicaoDisco posicao, Paciente* destino, char* nome);
+PosicaoDisco procurar_disco(ArvoreDisco* arvore, const char* nome);
+size_t posicao_residente_disco(ArvoreDisco* arvore, const char* nome);
+void desligar_residente_disco(ArvoreDisco* arvore, ResidenteDisco* residente);
+void ligar_residente_disco(ArvoreDisco* arvore, ResidenteDisco* residente);
+void retirar_residente_disco(ArvoreDisco* arvore, size_t posicao);
+Paciente* residente_disco(ArvoreDisco* arvore, const Paciente* lido);
+void soltar_residente_disco(ArvoreDisco* arvore, const char* nome);
+Paciente* buscar_disco(ArvoreDisco* arvore, const char* nome);
+int nome_cabe_disco(const char* nome);
+int inserir_disco(ArvoreDisco* arvore, const Paciente* paciente);
+void remover_disco(ArvoreDisco* arvore, const char* nome);
+int regravar_disco(ArvoreDisco* arvore, const Paciente* paciente);
+Paciente* atualizar_disco(ArvoreDisco* arvore, Paciente* paciente, Paciente alterado);
+void construir_disco(ArvoreDisco* arvore, Paciente* pacientes, int quantidade);
+void inserir_lote_disco(ArvoreDisco* arvore, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos);
+void resolver_lote_disco(ArvoreDisco* arvore, ConsultaLote* consultas, int quantidade);
+Paciente* copiar_paciente_pedacos(PedacoNomes** pedacos, const Paciente* paciente);
+void liberar_pedacos(PedacoNomes** pedacos);
+Paciente* duplicar_paciente(const Paciente* paciente);
+Paciente* copiar_paciente_disco(ArvoreDisco* arvore, const Paciente* paciente);
+void descartar_copias_disco(ArvoreDisco* arvore);
 void inserir_ordenado(ListaDupla* lista, Paciente paciente);
-Paciente* buscar_lista(ListaDupla* lista, char* nome);
-Paciente* buscar_avl(NoAVL* raiz, char* nome);
+void remover_lista(ListaDupla* lista, Paciente* paciente);
+Paciente* buscar_lista(ListaDupla* lista, const char* nome);
+void inserir_blocos(ListaBlocos* lista, Paciente paciente);
+void remover_blocos(ListaBlocos* lista, Paciente* paciente);
+Paciente* buscar_blocos(ListaBlocos* lista, const char* nome);
+Paciente* buscar_avl(NoAVL* raiz, const char* nome);
+void registrar_conflito(RelatorioConflitos* relatorio, const char* nome);
+void exibir_conflitos(RelatorioConflitos* relatorio);
+int comparar_pacientes_crescente(const void* a, const void* b);
+int comparar_pacientes_decrescente(const void* a, const void* b);
+void atualizar_altura_avl(NoAVL* no);
+NoAVL* balancear_avl(NoAVL* no);
+NoAVL* juntar_avl(NoAVL* esquerda, NoAVL* meio, NoAVL* direita);
+void dividir_avl(NoAVL* raiz, const Paciente* paciente, NoAVL** esquerda, NoAVL** igual, NoAVL** direita);
+NoAVL* unir_avl(NoAVL* existente, NoAVL* novos, RelatorioConflitos* conflitos);
+NoAVL* construir_avl_ordenada(Paciente* pacientes, int inicio, int fim);
+void inserir_lote_lista(ListaDupla* lista, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos);
+void inserir_lote_blocos(ListaBlocos* lista, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos);
+NoAVL* inserir_lote_avl(NoAVL* raiz, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos);
+int comparar_consultas(const void* a, const void* b);
+int limite_dobrado(ConsultaLote* consultas, int inicio, int fim, const Paciente* paciente, int estrito);
+void resolver_lote_lista(ListaDupla* lista, ConsultaLote* consultas, int quantidade);
+void resolver_lote_blocos(ListaBlocos* lista, ConsultaLote* consultas, int quantidade);
+void resolver_lote_avl(NoAVL* raiz, ConsultaLote* consultas, int inicio, int fim);
+void resolver_lote_compartilhado(SegmentoCompartilhado* segmento, ConsultaLote* consultas, int quantidade);
+void buscar_lote(Clinica* clinica, char** nomes, int quantidade, FILE* encontrados, FILE* ausentes);
+char** ler_nomes_arquivo(const char* nome_arquivo, int* quantidade);
+void conciliar_arquivo(Clinica* clinica, const char* nome_arquivo);
+HistoricoConsultas* criar_historico();
+int adicionar_data_historico(HistoricoConsultas* historico, int dia);
+int registrar_consulta(Paciente* paciente, int dia);
+int contar_consultas_periodo(const Paciente* paciente, int de, int ate);
+void listar_consultas_periodo(const Paciente* paciente, int de, int ate);
+void liberar_historico(HistoricoConsultas* historico);
+HistoricoConsultas* reter_historico(HistoricoConsultas* historico);
+HistoricoConsultas* copiar_historico(const HistoricoConsultas* historico);
 void exibir_paciente(Paciente* paciente);
-void listar_pacientes_lista(ListaDupla* lista);
-void listar_pacientes_avl(NoAVL* raiz);
 void limpar_string(char* str);
-void carregar_pacientes(ListaDupla* lista_m, NoAVL** raiz_l, char* nome_arquivo);
-void cadastrar_paciente(ListaDupla* lista_m, NoAVL** raiz_l);
-void alterar_registro(ListaDupla* lista_m, NoAVL* raiz_l);
-void salvar_pacientes_moises(ListaDupla* lista, const char* nome_arquivo);
-void salvar_pacientes_liz(NoAVL* raiz, FILE* arquivo);
-void salvar_pacientes_liz_arquivo(NoAVL* raiz, const char* nome_arquivo);
-void salvar_pacientes(ListaDupla* lista_m, NoAVL* raiz_l);
-void salvar_pacientes_original(ListaDupla* lista_m, NoAVL* raiz_l, char* nome_arquivo);
-void salvar_avl_em_arquivo(NoAVL* raiz, FILE* arquivo);
-void menu_moises(ListaDupla* lista);
-void menu_liz(NoAVL* raiz);
-void menu_principal(ListaDupla* lista_m, NoAVL* raiz_l);
+void adicionar_lote(LotePacientes* lote, Paciente paciente);
+void liberar_lote(LotePacientes* lote);
+int interpretar_linha_paciente(char* linha, Paciente* paciente);
+int tratar_linha_paciente(char* linha, int primeira, TabelaLinhas* linhas, Paciente* paciente);
+int ler_pacientes_arquivo(const char* nome_arquivo, LotePacientes* lote);
+void tarefa_inserir_lote(void* argumento);
+int distribuir_lote(Clinica* clinica, LotePacientes* lote, TarefaLote* tarefas);
+void concluir_tarefas_lote(Clinica* clinica, TarefaLote* tarefas, int sem_medico);
+void inserir_lote(Clinica* clinica, LotePacientes* lote);
+void importar_pacientes(Clinica* clinica, const char* nome_arquivo);
+int data_ordenavel(const char* data);
+void ordenar_fluxo(FluxoPacientes* fluxo);
+int ordem_arquivo(FILE* arquivo);
+char* ler_linha_reversa(FluxoPacientes* fluxo, int* primeira);
+int abrir_fluxo(FluxoPacientes* fluxo, const char* nome_arquivo);
+int avancar_fluxo(FluxoPacientes* fluxo);
+void fechar_fluxo(FluxoPacientes* fluxo);
+int comparar_fluxos(FluxoPacientes* fluxos, int a, int b);
+void descer_heap_fluxos(FluxoPacientes* fluxos, int* heap, int tamanho, int i);
+int paciente_sem_lugar(Clinica* clinica, const Paciente* paciente);
+void carregar_pacientes_multiplos(Clinica* clinica, char** arquivos, int quantidade);
+void carregar_pacientes(Clinica* clinica, char* nome_arquivo);
+uint64_t hash_nome_dobrado(const char* nome);
+int indexar_preguicoso(Clinica* clinica, char** arquivos, int quantidade);
+Paciente* materializar_entrada(IndicePreguicoso* indice, EntradaIndice* entrada);
+Paciente* buscar_preguicoso(IndicePreguicoso* indice, const char* nome);
+void liberar_preguicoso(IndicePreguicoso* indice);
+void materializar_clinica(Clinica* clinica);
+char* ler_texto_digitado();
+void cadastrar_paciente(Clinica* clinica);
+Paciente* atualizar_paciente(Clinica* clinica, Registro** registro, Paciente* paciente, const char* nome_atual, Paciente alterado);
+Paciente* aplicar_alteracao(Clinica* clinica, Registro** registro, Paciente* paciente, Paciente alterado);
+void alterar_registro(Clinica* clinica);
+void tarefa_salvar_registro(void* argumento);
+void tarefa_formatar_registro(void* argumento);
+void salvar_pacientes(Clinica* clinica);
+void salvar_pacientes_original(Clinica* clinica, char* nome_arquivo);
+void escrever_varint(FILE* arquivo, uint64_t valor);
+int ler_varint(FILE* arquivo, uint64_t* valor);
+int assinatura_compacta(const char* assinatura);
+int formato_compacto(const char* nome_arquivo);
+void escrever_data_compacta(FILE* arquivo, const char* data, char* anterior);
+int ler_data_compacta(FILE* arquivo, int escapes, int64_t* dias, char* data);
+void escrever_paciente_compacto(FILE* arquivo, const Paciente* paciente, Paciente* anterior);
+void salvar_pacientes_compacto(Clinica* clinica, const char* nome_arquivo);
+int ler_nome_prefixado(FILE* arquivo, char** nome, size_t* capacidade);
+int ler_pacientes_compacto(FILE* arquivo, LotePacientes* lote, int escapes);
+void salvar_historicos(Clinica* clinica, const char* nome_arquivo);
+void carregar_historicos(Clinica* clinica, const char* nome_arquivo);
+void* trabalhador_pool(void* argumento);
+PoolThreads* criar_pool(int num_threads);
+void pool_submeter(PoolThreads* pool, void (*funcao)(void*), void* argumento);
+void pool_aguardar(PoolThreads* pool);
+void destruir_pool(PoolThreads* pool);
+Clinica* criar_clinica(int num_threads);
+void gerar_arquivo_medico(const char* medico, char* arquivo, size_t tamanho);
+int adicionar_medico(Clinica* clinica, const char* medico, const char* motor, const char* criterio);
+void dividir_memoria_disco(Clinica* clinica, int megabytes);
+void configurar_clinica_padrao(Clinica* clinica);
+int carregar_configuracao_medicos(Clinica* clinica, const char* nome_arquivo);
+int medico_atende(Clinica* clinica, int indice, const Paciente* paciente);
+int rotear_paciente(Clinica* clinica, const Paciente* paciente);
+Paciente* registro_buscar(Registro* registro, const char* nome);
+int registro_inserir(Registro* registro, Paciente paciente);
+void registro_remover(Registro* registro, Paciente* paciente);
+void registro_inserir_lote(Registro* registro, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos);
+Paciente* registro_atualizar(Registro* registro, Paciente* paciente, Paciente alterado);
+int escrita_alterou(const Registro* registro, unsigned long escrita);
+int registro_desfazer(Clinica* clinica, Registro* registro, Registro** impedimento);
+void concluir_carregamento(Clinica* clinica);
+CacheBuscas* criar_cache_buscas();
+void limpar_cache_buscas(CacheBuscas* cache);
+void desligar_uso_cache(CacheBuscas* cache, int indice);
+void ligar_uso_cache(CacheBuscas* cache, int indice);
+Paciente* buscar_cache(CacheBuscas* cache, const char* nome, uint64_t hash);
+void guardar_cache(CacheBuscas* cache, const char* nome, uint64_t hash, Paciente* paciente);
+FiltroNomes* criar_filtro(size_t capacidade);
+void liberar_filtro(FiltroNomes* filtro);
+void filtro_adicionar(FiltroNomes* filtro, uint64_t hash);
+void filtro_remover(FiltroNomes* filtro, uint64_t hash);
+int filtro_pode_conter(const FiltroNomes* filtro, uint64_t hash);
+void adicionar_paciente_filtro(Paciente* paciente, void* contexto);
+void refazer_filtro(Registro* registro);
+void registro_contar_nome(Registro* registro, const char* nome);
+int registro_pode_conter(Registro* registro, uint64_t hash);
+Paciente* registro_buscar_candidato(Registro* registro, const char* nome, uint64_t hash);
+IndiceTermos* criar_indice_termos();
+void liberar_indice_termos(IndiceTermos* indice);
+int proximo_termo(const unsigned char** p, char* termo, size_t tamanho);
+EntradaTermo* localizar_termo(IndiceTermos* indice, const char* termo, uint64_t hash, int criar);
+size_t localizar_id_nome(IndiceTermos* indice, const char* nome, uint64_t hash);
+void acrescentar_postagem(ListaPostagens* lista, uint32_t id);
+void compactar_postagens(const IndiceTermos* indice, ListaPostagens* lista);
+void remover_postagem(const IndiceTermos* indice, ListaPostagens* lista);
+int indice_adicionar_nome(IndiceTermos* indice, const char* nome);
+void indice_remover_nome(IndiceTermos* indice, const char* nome);
+void adicionar_paciente_indice(Paciente* paciente, void* contexto);
+void refazer_indice_termos(Registro* registro);
+void iniciar_cursor(CursorPostagens* cursor, const ListaPostagens* lista);
+void avancar_cursor(CursorPostagens* cursor);
+void saltar_cursor(CursorPostagens* cursor, uint32_t alvo);
+int comparar_cursores(const void* a, const void* b);
+uint32_t* buscar_termos_registro(IndiceTermos* indice, const char* consulta, int* quantidade);
+void selecionar_termos_disco(Paciente* paciente, void* contexto);
+Paciente** buscar_termos_disco(Registro* registro, const char* consulta, int* quantidade);
+void buscar_por_termos(Clinica* clinica, const char* consulta);
+int uns_finais(uint64_t valor);
+int preencher_congelado(IndiceCongelado* indice, int i, size_t k);
+int congelar_registro(Registro* registro);
+void liberar_congelado(IndiceCongelado* indice);
+void invalidar_congelado(Registro* registro);
+int congelado_em_dia(Registro* registro);
+uint64_t calcular_resto_chave(const char* nome);
+int prefixo_menor(PrefixoNome a, PrefixoNome b);
+size_t limite_congelado(const IndiceCongelado* indice, PrefixoNome alvo);
+Paciente* buscar_congelado(const IndiceCongelado* indice, const char* nome);
+void congelar_clinica(Clinica* clinica);
+void sincronizar_compartilhado(Registro* registro);
+void iniciar_leitura_compartilhada(Clinica* clinica);
+void terminar_leitura_compartilhada(Clinica* clinica);
+int compartilhados_carregados(Clinica* clinica);
+void aguardar_carga_compartilhada(Clinica* clinica);
+Paciente* revalidar_paciente(Registro* registro, Paciente* paciente, const char* nome);
+const char* nome_motor(MotorRegistro motor);
+int motor_decrescente(MotorRegistro motor);
+void cursor_registro(CursorRegistro* cursor, Registro* registro);
+void cursor_arvore(CursorRegistro* cursor, NoAVL* raiz);
+uint64_t cursor_filho(const CursorRegistro* cursor, uint64_t no, int direita);
+Paciente* cursor_atual(CursorRegistro* cursor);
+Paciente* cursor_extremo(CursorRegistro* cursor, uint64_t no, int direita);
+Paciente* cursor_primeiro(CursorRegistro* cursor);
+Paciente* cursor_ultimo(CursorRegistro* cursor);
+Paciente* cursor_copiar_disco(CursorRegistro* cursor);
+Paciente* cursor_andar(CursorRegistro* cursor, int direita);
+Paciente* cursor_proximo(CursorRegistro* cursor);
+Paciente* cursor_anterior(CursorRegistro* cursor);
+Paciente* cursor_posicionar(CursorRegistro* cursor, const char* nome);
+void escolher_menor_iterador(IteradorClinica* iterador);
+Paciente* iniciar_iterador(IteradorClinica* iterador, Clinica* clinica);
+Paciente* iterador_posicionar(IteradorClinica* iterador, const char* nome);
+Paciente* iterador_atual(const IteradorClinica* iterador);
+Paciente* iterador_proximo(IteradorClinica* iterador);
+void liberar_iterador(IteradorClinica* iterador);
+int passou_do_limite(const char* limite, const char* nome);
+void listar_intervalo(Clinica* clinica, const char* de, const char* ate);
+void registro_percorrer(Registro* registro, void (*visitar)(Paciente*, void*), void* contexto);
+void exibir_paciente_visitado(Paciente* paciente, void* contexto);
+void gravar_paciente_visitado(Paciente* paciente, void* contexto);
+void contar_paciente(Paciente* paciente, void* contexto);
+int registro_contar(Registro* registro);
+void registro_listar(Registro* registro);
+void registro_salvar(Registro* registro, FILE* arquivo);
+void registro_destruir(Registro* registro);
+void tarefa_buscar_registro(void* argumento);
+Paciente* buscar_clinica(Clinica* clinica, const char* nome, Registro** registro);
+void iniciar_resumo(ResumoEstatistico* resumo);
+void somar_resumo(ResumoEstatistico* destino, const ResumoEstatistico* origem);
+int percentil_dias(const ResumoEstatistico* resumo, double percentil);
+void resumir_bloco_estatistica(ResumoEstatistico* resumo, BlocoEstatistica* bloco, int hoje);
+void acumular_estatistica_visitado(Paciente* paciente, void* contexto);
+void tarefa_estatisticas(void* argumento);
+int partes_paralelas(Clinica* clinica, int tamanho);
+RelatorioEstatisticas* calcular_relatorio(Clinica* clinica);
+void liberar_relatorio(RelatorioEstatisticas* relatorio);
+void exibir_resumo(const char* titulo, const ResumoEstatistico* resumo);
+void exibir_relatorio(Clinica* clinica, RelatorioEstatisticas* relatorio);
+void escrever_texto_json(FILE* arquivo, const char* texto);
+void escrever_resumo_json(FILE* arquivo, const ResumoEstatistico* resumo);
+void escrever_relatorio_json(Clinica* clinica, RelatorioEstatisticas* relatorio, FILE* arquivo);
+int gerar_relatorio_json(Clinica* clinica, const char* nome_arquivo);
+void exibir_estatisticas_medicos(Clinica* clinica);
+int comparar_atrasados(const PacienteAtrasado* a, const PacienteAtrasado* b);
+void iniciar_heap_atrasados(HeapAtrasados* heap, int limite);
+void descer_heap_atrasados(HeapAtrasados* heap, int i);
+void oferecer_atrasado(HeapAtrasados* heap, PacienteAtrasado item);
+void oferecer_atrasado_visitado(Paciente* paciente, void* contexto);
+void tarefa_atrasados(void* argumento);
+int ordenar_heap_atrasados(HeapAtrasados* heap);
+void exibir_atrasados(Clinica* clinica, int k, int por_medico);
+void selecionar_frequente(Paciente* paciente, void* contexto);
+void tarefa_frequentes_registro(void* argumento);
+void exibir_pacientes_frequentes(Clinica* clinica, int ano, int minimo);
+void coletar_paciente(Paciente* paciente, void* contexto);
+Paciente** coletar_registro(Registro* registro, int* quantidade);
+void tarefa_coletar_registro(void* argumento);
+Paciente** coletar_pacientes_medicos(Clinica* clinica, int* inicios);
+Paciente** coletar_pacientes_ordenados(Clinica* clinica, int* quantidade);
+int interpretar_campo_ordenacao(const char* texto);
+const char* nome_campo_ordenacao(CampoOrdenacao campo);
+uint32_t chave_ordenacao(const Paciente* paciente, CampoOrdenacao campo, int hoje);
+void tarefa_chaves_radix(void* argumento);
+void tarefa_contar_radix(void* argumento);
+void tarefa_espalhar_radix(void* argumento);
+void ordenar_pacientes_campo(Clinica* clinica, Paciente** pacientes, int quantidade, CampoOrdenacao campo);
+int comparar_entradas_ordenacao(const void* a, const void* b);
+void gravar_sequencia_ordenada(OrdenacaoExterna* ordenacao);
+void receber_ordenacao(Paciente* paciente, void* contexto);
+int ler_sequencia_ordenada(SequenciaOrdenada* sequencia);
+void descer_heap_sequencias(SequenciaOrdenada* sequencias, int* heap, int quantidade, int i);
+int terminar_ordenacao(OrdenacaoExterna* ordenacao, void (*visitar)(Paciente*, void*), void* contexto);
+int clinica_tem_disco(Clinica* clinica);
+int percorrer_por_campo(Clinica* clinica, Registro* registro, CampoOrdenacao campo,
+                        void (*visitar)(Paciente*, void*), void* contexto);
+void listar_registro_ordenado(Clinica* clinica, Registro* registro, CampoOrdenacao campo);
+void exportar_pacientes(Clinica* clinica, const char* nome_arquivo, CampoOrdenacao campo);
+double medir_vazao_buscas(Registro* registro, const char** nomes, int quantidade, int congelado);
+void medir_buscas(Clinica* clinica, int quantidade);
+void destruir_clinica(Clinica* clinica);
+void iniciar_escrita(Clinica* clinica);
+void terminar_escrita(Clinica* clinica);
+double milissegundos_agora();
+void copiar_paciente(Paciente* paciente, void* contexto);
+int copiar_cadastros(SalvamentoAutomatico* salvamento);
+int gravar_copia(SalvamentoAutomatico* salvamento);
+void* thread_salvamento_automatico(void* argumento);
+void iniciar_salvamento_automatico(Clinica* clinica, int intervalo, const char* nome_arquivo);
+void parar_salvamento_automatico(Clinica* clinica);
+void exibir_salvamento_automatico(Clinica* clinica);
+uint64_t hash_linha(const char* linha, size_t tamanho);
+uint64_t hash_linha_paciente(const Paciente* paciente);
+void iniciar_tabela_linhas(TabelaLinhas* tabela, size_t previsao);
+void liberar_tabela_linhas(TabelaLinhas* tabela);
+size_t posicao_linha(const TabelaLinhas* tabela, uint64_t hash);
+int marcar_linha(TabelaLinhas* tabela, uint64_t hash);
+void adicionar_linha(TabelaLinhas* tabela, uint64_t hash, uint64_t conteudo, const char* nome);
+void remover_linha(TabelaLinhas* tabela, uint64_t hash);
+int ler_assinatura(const char* nome_arquivo, AssinaturaArquivo* assinatura);
+int mesma_assinatura(const AssinaturaArquivo* a, const AssinaturaArquivo* b);
+int entregar_linhas_salvas(RecargaArquivo* recarga, const char* temporario, TabelaLinhas* linhas);
+void comparar_arquivo_recarga(RecargaArquivo* recarga, const AssinaturaArquivo* assinatura);
+void* thread_recarga(void* argumento);
+void preparar_recarga(Clinica* clinica, const char* nome_arquivo);
+void iniciar_recarga(Clinica* clinica);
+void parar_recarga(Clinica* clinica);
+int comparar_nomes_recarga(const void* a, const void* b);
+void aplicar_recarga(Clinica* clinica, int exibir);
+const char* nome_evento(TipoEvento tipo);
+void copiar_texto(char* destino, size_t tamanho, const char* origem);
+int enfileirar_evento(Auditoria* auditoria, const EventoAuditoria* evento);
+void auditar(Auditoria* auditoria, TipoEvento tipo, const char* medico, const char* paciente);
+int gravar_eventos_auditoria(Auditoria* auditoria);
+void* thread_auditoria(void* argumento);
+void iniciar_auditoria(Clinica* clinica, const char* nome_arquivo, PoliticaAuditoria politica, const char* operador);
+void parar_auditoria(Clinica* clinica);
+void consultar_historico(Clinica* clinica, Registro* registro);
+void menu_registro(Clinica* clinica, Registro* registro);
+void menu_principal(Clinica* clinica);
 void limpar_tela();
+unsigned long geracao_cadastros(Clinica* clinica);
+int comparar_prefixo(const char* prefixo, const Paciente* paciente);
+void atualizar_faixa_interativa(BuscaInterativa* busca);
+void percorrer_janela_interativa(BuscaInterativa* busca);
+Paciente* paciente_interativa(BuscaInterativa* busca, int posicao);
+int escrever_colunas(FILE* saida, const char* texto, int colunas, int preencher);
+void desenhar_busca_interativa(BuscaInterativa* busca);
+void exibir_detalhes_interativa(BuscaInterativa* busca);
+int tratar_teclas_interativa(BuscaInterativa* busca, const unsigned char* teclas, size_t quantidade);
+int entrar_modo_bruto(struct termios* original);
+void busca_interativa(Clinica* clinica);
 void destruir_avl(NoAVL* raiz);
 void destruir_lista(ListaDupla* lista);
+void destruir_lista_blocos(ListaBlocos* lista);
 //
 
 // Função principal
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Uso: %s <arquivo.txt>\n", argv[0]);
+    char* arquivo_conciliacao = NULL;
+    char* arquivo_compacto = NULL;
+    char* arquivo_medicos = NULL;
+    int num_threads = 0;
+    int intervalo_salvamento = 0;
+    int preguicoso = 0;
+    int estatisticas = 0;
+    char* arquivo_estatisticas = NULL;
+    int atrasados = 0;
+    int por_medico = 0;
+    char* arquivo_auditoria = NULL;
+    char* arquivo_exportacao = NULL;
+    char* arquivo_salvamento = NULL;
+    int congelar = 0;
+    int recarregar = 0;
+    int buscas_medidas = 0;
+    int memoria_disco = MEMORIA_DISCO_PADRAO_MB;
+    int campo_ordenacao = ORDEM_NOME;
+    PoliticaAuditoria politica_auditoria = AUDITORIA_DESCARTAR;
+    const char* operador = getenv("USER");
+    if (operador == NULL) operador = "desconhecido";
+
+    // Os primeiros argumentos são os arquivos de pacientes; as opções vêm depois
+    int arquivos = 1;
+    while (arquivos < argc && strncmp(argv[arquivos], "--", 2) != 0) arquivos++;
+
+    for (int i = arquivos; i < argc; i++) {
+        if (strcmp(argv[i], "--conciliar") == 0 && i + 1 < argc) {
+            arquivo_conciliacao = argv[++i];
+        } else if (strcmp(argv[i], "--exportar-compacto") == 0 && i + 1 < argc) {
+            arquivo_compacto = argv[++i];
+        } else if (strcmp(argv[i], "--medicos") == 0 && i + 1 < argc) {
+            arquivo_medicos = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--estatisticas") == 0) {
+            estatisticas = 1;
+        } else if (strcmp(argv[i], "--estatisticas-json") == 0 && i + 1 < argc) {
+            arquivo_estatisticas = argv[++i];
+        } else if (strcmp(argv[i], "--atrasados") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            atrasados = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--por-medico") == 0) {
+            por_medico = 1;
+        } else if (strcmp(argv[i], "--preguicoso") == 0) {
+            preguicoso = 1;
+        } else if (strcmp(argv[i], "--autosalvar") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            intervalo_salvamento = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--exportar") == 0 && i + 1 < argc) {
+            arquivo_exportacao = argv[++i];
+        } else if (strcmp(argv[i], "--ordenar-por") == 0 && i + 1 < argc && interpretar_campo_ordenacao(argv[i + 1]) >= 0) {
+            campo_ordenacao = interpretar_campo_ordenacao(argv[++i]);
+        } else if (strcmp(argv[i], "--congelar") == 0) {
+            congelar = 1;
+        } else if (strcmp(argv[i], "--recarregar") == 0) {
+            recarregar = 1;
+        } else if (strcmp(argv[i], "--medir-buscas") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            buscas_medidas = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--memoria-disco") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            memoria_disco = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--auditoria") == 0 && i + 1 < argc) {
+            arquivo_auditoria = argv[++i];
+        } else if (strcmp(argv[i], "--auditoria-politica") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "descartar") == 0 || strcmp(argv[i + 1], "esperar") == 0)) {
+            politica_auditoria = strcmp(argv[++i], "esperar") == 0 ? AUDITORIA_ESPERAR : AUDITORIA_DESCARTAR;
+        } else if (strcmp(argv[i], "--operador") == 0 && i + 1 < argc) {
+            operador = argv[++i];
+        } else if (strcmp(argv[i], "--salvar-em") == 0 && i + 1 < argc) {
+            arquivo_salvamento = argv[++i];
+        } else {
+            arquivos = 1; // Opção desconhecida: mostra o uso
+            break;
+        }
+    }
+    if (arquivos < 2) {
+        printf("Uso: %s <arquivo.txt> [outros_arquivos.txt ...] [--medicos <medicos.cfg>] [--threads <n>]\n", argv[0]);
+        printf("       [--preguicoso] [--autosalvar <segundos>] [--conciliar <nomes.txt>] [--exportar-compacto <arquivo.pcz>]\n");
+        printf("       [--estatisticas] [--estatisticas-json <arquivo.json | ->] [--atrasados <K> [--por-medico]]\n");
+        printf("       [--exportar <arquivo.txt> [--ordenar-por nome|nascimento|consulta|idade]]\n");
+        printf("       [--congelar] [--medir-buscas <N>] [--recarregar] [--memoria-disco <MB>]\n");
+        printf("       [--auditoria <arquivo.log> [--auditoria-politica descartar|esperar] [--operador <nome>]]\n");
+        printf("       [--salvar-em <arquivo.txt>]\n");
+        return 1;
+    }
+
+    Clinica* clinica = criar_clinica(num_threads);
+    if (arquivo_medicos == NULL) {
+        configurar_clinica_padrao(clinica);
+    } else if (!carregar_configuracao_medicos(clinica, arquivo_medicos)) {
+        destruir_clinica(clinica);
         return 1;
     }
+    dividir_memoria_disco(clinica, memoria_disco);
+
+    // Os outros processos esperam a carga dos cadastros compartilhados: eles não podem ficar para depois
+    for (int i = 0; preguicoso && i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_COMPARTILHADO) {
+            printf("O modo preguiçoso não vale com cadastros compartilhados; os pacientes serão carregados.\n");
+            preguicoso = 0;
+        } else if (clinica->registros[i].motor == MOTOR_DISCO) {
+            // As buscas preguiçosas só conhecem os pacientes do arquivo de texto, não os que já estão na árvore
+            printf("O modo preguiçoso não vale com cadastros em disco; os pacientes serão carregados.\n");
+            preguicoso = 0;
+        }
+    }
+
+    // A recarga compara o arquivo com as linhas lidas na carga: vale para um único arquivo, carregado por inteiro
+    if (recarregar && arquivos != 2) {
+        printf("A recarga automática acompanha um único arquivo de pacientes; ela ficará desligada.\n");
+        recarregar = 0;
+    }
+    if (recarregar) {
+        if (preguicoso) printf("O modo preguiçoso não vale com a recarga automática; os pacientes serão carregados.\n");
+        preguicoso = 0;
+        preparar_recarga(clinica, argv[1]);
+    }
+
+    // Se todos os cadastros estão em memória compartilhada criada por outro processo, basta anexar;
+    // no modo preguiçoso só os nomes são indexados; sem ele (ou se a indexação falhar) carrega tudo
+    aguardar_carga_compartilhada(clinica);
+    if (compartilhados_carregados(clinica)) {
+        printf("Cadastros anexados da memória compartilhada.\n");
+        concluir_carregamento(clinica);
+    } else if (!preguicoso || !indexar_preguicoso(clinica, argv + 1, arquivos - 1)) {
+        carregar_pacientes_multiplos(clinica, argv + 1, arquivos - 1);
+        carregar_historicos(clinica, ARQUIVO_HISTORICO);
+        concluir_carregamento(clinica);
+    }
+
+    // Sessões só de consulta: as buscas passam a usar o índice congelado de cada médico
+    if (congelar) congelar_clinica(clinica);
+
+    // Modo em lote: executa os comandos pedidos e termina sem abrir o menu
+    if (arquivo_conciliacao != NULL || arquivo_compacto != NULL || arquivo_exportacao != NULL || estatisticas ||
+        arquivo_estatisticas != NULL || atrasados > 0 || buscas_medidas > 0) {
+        if (arquivo_conciliacao != NULL) conciliar_arquivo(clinica, arquivo_conciliacao);
+        if (arquivo_compacto != NULL) salvar_pacientes_compacto(clinica, arquivo_compacto);
+        if (arquivo_exportacao != NULL) exportar_pacientes(clinica, arquivo_exportacao, (CampoOrdenacao)campo_ordenacao);
+        if (estatisticas) {
+            RelatorioEstatisticas* relatorio = calcular_relatorio(clinica);
+            exibir_relatorio(clinica, relatorio);
+            liberar_relatorio(relatorio);
+        }
+        if (arquivo_estatisticas != NULL) gerar_relatorio_json(clinica, arquivo_estatisticas);
+        if (atrasados > 0) exibir_atrasados(clinica, atrasados, por_medico);
+        if (buscas_medidas > 0) medir_buscas(clinica, buscas_medidas);
+        destruir_clinica(clinica);
+        return 0;
+    }
 
-    ListaDupla* lista_m = criar_lista();
-    NoAVL* raiz_l = NULL;
+    // Os pacientes voltam para o arquivo de onde vieram; com vários arquivos (ou um compacto) não há
+    // um só para regravar, e o destino precisa vir de --salvar-em
+    if (arquivo_salvamento == NULL && arquivos == 2 && !formato_compacto(argv[1])) arquivo_salvamento = argv[1];
+    if (arquivo_salvamento == NULL) {
+        printf("Os pacientes vieram de %s: sem --salvar-em <arquivo>, as alterações não serão salvas.\n",
+               arquivos == 2 ? "um arquivo compacto" : "vários arquivos");
+        if (intervalo_salvamento > 0) printf("O salvamento automático ficará desligado.\n");
+        intervalo_salvamento = 0;
+    }
+
+    if (clinica->recarga != NULL) iniciar_recarga(clinica);
+    if (intervalo_salvamento > 0) {
+        iniciar_salvamento_automatico(clinica, intervalo_salvamento, arquivo_salvamento);
+    }
+    if (arquivo_auditoria != NULL) {
+        iniciar_auditoria(clinica, arquivo_auditoria, politica_auditoria, operador);
+    }
 
-    carregar_pacientes(lista_m, &raiz_l, argv[1]);
+    menu_principal(clinica);
 
-    menu_principal(lista_m, raiz_l);
+    // O salvamento automático e a recarga param antes do salvamento final
+    if (clinica->salvamento != NULL) parar_salvamento_automatico(clinica);
+    if (clinica->recarga != NULL) parar_recarga(clinica);
 
-    salvar_pacientes(lista_m, raiz_l);
+    // Se ainda está no modo preguiçoso nada foi alterado: os arquivos ficam como estão
+    if (clinica->preguicoso != NULL) {
+        printf("Nenhuma alteração feita; arquivos mantidos.\n");
+    } else if (arquivo_salvamento != NULL) {
+        salvar_pacientes(clinica);
 
-    salvar_pacientes_original(lista_m, raiz_l, "pacientes.txt");
+        salvar_pacientes_original(clinica, arquivo_salvamento);
+
+        salvar_historicos(clinica, ARQUIVO_HISTORICO);
+    }
 
     // Liberar memória
-    destruir_lista(lista_m); // Libera a lista duplamente encadeada
-    printf("Memória da lista liberada.\n");
-    destruir_avl(raiz_l);    // Libera a árvore AVL
-    printf("Memória da árvore liberada.\n");
+    destruir_clinica(clinica); // Libera os cadastros de todos os médicos
+    liberar_arena_nomes();
+    printf("Memória dos cadastros liberada.\n");
 
 
     return 0;
@@ -134,64 +1693,430 @@ int calcular_diferenca_dias(const char *data1, const char *data2) {
     return diferenca_dias;
 }
 
-// Função para criar uma nova lista vazia
-ListaDupla* criar_lista() {
-    ListaDupla* lista = (ListaDupla*)malloc(sizeof(ListaDupla));
-    if (lista == NULL) {
-        printf("Erro ao alocar memória para a lista.\n");
-        exit(1);
+// Função para converter uma data "dd/mm/aaaa" no número de dias desde 01/03/0000 (mais um)
+// Usa só aritmética inteira; retorna 0 para datas mal formatadas
+int data_para_dias(const char* data) {
+    int dia, mes, ano;
+    const char* d = data;
+    int fixo = strlen(d) == 10 && d[2] == '/' && d[5] == '/';
+    for (int i = 0; fixo && i < 10; i++) {
+        if (i != 2 && i != 5 && (d[i] < '0' || d[i] > '9')) fixo = 0;
     }
-    lista->inicio = NULL;
-    lista->fim = NULL;
-    return lista;
+    if (fixo) {
+        // Caso comum dd/mm/aaaa: conversão direta, sem sscanf (usada nos relatórios sobre todos os pacientes)
+        dia = (d[0] - '0') * 10 + (d[1] - '0');
+        mes = (d[3] - '0') * 10 + (d[4] - '0');
+        ano = (d[6] - '0') * 1000 + (d[7] - '0') * 100 + (d[8] - '0') * 10 + (d[9] - '0');
+    } else if (sscanf(data, "%d/%d/%d", &dia, &mes, &ano) != 3) {
+        return 0;
+    }
+    if (mes < 1 || mes > 12 || dia < 1 || dia > 31 || ano < 0) return 0;
+
+    // O ano passa a começar em março, deixando o dia 29/02 no fim do ano
+    if (mes <= 2) ano--;
+    int era = (ano >= 0 ? ano : ano - 399) / 400;
+    int ano_da_era = ano - era * 400;
+    int dia_do_ano = (153 * (mes + (mes > 2 ? -3 : 9)) + 2) / 5 + dia - 1;
+    int dia_da_era = ano_da_era * 365 + ano_da_era / 4 - ano_da_era / 100 + dia_do_ano;
+    return era * 146097 + dia_da_era + 1;
 }
 
-// Função para criar um novo nó da árvore AVL
-NoAVL* criar_no_avl(Paciente paciente) {
-    NoAVL* novo_no = (NoAVL*)malloc(sizeof(NoAVL));
-    if (novo_no == NULL) {
-        printf("Erro ao alocar memória para o nó da árvore.\n");
-        exit(1);
+// Função para converter o número de dias de data_para_dias de volta para "dd/mm/aaaa"
+void dias_para_data(int dias, char* data) {
+    if (dias <= 0) {
+        data[0] = '\0';
+        return;
     }
-    novo_no->paciente = paciente;
-    novo_no->esquerda = NULL;
-    novo_no->direita = NULL;
-    novo_no->altura = 1;
-    return novo_no;
+
+    int dia, mes, ano;
+    dias_para_calendario(dias, &dia, &mes, &ano);
+    snprintf(data, 11, "%02u/%02u/%04u", (unsigned)dia % 100, (unsigned)mes % 100, (unsigned)ano % 10000);
 }
 
-// Função para calcular a altura de um nó da árvore AVL
-int altura_avl(NoAVL* no) {
-    if (no == NULL) return 0;
-    return no->altura;
+// Função para decompor o número de dias de data_para_dias (maior que zero) em dia, mês e ano
+void dias_para_calendario(int dias, int* dia, int* mes, int* ano) {
+    int z = dias - 1;
+    int era = z / 146097;
+    int dia_da_era = z - era * 146097;
+    int ano_da_era = (dia_da_era - dia_da_era / 1460 + dia_da_era / 36524 - dia_da_era / 146096) / 365;
+    int dia_do_ano = dia_da_era - (365 * ano_da_era + ano_da_era / 4 - ano_da_era / 100);
+    int mes_m = (5 * dia_do_ano + 2) / 153;
+    *dia = dia_do_ano - (153 * mes_m + 2) / 5 + 1;
+    *mes = mes_m < 10 ? mes_m + 3 : mes_m - 9;
+    *ano = ano_da_era + era * 400 + (*mes <= 2);
 }
 
-// Função para calcular o fator de balanceamento de um nó da árvore AVL
-int fator_balanceamento(NoAVL* no) {
-    if (no == NULL) return 0;
-    return altura_avl(no->esquerda) - altura_avl(no->direita);
+// Função para calcular a idade em anos completos entre o nascimento e hoje (em dias de data_para_dias)
+// É a diferença dos anos, menos um se o aniversário ainda não chegou; quem nasceu em 29/02 faz
+// aniversário em 01/03 nos anos comuns
+int idade_em_anos(int nascimento, int hoje) {
+    int dia_n, mes_n, ano_n, dia_h, mes_h, ano_h;
+    dias_para_calendario(nascimento, &dia_n, &mes_n, &ano_n);
+    dias_para_calendario(hoje, &dia_h, &mes_h, &ano_h);
+    return ano_h - ano_n - (mes_h * 100 + dia_h < mes_n * 100 + dia_n);
 }
 
-// Função para rotacionar à direita (rotação simples à direita)
-NoAVL* rotacionar_direita(NoAVL* y) {
-    NoAVL* x = y->esquerda;
-    NoAVL* T2 = x->direita;
+// Tabela de dobra dos caracteres latinos U+00C0 a U+00FF (sem acento, em maiúsculas)
+static const char tabela_dobra_latin1[64] =
+    "AAAAAAACEEEEIIIIDNOOOOO*OUUUUYTS"
+    "AAAAAAACEEEEIIIIDNOOOOO/OUUUUYTY";
 
-    x->direita = y;
-    y->esquerda = T2;
+// Função para decodificar uma sequência UTF-8 válida (sem formas longas nem surrogates)
+// Retorna o número de bytes dela, com o code point em *codigo, ou 0 se os bytes não forem UTF-8
+int decodificar_utf8(const unsigned char* s, int* codigo) {
+    int bytes, minimo;
+    if (s[0] < 0x80) {
+        *codigo = s[0];
+        return 1;
+    } else if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        bytes = 2, minimo = 0x80, *codigo = s[0] & 0x1F;
+    } else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        bytes = 3, minimo = 0x800, *codigo = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        bytes = 4, minimo = 0x10000, *codigo = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+    for (int i = 1; i < bytes; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0; // Também para no '\0'
+        *codigo = (*codigo << 6) | (s[i] & 0x3F);
+    }
+    if (*codigo < minimo || *codigo > 0x10FFFF || (*codigo >= 0xD800 && *codigo <= 0xDFFF)) return 0;
+    return bytes;
+}
 
-    y->altura = 1 + (altura_avl(y->esquerda) > altura_avl(y->direita) ? altura_avl(y->esquerda) : altura_avl(y->direita));
-    x->altura = 1 + (altura_avl(x->esquerda) > altura_avl(x->direita) ? altura_avl(x->esquerda) : altura_avl(x->direita));
+// Função para ler o próximo caractere do nome já sem acento e em maiúsculas
+// Decodifica UTF-8 (Ã = C3 83); a tabela só cobre U+00C0 a U+00FF, e os demais caracteres voltam
+// pelo code point. Um byte que não forma UTF-8 válido é lido como Latin-1 (Ã = C3)
+// Retorna 0 no fim da string
+int dobrar_caractere(const unsigned char** p) {
+    const unsigned char* s = *p;
+    int c;
 
-    return x;
+    if (s[0] == '\0') return 0;
+
+    int bytes = decodificar_utf8(s, &c);
+    if (bytes == 0) {
+        c = s[0];
+        bytes = 1;
+    }
+    *p = s + bytes;
+    if (c >= 0xC0 && c <= 0xFF) return (unsigned char)tabela_dobra_latin1[c - 0xC0];
+    if (c >= 'a' && c <= 'z') return c - 'a' + 'A';
+    return c;
 }
 
-// Função para rotacionar à esquerda (rotação simples à esquerda)
-NoAVL* rotacionar_esquerda(NoAVL* x) {
-    NoAVL* y = x->direita;
-    NoAVL* T2 = y->esquerda;
+// Função para juntar os próximos 8 caracteres dobrados em big-endian, um byte cada
+// Um caractere acima de U+00FF vira 0xFF (que nenhum caractere dobrado até ali usa), e os seguintes
+// ficam 0: a ordem dos inteiros continua a dos nomes, e quem empata é comparado caractere a caractere
+// Com *cheio (que começa em 0) já marcado, tudo fica 0
+uint64_t juntar_dobrados(const unsigned char** p, int* cheio) {
+    uint64_t bytes = 0;
+    for (int i = 0; i < 8; i++) {
+        int c = *cheio ? 0 : dobrar_caractere(p);
+        if (c >= 0xFF) {
+            c = 0xFF;
+            *cheio = 1;
+        }
+        bytes = (bytes << 8) | (uint64_t)c;
+    }
+    return bytes;
+}
 
-    y->esquerda = x;
+// Função para calcular a chave de ordenação: os 8 primeiros caracteres dobrados em big-endian
+// Assim a comparação de dois inteiros equivale a comparar os prefixos byte a byte
+uint64_t calcular_chave(const char* nome) {
+    const unsigned char* p = (const unsigned char*)nome;
+    int cheio = 0;
+    return juntar_dobrados(&p, &cheio);
+}
+
+// Função para comparar dois nomes dobrados depois do prefixo já coberto pela chave
+int comparar_dobrado(const char* a, const char* b) {
+    const unsigned char* pa = (const unsigned char*)a;
+    const unsigned char* pb = (const unsigned char*)b;
+
+    // Os 8 primeiros caracteres já foram comparados através da chave, a não ser que ela tenha
+    // parado em um caractere acima de U+00FF: aí a comparação recomeça do início
+    for (int i = 0; i < 8; i++) {
+        if (dobrar_caractere(&pa) >= 0xFF) {
+            pa = (const unsigned char*)a;
+            pb = (const unsigned char*)b;
+            break;
+        }
+        dobrar_caractere(&pb);
+    }
+
+    int ca, cb;
+    do {
+        ca = dobrar_caractere(&pa);
+        cb = dobrar_caractere(&pb);
+    } while (ca == cb && ca != 0);
+
+    return ca - cb;
+}
+
+// Função para comparar um nome buscado (com sua chave) com um paciente, ignorando acentos e caixa
+int comparar_busca(uint64_t chave, const char* nome, const Paciente* paciente) {
+    if (chave != paciente->chave) return chave < paciente->chave ? -1 : 1;
+    return comparar_dobrado(nome, paciente->nome);
+}
+
+// Função para comparar dois pacientes na ordem de agrupamento
+// Nomes que só diferem por acento ou caixa são desempatados pelos bytes originais
+int comparar_pacientes(const Paciente* a, const Paciente* b) {
+    int resultado = comparar_busca(a->chave, a->nome, b);
+    if (resultado != 0) return resultado;
+    return strcmp(a->nome, b->nome);
+}
+
+// Arena de nomes de todos os cadastros (a trava permite guardar nomes a partir das threads do pool)
+static ArenaNomes arena_nomes = {.trava = PTHREAD_MUTEX_INITIALIZER};
+
+// Função para calcular o hash FNV-1a dos bytes de um nome (grafia exata); o resultado nunca é 0
+uint64_t hash_nome_exato(const char* nome, size_t tamanho) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < tamanho; i++) {
+        hash = (hash ^ (unsigned char)nome[i]) * 1099511628211ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Função para calcular o hash FNV-1a de uma linha de arquivo, sem o \r final; o resultado nunca é 0
+uint64_t hash_linha(const char* linha, size_t tamanho) {
+    while (tamanho > 0 && linha[tamanho - 1] == '\r') tamanho--;
+    return hash_nome_exato(linha, tamanho);
+}
+
+// Função para calcular o hash da linha com que o paciente é gravado ("nome, sexo, nascimento, consulta"),
+// sem formatá-la: o FNV-1a passa pelos mesmos bytes na mesma ordem, então coincide com hash_linha
+uint64_t hash_linha_paciente(const Paciente* paciente) {
+    const char* partes[4] = {paciente->nome, NULL, paciente->nascimento, paciente->ultima_consulta};
+    char sexo[2] = {paciente->sexo, '\0'};
+    partes[1] = sexo;
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) {
+            hash = (hash ^ (unsigned char)',') * 1099511628211ULL;
+            hash = (hash ^ (unsigned char)' ') * 1099511628211ULL;
+        }
+        for (const char* c = partes[i]; *c != '\0'; c++) hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Função para dobrar a tabela de internação, reposicionando os nomes já guardados
+void crescer_internacao(ArenaNomes* arena) {
+    size_t capacidade = arena->capacidade_internacao * 2;
+    NomeInternado* internados = (NomeInternado*)calloc(capacidade, sizeof(NomeInternado));
+    if (internados == NULL) {
+        printf("Erro ao alocar memória para a tabela de nomes.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < arena->capacidade_internacao; i++) {
+        if (arena->internados[i].hash == 0) continue;
+        size_t posicao = arena->internados[i].hash & (capacidade - 1);
+        while (internados[posicao].hash != 0) posicao = (posicao + 1) & (capacidade - 1);
+        internados[posicao] = arena->internados[i];
+    }
+    free(arena->internados);
+    arena->internados = internados;
+    arena->capacidade_internacao = capacidade;
+}
+
+// Função para copiar um nome (de qualquer tamanho) para a arena e devolver o endereço permanente
+// Durante uma importação, um nome idêntico a um já guardado devolve o endereço do primeiro
+const char* guardar_nome(const char* nome) {
+    ArenaNomes* arena = &arena_nomes;
+    size_t tamanho = strlen(nome);
+    pthread_mutex_lock(&arena->trava);
+
+    uint64_t hash = 0;
+    size_t posicao = 0;
+    if (arena->internados != NULL) {
+        hash = hash_nome_exato(nome, tamanho);
+        size_t mascara = arena->capacidade_internacao - 1;
+        for (posicao = hash & mascara; arena->internados[posicao].hash != 0; posicao = (posicao + 1) & mascara) {
+            if (arena->internados[posicao].hash == hash && strcmp(arena->internados[posicao].nome, nome) == 0) {
+                arena->reaproveitados++;
+                pthread_mutex_unlock(&arena->trava);
+                return arena->internados[posicao].nome;
+            }
+        }
+    }
+
+    PedacoNomes* pedaco = arena->atual;
+    if (pedaco == NULL || pedaco->tamanho - pedaco->usado < tamanho + 1) {
+        size_t capacidade = tamanho + 1 > TAMANHO_PEDACO_NOMES ? tamanho + 1 : TAMANHO_PEDACO_NOMES;
+        PedacoNomes* novo = (PedacoNomes*)malloc(sizeof(PedacoNomes) + capacidade);
+        if (novo == NULL) {
+            printf("Erro ao alocar memória para os nomes.\n");
+            exit(1);
+        }
+        novo->usado = 0;
+        novo->tamanho = capacidade;
+        // Um nome que ganhou um pedaço só seu não tira o espaço livre do pedaço atual
+        if (pedaco != NULL && capacidade > TAMANHO_PEDACO_NOMES) {
+            novo->anterior = pedaco->anterior;
+            pedaco->anterior = novo;
+        } else {
+            novo->anterior = pedaco;
+            arena->atual = novo;
+        }
+        pedaco = novo;
+    }
+    char* guardado = pedaco->dados + pedaco->usado;
+    memcpy(guardado, nome, tamanho + 1);
+    pedaco->usado += tamanho + 1;
+    arena->bytes += tamanho + 1;
+    arena->nomes++;
+
+    if (arena->internados != NULL) {
+        arena->internados[posicao].hash = hash;
+        arena->internados[posicao].nome = guardado;
+        if (++arena->quantidade_internacao * 2 > arena->capacidade_internacao) crescer_internacao(arena);
+    }
+    pthread_mutex_unlock(&arena->trava);
+    return guardado;
+}
+
+// Funções para marcar o início e o fim de uma importação: enquanto houver alguma em andamento, os
+// nomes guardados passam pela tabela de internação, que depois é liberada (a arena continua)
+void iniciar_internacao_nomes() {
+    ArenaNomes* arena = &arena_nomes;
+    pthread_mutex_lock(&arena->trava);
+    if (arena->importacoes++ == 0) {
+        arena->capacidade_internacao = TAMANHO_MINIMO_INTERNACAO;
+        arena->quantidade_internacao = 0;
+        arena->internados = (NomeInternado*)calloc(arena->capacidade_internacao, sizeof(NomeInternado));
+        if (arena->internados == NULL) {
+            printf("Erro ao alocar memória para a tabela de nomes.\n");
+            exit(1);
+        }
+    }
+    pthread_mutex_unlock(&arena->trava);
+}
+
+void terminar_internacao_nomes() {
+    ArenaNomes* arena = &arena_nomes;
+    pthread_mutex_lock(&arena->trava);
+    if (--arena->importacoes == 0) {
+        free(arena->internados);
+        arena->internados = NULL;
+        arena->capacidade_internacao = 0;
+    }
+    pthread_mutex_unlock(&arena->trava);
+}
+
+// Função para liberar todos os nomes guardados (no fim do programa, com os cadastros já destruídos)
+void liberar_arena_nomes() {
+    ArenaNomes* arena = &arena_nomes;
+    while (arena->atual != NULL) {
+        PedacoNomes* anterior = arena->atual->anterior;
+        free(arena->atual);
+        arena->atual = anterior;
+    }
+    free(arena->internados);
+    arena->internados = NULL;
+}
+
+// Função para criar uma nova lista vazia
+ListaDupla* criar_lista() {
+    ListaDupla* lista = (ListaDupla*)malloc(sizeof(ListaDupla));
+    if (lista == NULL) {
+        printf("Erro ao alocar memória para a lista.\n");
+        exit(1);
+    }
+    lista->inicio = NULL;
+    lista->fim = NULL;
+    return lista;
+}
+
+// Função para criar uma lista desenrolada vazia
+ListaBlocos* criar_lista_blocos() {
+    ListaBlocos* lista = (ListaBlocos*)malloc(sizeof(ListaBlocos));
+    if (lista == NULL) {
+        printf("Erro ao alocar memória para a lista desenrolada.\n");
+        exit(1);
+    }
+    lista->inicio = NULL;
+    lista->fim = NULL;
+    return lista;
+}
+
+// Função para criar um bloco vazio e ligá-lo à lista desenrolada logo depois de 'anterior' (NULL: no início)
+BlocoPacientes* criar_bloco_pacientes(ListaBlocos* lista, BlocoPacientes* anterior) {
+    BlocoPacientes* bloco = (BlocoPacientes*)malloc(sizeof(BlocoPacientes));
+    if (bloco == NULL) {
+        printf("Erro ao alocar memória para o bloco da lista.\n");
+        exit(1);
+    }
+    bloco->quantidade = 0;
+    bloco->anterior = anterior;
+    bloco->proximo = anterior != NULL ? anterior->proximo : lista->inicio;
+    if (bloco->proximo != NULL) bloco->proximo->anterior = bloco;
+    else lista->fim = bloco;
+    if (anterior != NULL) anterior->proximo = bloco;
+    else lista->inicio = bloco;
+    return bloco;
+}
+
+// Função para desligar um bloco da lista desenrolada e liberá-lo (seus pacientes já saíram dele)
+void liberar_bloco_pacientes(ListaBlocos* lista, BlocoPacientes* bloco) {
+    if (bloco->anterior != NULL) bloco->anterior->proximo = bloco->proximo;
+    else lista->inicio = bloco->proximo;
+    if (bloco->proximo != NULL) bloco->proximo->anterior = bloco->anterior;
+    else lista->fim = bloco->anterior;
+    free(bloco);
+}
+
+// Função para criar um novo nó da árvore AVL
+NoAVL* criar_no_avl(Paciente paciente) {
+    NoAVL* novo_no = (NoAVL*)malloc(sizeof(NoAVL));
+    if (novo_no == NULL) {
+        printf("Erro ao alocar memória para o nó da árvore.\n");
+        exit(1);
+    }
+    novo_no->paciente = paciente;
+    novo_no->esquerda = NULL;
+    novo_no->direita = NULL;
+    novo_no->altura = 1;
+    atomic_init(&novo_no->referencias, 1);
+    return novo_no;
+}
+
+// Função para calcular a altura de um nó da árvore AVL
+int altura_avl(NoAVL* no) {
+    if (no == NULL) return 0;
+    return no->altura;
+}
+
+// Função para calcular o fator de balanceamento de um nó da árvore AVL
+int fator_balanceamento(NoAVL* no) {
+    if (no == NULL) return 0;
+    return altura_avl(no->esquerda) - altura_avl(no->direita);
+}
+
+// Função para rotacionar à direita (rotação simples à direita)
+NoAVL* rotacionar_direita(NoAVL* y) {
+    NoAVL* x = y->esquerda;
+    NoAVL* T2 = x->direita;
+
+    x->direita = y;
+    y->esquerda = T2;
+
+    y->altura = 1 + (altura_avl(y->esquerda) > altura_avl(y->direita) ? altura_avl(y->esquerda) : altura_avl(y->direita));
+    x->altura = 1 + (altura_avl(x->esquerda) > altura_avl(x->direita) ? altura_avl(x->esquerda) : altura_avl(x->direita));
+
+    return x;
+}
+
+// Função para rotacionar à esquerda (rotação simples à esquerda)
+NoAVL* rotacionar_esquerda(NoAVL* x) {
+    NoAVL* y = x->direita;
+    NoAVL* T2 = y->esquerda;
+
+    y->esquerda = x;
     x->direita = T2;
 
     x->altura = 1 + (altura_avl(x->esquerda) > altura_avl(x->direita) ? altura_avl(x->esquerda) : altura_avl(x->direita));
@@ -202,14 +2127,22 @@ NoAVL* rotacionar_esquerda(NoAVL* x) {
 
 // Função para inserir um paciente na árvore AVL
 NoAVL* inserir_avl(NoAVL* raiz, Paciente paciente) {
-    if (raiz == NULL) return criar_no_avl(paciente);
+    // A chave de ordenação é calculada uma única vez, antes da descida
+    paciente.chave = calcular_chave(paciente.nome);
+    return inserir_avl_no(raiz, &paciente);
+}
+
+// Função recursiva de inserção na árvore AVL (o paciente já tem a chave calculada)
+NoAVL* inserir_avl_no(NoAVL* raiz, const Paciente* paciente) {
+    if (raiz == NULL) return criar_no_avl(*paciente);
 
-    if (strcmp(paciente.nome, raiz->paciente.nome) < 0) {
-        raiz->esquerda = inserir_avl(raiz->esquerda, paciente);
-    } else if (strcmp(paciente.nome, raiz->paciente.nome) > 0) {
-        raiz->direita = inserir_avl(raiz->direita, paciente);
+    int comparacao = comparar_pacientes(paciente, &raiz->paciente);
+    if (comparacao < 0) {
+        raiz->esquerda = inserir_avl_no(raiz->esquerda, paciente);
+    } else if (comparacao > 0) {
+        raiz->direita = inserir_avl_no(raiz->direita, paciente);
     } else {
-        printf("Erro: Já existe um paciente com o nome %s.\n", paciente.nome);
+        printf("Erro: Já existe um paciente com o nome %s.\n", paciente->nome);
         return raiz; // Nomes iguais não são permitidos
     }
 
@@ -218,17 +2151,17 @@ NoAVL* inserir_avl(NoAVL* raiz, Paciente paciente) {
     int balanceamento = fator_balanceamento(raiz);
 
     // Casos de desbalanceamento
-    if (balanceamento > 1 && strcmp(paciente.nome, raiz->esquerda->paciente.nome) < 0) {
+    if (balanceamento > 1 && comparar_pacientes(paciente, &raiz->esquerda->paciente) < 0) {
         return rotacionar_direita(raiz);
     }
-    if (balanceamento < -1 && strcmp(paciente.nome, raiz->direita->paciente.nome) > 0) {
+    if (balanceamento < -1 && comparar_pacientes(paciente, &raiz->direita->paciente) > 0) {
         return rotacionar_esquerda(raiz);
     }
-    if (balanceamento > 1 && strcmp(paciente.nome, raiz->esquerda->paciente.nome) > 0) {
+    if (balanceamento > 1 && comparar_pacientes(paciente, &raiz->esquerda->paciente) > 0) {
         raiz->esquerda = rotacionar_esquerda(raiz->esquerda);
         return rotacionar_direita(raiz);
     }
-    if (balanceamento < -1 && strcmp(paciente.nome, raiz->direita->paciente.nome) < 0) {
+    if (balanceamento < -1 && comparar_pacientes(paciente, &raiz->direita->paciente) < 0) {
         raiz->direita = rotacionar_direita(raiz->direita);
         return rotacionar_esquerda(raiz);
     }
@@ -236,505 +2169,8475 @@ NoAVL* inserir_avl(NoAVL* raiz, Paciente paciente) {
     return raiz;
 }
 
-// Função para inserir um paciente na lista duplamente encadeada (Z-A)
-void inserir_ordenado(ListaDupla* lista, Paciente paciente) {
-    NoLista* novo_no = (NoLista*)malloc(sizeof(NoLista));
-    if (novo_no == NULL) {
-        printf("Erro ao alocar memória para o nó da lista.\n");
-        exit(1);
-    }
-    novo_no->paciente = paciente;
-    novo_no->proximo = NULL;
-    novo_no->anterior = NULL;
+// Função para remover um paciente da árvore AVL
+NoAVL* remover_avl(NoAVL* raiz, const Paciente* paciente) {
+    if (raiz == NULL) return NULL;
 
-    if (lista->inicio == NULL) {
-        lista->inicio = novo_no;
-        lista->fim = novo_no;
+    int comparacao = comparar_pacientes(paciente, &raiz->paciente);
+    if (comparacao < 0) {
+        raiz->esquerda = remover_avl(raiz->esquerda, paciente);
+    } else if (comparacao > 0) {
+        raiz->direita = remover_avl(raiz->direita, paciente);
+    } else if (raiz->esquerda == NULL || raiz->direita == NULL) {
+        NoAVL* filho = raiz->esquerda != NULL ? raiz->esquerda : raiz->direita;
+        free(raiz);
+        return filho;
     } else {
-        NoLista* atual = lista->inicio;
-        while (atual != NULL && strcmp(atual->paciente.nome, paciente.nome) > 0) {
-            atual = atual->proximo;
-        }
+        // Substitui pelo sucessor (menor nó da subárvore direita)
+        NoAVL* sucessor = raiz->direita;
+        while (sucessor->esquerda != NULL) sucessor = sucessor->esquerda;
+        raiz->paciente = sucessor->paciente;
+        raiz->direita = remover_avl(raiz->direita, &raiz->paciente);
+    }
 
-        if (atual == lista->inicio) {
-            novo_no->proximo = lista->inicio;
-            lista->inicio->anterior = novo_no;
-            lista->inicio = novo_no;
-        } else if (atual == NULL) {
-            novo_no->anterior = lista->fim;
-            lista->fim->proximo = novo_no;
-            lista->fim = novo_no;
-        } else {
-            novo_no->proximo = atual;
-            novo_no->anterior = atual->anterior;
-            atual->anterior->proximo = novo_no;
-            atual->anterior = novo_no;
-        }
+    raiz->altura = 1 + (altura_avl(raiz->esquerda) > altura_avl(raiz->direita) ? altura_avl(raiz->esquerda) : altura_avl(raiz->direita));
+
+    int balanceamento = fator_balanceamento(raiz);
+
+    // Casos de desbalanceamento
+    if (balanceamento > 1 && fator_balanceamento(raiz->esquerda) >= 0) {
+        return rotacionar_direita(raiz);
+    }
+    if (balanceamento > 1) {
+        raiz->esquerda = rotacionar_esquerda(raiz->esquerda);
+        return rotacionar_direita(raiz);
     }
+    if (balanceamento < -1 && fator_balanceamento(raiz->direita) <= 0) {
+        return rotacionar_esquerda(raiz);
+    }
+    if (balanceamento < -1) {
+        raiz->direita = rotacionar_direita(raiz->direita);
+        return rotacionar_esquerda(raiz);
+    }
+
+    return raiz;
 }
 
-// Função para buscar um paciente na lista duplamente encadeada
-Paciente* buscar_lista(ListaDupla* lista, char* nome) {
-    NoLista* atual = lista->inicio;
-    while (atual != NULL) {
-        if (strcmp(atual->paciente.nome, nome) == 0) {
-            return &(atual->paciente);
+// Funções da árvore persistente: os nós são compartilhados entre versões e contam as referências.
+// Quem recebe um nó (uma raiz guardada, um pai) fica com uma referência, devolvida em liberar_no
+NoAVL* reter_no(NoAVL* no) {
+    if (no != NULL) atomic_fetch_add(&no->referencias, 1);
+    return no;
+}
+
+// Libera uma referência; o último dono libera o nó, os filhos e o histórico do paciente
+void liberar_no(NoAVL* no) {
+    if (no == NULL || atomic_fetch_sub(&no->referencias, 1) != 1) return;
+    liberar_no(no->esquerda);
+    liberar_no(no->direita);
+    liberar_historico(no->paciente.historico);
+    free(no);
+}
+
+// Função para garantir que um nó só pertence à versão em construção, antes de alterá-lo
+// Um nó compartilhado é copiado (a cópia passa a referenciar os mesmos filhos) e a
+// referência ao original é devolvida; as demais versões continuam vendo o original
+NoAVL* tornar_unico(NoAVL* no) {
+    if (atomic_load(&no->referencias) == 1) return no;
+
+    NoAVL* copia = criar_no_avl(no->paciente);
+    copia->esquerda = reter_no(no->esquerda);
+    copia->direita = reter_no(no->direita);
+    copia->altura = no->altura;
+    reter_historico(copia->paciente.historico);
+    liberar_no(no);
+    return copia;
+}
+
+// Rotações da árvore persistente: o nó recebido já é exclusivo; o filho que sobe é copiado se preciso
+NoAVL* rotacionar_direita_persistente(NoAVL* y) {
+    NoAVL* x = tornar_unico(y->esquerda);
+    y->esquerda = x->direita;
+    x->direita = y;
+    atualizar_altura_avl(y);
+    atualizar_altura_avl(x);
+    return x;
+}
+
+NoAVL* rotacionar_esquerda_persistente(NoAVL* x) {
+    NoAVL* y = tornar_unico(x->direita);
+    x->direita = y->esquerda;
+    y->esquerda = x;
+    atualizar_altura_avl(x);
+    atualizar_altura_avl(y);
+    return y;
+}
+
+// Função para corrigir o balanceamento de um nó exclusivo cujos filhos já estão balanceados
+NoAVL* balancear_persistente(NoAVL* no) {
+    atualizar_altura_avl(no);
+    int balanceamento = fator_balanceamento(no);
+
+    if (balanceamento > 1) {
+        if (fator_balanceamento(no->esquerda) < 0) {
+            no->esquerda = rotacionar_esquerda_persistente(tornar_unico(no->esquerda));
         }
-        atual = atual->proximo;
+        return rotacionar_direita_persistente(no);
     }
-    return NULL;
+    if (balanceamento < -1) {
+        if (fator_balanceamento(no->direita) > 0) {
+            no->direita = rotacionar_direita_persistente(tornar_unico(no->direita));
+        }
+        return rotacionar_esquerda_persistente(no);
+    }
+    return no;
 }
 
-// Função para buscar um paciente na árvore AVL
-Paciente* buscar_avl(NoAVL* raiz, char* nome) {
-    if (raiz == NULL) return NULL;
+// Função para inserir na árvore persistente (o paciente já tem a chave calculada)
+// Consome a referência à raiz recebida e devolve a raiz da nova versão; só o caminho
+// até a posição do paciente é copiado, o resto da árvore é compartilhado
+// Em *inserido fica 0 se o nome já existia
+NoAVL* inserir_persistente(NoAVL* raiz, const Paciente* paciente, int* inserido) {
+    if (raiz == NULL) {
+        reter_historico(paciente->historico);
+        *inserido = 1;
+        return criar_no_avl(*paciente);
+    }
 
-    if (strcmp(nome, raiz->paciente.nome) < 0) {
-        return buscar_avl(raiz->esquerda, nome);
-    } else if (strcmp(nome, raiz->paciente.nome) > 0) {
-        return buscar_avl(raiz->direita, nome);
-    } else {
-        return &(raiz->paciente);
+    int comparacao = comparar_pacientes(paciente, &raiz->paciente);
+    if (comparacao == 0) {
+        *inserido = 0;
+        return raiz;
     }
+
+    raiz = tornar_unico(raiz);
+    if (comparacao < 0) raiz->esquerda = inserir_persistente(raiz->esquerda, paciente, inserido);
+    else raiz->direita = inserir_persistente(raiz->direita, paciente, inserido);
+    return balancear_persistente(raiz);
 }
 
-void exibir_paciente(Paciente* paciente) {
-    if (paciente != NULL) {
-        printf("Nome: %s\n", paciente->nome);
-        printf("Sexo: %c\n", paciente->sexo);
-        printf("Data de Nascimento: %s\n", paciente->nascimento);
-        printf("Última Consulta: %s\n", paciente->ultima_consulta);
+// Função para remover da árvore persistente; consome a referência à raiz e devolve a nova versão
+NoAVL* remover_persistente(NoAVL* raiz, const Paciente* paciente) {
+    if (raiz == NULL) return NULL;
 
-        // Obter a data atual
-        char data_atual[11];
-        obter_data_atual(data_atual);
+    int comparacao = comparar_pacientes(paciente, &raiz->paciente);
+    if (comparacao == 0 && (raiz->esquerda == NULL || raiz->direita == NULL)) {
+        NoAVL* filho = reter_no(raiz->esquerda != NULL ? raiz->esquerda : raiz->direita);
+        liberar_no(raiz);
+        return filho;
+    }
 
-        // Calcular a diferença em dias
-        int dias_desde_ultima_consulta = calcular_diferenca_dias(paciente->ultima_consulta, data_atual);
+    raiz = tornar_unico(raiz);
+    if (comparacao < 0) {
+        raiz->esquerda = remover_persistente(raiz->esquerda, paciente);
+    } else if (comparacao > 0) {
+        raiz->direita = remover_persistente(raiz->direita, paciente);
+    } else {
+        // Substitui pelo sucessor (menor nó da subárvore direita), copiado antes de sair de lá
+        NoAVL* sucessor = raiz->direita;
+        while (sucessor->esquerda != NULL) sucessor = sucessor->esquerda;
+        Paciente substituto = sucessor->paciente;
+        reter_historico(substituto.historico);
+        raiz->direita = remover_persistente(raiz->direita, &substituto);
+        liberar_historico(raiz->paciente.historico);
+        raiz->paciente = substituto;
+    }
+    return balancear_persistente(raiz);
+}
 
-        if (dias_desde_ultima_consulta >= 0) {
-            printf("Dias desde a última consulta: %d\n", dias_desde_ultima_consulta);
-        } else {
-            printf("Erro ao calcular a diferença de dias.\n");
-        }
+// Função para trocar os dados de um paciente sem mudar sua posição (mesmo nome)
+// Consome a referência à raiz e devolve a nova versão; em *resultado fica o paciente na nova versão
+NoAVL* substituir_persistente(NoAVL* raiz, const Paciente* atual, Paciente alterado, Paciente** resultado) {
+    if (raiz == NULL) return NULL;
+
+    int comparacao = comparar_pacientes(atual, &raiz->paciente);
+    raiz = tornar_unico(raiz);
+    if (comparacao < 0) {
+        raiz->esquerda = substituir_persistente(raiz->esquerda, atual, alterado, resultado);
+    } else if (comparacao > 0) {
+        raiz->direita = substituir_persistente(raiz->direita, atual, alterado, resultado);
     } else {
-        printf("Paciente não encontrado.\n");
+        reter_historico(alterado.historico);
+        liberar_historico(raiz->paciente.historico);
+        raiz->paciente = alterado;
+        *resultado = &raiz->paciente;
     }
+    return raiz;
 }
 
-// Função para listar todos os pacientes da lista duplamente encadeada
-void listar_pacientes_lista(ListaDupla* lista) {
-    NoLista* atual = lista->inicio;
-    if (atual == NULL) {
-        printf("Nenhum paciente cadastrado.\n");
-        return;
+// Função para saber se um processo ainda existe (o sinal 0 só confere, não é entregue)
+// Um processo que terminou e ainda não foi recolhido pelo pai (zumbi) conta como morto
+int processo_vivo(int pid) {
+    if (pid <= 0 || (kill(pid, 0) != 0 && errno != EPERM)) return 0;
+    char caminho[64], estado = 0;
+    snprintf(caminho, sizeof(caminho), "/proc/%d/stat", pid);
+    FILE* arquivo = fopen(caminho, "r");
+    if (arquivo == NULL) return 1;
+    // O estado vem depois do nome do programa, que fica entre parênteses e pode ter espaços
+    char linha[512];
+    if (fgets(linha, sizeof(linha), arquivo) != NULL) {
+        char* fim_nome = strrchr(linha, ')');
+        if (fim_nome != NULL && fim_nome[1] == ' ') estado = fim_nome[2];
     }
+    fclose(arquivo);
+    return estado != 'Z' && estado != 'X';
+}
 
-    printf("\n--- Lista de Pacientes (Moisés) ---\n");
-    while (atual != NULL) {
-        exibir_paciente(&(atual->paciente));
-        printf("\n");
-        atual = atual->proximo;
+// Função para esperar a vez na trava de um segmento: primeiro cede o processador, depois dorme um pouco
+// Retorna 1 quando a espera já passou a dormir: só então vale conferir se quem tem a trava morreu
+int esperar_trava_segmento(int* esperas) {
+    if (++*esperas < 100) {
+        sched_yield();
+        return 0;
     }
+    usleep(200);
+    return 1;
 }
 
-// Função para listar todos os pacientes da árvore AVL (em ordem A-Z)
-void listar_pacientes_avl(NoAVL* raiz) {
-    if (raiz == NULL) return;
+// Função para remover o nome de um segmento, se ele ainda for o que está aberto em 'descritor'
+// (outro processo pode já ter removido o antigo e criado um novo com o mesmo nome)
+// Retorna 1 se o nome foi removido
+int descartar_segmento(const char* nome, int descritor) {
+    int atual = shm_open(nome, O_RDONLY, 0600);
+    if (atual < 0) return 0;
+    struct stat aberto, nomeado;
+    int mesmo = fstat(descritor, &aberto) == 0 && fstat(atual, &nomeado) == 0 &&
+                aberto.st_dev == nomeado.st_dev && aberto.st_ino == nomeado.st_ino;
+    close(atual);
+    return mesmo && shm_unlink(nome) == 0;
+}
 
-    listar_pacientes_avl(raiz->esquerda);
-    exibir_paciente(&(raiz->paciente));
-    printf("\n");
-    listar_pacientes_avl(raiz->direita);
+// Função para contar os processos anexados a um segmento que ainda existem
+int processos_vivos_segmento(CabecalhoCompartilhado* cabecalho) {
+    int vivos = 0;
+    for (int i = 0; i < MAXIMO_PROCESSOS_SEGMENTO; i++) vivos += processo_vivo(atomic_load(&cabecalho->processos[i].pid));
+    return vivos;
 }
 
-// Função para remover caracteres indesejados (aspas e < >)
-void limpar_string(char* str) {
-    int i, j = 0;
-    for (i = 0; str[i] != '\0'; i++) {
-        if (str[i] != '<' && str[i] != '>') {
-            str[j++] = str[i];
-        }
+// Função para anexar o segmento de memória compartilhada de um cadastro, criando-o se ainda não existir
+// O primeiro processo inicia o cabeçalho; os seguintes esperam ele ficar pronto e mapeiam o segmento
+// onde o sistema escolher: os nós só guardam deslocamentos, que valem em qualquer endereço
+// Um segmento abandonado (quem o criou morreu antes de iniciá-lo, ou nenhum processo anexado existe
+// mais) é removido e criado de novo, para ser carregado dos arquivos
+// Retorna NULL se a memória compartilhada não puder ser usada
+SegmentoCompartilhado* anexar_segmento(const char* nome) {
+    SegmentoCompartilhado* segmento = (SegmentoCompartilhado*)calloc(1, sizeof(SegmentoCompartilhado));
+    if (segmento == NULL) {
+        printf("Erro ao alocar memória para o segmento compartilhado.\n");
+        exit(1);
     }
-    str[j] = '\0';
+    snprintf(segmento->nome, sizeof(segmento->nome), "%s", nome);
+    pthread_mutex_init(&segmento->trava_leitores, NULL);
+
+    int criado = 1, descritor = -1;
+    void* base = MAP_FAILED;
+    CabecalhoCompartilhado* cabecalho = NULL;
+    for (int tentativa = 0; tentativa < 3 && cabecalho == NULL; tentativa++) {
+        criado = 1;
+        descritor = shm_open(nome, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (descritor < 0 && errno == EEXIST) {
+            criado = 0;
+            descritor = shm_open(nome, O_RDWR, 0600);
+        }
+        if (descritor >= 0 && criado && ftruncate(descritor, TAMANHO_INICIAL_SEGMENTO) != 0) {
+            close(descritor);
+            shm_unlink(nome);
+            descritor = -1;
+        }
+
+        // Toda a reserva é mapeada de uma vez: quando o segmento cresce, o endereço de cada nó não muda
+        base = MAP_FAILED;
+        if (descritor >= 0) {
+            base = mmap(NULL, RESERVA_SEGMENTO, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, descritor, 0);
+        }
+        if (base == MAP_FAILED) break;
+
+        cabecalho = (CabecalhoCompartilhado*)base;
+        if (criado) {
+            // O ftruncate já zerou o segmento: raiz, livres, contadores e vagas começam em 0
+            cabecalho->assinatura = ASSINATURA_SEGMENTO;
+            cabecalho->criador = (int)getpid();
+            cabecalho->tamanho = TAMANHO_INICIAL_SEGMENTO;
+            cabecalho->usado = (sizeof(CabecalhoCompartilhado) + 63) & ~(uint64_t)63;
+            atomic_store(&cabecalho->pronto, 1);
+            break;
+        }
+
+        // Antes do ftruncate de quem criou, o segmento tem tamanho 0 e ler o cabeçalho daria SIGBUS
+        int pronto = 0, abandonado = 0;
+        struct stat informacoes;
+        for (int tentativas = 0; tentativas < 5000 && !pronto && !abandonado; tentativas++) {
+            int tamanho_lido = fstat(descritor, &informacoes) == 0 && informacoes.st_size >= (off_t)sizeof(CabecalhoCompartilhado);
+            pronto = tamanho_lido && atomic_load(&cabecalho->pronto);
+            abandonado = tamanho_lido && cabecalho->criador != 0 && !processo_vivo(cabecalho->criador);
+            if (!pronto && !abandonado) usleep(1000);
+        }
+        if (pronto && cabecalho->assinatura != ASSINATURA_SEGMENTO) {
+            printf("Erro: a memória compartilhada %s é inválida.\n", nome);
+            munmap(base, RESERVA_SEGMENTO);
+            close(descritor);
+            free(segmento);
+            return NULL;
+        }
+        if (!pronto || (processos_vivos_segmento(cabecalho) == 0 && !processo_vivo(cabecalho->criador))) {
+            printf("A memória compartilhada %s foi deixada por um processo que terminou; ela será recriada.\n", nome);
+            descartar_segmento(nome, descritor);
+            munmap(base, RESERVA_SEGMENTO);
+            close(descritor);
+            descritor = -1;
+            base = MAP_FAILED;
+            cabecalho = NULL;
+            continue;
+        }
+    }
+    // As vistas ocupam só as páginas dos nós lidos por este processo
+    void* vistas = MAP_FAILED;
+    if (cabecalho != NULL) {
+        vistas = mmap(NULL, RESERVA_SEGMENTO, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if (vistas == MAP_FAILED) {
+        printf("Erro ao abrir a memória compartilhada %s.\n", nome);
+        if (cabecalho != NULL) munmap(base, RESERVA_SEGMENTO);
+        if (descritor >= 0) close(descritor);
+        if (descritor >= 0 && criado) shm_unlink(nome);
+        free(segmento);
+        return NULL;
+    }
+
+    segmento->descritor = descritor;
+    segmento->cabecalho = cabecalho;
+    segmento->vistas = (char*)vistas;
+    travar_escrita_segmento(segmento);
+    // Uma vaga livre ou de um processo que já terminou
+    for (int i = 0; i < MAXIMO_PROCESSOS_SEGMENTO && segmento->vaga == NULL; i++) {
+        ProcessoSegmento* vaga = &cabecalho->processos[i];
+        int pid = atomic_load(&vaga->pid);
+        if (pid != 0 && processo_vivo(pid)) continue;
+        atomic_store(&vaga->lendo, 0);
+        atomic_store(&vaga->pid, (int)getpid());
+        segmento->vaga = vaga;
+    }
+    segmento->ja_carregado = !criado;
+    // Cache, filtro e índice deste processo começam vazios: a primeira sincronização os refaz por inteiro
+    segmento->geracao_vista = cabecalho->geracao - MUDANCAS_COMPARTILHADAS - 1;
+    destravar_escrita_segmento(segmento);
+    if (segmento->vaga == NULL) {
+        printf("Erro: a memória compartilhada %s já tem %d processos anexados.\n", nome, MAXIMO_PROCESSOS_SEGMENTO);
+        munmap(vistas, RESERVA_SEGMENTO);
+        munmap(base, RESERVA_SEGMENTO);
+        close(descritor);
+        free(segmento);
+        return NULL;
+    }
+    return segmento;
+}
+
+// Função para desanexar um segmento; o último processo a sair o remove (os arquivos já foram salvos)
+void desanexar_segmento(SegmentoCompartilhado* segmento) {
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    travar_escrita_segmento(segmento);
+    atomic_store(&segmento->vaga->pid, 0);
+    if (processos_vivos_segmento(cabecalho) == 0) descartar_segmento(segmento->nome, segmento->descritor);
+    destravar_escrita_segmento(segmento);
+    fechar_segmento(segmento);
+}
+
+// Função para desfazer o mapeamento de um segmento e liberar a sua estrutura neste processo
+void fechar_segmento(SegmentoCompartilhado* segmento) {
+    munmap(segmento->vistas, RESERVA_SEGMENTO);
+    munmap(segmento->cabecalho, RESERVA_SEGMENTO);
+    close(segmento->descritor);
+    pthread_mutex_destroy(&segmento->trava_leitores);
+    free(segmento);
+}
+
+// Função chamada quando o processo com a trava de escrita não existe mais: ele pode ter deixado a
+// árvore pela metade, então o segmento é removido (os próximos processos carregam os arquivos) e os
+// que estão anexados seguem com ele, avisados; a trava é liberada
+void liberar_escritor_morto(SegmentoCompartilhado* segmento, int escritor) {
+    if (!atomic_compare_exchange_strong(&segmento->cabecalho->escritor, &escritor, 0)) return;
+    descartar_segmento(segmento->nome, segmento->descritor);
+    printf("Aviso: o processo %d terminou no meio de uma escrita em %s; a memória compartilhada foi descartada "
+           "e será recriada dos arquivos no próximo início.\n", escritor, segmento->nome);
+}
+
+// Funções para tomar e soltar a trava de escrita do segmento (um processo por vez)
+// Quem escreve marca o seu pid e espera os processos que estão lendo saírem; a vaga de um
+// processo que morreu lendo é liberada
+void travar_escrita_segmento(SegmentoCompartilhado* segmento) {
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    int pid = (int)getpid(), esperas = 0;
+    for (;;) {
+        int escritor = 0;
+        if (atomic_compare_exchange_strong(&cabecalho->escritor, &escritor, pid)) break;
+        if (esperar_trava_segmento(&esperas) && !processo_vivo(escritor)) liberar_escritor_morto(segmento, escritor);
+    }
+    for (int i = 0; i < MAXIMO_PROCESSOS_SEGMENTO; i++) {
+        ProcessoSegmento* vaga = &cabecalho->processos[i];
+        while (atomic_load(&vaga->lendo)) {
+            int leitor = atomic_load(&vaga->pid);
+            if (esperar_trava_segmento(&esperas) && leitor != pid && !processo_vivo(leitor)) {
+                atomic_store(&vaga->lendo, 0);
+                atomic_store(&vaga->pid, 0);
+                break;
+            }
+        }
+    }
+}
+
+void destravar_escrita_segmento(SegmentoCompartilhado* segmento) {
+    atomic_store(&segmento->cabecalho->escritor, 0);
+}
+
+// Funções para ler o segmento com a trava de leitura (vários leitores, de qualquer processo)
+// A primeira thread do processo marca a vaga como lendo e só entra se não houver quem escreva; as
+// seguintes entram direto, então uma thread do pool pode ler enquanto quem a chamou já tem a leitura
+// Durante uma escrita deste processo a trava de escrita já está tomada e elas não fazem nada
+void travar_leitura_segmento(SegmentoCompartilhado* segmento) {
+    if (segmento->em_escrita) return;
+    pthread_mutex_lock(&segmento->trava_leitores);
+    if (segmento->leitores++ == 0) {
+        int esperas = 0;
+        for (;;) {
+            atomic_store(&segmento->vaga->lendo, 1);
+            int escritor = atomic_load(&segmento->cabecalho->escritor);
+            if (escritor == 0) break;
+            atomic_store(&segmento->vaga->lendo, 0);
+            if (esperar_trava_segmento(&esperas) && !processo_vivo(escritor)) liberar_escritor_morto(segmento, escritor);
+        }
+    }
+    pthread_mutex_unlock(&segmento->trava_leitores);
+}
+
+void destravar_segmento(SegmentoCompartilhado* segmento) {
+    if (segmento->em_escrita) return;
+    pthread_mutex_lock(&segmento->trava_leitores);
+    if (--segmento->leitores == 0) atomic_store(&segmento->vaga->lendo, 0);
+    pthread_mutex_unlock(&segmento->trava_leitores);
+}
+
+// Função para obter o endereço, neste processo, do nó que está em um deslocamento do segmento
+NoCompartilhado* no_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    return (NoCompartilhado*)((char*)segmento->cabecalho + deslocamento);
+}
+
+// Função para obter o endereço, neste processo, de um nome guardado no segmento
+const char* nome_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    return (const char*)segmento->cabecalho + deslocamento;
+}
+
+// Função para ler o paciente de um nó com o nome resolvido neste processo
+Paciente ler_no_compartilhado(SegmentoCompartilhado* segmento, const NoCompartilhado* no) {
+    Paciente paciente = no->paciente;
+    paciente.nome = nome_compartilhado(segmento, no->nome);
+    return paciente;
+}
+
+// Função para obter a vista, neste processo, do paciente de um nó: uma cópia com o nome resolvido,
+// refeita a cada chamada e guardada em 'vistas' no deslocamento do nó, então o endereço entregue
+// às buscas e ao cache não muda enquanto o nó existir (como o do próprio nó)
+Paciente* paciente_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    Paciente* vista = (Paciente*)(segmento->vistas + deslocamento);
+    *vista = ler_no_compartilhado(segmento, no_compartilhado(segmento, deslocamento));
+    return vista;
+}
+
+// Função para obter o deslocamento do nó de uma vista
+uint64_t deslocamento_vista(SegmentoCompartilhado* segmento, const Paciente* vista) {
+    return (uint64_t)((const char*)vista - segmento->vistas);
+}
+
+int altura_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    if (deslocamento == 0) return 0;
+    return no_compartilhado(segmento, deslocamento)->altura;
+}
+
+void atualizar_altura_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    NoCompartilhado* no = no_compartilhado(segmento, deslocamento);
+    int esquerda = altura_compartilhado(segmento, no->esquerda);
+    int direita = altura_compartilhado(segmento, no->direita);
+    no->altura = 1 + (esquerda > direita ? esquerda : direita);
+}
+
+// Rotações da árvore compartilhada, iguais às da AVL mas com deslocamentos
+uint64_t rotacionar_direita_compartilhado(SegmentoCompartilhado* segmento, uint64_t y) {
+    uint64_t x = no_compartilhado(segmento, y)->esquerda;
+    no_compartilhado(segmento, y)->esquerda = no_compartilhado(segmento, x)->direita;
+    no_compartilhado(segmento, x)->direita = y;
+    atualizar_altura_compartilhado(segmento, y);
+    atualizar_altura_compartilhado(segmento, x);
+    return x;
+}
+
+uint64_t rotacionar_esquerda_compartilhado(SegmentoCompartilhado* segmento, uint64_t x) {
+    uint64_t y = no_compartilhado(segmento, x)->direita;
+    no_compartilhado(segmento, x)->direita = no_compartilhado(segmento, y)->esquerda;
+    no_compartilhado(segmento, y)->esquerda = x;
+    atualizar_altura_compartilhado(segmento, x);
+    atualizar_altura_compartilhado(segmento, y);
+    return y;
+}
+
+// Função para corrigir o balanceamento de um nó da árvore compartilhada cujos filhos já estão balanceados
+uint64_t balancear_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    atualizar_altura_compartilhado(segmento, deslocamento);
+    NoCompartilhado* no = no_compartilhado(segmento, deslocamento);
+    int balanceamento = altura_compartilhado(segmento, no->esquerda) - altura_compartilhado(segmento, no->direita);
+
+    if (balanceamento > 1) {
+        NoCompartilhado* filho = no_compartilhado(segmento, no->esquerda);
+        if (altura_compartilhado(segmento, filho->esquerda) < altura_compartilhado(segmento, filho->direita)) {
+            no->esquerda = rotacionar_esquerda_compartilhado(segmento, no->esquerda);
+        }
+        return rotacionar_direita_compartilhado(segmento, deslocamento);
+    }
+    if (balanceamento < -1) {
+        NoCompartilhado* filho = no_compartilhado(segmento, no->direita);
+        if (altura_compartilhado(segmento, filho->esquerda) > altura_compartilhado(segmento, filho->direita)) {
+            no->direita = rotacionar_direita_compartilhado(segmento, no->direita);
+        }
+        return rotacionar_esquerda_compartilhado(segmento, deslocamento);
+    }
+    return deslocamento;
+}
+
+// Função para preparar um paciente para ser gravado no segmento: sem nome nem histórico (ponteiros
+// que só valem neste processo), e com o último byte de cada data em '\0', para que um leitor de
+// outro processo que pegue o registro no meio de uma alteração nunca leia além do campo
+void preparar_paciente_compartilhado(Paciente* paciente) {
+    paciente->nome = NULL;
+    paciente->historico = NULL;
+    paciente->nascimento[sizeof(paciente->nascimento) - 1] = '\0';
+    paciente->ultima_consulta[sizeof(paciente->ultima_consulta) - 1] = '\0';
+}
+
+// Função para avançar sobre o espaço livre do segmento (com a trava de escrita), dobrando o
+// segmento até caber; devolve o deslocamento do espaço entregue, sempre múltiplo de 8
+uint64_t reservar_compartilhado(SegmentoCompartilhado* segmento, uint64_t bytes) {
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    bytes = (bytes + 7) & ~(uint64_t)7;
+    if (cabecalho->usado + bytes > cabecalho->tamanho) {
+        uint64_t tamanho = cabecalho->tamanho;
+        while (cabecalho->usado + bytes > tamanho) tamanho *= 2;
+        if (tamanho > RESERVA_SEGMENTO || ftruncate(segmento->descritor, (off_t)tamanho) != 0) {
+            printf("Erro ao alocar memória compartilhada para o cadastro.\n");
+            exit(1);
+        }
+        cabecalho->tamanho = tamanho;
+    }
+    uint64_t deslocamento = cabecalho->usado;
+    cabecalho->usado += bytes;
+    return deslocamento;
+}
+
+// Função para criar um nó no segmento (com a trava de escrita): reaproveita um nó removido ou
+// avança sobre o espaço livre; o nome é copiado para o segmento, onde fica enquanto ele existir
+// (mesmo depois da remoção do paciente, pois outro processo pode estar lendo o nó)
+uint64_t alocar_no_compartilhado(SegmentoCompartilhado* segmento, const Paciente* paciente) {
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    size_t tamanho_nome = strlen(paciente->nome);
+    uint64_t nome = reservar_compartilhado(segmento, tamanho_nome + 1);
+    memcpy((char*)cabecalho + nome, paciente->nome, tamanho_nome + 1);
+
+    uint64_t deslocamento = cabecalho->livres;
+    if (deslocamento != 0) {
+        cabecalho->livres = no_compartilhado(segmento, deslocamento)->esquerda;
+    } else {
+        deslocamento = reservar_compartilhado(segmento, sizeof(NoCompartilhado));
+    }
+
+    NoCompartilhado* no = no_compartilhado(segmento, deslocamento);
+    no->paciente = *paciente;
+    preparar_paciente_compartilhado(&no->paciente);
+    no->nome = nome;
+    no->tamanho_nome = (uint32_t)tamanho_nome;
+    no->esquerda = 0;
+    no->direita = 0;
+    no->altura = 1;
+    return deslocamento;
+}
+
+// Função para devolver um nó removido à lista de nós livres do segmento
+void liberar_no_compartilhado(SegmentoCompartilhado* segmento, uint64_t deslocamento) {
+    no_compartilhado(segmento, deslocamento)->esquerda = segmento->cabecalho->livres;
+    segmento->cabecalho->livres = deslocamento;
+}
+
+// Função para inserir um paciente (com a chave já calculada) na árvore compartilhada
+// Devolve a nova raiz; em *inserido fica o deslocamento do novo nó, ou 0 se o nome já existir
+uint64_t inserir_compartilhado(SegmentoCompartilhado* segmento, uint64_t raiz, const Paciente* paciente, uint64_t* inserido) {
+    if (raiz == 0) {
+        *inserido = alocar_no_compartilhado(segmento, paciente);
+        return *inserido;
+    }
+
+    NoCompartilhado* no = no_compartilhado(segmento, raiz);
+    Paciente atual = ler_no_compartilhado(segmento, no);
+    int comparacao = comparar_pacientes(paciente, &atual);
+    if (comparacao == 0) {
+        *inserido = 0;
+        return raiz;
+    }
+    if (comparacao < 0) no->esquerda = inserir_compartilhado(segmento, no->esquerda, paciente, inserido);
+    else no->direita = inserir_compartilhado(segmento, no->direita, paciente, inserido);
+    return *inserido ? balancear_compartilhado(segmento, raiz) : raiz;
+}
+
+// Função para remover um paciente da árvore compartilhada; devolve a nova raiz
+uint64_t remover_compartilhado(SegmentoCompartilhado* segmento, uint64_t raiz, const Paciente* paciente) {
+    if (raiz == 0) return 0;
+
+    NoCompartilhado* no = no_compartilhado(segmento, raiz);
+    Paciente atual = ler_no_compartilhado(segmento, no);
+    int comparacao = comparar_pacientes(paciente, &atual);
+    if (comparacao < 0) {
+        no->esquerda = remover_compartilhado(segmento, no->esquerda, paciente);
+    } else if (comparacao > 0) {
+        no->direita = remover_compartilhado(segmento, no->direita, paciente);
+    } else if (no->esquerda == 0 || no->direita == 0) {
+        uint64_t filho = no->esquerda != 0 ? no->esquerda : no->direita;
+        liberar_no_compartilhado(segmento, raiz);
+        return filho;
+    } else {
+        // Substitui pelo sucessor (menor nó da subárvore direita)
+        uint64_t sucessor = no->direita;
+        while (no_compartilhado(segmento, sucessor)->esquerda != 0) sucessor = no_compartilhado(segmento, sucessor)->esquerda;
+        NoCompartilhado* origem = no_compartilhado(segmento, sucessor);
+        no->paciente = origem->paciente;
+        no->nome = origem->nome;
+        no->tamanho_nome = origem->tamanho_nome;
+        Paciente substituto = ler_no_compartilhado(segmento, no);
+        no->direita = remover_compartilhado(segmento, no->direita, &substituto);
+    }
+    return balancear_compartilhado(segmento, raiz);
+}
+
+// Função para buscar um paciente na árvore compartilhada (mesmas regras de buscar_avl)
+// Devolve a vista do paciente neste processo
+Paciente* buscar_compartilhado(SegmentoCompartilhado* segmento, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    uint64_t aproximado = 0;
+    uint64_t raiz = segmento->cabecalho->raiz;
+
+    while (raiz != 0) {
+        NoCompartilhado* no = no_compartilhado(segmento, raiz);
+        Paciente atual = ler_no_compartilhado(segmento, no);
+        int comparacao = comparar_busca(chave, nome, &atual);
+        if (comparacao == 0) {
+            comparacao = strcmp(nome, atual.nome);
+            if (comparacao == 0) return paciente_compartilhado(segmento, raiz);
+            aproximado = raiz;
+        }
+        raiz = comparacao < 0 ? no->esquerda : no->direita;
+    }
+    return aproximado != 0 ? paciente_compartilhado(segmento, aproximado) : NULL;
+}
+
+// Função para trocar os dados de um paciente do segmento (o nome continua o mesmo) a partir da sua vista;
+// os outros processos veem a alteração na hora. Devolve a vista refeita
+Paciente* atualizar_compartilhado(SegmentoCompartilhado* segmento, Paciente* vista, Paciente alterado) {
+    uint64_t deslocamento = deslocamento_vista(segmento, vista);
+    preparar_paciente_compartilhado(&alterado);
+    no_compartilhado(segmento, deslocamento)->paciente = alterado;
+    return paciente_compartilhado(segmento, deslocamento);
+}
+
+// Função para anotar uma inserção ou remoção no registro de mudanças do segmento (com a trava de escrita)
+// O nome é o do nó no deslocamento dado; este processo já atualizou o seu cache, filtro e índice, então a
+// mudança conta como vista
+void registrar_mudanca(SegmentoCompartilhado* segmento, int removido, uint64_t deslocamento) {
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    unsigned long geracao = cabecalho->geracao + 1;
+    MudancaCompartilhada* mudanca = &cabecalho->mudancas[geracao % MUDANCAS_COMPARTILHADAS];
+    mudanca->geracao = geracao;
+    mudanca->removido = removido;
+    mudanca->nome = no_compartilhado(segmento, deslocamento)->nome;
+    mudanca->tamanho_nome = no_compartilhado(segmento, deslocamento)->tamanho_nome;
+    cabecalho->geracao = geracao;
+    segmento->geracao_vista = geracao;
+}
+
+// Função para abrir (ou criar) o arquivo da árvore B+ de um cadastro em disco
+// O arquivo fica travado (flock) enquanto aberto: dois processos gravando as mesmas páginas o corromperiam
+// Retorna NULL se o arquivo não puder ser usado
+ArvoreDisco* abrir_arvore_disco(const char* arquivo) {
+    ArvoreDisco* arvore = (ArvoreDisco*)calloc(1, sizeof(ArvoreDisco));
+    if (arvore == NULL) {
+        printf("Erro ao alocar memória para o cadastro em disco.\n");
+        exit(1);
+    }
+    snprintf(arvore->arquivo, sizeof(arvore->arquivo), "%s", arquivo);
+    arvore->descritor = open(arquivo, O_RDWR | O_CREAT, 0644);
+    if (arvore->descritor < 0) {
+        printf("Erro ao abrir o arquivo %s do cadastro em disco.\n", arquivo);
+        free(arvore);
+        return NULL;
+    }
+    if (flock(arvore->descritor, LOCK_EX | LOCK_NB) != 0) {
+        printf("Erro: o arquivo %s já está em uso por outro processo.\n", arquivo);
+        close(arvore->descritor);
+        free(arvore);
+        return NULL;
+    }
+
+    ssize_t lidos = pread(arvore->descritor, &arvore->meta, sizeof(MetaArvore), 0);
+    if (lidos == 0) {
+        // Arquivo novo: a raiz é uma folha vazia na página 1
+        uint64_t pagina[TAMANHO_PAGINA_DISCO / 8];
+        arvore->meta.assinatura = ASSINATURA_DISCO;
+        arvore->meta.tamanho_pagina = TAMANHO_PAGINA_DISCO;
+        arvore->meta.raiz = 1;
+        arvore->meta.altura = 1;
+        arvore->meta.paginas = 2;
+        arvore->meta.primeira_folha = 1;
+        arvore->meta.ultima_folha = 1;
+        iniciar_pagina((uint8_t*)pagina, 1);
+        gravar_pagina_disco(arvore, 1, (uint8_t*)pagina);
+    } else if (lidos == (ssize_t)sizeof(MetaArvore) && arvore->meta.assinatura == ASSINATURA_DISCO_V1) {
+        // As chaves gravadas seguem a ordem antiga: a árvore é refeita a partir do arquivo de pacientes
+        printf("Erro: %s foi gravado por uma versão anterior, com outra ordem de nomes; apague-o para que ele seja "
+               "refeito a partir do arquivo de pacientes.\n", arquivo);
+        close(arvore->descritor);
+        free(arvore);
+        return NULL;
+    } else if (lidos != (ssize_t)sizeof(MetaArvore) || arvore->meta.assinatura != ASSINATURA_DISCO ||
+               arvore->meta.tamanho_pagina != TAMANHO_PAGINA_DISCO) {
+        printf("Erro: %s não é um arquivo de cadastro em disco.\n", arquivo);
+        close(arvore->descritor);
+        free(arvore);
+        return NULL;
+    } else if (arvore->meta.aberta) {
+        printf("Aviso: %s não foi fechado corretamente; as alterações depois da última gravação podem ter se perdido.\n", arquivo);
+    }
+    arvore->meta.aberta = 1;
+    arvore->em_carga = 1;
+    gravar_meta_disco(arvore);
+
+    pthread_mutex_init(&arvore->trava, NULL);
+    dimensionar_buffer_disco(arvore, QUADROS_MINIMOS_DISCO);
+    arvore->residentes = (ResidenteDisco**)calloc(2 * RESIDENTES_DISCO, sizeof(ResidenteDisco*));
+    if (arvore->residentes == NULL) {
+        printf("Erro ao alocar memória para o cadastro em disco.\n");
+        exit(1);
+    }
+    return arvore;
+}
+
+// Função para gravar a árvore e fechar o arquivo, marcando-o como fechado corretamente
+void fechar_arvore_disco(ArvoreDisco* arvore) {
+    gravar_arvore_disco(arvore);
+    arvore->meta.aberta = 0;
+    gravar_meta_disco(arvore);
+    fsync(arvore->descritor);
+    close(arvore->descritor);
+
+    for (size_t i = 0; i < 2 * RESIDENTES_DISCO; i++) free(arvore->residentes[i]);
+    free(arvore->residentes);
+    descartar_copias_disco(arvore);
+    free(arvore->dados);
+    free(arvore->quadros);
+    free(arvore->baldes);
+    pthread_mutex_destroy(&arvore->trava);
+    free(arvore);
+}
+
+// Funções para ler e gravar uma página inteira do arquivo; um erro de E/S encerra o programa, pois a
+// árvore ficaria pela metade
+void ler_pagina_disco(ArvoreDisco* arvore, uint32_t pagina, uint8_t* destino) {
+    if (pread(arvore->descritor, destino, TAMANHO_PAGINA_DISCO, (off_t)pagina * TAMANHO_PAGINA_DISCO) != TAMANHO_PAGINA_DISCO) {
+        printf("Erro ao ler a página %u de %s.\n", pagina, arvore->arquivo);
+        exit(1);
+    }
+}
+
+void gravar_pagina_disco(ArvoreDisco* arvore, uint32_t pagina, const uint8_t* origem) {
+    if (pwrite(arvore->descritor, origem, TAMANHO_PAGINA_DISCO, (off_t)pagina * TAMANHO_PAGINA_DISCO) != TAMANHO_PAGINA_DISCO) {
+        printf("Erro ao gravar a página %u de %s.\n", pagina, arvore->arquivo);
+        exit(1);
+    }
+}
+
+// Função para gravar a página de controle (raiz, altura, folhas e contagem)
+void gravar_meta_disco(ArvoreDisco* arvore) {
+    if (pwrite(arvore->descritor, &arvore->meta, sizeof(MetaArvore), 0) != (ssize_t)sizeof(MetaArvore)) {
+        printf("Erro ao gravar o controle de %s.\n", arvore->arquivo);
+        exit(1);
+    }
+}
+
+// Função para gravar no arquivo as páginas alteradas que estão no buffer e a página de controle,
+// esperando o disco confirmar; retorna 0 se a confirmação falhar
+int gravar_arvore_disco(ArvoreDisco* arvore) {
+    pthread_mutex_lock(&arvore->trava);
+    for (int q = 0; q < arvore->num_quadros; q++) {
+        if (arvore->quadros[q].pagina != UINT32_MAX && arvore->quadros[q].sujo) gravar_quadro_disco(arvore, q);
+    }
+    gravar_meta_disco(arvore);
+    int sucesso = fsync(arvore->descritor) == 0;
+    pthread_mutex_unlock(&arvore->trava);
+    return sucesso;
+}
+
+// Função para (re)alocar o buffer com o número de quadros pedido (ao menos QUADROS_MINIMOS_DISCO)
+// As páginas alteradas vão antes para o arquivo, então nada se perde com a troca
+void dimensionar_buffer_disco(ArvoreDisco* arvore, int quadros) {
+    if (quadros < QUADROS_MINIMOS_DISCO) quadros = QUADROS_MINIMOS_DISCO;
+    pthread_mutex_lock(&arvore->trava);
+    for (int q = 0; q < arvore->num_quadros; q++) {
+        if (arvore->quadros[q].pagina != UINT32_MAX && arvore->quadros[q].sujo) gravar_quadro_disco(arvore, q);
+    }
+    free(arvore->dados);
+    free(arvore->quadros);
+    free(arvore->baldes);
+
+    arvore->num_baldes = 1;
+    while (arvore->num_baldes < quadros * 2) arvore->num_baldes *= 2;
+    arvore->dados = (uint8_t*)aligned_alloc(TAMANHO_PAGINA_DISCO, (size_t)quadros * TAMANHO_PAGINA_DISCO);
+    arvore->quadros = (QuadroBuffer*)malloc((size_t)quadros * sizeof(QuadroBuffer));
+    arvore->baldes = (int*)malloc((size_t)arvore->num_baldes * sizeof(int));
+    if (arvore->dados == NULL || arvore->quadros == NULL || arvore->baldes == NULL) {
+        printf("Erro ao alocar memória para o buffer do cadastro em disco.\n");
+        exit(1);
+    }
+    for (int q = 0; q < quadros; q++) {
+        arvore->quadros[q].pagina = UINT32_MAX;
+        arvore->quadros[q].fixacoes = 0;
+        arvore->quadros[q].proximo = -1;
+        arvore->quadros[q].referencia = 0;
+        arvore->quadros[q].sujo = 0;
+    }
+    for (int b = 0; b < arvore->num_baldes; b++) arvore->baldes[b] = -1;
+    arvore->num_quadros = quadros;
+    arvore->ponteiro = 0;
+    pthread_mutex_unlock(&arvore->trava);
+}
+
+// Função para obter os bytes da página que está em um quadro
+uint8_t* pagina_quadro(ArvoreDisco* arvore, int quadro) {
+    return arvore->dados + (size_t)quadro * TAMANHO_PAGINA_DISCO;
+}
+
+// Função para gravar no arquivo a página de um quadro alterado
+void gravar_quadro_disco(ArvoreDisco* arvore, int quadro) {
+    gravar_pagina_disco(arvore, arvore->quadros[quadro].pagina, pagina_quadro(arvore, quadro));
+    arvore->quadros[quadro].sujo = 0;
+    arvore->gravacoes++;
+}
+
+// Função para escolher o quadro que recebe uma página, pelo relógio: o ponteiro passa pelos quadros
+// apagando o bit de referência, e o primeiro quadro solto sem o bit é reaproveitado (gravado antes, se sujo)
+int liberar_quadro_disco(ArvoreDisco* arvore) {
+    for (int passos = 0; passos <= 2 * arvore->num_quadros; passos++) {
+        int q = arvore->ponteiro;
+        QuadroBuffer* quadro = &arvore->quadros[q];
+        arvore->ponteiro = (q + 1) % arvore->num_quadros;
+        if (quadro->fixacoes > 0) continue;
+        if (quadro->referencia) {
+            quadro->referencia = 0;
+            continue;
+        }
+        if (quadro->pagina != UINT32_MAX) {
+            if (quadro->sujo) gravar_quadro_disco(arvore, q);
+            int* elo = &arvore->baldes[quadro->pagina & (uint32_t)(arvore->num_baldes - 1)];
+            while (*elo != q) elo = &arvore->quadros[*elo].proximo;
+            *elo = quadro->proximo;
+            quadro->pagina = UINT32_MAX;
+        }
+        return q;
+    }
+    printf("Erro: todas as páginas do buffer de %s estão em uso.\n", arvore->arquivo);
+    exit(1);
+}
+
+// Função para pôr uma página em um quadro livre, já fixada e na tabela de páginas
+void ocupar_quadro_disco(ArvoreDisco* arvore, int quadro, uint32_t pagina) {
+    int* balde = &arvore->baldes[pagina & (uint32_t)(arvore->num_baldes - 1)];
+    arvore->quadros[quadro].pagina = pagina;
+    arvore->quadros[quadro].fixacoes = 1;
+    arvore->quadros[quadro].referencia = 1;
+    arvore->quadros[quadro].sujo = 0;
+    arvore->quadros[quadro].proximo = *balde;
+    *balde = quadro;
+}
+
+// Função para fixar uma página no buffer (lendo-a do arquivo se ela não estiver lá)
+// Retorna o quadro; a página fica nele até soltar_pagina
+int fixar_pagina(ArvoreDisco* arvore, uint32_t pagina) {
+    for (int q = arvore->baldes[pagina & (uint32_t)(arvore->num_baldes - 1)]; q >= 0; q = arvore->quadros[q].proximo) {
+        if (arvore->quadros[q].pagina == pagina) {
+            arvore->quadros[q].fixacoes++;
+            arvore->quadros[q].referencia = 1;
+            arvore->acertos++;
+            return q;
+        }
+    }
+    int q = liberar_quadro_disco(arvore);
+    ler_pagina_disco(arvore, pagina, pagina_quadro(arvore, q));
+    arvore->leituras++;
+    ocupar_quadro_disco(arvore, q, pagina);
+    return q;
+}
+
+// Função para criar uma página vazia no fim do arquivo, já fixada (ela vai para o arquivo ao sair do buffer)
+int nova_pagina(ArvoreDisco* arvore, int folha, uint32_t* pagina) {
+    *pagina = arvore->meta.paginas++;
+    int q = liberar_quadro_disco(arvore);
+    ocupar_quadro_disco(arvore, q, *pagina);
+    iniciar_pagina(pagina_quadro(arvore, q), folha);
+    arvore->quadros[q].sujo = 1;
+    return q;
+}
+
+// Função para soltar uma página fixada, marcando-a como alterada se for o caso
+void soltar_pagina(ArvoreDisco* arvore, int quadro, int sujo) {
+    arvore->quadros[quadro].fixacoes--;
+    if (sujo) arvore->quadros[quadro].sujo = 1;
+}
+
+// Funções de acesso ao conteúdo de uma página (ver CabecalhoPagina)
+CabecalhoPagina* cabecalho_pagina(uint8_t* pagina) {
+    return (CabecalhoPagina*)pagina;
+}
+
+uint16_t* deslocamentos_pagina(uint8_t* pagina) {
+    return (uint16_t*)(pagina + sizeof(CabecalhoPagina));
+}
+
+uint8_t* registro_pagina(uint8_t* pagina, int posicao) {
+    return pagina + deslocamentos_pagina(pagina)[posicao];
+}
+
+const char* nome_registro_disco(const uint8_t* registro, int folha) {
+    return (const char*)registro + (folha ? CABECALHO_FOLHA_DISCO : CABECALHO_INTERNO_DISCO);
+}
+
+uint64_t chave_registro_disco(const uint8_t* registro, int folha) {
+    uint64_t chave;
+    memcpy(&chave, registro + (folha ? 0 : 4), sizeof(chave));
+    return chave;
+}
+
+uint32_t filho_registro_disco(const uint8_t* registro) {
+    uint32_t filho;
+    memcpy(&filho, registro, sizeof(filho));
+    return filho;
+}
+
+int tamanho_registro_disco(const uint8_t* registro, int folha) {
+    int cabecalho = folha ? CABECALHO_FOLHA_DISCO : CABECALHO_INTERNO_DISCO;
+    uint16_t tamanho;
+    memcpy(&tamanho, registro + cabecalho - 2, sizeof(tamanho));
+    return cabecalho + tamanho + 1;
+}
+
+// Função para montar o registro de folha de um paciente (com a chave já calculada); retorna o tamanho
+int montar_registro_folha(uint8_t* destino, const Paciente* paciente) {
+    uint16_t tamanho = (uint16_t)strlen(paciente->nome);
+    memcpy(destino, &paciente->chave, 8);
+    destino[8] = (uint8_t)paciente->sexo;
+    memcpy(destino + 9, paciente->nascimento, 11);
+    memcpy(destino + 20, paciente->ultima_consulta, 11);
+    memcpy(destino + 31, &tamanho, 2);
+    memcpy(destino + CABECALHO_FOLHA_DISCO, paciente->nome, (size_t)tamanho + 1);
+    return CABECALHO_FOLHA_DISCO + tamanho + 1;
+}
+
+// Função para montar o registro de um separador de nó interno; retorna o tamanho
+int montar_registro_interno(uint8_t* destino, uint32_t filho, uint64_t chave, const char* nome) {
+    uint16_t tamanho = (uint16_t)strlen(nome);
+    memcpy(destino, &filho, 4);
+    memcpy(destino + 4, &chave, 8);
+    memcpy(destino + 12, &tamanho, 2);
+    memcpy(destino + CABECALHO_INTERNO_DISCO, nome, (size_t)tamanho + 1);
+    return CABECALHO_INTERNO_DISCO + tamanho + 1;
+}
+
+// Função para ler um registro de folha para um paciente, com o nome copiado para 'nome'
+void ler_registro_folha(const uint8_t* registro, Paciente* destino, char* nome) {
+    uint16_t tamanho;
+    memcpy(&tamanho, registro + 31, 2);
+    memcpy(nome, registro + CABECALHO_FOLHA_DISCO, (size_t)tamanho + 1);
+    destino->nome = nome;
+    destino->sexo = (char)registro[8];
+    memcpy(destino->nascimento, registro + 9, 11);
+    destino->nascimento[10] = '\0';
+    memcpy(destino->ultima_consulta, registro + 20, 11);
+    destino->ultima_consulta[10] = '\0';
+    memcpy(&destino->chave, registro, 8);
+    destino->historico = NULL;
+}
+
+// Função para comparar um nome com o de um registro: pela chave, depois sem acentos e caixa e, com
+// 'exato', pelos bytes originais (a mesma ordem de comparar_pacientes)
+int comparar_registro_disco(uint64_t chave, const char* nome, const uint8_t* registro, int folha, int exato) {
+    uint64_t outra = chave_registro_disco(registro, folha);
+    if (chave != outra) return chave < outra ? -1 : 1;
+    const char* nome_registro = nome_registro_disco(registro, folha);
+    int comparacao = comparar_dobrado(nome, nome_registro);
+    if (comparacao != 0 || !exato) return comparacao;
+    return strcmp(nome, nome_registro);
+}
+
+// Função para a busca binária em um nó: a primeira posição cujo registro vem depois do nome
+// ('estrito') ou não vem antes dele
+int limite_pagina(uint8_t* pagina, uint64_t chave, const char* nome, int exato, int estrito) {
+    CabecalhoPagina* cabecalho = cabecalho_pagina(pagina);
+    int inicio = 0, fim = cabecalho->quantidade;
+    while (inicio < fim) {
+        int meio = inicio + (fim - inicio) / 2;
+        int comparacao = comparar_registro_disco(chave, nome, registro_pagina(pagina, meio), cabecalho->folha, exato);
+        if (comparacao > 0 || (estrito && comparacao == 0)) inicio = meio + 1;
+        else fim = meio;
+    }
+    return inicio;
+}
+
+// Função para escolher o filho de um nó interno por onde a descida segue
+// Com 'exato' é o filho que contém o nome; sem ele, o primeiro que pode ter um nome igual sem acentos e caixa
+uint32_t filho_disco(uint8_t* pagina, uint64_t chave, const char* nome, int exato) {
+    int posicao = limite_pagina(pagina, chave, nome, exato, exato);
+    return posicao == 0 ? cabecalho_pagina(pagina)->esquerda : filho_registro_disco(registro_pagina(pagina, posicao - 1));
+}
+
+// Função para calcular os bytes livres de uma página, contando os buracos deixados por remoções
+int espaco_pagina(uint8_t* pagina) {
+    CabecalhoPagina* cabecalho = cabecalho_pagina(pagina);
+    return TAMANHO_PAGINA_DISCO - (int)sizeof(CabecalhoPagina) - 2 * cabecalho->quantidade - cabecalho->usados;
+}
+
+void iniciar_pagina(uint8_t* pagina, int folha) {
+    memset(pagina, 0, TAMANHO_PAGINA_DISCO);
+    cabecalho_pagina(pagina)->folha = (uint8_t)folha;
+    cabecalho_pagina(pagina)->inicio_dados = TAMANHO_PAGINA_DISCO;
+}
+
+// Função para juntar os registros no fim da página, eliminando os buracos
+void compactar_pagina(uint8_t* pagina) {
+    uint64_t copia[TAMANHO_PAGINA_DISCO / 8];
+    memcpy(copia, pagina, TAMANHO_PAGINA_DISCO);
+    CabecalhoPagina* cabecalho = cabecalho_pagina(pagina);
+    int fim = TAMANHO_PAGINA_DISCO;
+    for (int i = 0; i < cabecalho->quantidade; i++) {
+        const uint8_t* registro = registro_pagina((uint8_t*)copia, i);
+        int tamanho = tamanho_registro_disco(registro, cabecalho->folha);
+        fim -= tamanho;
+        memcpy(pagina + fim, registro, (size_t)tamanho);
+        deslocamentos_pagina(pagina)[i] = (uint16_t)fim;
+    }
+    cabecalho->inicio_dados = (uint16_t)fim;
+}
+
+// Função para pôr um registro na posição dada (quem chama já conferiu o espaço com espaco_pagina)
+void colocar_registro(uint8_t* pagina, int posicao, const uint8_t* registro, int tamanho) {
+    CabecalhoPagina* cabecalho = cabecalho_pagina(pagina);
+    uint16_t* deslocamentos = deslocamentos_pagina(pagina);
+    if (cabecalho->inicio_dados - tamanho < (int)sizeof(CabecalhoPagina) + 2 * (cabecalho->quantidade + 1)) compactar_pagina(pagina);
+    cabecalho->inicio_dados = (uint16_t)(cabecalho->inicio_dados - tamanho);
+    memcpy(pagina + cabecalho->inicio_dados, registro, (size_t)tamanho);
+    memmove(deslocamentos + posicao + 1, deslocamentos + posicao, (size_t)(cabecalho->quantidade - posicao) * 2);
+    deslocamentos[posicao] = cabecalho->inicio_dados;
+    cabecalho->quantidade++;
+    cabecalho->usados = (uint16_t)(cabecalho->usados + tamanho);
+}
+
+// Função para tirar o registro de uma posição (os bytes dele viram buraco)
+void retirar_registro(uint8_t* pagina, int posicao) {
+    CabecalhoPagina* cabecalho = cabecalho_pagina(pagina);
+    uint16_t* deslocamentos = deslocamentos_pagina(pagina);
+    cabecalho->usados = (uint16_t)(cabecalho->usados - tamanho_registro_disco(registro_pagina(pagina, posicao), cabecalho->folha));
+    memmove(deslocamentos + posicao, deslocamentos + posicao + 1, (size_t)(cabecalho->quantidade - posicao - 1) * 2);
+    cabecalho->quantidade--;
+    if (cabecalho->quantidade == 0) cabecalho->inicio_dados = TAMANHO_PAGINA_DISCO;
+}
+
+// Função para dividir um nó cheio que precisa receber 'registro' na posição dada
+// Os registros (os antigos e o novo) são repartidos pelos bytes entre o nó e uma página nova à direita.
+// Folha: o separador é o primeiro nome da página nova, que entra na lista de folhas. Nó interno: o
+// registro do meio sobe como separador, e o filho dele passa a ser o 'esquerda' da página nova.
+// Um registro que vai para o fim da última folha (ou de um nó interno) fica sozinho na página nova: na
+// carga em ordem A-Z as folhas saem cheias, em vez de pela metade.
+// Em 'separador' (que pode ser o próprio 'registro') fica o registro a inserir no pai, apontando para a
+// página nova; o quadro do nó é solto
+void dividir_no_disco(ArvoreDisco* arvore, int quadro, int posicao, const uint8_t* registro, uint8_t* separador) {
+    uint64_t copia[TAMANHO_PAGINA_DISCO / 8];
+    const uint8_t* registros[TAMANHO_PAGINA_DISCO / 16]; // Cada registro ocupa mais de 16 bytes com o deslocamento
+    uint8_t* pagina = pagina_quadro(arvore, quadro);
+    memcpy(copia, pagina, TAMANHO_PAGINA_DISCO);
+    CabecalhoPagina* antigo = cabecalho_pagina((uint8_t*)copia);
+    int folha = antigo->folha;
+    int total = antigo->quantidade + 1;
+    int bytes = 0;
+    for (int i = 0, j = 0; i < total; i++) {
+        registros[i] = i == posicao ? registro : registro_pagina((uint8_t*)copia, j++);
+        bytes += tamanho_registro_disco(registros[i], folha) + 2;
+    }
+    // O nó fica com até metade dos bytes, e sempre com um registro ao menos
+    int corte = 0, esquerda = 0;
+    while (corte < total - 1 && esquerda + tamanho_registro_disco(registros[corte], folha) + 2 <= bytes / 2) {
+        esquerda += tamanho_registro_disco(registros[corte], folha) + 2;
+        corte++;
+    }
+    if (corte == 0) corte = 1;
+    if (posicao == total - 1 && (folha ? antigo->direita == 0 : total > 2)) corte = folha ? total - 1 : total - 2;
+
+    uint32_t numero = arvore->quadros[quadro].pagina;
+    uint32_t nova;
+    int quadro_novo = nova_pagina(arvore, folha, &nova);
+    uint8_t* direita = pagina_quadro(arvore, quadro_novo);
+    iniciar_pagina(pagina, folha);
+    cabecalho_pagina(pagina)->esquerda = antigo->esquerda;
+    for (int i = 0; i < corte; i++) colocar_registro(pagina, i, registros[i], tamanho_registro_disco(registros[i], folha));
+    if (folha) {
+        for (int i = corte; i < total; i++) colocar_registro(direita, i - corte, registros[i], tamanho_registro_disco(registros[i], 1));
+        cabecalho_pagina(direita)->esquerda = numero;
+        cabecalho_pagina(direita)->direita = antigo->direita;
+        cabecalho_pagina(pagina)->direita = nova;
+        if (antigo->direita != 0) {
+            int vizinha = fixar_pagina(arvore, antigo->direita);
+            cabecalho_pagina(pagina_quadro(arvore, vizinha))->esquerda = nova;
+            soltar_pagina(arvore, vizinha, 1);
+        } else {
+            arvore->meta.ultima_folha = nova;
+        }
+        montar_registro_interno(separador, nova, chave_registro_disco(registros[corte], 1), nome_registro_disco(registros[corte], 1));
+    } else {
+        cabecalho_pagina(direita)->esquerda = filho_registro_disco(registros[corte]);
+        for (int i = corte + 1; i < total; i++) colocar_registro(direita, i - corte - 1, registros[i], tamanho_registro_disco(registros[i], 0));
+        memmove(separador, registros[corte], (size_t)tamanho_registro_disco(registros[corte], 0));
+        memcpy(separador, &nova, 4);
+    }
+    soltar_pagina(arvore, quadro, 1);
+    soltar_pagina(arvore, quadro_novo, 1);
+}
+
+// Função para descer até a folha de um nome e achar nela a primeira posição que não vem antes dele
+// (com 'exato', pelos bytes originais; sem ele, sem acentos e caixa)
+// Uma posição no fim da folha passa para a próxima folha com pacientes; folha 0 se não houver nenhuma
+PosicaoDisco localizar_disco(ArvoreDisco* arvore, uint64_t chave, const char* nome, int exato) {
+    int quadro = fixar_pagina(arvore, arvore->meta.raiz);
+    while (!cabecalho_pagina(pagina_quadro(arvore, quadro))->folha) {
+        uint32_t filho = filho_disco(pagina_quadro(arvore, quadro), chave, nome, exato);
+        soltar_pagina(arvore, quadro, 0);
+        quadro = fixar_pagina(arvore, filho);
+    }
+    uint8_t* pagina = pagina_quadro(arvore, quadro);
+    PosicaoDisco posicao = {arvore->quadros[quadro].pagina, limite_pagina(pagina, chave, nome, exato, 0)};
+    int quantidade = cabecalho_pagina(pagina)->quantidade;
+    soltar_pagina(arvore, quadro, 0);
+    if (posicao.posicao == quantidade) {
+        posicao.posicao--;
+        andar_posicao_disco(arvore, &posicao, 1);
+    }
+    return posicao;
+}
+
+// Função para passar ao paciente seguinte (ou anterior) na lista de folhas, pulando folhas vazias
+void andar_posicao_disco(ArvoreDisco* arvore, PosicaoDisco* posicao, int direita) {
+    posicao->posicao += direita ? 1 : -1;
+    int do_fim = 0; // Ao voltar para a folha anterior, a posição é o último registro dela
+    while (posicao->folha != 0) {
+        int quadro = fixar_pagina(arvore, posicao->folha);
+        CabecalhoPagina* cabecalho = cabecalho_pagina(pagina_quadro(arvore, quadro));
+        if (do_fim) posicao->posicao = cabecalho->quantidade - 1;
+        int dentro = posicao->posicao >= 0 && posicao->posicao < cabecalho->quantidade;
+        uint32_t vizinha = direita ? cabecalho->direita : cabecalho->esquerda;
+        soltar_pagina(arvore, quadro, 0);
+        if (dentro) return;
+        posicao->folha = vizinha;
+        posicao->posicao = 0;
+        do_fim = !direita;
+    }
+}
+
+// Função para obter o primeiro ('ultimo' = 0) ou o último paciente da árvore
+PosicaoDisco extremo_disco(ArvoreDisco* arvore, int ultimo) {
+    PosicaoDisco posicao = {ultimo ? arvore->meta.ultima_folha : arvore->meta.primeira_folha, -1};
+    if (ultimo) {
+        int quadro = fixar_pagina(arvore, posicao.folha);
+        posicao.posicao = cabecalho_pagina(pagina_quadro(arvore, quadro))->quantidade;
+        soltar_pagina(arvore, quadro, 0);
+    }
+    andar_posicao_disco(arvore, &posicao, !ultimo);
+    return posicao;
+}
+
+// Função para comparar um nome com o paciente de uma posição (como comparar_registro_disco)
+int comparar_posicao_disco(ArvoreDisco* arvore, PosicaoDisco posicao, uint64_t chave, const char* nome, int exato) {
+    int quadro = fixar_pagina(arvore, posicao.folha);
+    int comparacao = comparar_registro_disco(chave, nome, registro_pagina(pagina_quadro(arvore, quadro), posicao.posicao), 1, exato);
+    soltar_pagina(arvore, quadro, 0);
+    return comparacao;
+}
+
+// Função para ler o paciente de uma posição, com o nome copiado para 'nome' (MAIOR_NOME_DISCO + 1 bytes)
+void ler_posicao_disco(ArvoreDisco* arvore, PosicaoDisco posicao, Paciente* destino, char* nome) {
+    int quadro = fixar_pagina(arvore, posicao.folha);
+    ler_registro_folha(registro_pagina(pagina_quadro(arvore, quadro), posicao.posicao), destino, nome);
+    soltar_pagina(arvore, quadro, 0);
+}
+
+// Função para achar a posição de um nome, com as regras de buscar_avl: sem acentos e caixa, com
+// preferência pela grafia exata; folha 0 se ele não estiver na árvore
+PosicaoDisco procurar_disco(ArvoreDisco* arvore, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    PosicaoDisco aproximado = {0, 0};
+    // Os nomes iguais sem acentos e caixa ficam juntos, a partir do primeiro deles
+    for (PosicaoDisco posicao = localizar_disco(arvore, chave, nome, 0); posicao.folha != 0; andar_posicao_disco(arvore, &posicao, 1)) {
+        int quadro = fixar_pagina(arvore, posicao.folha);
+        const uint8_t* registro = registro_pagina(pagina_quadro(arvore, quadro), posicao.posicao);
+        int igual = comparar_registro_disco(chave, nome, registro, 1, 0) == 0;
+        int exato = igual && strcmp(nome, nome_registro_disco(registro, 1)) == 0;
+        soltar_pagina(arvore, quadro, 0);
+        if (!igual) break;
+        if (exato) return posicao;
+        if (aproximado.folha == 0) aproximado = posicao;
+    }
+    return aproximado;
+}
+
+// Função para achar a posição de um nome na tabela de residentes, ou a posição vazia onde ele entraria
+// (RESIDENTES_DISCO é potência de 2, e a tabela nunca passa da metade)
+size_t posicao_residente_disco(ArvoreDisco* arvore, const char* nome) {
+    size_t mascara = 2 * RESIDENTES_DISCO - 1;
+    size_t posicao = hash_nome_exato(nome, strlen(nome)) & mascara;
+    while (arvore->residentes[posicao] != NULL && strcmp(arvore->residentes[posicao]->nome, nome) != 0) {
+        posicao = (posicao + 1) & mascara;
+    }
+    return posicao;
+}
+
+// Funções para tirar um residente da ordem de uso e para recolocá-lo como o mais recente
+void desligar_residente_disco(ArvoreDisco* arvore, ResidenteDisco* residente) {
+    if (residente->anterior != NULL) residente->anterior->proximo = residente->proximo;
+    else arvore->mais_recente = residente->proximo;
+    if (residente->proximo != NULL) residente->proximo->anterior = residente->anterior;
+    else arvore->menos_recente = residente->anterior;
+}
+
+void ligar_residente_disco(ArvoreDisco* arvore, ResidenteDisco* residente) {
+    residente->anterior = NULL;
+    residente->proximo = arvore->mais_recente;
+    if (arvore->mais_recente != NULL) arvore->mais_recente->anterior = residente;
+    else arvore->menos_recente = residente;
+    arvore->mais_recente = residente;
+}
+
+// Função para liberar o residente de uma posição da tabela
+void retirar_residente_disco(ArvoreDisco* arvore, size_t posicao) {
+    size_t mascara = 2 * RESIDENTES_DISCO - 1;
+    desligar_residente_disco(arvore, arvore->residentes[posicao]);
+    free(arvore->residentes[posicao]);
+    arvore->num_residentes--;
+
+    // Os residentes seguintes que estavam fora do lugar voltam para trás, fechando o buraco
+    size_t buraco = posicao;
+    for (size_t atual = (posicao + 1) & mascara; arvore->residentes[atual] != NULL; atual = (atual + 1) & mascara) {
+        const char* outro = arvore->residentes[atual]->nome;
+        size_t ideal = hash_nome_exato(outro, strlen(outro)) & mascara;
+        if (((atual - ideal) & mascara) >= ((atual - buraco) & mascara)) {
+            arvore->residentes[buraco] = arvore->residentes[atual];
+            buraco = atual;
+        }
+    }
+    arvore->residentes[buraco] = NULL;
+}
+
+// Função para obter o residente de um paciente lido da árvore, criando-o se ele não estiver na tabela
+// Os dados vêm sempre da página; com a tabela cheia, sai o residente usado há mais tempo
+Paciente* residente_disco(ArvoreDisco* arvore, const Paciente* lido) {
+    size_t posicao = posicao_residente_disco(arvore, lido->nome);
+    ResidenteDisco* residente = arvore->residentes[posicao];
+    if (residente != NULL) {
+        desligar_residente_disco(arvore, residente);
+    } else {
+        if (arvore->num_residentes == RESIDENTES_DISCO) {
+            // A retirada reorganiza a tabela: a posição do novo é procurada de novo
+            retirar_residente_disco(arvore, posicao_residente_disco(arvore, arvore->menos_recente->nome));
+            posicao = posicao_residente_disco(arvore, lido->nome);
+        }
+        size_t tamanho = strlen(lido->nome) + 1;
+        residente = (ResidenteDisco*)malloc(sizeof(ResidenteDisco) + tamanho);
+        if (residente == NULL) {
+            printf("Erro ao alocar memória para o cadastro em disco.\n");
+            exit(1);
+        }
+        memcpy(residente->nome, lido->nome, tamanho);
+        arvore->residentes[posicao] = residente;
+        arvore->num_residentes++;
+    }
+    residente->paciente = *lido;
+    residente->paciente.nome = residente->nome;
+    ligar_residente_disco(arvore, residente);
+    return &residente->paciente;
+}
+
+// Função para liberar o residente de um paciente removido da árvore (se ele estiver na tabela)
+void soltar_residente_disco(ArvoreDisco* arvore, const char* nome) {
+    size_t posicao = posicao_residente_disco(arvore, nome);
+    if (arvore->residentes[posicao] != NULL) retirar_residente_disco(arvore, posicao);
+}
+
+// Função para buscar um paciente na árvore em disco (mesmas regras de buscar_avl)
+// Retorna o residente do paciente ou NULL se não encontrado
+Paciente* buscar_disco(ArvoreDisco* arvore, const char* nome) {
+    Paciente* paciente = NULL;
+    pthread_mutex_lock(&arvore->trava);
+    PosicaoDisco posicao = procurar_disco(arvore, nome);
+    if (posicao.folha != 0) {
+        Paciente lido;
+        char nome_lido[MAIOR_NOME_DISCO + 1];
+        ler_posicao_disco(arvore, posicao, &lido, nome_lido);
+        paciente = residente_disco(arvore, &lido);
+    }
+    pthread_mutex_unlock(&arvore->trava);
+    return paciente;
+}
+
+// Função para conferir se um nome cabe em um registro da árvore em disco
+int nome_cabe_disco(const char* nome) {
+    if (strlen(nome) <= MAIOR_NOME_DISCO) return 1;
+    printf("Erro: o nome '%.40s...' passa de %d bytes, o maior aceito pelo cadastro em disco.\n", nome, MAIOR_NOME_DISCO);
+    return 0;
+}
+
+// Função para inserir um paciente na árvore; retorna 0 se o nome (grafia exata) já estiver nela
+// A descida guarda o caminho: um nó dividido manda o separador para o pai, e a divisão da raiz cria
+// uma raiz nova
+int inserir_disco(ArvoreDisco* arvore, const Paciente* paciente) {
+    uint8_t registro[CABECALHO_FOLHA_DISCO + MAIOR_NOME_DISCO + 1];
+    uint8_t separador[CABECALHO_INTERNO_DISCO + MAIOR_NOME_DISCO + 1];
+    uint32_t caminho[ALTURA_MAXIMA_CURSOR];
+    int niveis = 0;
+    Paciente novo = *paciente;
+    novo.chave = calcular_chave(novo.nome);
+    int tamanho = montar_registro_folha(registro, &novo);
+
+    pthread_mutex_lock(&arvore->trava);
+    int quadro = fixar_pagina(arvore, arvore->meta.raiz);
+    while (!cabecalho_pagina(pagina_quadro(arvore, quadro))->folha) {
+        caminho[niveis++] = arvore->quadros[quadro].pagina;
+        uint32_t filho = filho_disco(pagina_quadro(arvore, quadro), novo.chave, novo.nome, 1);
+        soltar_pagina(arvore, quadro, 0);
+        quadro = fixar_pagina(arvore, filho);
+    }
+    uint8_t* pagina = pagina_quadro(arvore, quadro);
+    int posicao = limite_pagina(pagina, novo.chave, novo.nome, 1, 0);
+    if (posicao < cabecalho_pagina(pagina)->quantidade &&
+        comparar_registro_disco(novo.chave, novo.nome, registro_pagina(pagina, posicao), 1, 1) == 0) {
+        soltar_pagina(arvore, quadro, 0);
+        pthread_mutex_unlock(&arvore->trava);
+        return 0;
+    }
+
+    if (espaco_pagina(pagina) >= tamanho + 2) {
+        colocar_registro(pagina, posicao, registro, tamanho);
+        soltar_pagina(arvore, quadro, 1);
+    } else {
+        dividir_no_disco(arvore, quadro, posicao, registro, separador);
+        // O separador sobe até um nó com espaço para ele
+        int subindo = 1;
+        while (subindo && niveis > 0) {
+            quadro = fixar_pagina(arvore, caminho[--niveis]);
+            pagina = pagina_quadro(arvore, quadro);
+            int tamanho_separador = tamanho_registro_disco(separador, 0);
+            posicao = limite_pagina(pagina, chave_registro_disco(separador, 0), nome_registro_disco(separador, 0), 1, 1);
+            if (espaco_pagina(pagina) >= tamanho_separador + 2) {
+                colocar_registro(pagina, posicao, separador, tamanho_separador);
+                soltar_pagina(arvore, quadro, 1);
+                subindo = 0;
+            } else {
+                dividir_no_disco(arvore, quadro, posicao, separador, separador);
+            }
+        }
+        if (subindo) {
+            // A raiz foi dividida: a raiz nova tem a antiga à esquerda e o separador apontando para a outra metade
+            uint32_t raiz;
+            quadro = nova_pagina(arvore, 0, &raiz);
+            pagina = pagina_quadro(arvore, quadro);
+            cabecalho_pagina(pagina)->esquerda = arvore->meta.raiz;
+            colocar_registro(pagina, 0, separador, tamanho_registro_disco(separador, 0));
+            soltar_pagina(arvore, quadro, 1);
+            arvore->meta.raiz = raiz;
+            arvore->meta.altura++;
+        }
+    }
+    arvore->meta.pacientes++;
+    arvore->modificacoes++;
+    pthread_mutex_unlock(&arvore->trava);
+    return 1;
+}
+
+// Função para remover um paciente (grafia exata) da árvore
+// Os nós não são juntados: uma folha pode ficar vazia, e os cursores e buscas passam por ela
+void remover_disco(ArvoreDisco* arvore, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    pthread_mutex_lock(&arvore->trava);
+    PosicaoDisco posicao = localizar_disco(arvore, chave, nome, 1);
+    if (posicao.folha != 0 && comparar_posicao_disco(arvore, posicao, chave, nome, 1) == 0) {
+        int quadro = fixar_pagina(arvore, posicao.folha);
+        retirar_registro(pagina_quadro(arvore, quadro), posicao.posicao);
+        soltar_pagina(arvore, quadro, 1);
+        arvore->meta.pacientes--;
+        arvore->modificacoes++;
+    }
+    soltar_residente_disco(arvore, nome);
+    pthread_mutex_unlock(&arvore->trava);
+}
+
+// Função para trocar no lugar os dados (menos o nome) do registro de um paciente e do seu residente,
+// se houver; chamada com a trava da árvore. Retorna 0 se o nome não estiver na árvore
+int regravar_disco(ArvoreDisco* arvore, const Paciente* paciente) {
+    PosicaoDisco posicao = localizar_disco(arvore, paciente->chave, paciente->nome, 1);
+    if (posicao.folha == 0 || comparar_posicao_disco(arvore, posicao, paciente->chave, paciente->nome, 1) != 0) return 0;
+    int quadro = fixar_pagina(arvore, posicao.folha);
+    uint8_t* registro = registro_pagina(pagina_quadro(arvore, quadro), posicao.posicao);
+    registro[8] = (uint8_t)paciente->sexo;
+    memcpy(registro + 9, paciente->nascimento, 11);
+    memcpy(registro + 20, paciente->ultima_consulta, 11);
+    soltar_pagina(arvore, quadro, 1);
+
+    ResidenteDisco* residente = arvore->residentes[posicao_residente_disco(arvore, paciente->nome)];
+    if (residente != NULL) {
+        residente->paciente.sexo = paciente->sexo;
+        memcpy(residente->paciente.nascimento, paciente->nascimento, 11);
+        memcpy(residente->paciente.ultima_consulta, paciente->ultima_consulta, 11);
+    }
+    return 1;
+}
+
+// Função para trocar os dados de um paciente que continua com o mesmo nome: o registro muda no lugar,
+// e o residente recebe os dados novos
+Paciente* atualizar_disco(ArvoreDisco* arvore, Paciente* paciente, Paciente alterado) {
+    pthread_mutex_lock(&arvore->trava);
+    regravar_disco(arvore, &alterado);
+    alterado.historico = NULL;
+    *paciente = alterado;
+    pthread_mutex_unlock(&arvore->trava);
+    return paciente;
+}
+
+// Função para montar a árvore (vazia) de uma vez a partir de pacientes em ordem A-Z, sem nomes repetidos
+// As folhas são preenchidas em sequência, e cada nível de nós internos é montado com a página e o
+// primeiro nome de cada página do nível de baixo, até sobrar uma página só: a raiz
+void construir_disco(ArvoreDisco* arvore, Paciente* pacientes, int quantidade) {
+    uint8_t registro[CABECALHO_FOLHA_DISCO + MAIOR_NOME_DISCO + 1];
+    int limite = (TAMANHO_PAGINA_DISCO - (int)sizeof(CabecalhoPagina)) * OCUPACAO_CARGA_DISCO / 100;
+    // Cada nível tem no máximo uma página por paciente; o de cima é escrito por cima do de baixo
+    EntradaCargaDisco* nivel = (EntradaCargaDisco*)malloc((size_t)quantidade * sizeof(EntradaCargaDisco));
+    if (nivel == NULL) {
+        printf("Erro ao alocar memória para a carga do cadastro em disco.\n");
+        exit(1);
+    }
+    int paginas = 0;
+
+    uint32_t pagina = arvore->meta.raiz;
+    int quadro = fixar_pagina(arvore, pagina);
+    for (int i = 0; i < quantidade; i++) {
+        int tamanho = montar_registro_folha(registro, &pacientes[i]);
+        CabecalhoPagina* cabecalho = cabecalho_pagina(pagina_quadro(arvore, quadro));
+        if (cabecalho->quantidade > 0 && cabecalho->usados + 2 * (cabecalho->quantidade + 1) + tamanho > limite) {
+            uint32_t nova;
+            int quadro_novo = nova_pagina(arvore, 1, &nova);
+            cabecalho->direita = nova;
+            cabecalho_pagina(pagina_quadro(arvore, quadro_novo))->esquerda = pagina;
+            soltar_pagina(arvore, quadro, 1);
+            pagina = nova;
+            quadro = quadro_novo;
+            cabecalho = cabecalho_pagina(pagina_quadro(arvore, quadro));
+        }
+        if (cabecalho->quantidade == 0) {
+            nivel[paginas].pagina = pagina;
+            nivel[paginas].chave = pacientes[i].chave;
+            nivel[paginas].nome = pacientes[i].nome;
+            paginas++;
+        }
+        colocar_registro(pagina_quadro(arvore, quadro), cabecalho->quantidade, registro, tamanho);
+    }
+    soltar_pagina(arvore, quadro, 1);
+    arvore->meta.ultima_folha = pagina;
+
+    uint8_t separador[CABECALHO_INTERNO_DISCO + MAIOR_NOME_DISCO + 1];
+    while (paginas > 1) {
+        int acima = 0;
+        quadro = -1;
+        for (int i = 0; i < paginas; i++) {
+            EntradaCargaDisco entrada = nivel[i];
+            if (quadro >= 0) {
+                int tamanho = montar_registro_interno(separador, entrada.pagina, entrada.chave, entrada.nome);
+                uint8_t* dados = pagina_quadro(arvore, quadro);
+                CabecalhoPagina* cabecalho = cabecalho_pagina(dados);
+                if (cabecalho->usados + 2 * (cabecalho->quantidade + 1) + tamanho <= limite) {
+                    colocar_registro(dados, cabecalho->quantidade, separador, tamanho);
+                    continue;
+                }
+                soltar_pagina(arvore, quadro, 1);
+            }
+            // Nó novo: a página de baixo é o seu 'esquerda', e o nome dela sobe para o próximo nível
+            quadro = nova_pagina(arvore, 0, &pagina);
+            cabecalho_pagina(pagina_quadro(arvore, quadro))->esquerda = entrada.pagina;
+            entrada.pagina = pagina;
+            nivel[acima++] = entrada;
+        }
+        soltar_pagina(arvore, quadro, 1);
+        paginas = acima;
+        arvore->meta.altura++;
+    }
+    arvore->meta.raiz = nivel[0].pagina;
+    arvore->meta.pacientes += (uint64_t)quantidade;
+    arvore->modificacoes++;
+    free(nivel);
+}
+
+// Função para inserir vários pacientes na árvore em disco: com a árvore vazia ela é montada de uma vez
+// pelo lote ordenado; senão cada paciente desce até a sua folha (em ordem A-Z, as folhas seguidas já
+// estão no buffer)
+// O vetor de pacientes é reordenado; nomes repetidos no lote vão para o relatório de conflitos. Um nome
+// que já está na árvore também vai, salvo na carga dos arquivos: ele foi gravado no arquivo de texto
+// junto com a árvore, e recebe os dados de lá (que podem ter sido editados entre as execuções)
+void inserir_lote_disco(ArvoreDisco* arvore, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos) {
+    for (int i = 0; i < quantidade; i++) {
+        pacientes[i].chave = calcular_chave(pacientes[i].nome);
+    }
+    qsort(pacientes, quantidade, sizeof(Paciente), comparar_pacientes_crescente);
+    int unicos = 0;
+    for (int i = 0; i < quantidade; i++) {
+        if (!nome_cabe_disco(pacientes[i].nome)) continue;
+        if (unicos > 0 && comparar_pacientes(&pacientes[unicos - 1], &pacientes[i]) == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+            continue;
+        }
+        pacientes[unicos++] = pacientes[i];
+    }
+
+    pthread_mutex_lock(&arvore->trava);
+    int vazia = arvore->meta.altura == 1 && arvore->meta.pacientes == 0;
+    if (vazia && unicos > 0) construir_disco(arvore, pacientes, unicos);
+    pthread_mutex_unlock(&arvore->trava);
+    if (vazia) return;
+    for (int i = 0; i < unicos; i++) {
+        if (inserir_disco(arvore, &pacientes[i])) continue;
+        pthread_mutex_lock(&arvore->trava);
+        if (!arvore->em_carga || !regravar_disco(arvore, &pacientes[i])) registrar_conflito(conflitos, pacientes[i].nome);
+        pthread_mutex_unlock(&arvore->trava);
+    }
+}
+
+// Função para resolver as consultas ordenadas (A-Z) com uma descida por nome: os nomes seguidos caem
+// nas mesmas folhas, que já estão no buffer. Os pacientes achados são cópias (ver copiar_paciente_disco)
+void resolver_lote_disco(ArvoreDisco* arvore, ConsultaLote* consultas, int quantidade) {
+    descartar_copias_disco(arvore);
+    for (int i = 0; i < quantidade; i++) {
+        if (consultas[i].encontrado != NULL) continue;
+        Paciente lido;
+        char nome[MAIOR_NOME_DISCO + 1];
+        pthread_mutex_lock(&arvore->trava);
+        PosicaoDisco posicao = procurar_disco(arvore, consultas[i].nome);
+        if (posicao.folha != 0) ler_posicao_disco(arvore, posicao, &lido, nome);
+        pthread_mutex_unlock(&arvore->trava);
+        if (posicao.folha == 0) continue;
+
+        Paciente* paciente = copiar_paciente_disco(arvore, &lido);
+        if (strcmp(consultas[i].nome, paciente->nome) == 0) consultas[i].encontrado = paciente;
+        else if (consultas[i].aproximado == NULL) consultas[i].aproximado = paciente;
+    }
+}
+
+// Função para copiar um paciente para uma área de pedaços: o paciente e o nome ficam juntos, alinhados
+// em 8 bytes, e a cópia vale até liberar_pedacos (o histórico não é copiado)
+Paciente* copiar_paciente_pedacos(PedacoNomes** pedacos, const Paciente* paciente) {
+    size_t tamanho_nome = strlen(paciente->nome) + 1;
+    size_t bytes = sizeof(Paciente) + tamanho_nome;
+    PedacoNomes* pedaco = *pedacos;
+    size_t inicio = pedaco != NULL ? (pedaco->usado + 7) & ~(size_t)7 : 0;
+    if (pedaco == NULL || inicio + bytes > pedaco->tamanho) {
+        size_t tamanho = bytes > TAMANHO_PEDACO_NOMES ? bytes : TAMANHO_PEDACO_NOMES;
+        pedaco = (PedacoNomes*)malloc(sizeof(PedacoNomes) + tamanho);
+        if (pedaco == NULL) {
+            printf("Erro ao alocar memória para as cópias dos pacientes.\n");
+            exit(1);
+        }
+        pedaco->anterior = *pedacos;
+        pedaco->usado = 0;
+        pedaco->tamanho = tamanho;
+        *pedacos = pedaco;
+        inicio = 0;
+    }
+    Paciente* copia = (Paciente*)(pedaco->dados + inicio);
+    char* nome = pedaco->dados + inicio + sizeof(Paciente);
+    memcpy(nome, paciente->nome, tamanho_nome);
+    *copia = *paciente;
+    copia->nome = nome;
+    copia->historico = NULL;
+    pedaco->usado = inicio + bytes;
+    return copia;
+}
+
+// Função para liberar todas as cópias de uma área de pedaços
+void liberar_pedacos(PedacoNomes** pedacos) {
+    while (*pedacos != NULL) {
+        PedacoNomes* anterior = (*pedacos)->anterior;
+        free(*pedacos);
+        *pedacos = anterior;
+    }
+}
+
+// Função para copiar um paciente para um bloco só seu, com o nome (liberado com free)
+// Usada quando as cópias saem em qualquer ordem, como nos heaps limitados
+Paciente* duplicar_paciente(const Paciente* paciente) {
+    size_t tamanho_nome = strlen(paciente->nome) + 1;
+    Paciente* copia = (Paciente*)malloc(sizeof(Paciente) + tamanho_nome);
+    if (copia == NULL) {
+        printf("Erro ao alocar memória para as cópias dos pacientes.\n");
+        exit(1);
+    }
+    char* nome = (char*)(copia + 1);
+    memcpy(nome, paciente->nome, tamanho_nome);
+    *copia = *paciente;
+    copia->nome = nome;
+    copia->historico = NULL;
+    return copia;
+}
+
+// Função para copiar um paciente da árvore para a área das coletas: um vetor de pacientes guarda
+// endereços, e o paciente de um cursor muda a cada passo. A cópia vale até descartar_copias_disco
+Paciente* copiar_paciente_disco(ArvoreDisco* arvore, const Paciente* paciente) {
+    pthread_mutex_lock(&arvore->trava);
+    Paciente* copia = copiar_paciente_pedacos(&arvore->copias, paciente);
+    pthread_mutex_unlock(&arvore->trava);
+    return copia;
+}
+
+// Função para liberar as cópias da última coleta do cadastro
+void descartar_copias_disco(ArvoreDisco* arvore) {
+    pthread_mutex_lock(&arvore->trava);
+    liberar_pedacos(&arvore->copias);
+    pthread_mutex_unlock(&arvore->trava);
+}
+
+// Função para inserir um paciente na lista duplamente encadeada (Z-A)
+void inserir_ordenado(ListaDupla* lista, Paciente paciente) {
+    NoLista* novo_no = (NoLista*)malloc(sizeof(NoLista));
+    if (novo_no == NULL) {
+        printf("Erro ao alocar memória para o nó da lista.\n");
+        exit(1);
+    }
+    paciente.chave = calcular_chave(paciente.nome);
+    novo_no->paciente = paciente;
+    novo_no->proximo = NULL;
+    novo_no->anterior = NULL;
+
+    if (lista->inicio == NULL) {
+        lista->inicio = novo_no;
+        lista->fim = novo_no;
+    } else {
+        NoLista* atual = lista->inicio;
+        while (atual != NULL && comparar_pacientes(&atual->paciente, &novo_no->paciente) > 0) {
+            atual = atual->proximo;
+        }
+
+        if (atual == lista->inicio) {
+            novo_no->proximo = lista->inicio;
+            lista->inicio->anterior = novo_no;
+            lista->inicio = novo_no;
+        } else if (atual == NULL) {
+            novo_no->anterior = lista->fim;
+            lista->fim->proximo = novo_no;
+            lista->fim = novo_no;
+        } else {
+            novo_no->proximo = atual;
+            novo_no->anterior = atual->anterior;
+            atual->anterior->proximo = novo_no;
+            atual->anterior = novo_no;
+        }
+    }
+}
+
+// Função para remover um paciente da lista duplamente encadeada
+// O paciente precisa ser um ponteiro devolvido por buscar_lista
+void remover_lista(ListaDupla* lista, Paciente* paciente) {
+    NoLista* no = (NoLista*)paciente; // paciente é o primeiro campo de NoLista
+
+    if (no->anterior != NULL) no->anterior->proximo = no->proximo;
+    else lista->inicio = no->proximo;
+    if (no->proximo != NULL) no->proximo->anterior = no->anterior;
+    else lista->fim = no->anterior;
+
+    free(no);
+}
+
+// Função para buscar um paciente na lista duplamente encadeada
+// Ignora acentos e caixa; se houver um nome idêntico byte a byte, ele tem preferência
+Paciente* buscar_lista(ListaDupla* lista, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    Paciente* aproximado = NULL;
+
+    NoLista* atual = lista->inicio;
+    while (atual != NULL) {
+        int comparacao = comparar_busca(chave, nome, &atual->paciente);
+        if (comparacao > 0) break; // Lista em ordem Z-A: o nome já teria aparecido
+        if (comparacao == 0) {
+            if (strcmp(atual->paciente.nome, nome) == 0) {
+                return &(atual->paciente);
+            }
+            if (aproximado == NULL) aproximado = &(atual->paciente);
+        }
+        atual = atual->proximo;
+    }
+    return aproximado;
+}
+
+// Função para inserir um paciente na lista desenrolada (Z-A)
+// Ele entra antes do primeiro nome menor que o seu; um bloco cheio é dividido ao meio
+void inserir_blocos(ListaBlocos* lista, Paciente paciente) {
+    paciente.chave = calcular_chave(paciente.nome);
+
+    // Pula os blocos cujo menor nome (o último) ainda vem depois do novo
+    BlocoPacientes* bloco = lista->inicio;
+    while (bloco != NULL && comparar_pacientes(&bloco->pacientes[bloco->quantidade - 1], &paciente) > 0) {
+        bloco = bloco->proximo;
+    }
+
+    int posicao;
+    if (bloco == NULL) {
+        // Menor que todos (ou lista vazia): vai para o fim do último bloco
+        bloco = lista->fim != NULL ? lista->fim : criar_bloco_pacientes(lista, NULL);
+        posicao = bloco->quantidade;
+    } else {
+        posicao = 0;
+        while (comparar_pacientes(&bloco->pacientes[posicao], &paciente) > 0) posicao++;
+        // No começo de um bloco, o paciente pode ficar no fim do anterior se lá houver espaço
+        if (posicao == 0 && bloco->anterior != NULL && bloco->anterior->quantidade < PACIENTES_POR_BLOCO) {
+            bloco = bloco->anterior;
+            posicao = bloco->quantidade;
+        }
+    }
+
+    if (bloco->quantidade == PACIENTES_POR_BLOCO) {
+        // Bloco cheio: a segunda metade passa para um bloco novo logo depois dele
+        int metade = PACIENTES_POR_BLOCO / 2;
+        BlocoPacientes* novo = criar_bloco_pacientes(lista, bloco);
+        memcpy(novo->pacientes, bloco->pacientes + metade, (PACIENTES_POR_BLOCO - metade) * sizeof(Paciente));
+        novo->quantidade = PACIENTES_POR_BLOCO - metade;
+        bloco->quantidade = metade;
+        if (posicao > metade) {
+            bloco = novo;
+            posicao -= metade;
+        }
+    }
+    memmove(&bloco->pacientes[posicao + 1], &bloco->pacientes[posicao], (bloco->quantidade - posicao) * sizeof(Paciente));
+    bloco->pacientes[posicao] = paciente;
+    bloco->quantidade++;
+}
+
+// Função para remover um paciente da lista desenrolada
+// O paciente precisa ser um ponteiro devolvido por buscar_blocos; um bloco que fica com menos da
+// metade se junta a um vizinho quando os dois cabem em um só
+void remover_blocos(ListaBlocos* lista, Paciente* paciente) {
+    BlocoPacientes* bloco = lista->inicio;
+    while (comparar_pacientes(&bloco->pacientes[bloco->quantidade - 1], paciente) > 0) bloco = bloco->proximo;
+
+    int posicao = (int)(paciente - bloco->pacientes);
+    memmove(&bloco->pacientes[posicao], &bloco->pacientes[posicao + 1], (bloco->quantidade - posicao - 1) * sizeof(Paciente));
+    bloco->quantidade--;
+
+    if (bloco->quantidade == 0) {
+        liberar_bloco_pacientes(lista, bloco);
+    } else if (bloco->quantidade < PACIENTES_POR_BLOCO / 2) {
+        BlocoPacientes* proximo = bloco->proximo;
+        BlocoPacientes* anterior = bloco->anterior;
+        if (proximo != NULL && bloco->quantidade + proximo->quantidade <= PACIENTES_POR_BLOCO) {
+            memcpy(bloco->pacientes + bloco->quantidade, proximo->pacientes, proximo->quantidade * sizeof(Paciente));
+            bloco->quantidade += proximo->quantidade;
+            liberar_bloco_pacientes(lista, proximo);
+        } else if (anterior != NULL && anterior->quantidade + bloco->quantidade <= PACIENTES_POR_BLOCO) {
+            memcpy(anterior->pacientes + anterior->quantidade, bloco->pacientes, bloco->quantidade * sizeof(Paciente));
+            anterior->quantidade += bloco->quantidade;
+            liberar_bloco_pacientes(lista, bloco);
+        }
+    }
+}
+
+// Função para buscar um paciente na lista desenrolada, com a mesma resposta de buscar_lista
+// Um bloco cujo menor nome (o último) ainda vem depois do buscado é pulado com uma só comparação
+Paciente* buscar_blocos(ListaBlocos* lista, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    Paciente* aproximado = NULL;
+
+    for (BlocoPacientes* bloco = lista->inicio; bloco != NULL; bloco = bloco->proximo) {
+        PREFETCH(bloco->proximo);
+        if (comparar_busca(chave, nome, &bloco->pacientes[bloco->quantidade - 1]) < 0) continue;
+        for (int i = 0; i < bloco->quantidade; i++) {
+            int comparacao = comparar_busca(chave, nome, &bloco->pacientes[i]);
+            if (comparacao > 0) return aproximado; // Ordem Z-A: o nome já teria aparecido
+            if (comparacao == 0) {
+                if (strcmp(bloco->pacientes[i].nome, nome) == 0) return &bloco->pacientes[i];
+                if (aproximado == NULL) aproximado = &bloco->pacientes[i];
+            }
+        }
+    }
+    return aproximado;
+}
+
+// Função para buscar um paciente na árvore AVL
+// Ignora acentos e caixa; se houver um nome idêntico byte a byte, ele tem preferência
+Paciente* buscar_avl(NoAVL* raiz, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    Paciente* aproximado = NULL;
+
+    while (raiz != NULL) {
+        int comparacao = comparar_busca(chave, nome, &raiz->paciente);
+        if (comparacao == 0) {
+            comparacao = strcmp(nome, raiz->paciente.nome);
+            if (comparacao == 0) return &(raiz->paciente);
+            aproximado = &(raiz->paciente);
+        }
+        raiz = comparacao < 0 ? raiz->esquerda : raiz->direita;
+    }
+    return aproximado;
+}
+
+// Função para guardar um nome rejeitado para o relatório em bloco
+void registrar_conflito(RelatorioConflitos* relatorio, const char* nome) {
+    if (relatorio->quantidade == relatorio->capacidade) {
+        relatorio->capacidade = relatorio->capacidade > 0 ? relatorio->capacidade * 2 : 16;
+        relatorio->nomes = (char**)realloc(relatorio->nomes, relatorio->capacidade * sizeof(char*));
+        if (relatorio->nomes == NULL) {
+            printf("Erro ao alocar memória para o relatório de conflitos.\n");
+            exit(1);
+        }
+    }
+    size_t tamanho = strlen(nome) + 1;
+    char* copia = (char*)malloc(tamanho);
+    if (copia == NULL) {
+        printf("Erro ao alocar memória para o relatório de conflitos.\n");
+        exit(1);
+    }
+    memcpy(copia, nome, tamanho);
+    relatorio->nomes[relatorio->quantidade++] = copia;
+}
+
+// Função para exibir de uma vez os nomes rejeitados e liberar o relatório
+void exibir_conflitos(RelatorioConflitos* relatorio) {
+    if (relatorio->quantidade > 0) {
+        printf("Erro: %d paciente(s) com nome já cadastrado não foram inseridos:\n", relatorio->quantidade);
+        for (int i = 0; i < relatorio->quantidade; i++) {
+            printf("  %s\n", relatorio->nomes[i]);
+            free(relatorio->nomes[i]);
+        }
+    }
+    free(relatorio->nomes);
+    relatorio->nomes = NULL;
+    relatorio->quantidade = 0;
+    relatorio->capacidade = 0;
+}
+
+// Funções de comparação de pacientes para o qsort (A-Z e Z-A)
+int comparar_pacientes_crescente(const void* a, const void* b) {
+    return comparar_pacientes((const Paciente*)a, (const Paciente*)b);
+}
+
+int comparar_pacientes_decrescente(const void* a, const void* b) {
+    return comparar_pacientes((const Paciente*)b, (const Paciente*)a);
+}
+
+// Função para recalcular a altura de um nó a partir dos filhos
+void atualizar_altura_avl(NoAVL* no) {
+    no->altura = 1 + (altura_avl(no->esquerda) > altura_avl(no->direita) ? altura_avl(no->esquerda) : altura_avl(no->direita));
+}
+
+// Função para corrigir o balanceamento de um nó cujos filhos já estão balanceados
+NoAVL* balancear_avl(NoAVL* no) {
+    atualizar_altura_avl(no);
+    int balanceamento = fator_balanceamento(no);
+
+    if (balanceamento > 1) {
+        if (fator_balanceamento(no->esquerda) < 0) no->esquerda = rotacionar_esquerda(no->esquerda);
+        return rotacionar_direita(no);
+    }
+    if (balanceamento < -1) {
+        if (fator_balanceamento(no->direita) > 0) no->direita = rotacionar_direita(no->direita);
+        return rotacionar_esquerda(no);
+    }
+    return no;
+}
+
+// Função para juntar duas árvores AVL com um nó do meio (todos da esquerda < meio < todos da direita)
+// Desce pela borda da árvore mais alta até encontrar uma subárvore de altura compatível
+NoAVL* juntar_avl(NoAVL* esquerda, NoAVL* meio, NoAVL* direita) {
+    if (altura_avl(esquerda) > altura_avl(direita) + 1) {
+        esquerda->direita = juntar_avl(esquerda->direita, meio, direita);
+        return balancear_avl(esquerda);
+    }
+    if (altura_avl(direita) > altura_avl(esquerda) + 1) {
+        direita->esquerda = juntar_avl(esquerda, meio, direita->esquerda);
+        return balancear_avl(direita);
+    }
+    meio->esquerda = esquerda;
+    meio->direita = direita;
+    atualizar_altura_avl(meio);
+    return meio;
+}
+
+// Função para dividir a árvore em nós menores e maiores que o paciente
+// Se houver um nó com o mesmo nome, ele é devolvido separado em *igual
+void dividir_avl(NoAVL* raiz, const Paciente* paciente, NoAVL** esquerda, NoAVL** igual, NoAVL** direita) {
+    if (raiz == NULL) {
+        *esquerda = NULL;
+        *igual = NULL;
+        *direita = NULL;
+        return;
+    }
+
+    int comparacao = comparar_pacientes(paciente, &raiz->paciente);
+    if (comparacao == 0) {
+        *esquerda = raiz->esquerda;
+        *direita = raiz->direita;
+        raiz->esquerda = NULL;
+        raiz->direita = NULL;
+        raiz->altura = 1;
+        *igual = raiz;
+    } else if (comparacao < 0) {
+        NoAVL* resto;
+        dividir_avl(raiz->esquerda, paciente, esquerda, igual, &resto);
+        *direita = juntar_avl(resto, raiz, raiz->direita);
+    } else {
+        NoAVL* resto;
+        dividir_avl(raiz->direita, paciente, &resto, igual, direita);
+        *esquerda = juntar_avl(raiz->esquerda, raiz, resto);
+    }
+}
+
+// Função para unir duas árvores AVL por divisão e junção
+// Em caso de nome repetido o registro existente é mantido e o novo é rejeitado
+NoAVL* unir_avl(NoAVL* existente, NoAVL* novos, RelatorioConflitos* conflitos) {
+    if (existente == NULL) return novos;
+    if (novos == NULL) return existente;
+
+    NoAVL* novos_esquerda = novos->esquerda;
+    NoAVL* novos_direita = novos->direita;
+    NoAVL *esquerda, *igual, *direita;
+    dividir_avl(existente, &novos->paciente, &esquerda, &igual, &direita);
+
+    NoAVL* meio = novos;
+    if (igual != NULL) {
+        registrar_conflito(conflitos, novos->paciente.nome);
+        free(novos);
+        meio = igual;
+    }
+
+    esquerda = unir_avl(esquerda, novos_esquerda, conflitos);
+    direita = unir_avl(direita, novos_direita, conflitos);
+    return juntar_avl(esquerda, meio, direita);
+}
+
+// Função para montar uma árvore AVL perfeitamente balanceada a partir de pacientes[inicio, fim) ordenados
+NoAVL* construir_avl_ordenada(Paciente* pacientes, int inicio, int fim) {
+    if (inicio >= fim) return NULL;
+
+    int meio = inicio + (fim - inicio) / 2;
+    NoAVL* no = criar_no_avl(pacientes[meio]);
+    no->esquerda = construir_avl_ordenada(pacientes, inicio, meio);
+    no->direita = construir_avl_ordenada(pacientes, meio + 1, fim);
+    atualizar_altura_avl(no);
+    return no;
+}
+
+// Função para inserir vários pacientes na lista (Z-A) com uma única intercalação linear
+// O vetor de pacientes é reordenado; nomes já cadastrados vão para o relatório de conflitos
+void inserir_lote_lista(ListaDupla* lista, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos) {
+    for (int i = 0; i < quantidade; i++) {
+        pacientes[i].chave = calcular_chave(pacientes[i].nome);
+    }
+    qsort(pacientes, quantidade, sizeof(Paciente), comparar_pacientes_decrescente);
+
+    NoLista* anterior = NULL;
+    NoLista* atual = lista->inicio;
+    for (int i = 0; i < quantidade; i++) {
+        if (i > 0 && comparar_pacientes(&pacientes[i - 1], &pacientes[i]) == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+            continue;
+        }
+        while (atual != NULL && comparar_pacientes(&atual->paciente, &pacientes[i]) > 0) {
+            anterior = atual;
+            atual = atual->proximo;
+        }
+        if (atual != NULL && comparar_pacientes(&atual->paciente, &pacientes[i]) == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+            continue;
+        }
+
+        NoLista* novo_no = (NoLista*)malloc(sizeof(NoLista));
+        if (novo_no == NULL) {
+            printf("Erro ao alocar memória para o nó da lista.\n");
+            exit(1);
+        }
+        novo_no->paciente = pacientes[i];
+        novo_no->anterior = anterior;
+        novo_no->proximo = atual;
+        if (anterior != NULL) anterior->proximo = novo_no;
+        else lista->inicio = novo_no;
+        if (atual != NULL) atual->anterior = novo_no;
+        else lista->fim = novo_no;
+        anterior = novo_no;
+    }
+}
+
+// Função para inserir vários pacientes na lista desenrolada com uma única intercalação linear
+// Os pacientes atuais e os novos (ordenados Z-A) são copiados para blocos novos e cheios
+// O vetor de pacientes é reordenado; nomes já cadastrados vão para o relatório de conflitos
+void inserir_lote_blocos(ListaBlocos* lista, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos) {
+    for (int i = 0; i < quantidade; i++) {
+        pacientes[i].chave = calcular_chave(pacientes[i].nome);
+    }
+    qsort(pacientes, quantidade, sizeof(Paciente), comparar_pacientes_decrescente);
+
+    ListaBlocos nova = {NULL, NULL};
+    BlocoPacientes* destino = NULL;
+
+    // Lote todo depois do maior nome da lista (a carga de arquivos chega A-Z, um lote por vez): os
+    // blocos novos só entram na frente, sem copiar os que já existem
+    if (quantidade > 0 && (lista->inicio == NULL || comparar_pacientes(&pacientes[quantidade - 1], &lista->inicio->pacientes[0]) > 0)) {
+        for (int i = 0; i < quantidade; i++) {
+            if (i > 0 && comparar_pacientes(&pacientes[i - 1], &pacientes[i]) == 0) {
+                registrar_conflito(conflitos, pacientes[i].nome);
+                continue;
+            }
+            if (destino == NULL || destino->quantidade == PACIENTES_POR_BLOCO) destino = criar_bloco_pacientes(&nova, destino);
+            destino->pacientes[destino->quantidade++] = pacientes[i];
+        }
+        nova.fim->proximo = lista->inicio;
+        if (lista->inicio != NULL) lista->inicio->anterior = nova.fim;
+        else lista->fim = nova.fim;
+        lista->inicio = nova.inicio;
+        return;
+    }
+
+    BlocoPacientes* bloco = lista->inicio;
+    int posicao = 0;
+    int i = 0;
+    while (bloco != NULL || i < quantidade) {
+        if (i < quantidade && i > 0 && comparar_pacientes(&pacientes[i - 1], &pacientes[i]) == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+            i++;
+            continue;
+        }
+        int comparacao = bloco == NULL ? -1 : i == quantidade ? 1 : comparar_pacientes(&bloco->pacientes[posicao], &pacientes[i]);
+        if (comparacao == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+            i++;
+            continue;
+        }
+
+        Paciente* proximo;
+        if (comparacao > 0) {
+            proximo = &bloco->pacientes[posicao];
+            if (++posicao == bloco->quantidade) {
+                bloco = bloco->proximo;
+                posicao = 0;
+            }
+        } else {
+            proximo = &pacientes[i++];
+        }
+        if (destino == NULL || destino->quantidade == PACIENTES_POR_BLOCO) destino = criar_bloco_pacientes(&nova, destino);
+        destino->pacientes[destino->quantidade++] = *proximo;
+    }
+
+    // Os pacientes (e a referência aos seus históricos) já passaram para os blocos novos
+    while (lista->inicio != NULL) liberar_bloco_pacientes(lista, lista->inicio);
+    *lista = nova;
+}
+
+// Função para inserir vários pacientes na árvore: monta uma AVL com o lote ordenado e une com a existente
+// O vetor de pacientes é reordenado; nomes já cadastrados vão para o relatório de conflitos
+NoAVL* inserir_lote_avl(NoAVL* raiz, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos) {
+    for (int i = 0; i < quantidade; i++) {
+        pacientes[i].chave = calcular_chave(pacientes[i].nome);
+    }
+    qsort(pacientes, quantidade, sizeof(Paciente), comparar_pacientes_crescente);
+
+    // Remove os nomes repetidos dentro do próprio lote
+    int unicos = 0;
+    for (int i = 0; i < quantidade; i++) {
+        if (unicos > 0 && comparar_pacientes(&pacientes[unicos - 1], &pacientes[i]) == 0) {
+            registrar_conflito(conflitos, pacientes[i].nome);
+        } else {
+            pacientes[unicos++] = pacientes[i];
+        }
+    }
+
+    NoAVL* novos = construir_avl_ordenada(pacientes, 0, unicos);
+    return unir_avl(raiz, novos, conflitos);
+}
+
+// Função para comparar dois nomes consultados na ordem de agrupamento (usada pelo qsort)
+int comparar_consultas(const void* a, const void* b) {
+    const ConsultaLote* ca = (const ConsultaLote*)a;
+    const ConsultaLote* cb = (const ConsultaLote*)b;
+    if (ca->chave != cb->chave) return ca->chave < cb->chave ? -1 : 1;
+    int resultado = comparar_dobrado(ca->nome, cb->nome);
+    if (resultado != 0) return resultado;
+    return strcmp(ca->nome, cb->nome);
+}
+
+// Função para achar, nas consultas ordenadas, a primeira que não fica antes do paciente
+// (estrito = 0) ou a primeira que fica depois dele (estrito = 1), ignorando acentos e caixa
+int limite_dobrado(ConsultaLote* consultas, int inicio, int fim, const Paciente* paciente, int estrito) {
+    while (inicio < fim) {
+        int meio = inicio + (fim - inicio) / 2;
+        int comparacao = comparar_busca(consultas[meio].chave, consultas[meio].nome, paciente);
+        if (comparacao < 0 || (estrito && comparacao == 0)) inicio = meio + 1;
+        else fim = meio;
+    }
+    return inicio;
+}
+
+// Função para resolver as consultas ordenadas (A-Z) em um único percurso da lista
+// A lista está em ordem Z-A, então é percorrida de trás para frente a partir do fim
+void resolver_lote_lista(ListaDupla* lista, ConsultaLote* consultas, int quantidade) {
+    NoLista* atual = lista->fim;
+    int i = 0;
+
+    while (atual != NULL && i < quantidade) {
+        PREFETCH(atual->anterior);
+        ConsultaLote* consulta = &consultas[i];
+        int comparacao = comparar_busca(consulta->chave, consulta->nome, &atual->paciente);
+        if (comparacao == 0) {
+            if (consulta->aproximado == NULL) consulta->aproximado = &atual->paciente;
+            comparacao = strcmp(consulta->nome, atual->paciente.nome);
+        }
+
+        if (comparacao < 0) {
+            i++;
+        } else if (comparacao > 0) {
+            atual = atual->anterior;
+        } else {
+            consulta->encontrado = &atual->paciente;
+            i++; // O mesmo nó pode atender a um nome repetido na consulta
+        }
+    }
+}
+
+// Função para resolver as consultas ordenadas (A-Z) em um único percurso da lista desenrolada,
+// também de trás para frente, bloco a bloco
+void resolver_lote_blocos(ListaBlocos* lista, ConsultaLote* consultas, int quantidade) {
+    BlocoPacientes* bloco = lista->fim;
+    int posicao = bloco != NULL ? bloco->quantidade - 1 : 0;
+    int i = 0;
+
+    while (bloco != NULL && i < quantidade) {
+        Paciente* atual = &bloco->pacientes[posicao];
+        ConsultaLote* consulta = &consultas[i];
+        int comparacao = comparar_busca(consulta->chave, consulta->nome, atual);
+        if (comparacao == 0) {
+            if (consulta->aproximado == NULL) consulta->aproximado = atual;
+            comparacao = strcmp(consulta->nome, atual->nome);
+        }
+
+        if (comparacao < 0) {
+            i++;
+        } else if (comparacao > 0) {
+            if (--posicao < 0) {
+                bloco = bloco->anterior;
+                if (bloco != NULL) {
+                    PREFETCH(bloco->anterior);
+                    posicao = bloco->quantidade - 1;
+                }
+            }
+        } else {
+            consulta->encontrado = atual;
+            i++; // O mesmo paciente pode atender a um nome repetido na consulta
+        }
+    }
+}
+
+// Função para resolver as consultas[inicio, fim) (ordenadas) em uma descida em ordem pela árvore
+// Cada nó divide as consultas entre as subárvores; só se desce onde ainda há nomes pendentes
+void resolver_lote_avl(NoAVL* raiz, ConsultaLote* consultas, int inicio, int fim) {
+    while (raiz != NULL && inicio < fim) {
+        PREFETCH(raiz->esquerda);
+        PREFETCH(raiz->direita);
+
+        // Consultas iguais ao nó ignorando acentos e caixa ficam em [iguais, depois)
+        int iguais = limite_dobrado(consultas, inicio, fim, &raiz->paciente, 0);
+        int depois = limite_dobrado(consultas, iguais, fim, &raiz->paciente, 1);
+
+        int esquerda_fim = iguais;
+        int direita_inicio = depois;
+        for (int i = iguais; i < depois; i++) {
+            int comparacao = strcmp(consultas[i].nome, raiz->paciente.nome);
+            if (consultas[i].aproximado == NULL) consultas[i].aproximado = &raiz->paciente;
+            if (comparacao == 0) consultas[i].encontrado = &raiz->paciente;
+            if (comparacao < 0) esquerda_fim = i + 1;
+            if (comparacao > 0 && direita_inicio == depois) direita_inicio = i;
+        }
+
+        resolver_lote_avl(raiz->esquerda, consultas, inicio, esquerda_fim);
+        inicio = direita_inicio;
+        raiz = raiz->direita;
+    }
+}
+
+// Função para resolver as consultas no cadastro compartilhado, com uma descida por nome
+// (a trava de leitura fica com o lote inteiro)
+void resolver_lote_compartilhado(SegmentoCompartilhado* segmento, ConsultaLote* consultas, int quantidade) {
+    travar_leitura_segmento(segmento);
+    for (int i = 0; i < quantidade; i++) {
+        if (consultas[i].encontrado != NULL) continue;
+        Paciente* paciente = buscar_compartilhado(segmento, consultas[i].nome);
+        if (paciente == NULL) continue;
+        if (strcmp(consultas[i].nome, paciente->nome) == 0) consultas[i].encontrado = paciente;
+        else if (consultas[i].aproximado == NULL) consultas[i].aproximado = paciente;
+    }
+    destravar_segmento(segmento);
+}
+
+// Função para buscar vários nomes de uma vez: ordena as consultas e faz um único
+// percurso no cadastro de cada médico, gravando encontrados e ausentes em bloco
+void buscar_lote(Clinica* clinica, char** nomes, int quantidade, FILE* encontrados, FILE* ausentes) {
+    ConsultaLote* consultas = (ConsultaLote*)malloc((quantidade > 0 ? quantidade : 1) * sizeof(ConsultaLote));
+    if (consultas == NULL) {
+        printf("Erro ao alocar memória para a busca em lote.\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < quantidade; i++) {
+        consultas[i].nome = nomes[i];
+        consultas[i].chave = calcular_chave(nomes[i]);
+        consultas[i].encontrado = NULL;
+        consultas[i].aproximado = NULL;
+    }
+    qsort(consultas, quantidade, sizeof(ConsultaLote), comparar_consultas);
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_LISTA) resolver_lote_lista(registro->lista, consultas, quantidade);
+        else if (registro->motor == MOTOR_BLOCOS) resolver_lote_blocos(registro->blocos, consultas, quantidade);
+        else if (registro->motor == MOTOR_COMPARTILHADO) resolver_lote_compartilhado(registro->compartilhado, consultas, quantidade);
+        else if (registro->motor == MOTOR_DISCO) resolver_lote_disco(registro->disco, consultas, quantidade);
+        else resolver_lote_avl(registro->raiz, consultas, 0, quantidade);
+    }
+
+    for (int i = 0; i < quantidade; i++) {
+        Paciente* paciente = consultas[i].encontrado != NULL ? consultas[i].encontrado : consultas[i].aproximado;
+        if (paciente != NULL) {
+            fprintf(encontrados, "%s, %c, %s, %s\n", paciente->nome, paciente->sexo, paciente->nascimento, paciente->ultima_consulta);
+        } else {
+            fprintf(ausentes, "%s\n", consultas[i].nome);
+        }
+    }
+
+    free(consultas);
+}
+
+// Função para ler um arquivo com um nome por linha (se houver vírgula, usa só o primeiro campo)
+char** ler_nomes_arquivo(const char* nome_arquivo, int* quantidade) {
+    FILE* arquivo = fopen(nome_arquivo, "r");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo %s.\n", nome_arquivo);
+        return NULL;
+    }
+
+    int capacidade = 1024;
+    char** nomes = (char**)malloc(capacidade * sizeof(char*));
+    char* linha = NULL;
+    size_t tamanho_linha = 0;
+    *quantidade = 0;
+
+    while (nomes != NULL && getline(&linha, &tamanho_linha, arquivo) != -1) {
+        linha[strcspn(linha, "\r\n,")] = '\0';
+        if ((unsigned char)linha[0] == 0xEF && (unsigned char)linha[1] == 0xBB && (unsigned char)linha[2] == 0xBF) {
+            memmove(linha, linha + 3, strlen(linha) - 2);
+        }
+        limpar_string(linha);
+        if (linha[0] == '\0') continue;
+
+        if (*quantidade == capacidade) {
+            capacidade *= 2;
+            nomes = (char**)realloc(nomes, capacidade * sizeof(char*));
+            if (nomes == NULL) break;
+        }
+        size_t tamanho = strlen(linha) + 1;
+        nomes[*quantidade] = (char*)malloc(tamanho);
+        if (nomes[*quantidade] == NULL) break;
+        memcpy(nomes[(*quantidade)++], linha, tamanho);
+    }
+    free(linha);
+    fclose(arquivo);
+
+    if (nomes == NULL) {
+        printf("Erro ao alocar memória para os nomes.\n");
+        exit(1);
+    }
+    return nomes;
+}
+
+// Função para conciliar um arquivo de nomes com os cadastros
+// Resultados em conciliacao_encontrados.txt e conciliacao_ausentes.txt
+void conciliar_arquivo(Clinica* clinica, const char* nome_arquivo) {
+    materializar_clinica(clinica);
+    int quantidade;
+    char** nomes = ler_nomes_arquivo(nome_arquivo, &quantidade);
+    if (nomes == NULL) return;
+
+    FILE* encontrados = fopen("conciliacao_encontrados.txt", "w");
+    FILE* ausentes = fopen("conciliacao_ausentes.txt", "w");
+    if (encontrados == NULL || ausentes == NULL) {
+        printf("Erro ao abrir os arquivos da conciliação.\n");
+    } else {
+        // Buffers grandes para gravar os resultados em bloco
+        setvbuf(encontrados, NULL, _IOFBF, 1 << 16);
+        setvbuf(ausentes, NULL, _IOFBF, 1 << 16);
+        buscar_lote(clinica, nomes, quantidade, encontrados, ausentes);
+        printf("%d nomes conciliados: resultados em conciliacao_encontrados.txt e conciliacao_ausentes.txt.\n", quantidade);
+    }
+    if (encontrados != NULL) fclose(encontrados);
+    if (ausentes != NULL) fclose(ausentes);
+
+    for (int i = 0; i < quantidade; i++) free(nomes[i]);
+    free(nomes);
+}
+
+// Função para criar um histórico de consultas vazio
+HistoricoConsultas* criar_historico() {
+    HistoricoConsultas* historico = (HistoricoConsultas*)calloc(1, sizeof(HistoricoConsultas));
+    if (historico == NULL) {
+        printf("Erro ao alocar memória para o histórico de consultas.\n");
+        exit(1);
+    }
+    atomic_init(&historico->referencias, 1);
+    return historico;
+}
+
+// Função para acrescentar uma data ao histórico, mantendo a ordem
+// O caso comum (consulta mais recente que todas) só escreve no último bloco;
+// uma data antiga é inserida no seu bloco, que é dividido ao meio se estiver cheio
+// Retorna 0 se a data já estava no histórico
+int adicionar_data_historico(HistoricoConsultas* historico, int dia) {
+    BlocoConsultas* bloco = historico->primeiro;
+    if (historico->ultimo != NULL && dia > historico->ultimo->datas[historico->ultimo->quantidade - 1]) {
+        bloco = historico->ultimo;
+    } else {
+        // Primeiro bloco cuja última data alcança o dia
+        while (bloco != NULL && bloco->datas[bloco->quantidade - 1] < dia) bloco = bloco->proximo;
+    }
+
+    if (bloco == NULL) {
+        bloco = (BlocoConsultas*)calloc(1, sizeof(BlocoConsultas));
+        if (bloco == NULL) {
+            printf("Erro ao alocar memória para o histórico de consultas.\n");
+            exit(1);
+        }
+        if (historico->ultimo != NULL) historico->ultimo->proximo = bloco;
+        else historico->primeiro = bloco;
+        historico->ultimo = bloco;
+    }
+
+    int posicao = 0;
+    while (posicao < bloco->quantidade && bloco->datas[posicao] < dia) posicao++;
+    if (posicao < bloco->quantidade && bloco->datas[posicao] == dia) return 0;
+
+    if (bloco->quantidade == CONSULTAS_POR_BLOCO) {
+        BlocoConsultas* novo = (BlocoConsultas*)calloc(1, sizeof(BlocoConsultas));
+        if (novo == NULL) {
+            printf("Erro ao alocar memória para o histórico de consultas.\n");
+            exit(1);
+        }
+        // Bloco cheio no fim: abre um bloco novo; no meio: divide ao meio
+        int metade = posicao == CONSULTAS_POR_BLOCO ? CONSULTAS_POR_BLOCO : CONSULTAS_POR_BLOCO / 2;
+        novo->quantidade = CONSULTAS_POR_BLOCO - metade;
+        memcpy(novo->datas, bloco->datas + metade, novo->quantidade * sizeof(int));
+        bloco->quantidade = metade;
+        novo->proximo = bloco->proximo;
+        bloco->proximo = novo;
+        if (historico->ultimo == bloco) historico->ultimo = novo;
+        if (posicao >= metade) {
+            bloco = novo;
+            posicao -= metade;
+        }
+    }
+
+    memmove(bloco->datas + posicao + 1, bloco->datas + posicao, (bloco->quantidade - posicao) * sizeof(int));
+    bloco->datas[posicao] = dia;
+    bloco->quantidade++;
+    historico->total++;
+    return 1;
+}
+
+// Função para registrar uma consulta de um paciente
+// O histórico é criado na primeira consulta registrada, a partir da última consulta do cadastro,
+// e a última consulta passa a ser a data mais recente do histórico
+// Retorna 0 se a consulta já estava registrada
+int registrar_consulta(Paciente* paciente, int dia) {
+    if (paciente->historico == NULL) {
+        paciente->historico = criar_historico();
+        int ultima = data_para_dias(paciente->ultima_consulta);
+        if (ultima > 0) adicionar_data_historico(paciente->historico, ultima);
+    }
+    if (!adicionar_data_historico(paciente->historico, dia)) return 0;
+
+    BlocoConsultas* ultimo = paciente->historico->ultimo;
+    dias_para_data(ultimo->datas[ultimo->quantidade - 1], paciente->ultima_consulta);
+    return 1;
+}
+
+// Função para contar as consultas de um paciente entre dois dias (inclusive)
+// Blocos inteiros fora ou dentro do período são resolvidos pela primeira e última data
+int contar_consultas_periodo(const Paciente* paciente, int de, int ate) {
+    if (paciente->historico == NULL) {
+        int ultima = data_para_dias(paciente->ultima_consulta);
+        return ultima > 0 && ultima >= de && ultima <= ate;
+    }
+
+    int total = 0;
+    for (BlocoConsultas* bloco = paciente->historico->primeiro; bloco != NULL; bloco = bloco->proximo) {
+        if (bloco->datas[bloco->quantidade - 1] < de) continue;
+        if (bloco->datas[0] > ate) break;
+        if (bloco->datas[0] >= de && bloco->datas[bloco->quantidade - 1] <= ate) {
+            total += bloco->quantidade;
+            continue;
+        }
+        for (int i = 0; i < bloco->quantidade; i++) {
+            total += bloco->datas[i] >= de && bloco->datas[i] <= ate;
+        }
+    }
+    return total;
+}
+
+// Função para exibir as consultas de um paciente entre dois dias (inclusive)
+void listar_consultas_periodo(const Paciente* paciente, int de, int ate) {
+    char data[11];
+    if (paciente->historico == NULL) {
+        if (contar_consultas_periodo(paciente, de, ate) > 0) printf("  %s\n", paciente->ultima_consulta);
+        return;
+    }
+    for (BlocoConsultas* bloco = paciente->historico->primeiro; bloco != NULL; bloco = bloco->proximo) {
+        if (bloco->datas[bloco->quantidade - 1] < de) continue;
+        if (bloco->datas[0] > ate) break;
+        for (int i = 0; i < bloco->quantidade; i++) {
+            if (bloco->datas[i] < de || bloco->datas[i] > ate) continue;
+            dias_para_data(bloco->datas[i], data);
+            printf("  %s\n", data);
+        }
+    }
+}
+
+// Função para liberar uma referência ao histórico; a última libera os blocos
+void liberar_historico(HistoricoConsultas* historico) {
+    if (historico == NULL || atomic_fetch_sub(&historico->referencias, 1) != 1) return;
+    BlocoConsultas* bloco = historico->primeiro;
+    while (bloco != NULL) {
+        BlocoConsultas* proximo = bloco->proximo;
+        free(bloco);
+        bloco = proximo;
+    }
+    free(historico);
+}
+
+// Função para acrescentar uma referência ao histórico (mais um nó apontando para ele)
+HistoricoConsultas* reter_historico(HistoricoConsultas* historico) {
+    if (historico != NULL) atomic_fetch_add(&historico->referencias, 1);
+    return historico;
+}
+
+// Função para copiar um histórico que não pode ser alterado no lugar (motor persistente)
+HistoricoConsultas* copiar_historico(const HistoricoConsultas* historico) {
+    if (historico == NULL) return NULL;
+    HistoricoConsultas* copia = criar_historico();
+    BlocoConsultas** fim = &copia->primeiro;
+    for (BlocoConsultas* bloco = historico->primeiro; bloco != NULL; bloco = bloco->proximo) {
+        BlocoConsultas* novo = (BlocoConsultas*)malloc(sizeof(BlocoConsultas));
+        if (novo == NULL) {
+            printf("Erro ao alocar memória para o histórico de consultas.\n");
+            exit(1);
+        }
+        *novo = *bloco;
+        novo->proximo = NULL;
+        *fim = novo;
+        fim = &novo->proximo;
+        copia->ultimo = novo;
+    }
+    copia->total = historico->total;
+    return copia;
+}
+
+void exibir_paciente(Paciente* paciente) {
+    if (paciente != NULL) {
+        printf("Nome: %s\n", paciente->nome);
+        printf("Sexo: %c\n", paciente->sexo);
+        printf("Data de Nascimento: %s\n", paciente->nascimento);
+        printf("Última Consulta: %s\n", paciente->ultima_consulta);
+        if (paciente->historico != NULL) {
+            printf("Consultas registradas: %d\n", paciente->historico->total);
+        }
+
+        // Obter a data atual
+        char data_atual[11];
+        obter_data_atual(data_atual);
+
+        // Calcular a diferença em dias
+        int dias_desde_ultima_consulta = calcular_diferenca_dias(paciente->ultima_consulta, data_atual);
+
+        if (dias_desde_ultima_consulta >= 0) {
+            printf("Dias desde a última consulta: %d\n", dias_desde_ultima_consulta);
+        } else {
+            printf("Erro ao calcular a diferença de dias.\n");
+        }
+    } else {
+        printf("Paciente não encontrado.\n");
+    }
+}
+
+// Função para remover caracteres indesejados (aspas e < >)
+void limpar_string(char* str) {
+    int i, j = 0;
+    for (i = 0; str[i] != '\0'; i++) {
+        if (str[i] != '<' && str[i] != '>') {
+            str[j++] = str[i];
+        }
+    }
+    str[j] = '\0';
+}
+
+// Função para acrescentar um paciente ao lote, aumentando o vetor quando necessário
+void adicionar_lote(LotePacientes* lote, Paciente paciente) {
+    if (lote->quantidade == lote->capacidade) {
+        lote->capacidade = lote->capacidade > 0 ? lote->capacidade * 2 : 256;
+        lote->pacientes = (Paciente*)realloc(lote->pacientes, lote->capacidade * sizeof(Paciente));
+        if (lote->pacientes == NULL) {
+            printf("Erro ao alocar memória para o lote de pacientes.\n");
+            exit(1);
+        }
+    }
+    lote->pacientes[lote->quantidade++] = paciente;
+}
+
+// Função para liberar o vetor de um lote
+void liberar_lote(LotePacientes* lote) {
+    free(lote->pacientes);
+    lote->pacientes = NULL;
+    lote->quantidade = 0;
+    lote->capacidade = 0;
+}
+
+// Função para extrair os dados de um paciente de uma linha já limpa
+// O nome vai até a primeira vírgula, de qualquer tamanho, e só é guardado na arena se a linha for válida
+// Retorna 1 em caso de sucesso e 0 se a linha estiver mal formatada
+int interpretar_linha_paciente(char* linha, Paciente* paciente) {
+    paciente->historico = NULL;
+    char* virgula = strchr(linha, ',');
+    if (virgula == NULL || virgula == linha) return 0;
+    if (sscanf(virgula + 1, " %c, %10[^,], %10s", &paciente->sexo, paciente->nascimento, paciente->ultima_consulta) != 3) return 0;
+
+    *virgula = '\0';
+    paciente->nome = guardar_nome(linha);
+    *virgula = ',';
+    return 1;
+}
+
+// Função para tratar uma linha de um arquivo de pacientes de texto, já sem o '\n': as vazias são puladas
+// e a primeira perde o BOM; com a tabela de linhas (recarga), uma linha idêntica a uma já lida só é
+// marcada como vista. As demais são interpretadas
+// Retorna 1 se a linha trouxe um paciente
+int tratar_linha_paciente(char* linha, int primeira, TabelaLinhas* linhas, Paciente* paciente) {
+    // Verifica se a linha está vazia ou mal formatada
+    if (linha[0] == '\0' || linha[0] == '\r') {
+        return 0; // Ignora linhas vazias ou com apenas um carriage return
+    }
+
+    // Remove o BOM (Byte Order Mark) se presente na primeira linha
+    if (primeira && (unsigned char)linha[0] == 0xEF && (unsigned char)linha[1] == 0xBB && (unsigned char)linha[2] == 0xBF) {
+        memmove(linha, linha + 3, strlen(linha) - 2); // Remove os 3 primeiros bytes (BOM)
+    }
+
+    uint64_t hash = 0;
+    if (linhas != NULL) {
+        hash = hash_linha(linha, strlen(linha));
+        if (marcar_linha(linhas, hash)) return 0;
+    }
+
+    // Limpa caracteres indesejados (aspas e < >)
+    limpar_string(linha);
+
+    // Processa a linha para extrair os dados do paciente
+    if (interpretar_linha_paciente(linha, paciente)) {
+        if (linhas != NULL) adicionar_linha(linhas, hash, hash_linha_paciente(paciente), paciente->nome);
+        return 1;
+    }
+    printf("Erro ao processar a linha: %s\n", linha);
+    if (linhas != NULL) adicionar_linha(linhas, hash, 0, NULL);
+    return 0;
+}
+
+// Função para ler todos os pacientes de um arquivo TXT para um lote
+// Retorna 0 se o arquivo não puder ser aberto
+int ler_pacientes_arquivo(const char* nome_arquivo, LotePacientes* lote) {
+    FILE* arquivo = fopen(nome_arquivo, "rb");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo.\n");
+        return 0;
+    }
+
+    // Arquivo no formato compacto: decodifica direto para o lote
+    char assinatura[4];
+    int versao = fread(assinatura, 1, 4, arquivo) == 4 ? assinatura_compacta(assinatura) : 0;
+    if (versao > 0) {
+        if (lote->linhas != NULL) {
+            lote->linhas->texto = 0;
+            lote->linhas = NULL;
+        }
+        if (!ler_pacientes_compacto(arquivo, lote, versao > 1)) {
+            printf("Erro: arquivo compacto %s corrompido.\n", nome_arquivo);
+        }
+        fclose(arquivo);
+        return 1;
+    }
+    rewind(arquivo);
+    if (lote->linhas != NULL) lote->linhas->texto = 1;
+
+    char* linha = NULL; // Aumentado pelo getline conforme o tamanho das linhas
+    size_t capacidade = 0;
+    int primeira_linha = 1; // Flag para verificar se é a primeira linha
+
+    while (getline(&linha, &capacidade, arquivo) != -1) {
+        // Remove o caractere de nova linha (\n) do final da linha, se existir
+        linha[strcspn(linha, "\n")] = '\0';
+        int vazia = linha[0] == '\0' || linha[0] == '\r';
+
+        Paciente paciente;
+        if (tratar_linha_paciente(linha, primeira_linha, lote->linhas, &paciente)) adicionar_lote(lote, paciente);
+        if (!vazia) primeira_linha = 0; // Marca que a primeira linha já foi processada
+    }
+
+    free(linha);
+    fclose(arquivo);
+    return 1;
+}
+
+// Função de tarefa: insere no cadastro de um médico o seu pedaço do lote
+void tarefa_inserir_lote(void* argumento) {
+    TarefaLote* tarefa = (TarefaLote*)argumento;
+    registro_inserir_lote(tarefa->registro, tarefa->lote.pacientes, tarefa->lote.quantidade, &tarefa->conflitos);
+}
+
+// Função para distribuir um lote de pacientes: cada paciente vai para o médico indicado pela regra
+// e cada cadastro recebe o seu grupo de uma vez, em paralelo com os demais
+// As tarefas (uma por médico) podem servir a vários lotes seguidos: os conflitos se acumulam nelas
+// Retorna o número de pacientes que não se encaixam em nenhum médico
+int distribuir_lote(Clinica* clinica, LotePacientes* lote, TarefaLote* tarefas) {
+    int sem_medico = 0;
+    for (int i = 0; i < lote->quantidade; i++) {
+        int indice = rotear_paciente(clinica, &lote->pacientes[i]);
+        if (indice < 0) {
+            sem_medico++;
+            continue;
+        }
+        adicionar_lote(&tarefas[indice].lote, lote->pacientes[i]);
+    }
+
+    iniciar_escrita(clinica);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        tarefas[i].registro = &clinica->registros[i];
+        if (tarefas[i].lote.quantidade > 0) pool_submeter(clinica->pool, tarefa_inserir_lote, &tarefas[i]);
+    }
+    pool_aguardar(clinica->pool);
+    terminar_escrita(clinica);
+
+    // O vetor de cada tarefa fica para o próximo lote
+    for (int i = 0; i < clinica->quantidade; i++) tarefas[i].lote.quantidade = 0;
+    return sem_medico;
+}
+
+// Função para exibir os conflitos acumulados nas tarefas de inserção e liberá-las
+void concluir_tarefas_lote(Clinica* clinica, TarefaLote* tarefas, int sem_medico) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        exibir_conflitos(&tarefas[i].conflitos);
+        liberar_lote(&tarefas[i].lote);
+    }
+    if (sem_medico > 0) {
+        printf("Erro: %d paciente(s) não se encaixam em nenhum médico e foram ignorados.\n", sem_medico);
+    }
+    free(tarefas);
+}
+
+// Função para inserir um lote de pacientes nos cadastros dos médicos
+void inserir_lote(Clinica* clinica, LotePacientes* lote) {
+    TarefaLote* tarefas = (TarefaLote*)calloc(clinica->quantidade, sizeof(TarefaLote));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para a inserção em lote.\n");
+        exit(1);
+    }
+    concluir_tarefas_lote(clinica, tarefas, distribuir_lote(clinica, lote, tarefas));
+}
+
+// Função para importar um arquivo de pacientes para os cadastros já carregados
+void importar_pacientes(Clinica* clinica, const char* nome_arquivo) {
+    materializar_clinica(clinica);
+    LotePacientes lote = {NULL, 0, 0, NULL};
+    iniciar_internacao_nomes();
+    if (ler_pacientes_arquivo(nome_arquivo, &lote)) {
+        inserir_lote(clinica, &lote);
+        printf("%d pacientes lidos de %s.\n", lote.quantidade, nome_arquivo);
+        auditar(clinica->auditoria, EVENTO_IMPORTACAO, "", nome_arquivo);
+    }
+    terminar_internacao_nomes();
+    liberar_lote(&lote);
+}
+
+// Função para converter uma data "dd/mm/aaaa" em um inteiro aaaammdd, comparável diretamente
+// Retorna 0 para datas mal formatadas
+int data_ordenavel(const char* data) {
+    int dia, mes, ano;
+    if (sscanf(data, "%d/%d/%d", &dia, &mes, &ano) != 3) return 0;
+    return ano * 10000 + mes * 100 + dia;
+}
+
+// Função para deixar os pacientes de um arquivo em ordem A-Z
+// Arquivos já ordenados (A-Z, ou Z-A como os salvos do Moisés) não passam pelo qsort
+void ordenar_fluxo(FluxoPacientes* fluxo) {
+    Paciente* pacientes = fluxo->lote.pacientes;
+    int quantidade = fluxo->lote.quantidade;
+    int crescente = 1, decrescente = 1;
+
+    for (int i = 0; i < quantidade; i++) {
+        pacientes[i].chave = calcular_chave(pacientes[i].nome);
+        if (i > 0) {
+            int comparacao = comparar_pacientes(&pacientes[i - 1], &pacientes[i]);
+            if (comparacao > 0) crescente = 0;
+            if (comparacao <= 0) decrescente = 0;
+        }
+    }
+
+    if (crescente) return;
+    if (decrescente) {
+        for (int i = 0, j = quantidade - 1; i < j; i++, j--) {
+            Paciente temporario = pacientes[i];
+            pacientes[i] = pacientes[j];
+            pacientes[j] = temporario;
+        }
+        return;
+    }
+    qsort(pacientes, quantidade, sizeof(Paciente), comparar_pacientes_crescente);
+}
+
+// Função para descobrir, com uma leitura rápida só dos nomes, se um arquivo de texto já está em ordem
+// A-Z (1) ou Z-A sem nomes repetidos (-1); a leitura para assim que o arquivo sai das duas ordens (0)
+// Linhas mal formatadas também contam, o que só pode fazer um arquivo parecer fora de ordem
+// O arquivo volta ao início
+int ordem_arquivo(FILE* arquivo) {
+    char* linha = NULL;
+    char* anterior = NULL;
+    size_t capacidade = 0, capacidade_anterior = 0;
+    Paciente atual, ultimo;
+    int lidos = 0, crescente = 1, decrescente = 1;
+
+    while ((crescente || decrescente) && getline(&linha, &capacidade, arquivo) != -1) {
+        linha[strcspn(linha, "\n")] = '\0';
+        char* nome = linha;
+        if ((unsigned char)nome[0] == 0xEF && (unsigned char)nome[1] == 0xBB && (unsigned char)nome[2] == 0xBF) nome += 3;
+        limpar_string(nome);
+        char* virgula = strchr(nome, ',');
+        if (virgula == NULL || virgula == nome) continue;
+        *virgula = '\0';
+
+        atual.nome = nome;
+        atual.chave = calcular_chave(nome);
+        if (lidos++ > 0) {
+            int comparacao = comparar_pacientes(&ultimo, &atual);
+            if (comparacao > 0) crescente = 0;
+            if (comparacao <= 0) decrescente = 0;
+        }
+        // O nome atual fica no buffer que a próxima linha não usa
+        ultimo = atual;
+        char* troca = linha;
+        linha = anterior;
+        anterior = troca;
+        size_t troca_capacidade = capacidade;
+        capacidade = capacidade_anterior;
+        capacidade_anterior = troca_capacidade;
+    }
+    free(linha);
+    free(anterior);
+    rewind(arquivo);
+    return crescente ? 1 : decrescente ? -1 : 0;
+}
+
+// Função para ler a linha anterior de um arquivo lido do fim para o início (sem o '\n')
+// O buffer guarda o trecho já lido e ainda não entregue; sem o começo da linha nele, o bloco anterior
+// do arquivo é lido para a frente do trecho. Em *primeira fica se a linha é a do início do arquivo
+// Retorna NULL depois dela; a linha vale até a próxima chamada
+char* ler_linha_reversa(FluxoPacientes* fluxo, int* primeira) {
+    if (fluxo->restante < 0) return NULL;
+    for (;;) {
+        size_t inicio = fluxo->pendentes;
+        while (inicio > 0 && fluxo->linha[inicio - 1] != '\n') inicio--;
+        if (inicio > 0 || fluxo->restante == 0) {
+            fluxo->linha[fluxo->pendentes] = '\0';
+            *primeira = inicio == 0;
+            if (inicio == 0) fluxo->restante = -1;
+            else fluxo->pendentes = inicio - 1; // O '\n' termina a linha anterior
+            return fluxo->linha + inicio;
+        }
+
+        size_t bloco = fluxo->restante < BLOCO_LEITURA_REVERSA ? (size_t)fluxo->restante : BLOCO_LEITURA_REVERSA;
+        if (fluxo->pendentes + bloco + 1 > fluxo->capacidade) {
+            size_t capacidade = fluxo->capacidade > 0 ? fluxo->capacidade * 2 : 2 * BLOCO_LEITURA_REVERSA;
+            while (fluxo->pendentes + bloco + 1 > capacidade) capacidade *= 2;
+            fluxo->linha = (char*)realloc(fluxo->linha, capacidade);
+            if (fluxo->linha == NULL) {
+                printf("Erro ao alocar memória para a leitura dos arquivos.\n");
+                exit(1);
+            }
+            fluxo->capacidade = capacidade;
+        }
+        memmove(fluxo->linha + bloco, fluxo->linha, fluxo->pendentes);
+        fluxo->restante -= (long)bloco;
+        if (fseek(fluxo->arquivo, fluxo->restante, SEEK_SET) != 0 || fread(fluxo->linha, 1, bloco, fluxo->arquivo) != bloco) {
+            printf("Erro ao ler o arquivo de pacientes.\n");
+            fluxo->restante = -1;
+            return NULL;
+        }
+        fluxo->pendentes += bloco;
+    }
+}
+
+// Função para abrir um arquivo para a intercalação, deixando em 'atual' o seu primeiro paciente (A-Z)
+// Arquivos de texto em ordem são lidos aos poucos; os fora de ordem e os compactos, inteiros
+// Retorna 0 se o arquivo não puder ser aberto ou não tiver pacientes
+int abrir_fluxo(FluxoPacientes* fluxo, const char* nome_arquivo) {
+    FILE* arquivo = fopen(nome_arquivo, "rb");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo.\n");
+        return 0;
+    }
+    char assinatura[4];
+    int compacto = fread(assinatura, 1, 4, arquivo) == 4 && assinatura_compacta(assinatura) > 0;
+    rewind(arquivo);
+    int ordem = compacto ? 0 : ordem_arquivo(arquivo);
+
+    if (ordem == 0) {
+        fclose(arquivo);
+        fluxo->lote.linhas = fluxo->linhas;
+        if (!ler_pacientes_arquivo(nome_arquivo, &fluxo->lote)) return 0;
+        ordenar_fluxo(fluxo);
+        return avancar_fluxo(fluxo);
+    }
+
+    fluxo->arquivo = arquivo;
+    fluxo->reverso = ordem < 0;
+    fluxo->primeira = 1;
+    if (fluxo->linhas != NULL) fluxo->linhas->texto = 1;
+    if (fluxo->reverso) {
+        // O '\n' do fim do arquivo não abre uma linha vazia
+        fseek(arquivo, 0, SEEK_END);
+        fluxo->restante = ftell(arquivo);
+        if (fluxo->restante > 0 && fseek(arquivo, fluxo->restante - 1, SEEK_SET) == 0 && fgetc(arquivo) == '\n') {
+            fluxo->restante--;
+        }
+    }
+    return avancar_fluxo(fluxo);
+}
+
+// Função para trazer para 'atual' o próximo paciente (A-Z) de um arquivo; retorna 0 no fim dele
+int avancar_fluxo(FluxoPacientes* fluxo) {
+    if (fluxo->arquivo == NULL) {
+        if (fluxo->posicao == fluxo->lote.quantidade) return 0;
+        fluxo->atual = fluxo->lote.pacientes[fluxo->posicao++];
+        return 1;
+    }
+    for (;;) {
+        char* linha;
+        int primeira;
+        if (fluxo->reverso) {
+            linha = ler_linha_reversa(fluxo, &primeira);
+            if (linha == NULL) return 0;
+        } else {
+            if (getline(&fluxo->linha, &fluxo->capacidade, fluxo->arquivo) == -1) return 0;
+            linha = fluxo->linha;
+            linha[strcspn(linha, "\n")] = '\0';
+            primeira = fluxo->primeira;
+            if (linha[0] != '\0' && linha[0] != '\r') fluxo->primeira = 0;
+        }
+        if (tratar_linha_paciente(linha, primeira, fluxo->linhas, &fluxo->atual)) {
+            fluxo->atual.chave = calcular_chave(fluxo->atual.nome);
+            return 1;
+        }
+    }
+}
+
+// Função para fechar um arquivo da intercalação e liberar a sua memória
+void fechar_fluxo(FluxoPacientes* fluxo) {
+    if (fluxo->arquivo != NULL) fclose(fluxo->arquivo);
+    fluxo->arquivo = NULL;
+    free(fluxo->linha);
+    fluxo->linha = NULL;
+    liberar_lote(&fluxo->lote);
+}
+
+// Função para comparar o próximo paciente de dois arquivos na intercalação
+// Empates de nome ficam com o arquivo informado primeiro, para a ordem ser estável
+int comparar_fluxos(FluxoPacientes* fluxos, int a, int b) {
+    int comparacao = comparar_pacientes(&fluxos[a].atual, &fluxos[b].atual);
+    if (comparacao != 0) return comparacao;
+    return a - b;
+}
+
+// Função para restaurar o heap mínimo de arquivos a partir da posição i
+void descer_heap_fluxos(FluxoPacientes* fluxos, int* heap, int tamanho, int i) {
+    while (1) {
+        int menor = i;
+        int esquerda = 2 * i + 1;
+        int direita = 2 * i + 2;
+        if (esquerda < tamanho && comparar_fluxos(fluxos, heap[esquerda], heap[menor]) < 0) menor = esquerda;
+        if (direita < tamanho && comparar_fluxos(fluxos, heap[direita], heap[menor]) < 0) menor = direita;
+        if (menor == i) return;
+        int temporario = heap[i];
+        heap[i] = heap[menor];
+        heap[menor] = temporario;
+        i = menor;
+    }
+}
+
+// Função para saber se um paciente da carga não tem onde ficar: com todos os cadastros em disco, um nome
+// longo demais para as árvores sairia do arquivo de pacientes no próximo salvamento
+int paciente_sem_lugar(Clinica* clinica, const Paciente* paciente) {
+    if (strlen(paciente->nome) <= MAIOR_NOME_DISCO || rotear_paciente(clinica, paciente) >= 0) return 0;
+    int atendido = 0;
+    for (int j = 0; j < clinica->quantidade && !atendido; j++) atendido = medico_atende(clinica, j, paciente);
+    if (!atendido) return 0;
+    printf("Erro: o nome '%.40s...' passa de %d bytes, o maior aceito pelo cadastro em disco, e nenhum cadastro "
+           "em memória pode recebê-lo.\n", paciente->nome, MAIOR_NOME_DISCO);
+    return 1;
+}
+
+// Função para carregar vários arquivos de pacientes com uma intercalação de k vias por nome
+// Cada arquivo é lido em sequência (depois de uma passada que só confere a ordem dos nomes), e só os
+// que estão fora de ordem ficam inteiros na memória; os pacientes intercalados seguem para os cadastros
+// a cada LOTE_CARGA, então a carga não guarda uma cópia dos arquivos
+// Se o mesmo nome aparece em mais de um arquivo, fica o registro com a última consulta mais recente
+// (e o nome é guardado uma vez só); repetido dentro de um mesmo arquivo, o nome vai para o relatório de
+// conflitos e fica um registro só, como em qualquer inserção (nos arquivos lidos em ordem, o primeiro)
+void carregar_pacientes_multiplos(Clinica* clinica, char** arquivos, int quantidade) {
+    FluxoPacientes* fluxos = (FluxoPacientes*)calloc(quantidade, sizeof(FluxoPacientes));
+    int* heap = (int*)malloc(quantidade * sizeof(int));
+    TarefaLote* tarefas = (TarefaLote*)calloc(clinica->quantidade, sizeof(TarefaLote));
+    if (fluxos == NULL || heap == NULL || tarefas == NULL) {
+        printf("Erro ao alocar memória para a leitura dos arquivos.\n");
+        exit(1);
+    }
+
+    // Com a recarga ligada (um único arquivo), as linhas lidas formam a primeira versão de referência
+    if (quantidade == 1 && clinica->recarga != NULL) fluxos[0].linhas = &clinica->recarga->base;
+
+    int tamanho = 0;
+    iniciar_internacao_nomes();
+    for (int i = 0; i < quantidade; i++) {
+        if (abrir_fluxo(&fluxos[i], arquivos[i])) heap[tamanho++] = i;
+        else fechar_fluxo(&fluxos[i]);
+    }
+    for (int i = tamanho / 2 - 1; i >= 0; i--) {
+        descer_heap_fluxos(fluxos, heap, tamanho, i);
+    }
+
+    // O último paciente intercalado espera o próximo: um nome repetido ainda pode trocá-lo
+    LotePacientes saida = {NULL, 0, 0, NULL};
+    RelatorioConflitos repetidos_arquivo = {NULL, 0, 0};
+    Paciente pendente;
+    int origem = -1; // Arquivo do paciente pendente (-1 antes do primeiro)
+    int carregados = 0, repetidos = 0, sem_lugar = 0, sem_medico = 0;
+    while (tamanho > 0 || origem >= 0) {
+        Paciente* paciente = tamanho > 0 ? &fluxos[heap[0]].atual : NULL;
+        if (paciente != NULL && origem >= 0 && comparar_pacientes(&pendente, paciente) == 0) {
+            if (origem == heap[0]) {
+                registrar_conflito(&repetidos_arquivo, paciente->nome);
+            } else {
+                if (data_ordenavel(paciente->ultima_consulta) > data_ordenavel(pendente.ultima_consulta)) {
+                    pendente = *paciente;
+                    origem = heap[0];
+                }
+                repetidos++;
+            }
+        } else {
+            if (origem >= 0) {
+                sem_lugar += paciente_sem_lugar(clinica, &pendente);
+                adicionar_lote(&saida, pendente);
+                carregados++;
+            }
+            if (saida.quantidade == LOTE_CARGA || (paciente == NULL && saida.quantidade > 0)) {
+                sem_medico += distribuir_lote(clinica, &saida, tarefas);
+                saida.quantidade = 0;
+            }
+            if (paciente == NULL) break;
+            pendente = *paciente;
+            origem = heap[0];
+        }
+
+        // Avança no arquivo; quando ele acaba, sai do heap e a memória é liberada
+        if (!avancar_fluxo(&fluxos[heap[0]])) {
+            fechar_fluxo(&fluxos[heap[0]]);
+            heap[0] = heap[--tamanho];
+        }
+        descer_heap_fluxos(fluxos, heap, tamanho, 0);
+    }
+    terminar_internacao_nomes();
+
+    exibir_conflitos(&repetidos_arquivo);
+    concluir_tarefas_lote(clinica, tarefas, sem_medico - sem_lugar); // Os sem lugar já foram informados
+    if (sem_lugar > 0) {
+        printf("A clínica não será aberta, para que esses pacientes não saiam do arquivo de pacientes: configure um médico "
+               "com outro motor para esses %d nome(s).\n", sem_lugar);
+        exit(1);
+    }
+    if (quantidade > 1) {
+        printf("%d pacientes carregados de %d arquivos (%d registros repetidos resolvidos pela consulta mais recente).\n",
+               carregados, quantidade, repetidos);
+    }
+
+    liberar_lote(&saida);
+    free(heap);
+    free(fluxos);
+}
+
+// Função para carregar os pacientes do arquivo TXT
+void carregar_pacientes(Clinica* clinica, char* nome_arquivo) {
+    carregar_pacientes_multiplos(clinica, &nome_arquivo, 1);
+}
+
+// Função para calcular o hash FNV-1a do nome dobrado (sem acentos e em maiúsculas)
+// Grafias com e sem acento têm o mesmo hash; o resultado nunca é 0
+uint64_t hash_nome_dobrado(const char* nome) {
+    const unsigned char* p = (const unsigned char*)nome;
+    uint64_t hash = 14695981039346656037ULL;
+    int c;
+    while ((c = dobrar_caractere(&p)) != 0) {
+        hash = (hash ^ (uint64_t)c) * 1099511628211ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Função para abrir os arquivos no modo preguiçoso: mapeia cada arquivo e indexa só o nome
+// de cada linha; os demais campos ficam para quando o paciente for consultado
+// Retorna 0 se algum arquivo não puder ser indexado (a clínica deve então ser carregada por completo)
+int indexar_preguicoso(Clinica* clinica, char** arquivos, int quantidade) {
+    double inicio = milissegundos_agora();
+    IndicePreguicoso* indice = (IndicePreguicoso*)calloc(1, sizeof(IndicePreguicoso));
+    if (indice == NULL) {
+        printf("Erro ao alocar memória para o índice.\n");
+        exit(1);
+    }
+    indice->nomes_arquivos = arquivos;
+    indice->num_arquivos = quantidade;
+    indice->dados = (char**)calloc(quantidade, sizeof(char*));
+    indice->tamanhos = (size_t*)calloc(quantidade, sizeof(size_t));
+    if (indice->dados == NULL || indice->tamanhos == NULL) {
+        printf("Erro ao alocar memória para o índice.\n");
+        exit(1);
+    }
+
+    // Mapeia os arquivos e conta as linhas para dimensionar a tabela de uma vez
+    size_t linhas = 0;
+    for (int i = 0; i < quantidade; i++) {
+        int descritor = open(arquivos[i], O_RDONLY);
+        struct stat informacoes;
+        if (descritor < 0 || fstat(descritor, &informacoes) != 0) {
+            if (descritor >= 0) close(descritor);
+            liberar_preguicoso(indice);
+            return 0;
+        }
+        indice->tamanhos[i] = (size_t)informacoes.st_size;
+        if (indice->tamanhos[i] > 0) {
+            void* dados = mmap(NULL, indice->tamanhos[i], PROT_READ, MAP_PRIVATE, descritor, 0);
+            if (dados == MAP_FAILED) {
+                close(descritor);
+                liberar_preguicoso(indice);
+                return 0;
+            }
+            indice->dados[i] = (char*)dados;
+        }
+        close(descritor);
+
+        // Arquivo compacto não tem linhas para indexar
+        if (indice->tamanhos[i] >= 4 && assinatura_compacta(indice->dados[i]) > 0) {
+            liberar_preguicoso(indice);
+            return 0;
+        }
+        madvise(indice->dados[i], indice->tamanhos[i], MADV_SEQUENTIAL);
+        for (const char* p = indice->dados[i]; p != NULL && p < indice->dados[i] + indice->tamanhos[i]; p++) {
+            p = memchr(p, '\n', indice->dados[i] + indice->tamanhos[i] - p);
+            linhas++;
+            if (p == NULL) break;
+        }
+    }
+
+    indice->capacidade = 16;
+    while (indice->capacidade < linhas * 2) indice->capacidade *= 2;
+    indice->tabela = (EntradaIndice*)calloc(indice->capacidade, sizeof(EntradaIndice));
+    if (indice->tabela == NULL) {
+        printf("Erro ao alocar memória para o índice.\n");
+        exit(1);
+    }
+
+    char* nome = NULL; // Aumentado conforme o tamanho das linhas
+    size_t capacidade_nome = 0;
+    for (int i = 0; i < quantidade; i++) {
+        const char* dados = indice->dados[i];
+        const char* fim = dados + indice->tamanhos[i];
+        const char* linha = dados;
+
+        // Pula o BOM no início do arquivo
+        if (fim - linha >= 3 && memcmp(linha, "\xEF\xBB\xBF", 3) == 0) linha += 3;
+
+        while (linha < fim) {
+            const char* fim_linha = memchr(linha, '\n', fim - linha);
+            if (fim_linha == NULL) fim_linha = fim;
+
+            // Copia o nome até a primeira vírgula, sem os caracteres < e >
+            if ((size_t)(fim_linha - linha) >= capacidade_nome) {
+                capacidade_nome = (size_t)(fim_linha - linha) + 64;
+                nome = (char*)realloc(nome, capacidade_nome);
+                if (nome == NULL) {
+                    printf("Erro ao alocar memória para o índice.\n");
+                    exit(1);
+                }
+            }
+            size_t tamanho = 0;
+            const char* p = linha;
+            while (p < fim_linha && *p != ',') {
+                if (*p != '<' && *p != '>') nome[tamanho++] = *p;
+                p++;
+            }
+            nome[tamanho] = '\0';
+
+            // Linhas vazias ou sem vírgula não são indexadas
+            if (p < fim_linha && tamanho > 0) {
+                uint64_t hash = hash_nome_dobrado(nome);
+                size_t posicao = hash & (indice->capacidade - 1);
+                while (indice->tabela[posicao].hash != 0) posicao = (posicao + 1) & (indice->capacidade - 1);
+                indice->tabela[posicao].hash = hash;
+                indice->tabela[posicao].deslocamento = (size_t)(linha - dados);
+                indice->tabela[posicao].arquivo = i;
+                indice->quantidade++;
+            }
+            linha = fim_linha + 1;
+        }
+        madvise(indice->dados[i], indice->tamanhos[i], MADV_RANDOM);
+    }
+    free(nome);
+
+    clinica->preguicoso = indice;
+    printf("Modo preguiçoso: %zu pacientes indexados em %.1f ms (carregamento completo só quando necessário).\n",
+           indice->quantidade, milissegundos_agora() - inicio);
+    return 1;
+}
+
+// Função para interpretar a linha de uma entrada do índice na primeira vez em que ela é consultada
+// Retorna NULL se a linha estiver mal formatada
+Paciente* materializar_entrada(IndicePreguicoso* indice, EntradaIndice* entrada) {
+    if (entrada->paciente != NULL) return entrada->paciente;
+
+    const char* dados = indice->dados[entrada->arquivo];
+    size_t restante = indice->tamanhos[entrada->arquivo] - entrada->deslocamento;
+    const char* inicio = dados + entrada->deslocamento;
+    const char* fim_linha = memchr(inicio, '\n', restante);
+    size_t tamanho = fim_linha != NULL ? (size_t)(fim_linha - inicio) : restante;
+
+    char* linha = (char*)malloc(tamanho + 1);
+    if (linha == NULL) {
+        printf("Erro ao alocar memória para o paciente.\n");
+        exit(1);
+    }
+    memcpy(linha, inicio, tamanho);
+    linha[tamanho] = '\0';
+    limpar_string(linha);
+
+    Paciente paciente;
+    int valida = interpretar_linha_paciente(linha, &paciente);
+    free(linha);
+    if (!valida) return NULL;
+    paciente.chave = calcular_chave(paciente.nome);
+
+    entrada->paciente = (Paciente*)malloc(sizeof(Paciente));
+    if (entrada->paciente == NULL) {
+        printf("Erro ao alocar memória para o paciente.\n");
+        exit(1);
+    }
+    *entrada->paciente = paciente;
+    indice->materializados++;
+    return entrada->paciente;
+}
+
+// Função para buscar um paciente no índice preguiçoso, ignorando acentos e caixa
+// Um nome idêntico tem preferência; entre linhas repetidas fica a consulta mais recente,
+// como no carregamento completo
+Paciente* buscar_preguicoso(IndicePreguicoso* indice, const char* nome) {
+    uint64_t hash = hash_nome_dobrado(nome);
+    uint64_t chave = calcular_chave(nome);
+    Paciente* resultado = NULL;
+
+    size_t posicao = hash & (indice->capacidade - 1);
+    for (; indice->tabela[posicao].hash != 0; posicao = (posicao + 1) & (indice->capacidade - 1)) {
+        if (indice->tabela[posicao].hash != hash) continue;
+        Paciente* paciente = materializar_entrada(indice, &indice->tabela[posicao]);
+        if (paciente == NULL || paciente->chave != chave || comparar_dobrado(paciente->nome, nome) != 0) continue;
+
+        if (resultado == NULL) {
+            resultado = paciente;
+            continue;
+        }
+        int exato = strcmp(paciente->nome, nome) == 0;
+        int exato_resultado = strcmp(resultado->nome, nome) == 0;
+        if (exato && !exato_resultado) {
+            resultado = paciente;
+        } else if (exato == exato_resultado && strcmp(paciente->nome, resultado->nome) == 0 &&
+                   data_ordenavel(paciente->ultima_consulta) > data_ordenavel(resultado->ultima_consulta)) {
+            resultado = paciente;
+        }
+    }
+    return resultado;
+}
+
+// Função para liberar o índice preguiçoso e desfazer o mapeamento dos arquivos
+void liberar_preguicoso(IndicePreguicoso* indice) {
+    if (indice->tabela != NULL) {
+        for (size_t i = 0; i < indice->capacidade; i++) free(indice->tabela[i].paciente);
+        free(indice->tabela);
+    }
+    for (int i = 0; i < indice->num_arquivos; i++) {
+        if (indice->dados[i] != NULL) munmap(indice->dados[i], indice->tamanhos[i]);
+    }
+    free(indice->dados);
+    free(indice->tamanhos);
+    free(indice);
+}
+
+// Função para sair do modo preguiçoso: carrega todos os pacientes nos cadastros dos médicos
+// Chamada antes de qualquer operação que precise de todos os pacientes (listagens, alterações, salvamentos)
+void materializar_clinica(Clinica* clinica) {
+    IndicePreguicoso* indice = clinica->preguicoso;
+    if (indice == NULL) return;
+
+    printf("Carregando todos os pacientes (%d de %zu já consultados)...\n", indice->materializados, indice->quantidade);
+    clinica->preguicoso = NULL;
+    carregar_pacientes_multiplos(clinica, indice->nomes_arquivos, indice->num_arquivos);
+    carregar_historicos(clinica, ARQUIVO_HISTORICO);
+    concluir_carregamento(clinica);
+    liberar_preguicoso(indice);
+}
+
+// Função para ler um texto digitado até o fim da linha, de qualquer tamanho, pulando os espaços
+// do início como o scanf(" %[^\n]"); o texto (vazio no fim da entrada) deve ser liberado por quem chamou
+char* ler_texto_digitado() {
+    size_t capacidade = 64, tamanho = 0;
+    char* texto = (char*)malloc(capacidade);
+    if (texto == NULL) {
+        printf("Erro ao alocar memória para o texto digitado.\n");
+        exit(1);
+    }
+
+    int c;
+    do {
+        c = getchar();
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+    while (c != EOF && c != '\n') {
+        if (tamanho + 1 == capacidade) {
+            capacidade *= 2;
+            texto = (char*)realloc(texto, capacidade);
+            if (texto == NULL) {
+                printf("Erro ao alocar memória para o texto digitado.\n");
+                exit(1);
+            }
+        }
+        texto[tamanho++] = (char)c;
+        c = getchar();
+    }
+    texto[tamanho] = '\0';
+    return texto;
+}
+
+// Função para criar um paciente 
+void cadastrar_paciente(Clinica* clinica) {
+    materializar_clinica(clinica);
+
+    Paciente paciente;
+    paciente.historico = NULL;
+    char sexo;
+
+    printf("Digite o nome do paciente: ");
+    char* nome = ler_texto_digitado();
+
+    printf("Digite o sexo do paciente (M/F): ");
+    scanf(" %c", &sexo);
+    paciente.sexo = sexo;
+
+    printf("Digite a data de nascimento (dd/mm/aaaa): ");
+    scanf(" %10s", paciente.nascimento);
+
+    printf("Digite a data da última consulta (dd/mm/aaaa): ");
+    scanf(" %10s", paciente.ultima_consulta);
+
+    if (sexo != 'M' && sexo != 'F') {
+        printf("Sexo inválido. Use 'M' para masculino ou 'F' para feminino.\n");
+        free(nome);
+        return;
+    }
+    paciente.nome = guardar_nome(nome);
+    free(nome);
+
+    iniciar_escrita(clinica);
+    int indice = rotear_paciente(clinica, &paciente);
+    if (indice < 0) {
+        printf("Nenhum médico atende este paciente.\n");
+    } else if (registro_inserir(&clinica->registros[indice], paciente)) {
+        printf("Paciente cadastrado com %s.\n", clinica->registros[indice].medico);
+        auditar(clinica->auditoria, EVENTO_CADASTRO, clinica->registros[indice].medico, paciente.nome);
+    }
+    terminar_escrita(clinica);
+}
+
+// Função para gravar as alterações de um paciente (nome_atual é o nome antes da alteração)
+// Retorna o novo endereço do paciente, ou NULL se a alteração foi recusada
+Paciente* atualizar_paciente(Clinica* clinica, Registro** registro, Paciente* paciente, const char* nome_atual, Paciente alterado) {
+    iniciar_escrita(clinica);
+    Paciente* resultado = NULL;
+    paciente = revalidar_paciente(*registro, paciente, nome_atual);
+    if (paciente != NULL) resultado = aplicar_alteracao(clinica, registro, paciente, alterado);
+    terminar_escrita(clinica);
+    return resultado;
+}
+
+// Função que aplica a alteração com a clínica já travada
+// Se o nome ou o sexo mudarem, o paciente é reposicionado (e pode trocar de médico)
+Paciente* aplicar_alteracao(Clinica* clinica, Registro** registro, Paciente* paciente, Paciente alterado) {
+    int destino = rotear_paciente(clinica, &alterado);
+    if (destino < 0) {
+        printf("Nenhum médico atende este paciente.\n");
+        return NULL;
+    }
+
+    Registro* novo_registro = &clinica->registros[destino];
+    if (novo_registro == *registro && strcmp(alterado.nome, paciente->nome) == 0) {
+        // A posição não muda: basta atualizar os dados
+        return registro_atualizar(novo_registro, paciente, alterado);
+    }
+
+    Paciente* existente = registro_buscar(novo_registro, alterado.nome);
+    if (existente != NULL && existente != paciente && strcmp(existente->nome, alterado.nome) == 0) {
+        printf("Erro: Já existe um paciente com o nome %s.\n", alterado.nome);
+        return NULL;
+    }
+    // O histórico segue com o paciente: a referência retida o mantém vivo entre a remoção e a inserção
+    // O nome de um residente em disco é liberado na remoção: um nome mantido vai para a arena
+    if ((*registro)->motor == MOTOR_DISCO && alterado.nome == paciente->nome) alterado.nome = guardar_nome(alterado.nome);
+    reter_historico(alterado.historico);
+    registro_remover(*registro, paciente);
+    registro_inserir(novo_registro, alterado);
+    liberar_historico(alterado.historico);
+    if (novo_registro != *registro) {
+        printf("Paciente transferido para %s.\n", novo_registro->medico);
+    }
+    *registro = novo_registro;
+    return registro_buscar(novo_registro, alterado.nome);
+}
+
+// Função para alterar um registro de paciente
+void alterar_registro(Clinica* clinica) {
+    materializar_clinica(clinica);
+    int menu;
+
+    printf("Digite o nome do paciente que deseja alterar: ");
+    char* nome = ler_texto_digitado();
+
+    // Busca no cadastro de todos os médicos
+    Registro* registro;
+    Paciente* paciente = buscar_clinica(clinica, nome, &registro);
+    free(nome);
+    if (paciente != NULL) {
+        printf("Paciente encontrado no cadastro de %s.\n", registro->medico);
+    } else {
+        printf("Paciente não encontrado.\n");
+        return;
+    }
+    // Nomes guardados nunca são liberados: este continua válido mesmo se o paciente sair do cadastro
+    // (o nome de um residente em disco vai embora com ele, então é guardado à parte)
+    const char* nome_atual = registro->motor == MOTOR_DISCO ? guardar_nome(paciente->nome) : paciente->nome;
+
+    do {
+        // Em um cadastro compartilhado outro processo pode ter mexido no paciente enquanto o menu esperava
+        paciente = revalidar_paciente(registro, paciente, nome_atual);
+        if (paciente == NULL) return;
+
+        printf("\nO que deseja alterar?\n");
+        printf("1. Nome\n");
+        printf("2. Sexo\n");
+        printf("3. Data de Nascimento\n");
+        printf("4. Registrar nova consulta\n");
+        printf("5. Voltar\n");
+        printf("Sua escolha: ");
+        if (scanf("%d", &menu) == EOF) menu = 5; // Fim da entrada
+        setbuf(stdin, NULL);
+
+        Paciente alterado = *paciente;
+        Paciente* resultado = NULL;
+        switch(menu) {
+            case 1:
+                printf("Digite o novo nome: ");
+                nome = ler_texto_digitado();
+                alterado.nome = guardar_nome(nome);
+                free(nome);
+                resultado = atualizar_paciente(clinica, &registro, paciente, nome_atual, alterado);
+                break;
+            case 2:
+                printf("Digite o novo sexo (M/F): ");
+                scanf(" %c", &alterado.sexo);
+                if (alterado.sexo == 'M' || alterado.sexo == 'F') {
+                    resultado = atualizar_paciente(clinica, &registro, paciente, nome_atual, alterado);
+                } else {
+                    printf("Sexo inválido. Use 'M' para masculino ou 'F' para feminino.\n");
+                }
+                break;
+            case 3:
+                printf("Digite a nova data de nascimento (dd/mm/aaaa): ");
+                scanf(" %10s", alterado.nascimento);
+                resultado = atualizar_paciente(clinica, &registro, paciente, nome_atual, alterado);
+                break;
+            case 4: {
+                // A consulta entra no histórico; a última consulta só muda se ela for a mais recente
+                char data[11];
+                printf("Digite a data da consulta (dd/mm/aaaa): ");
+                scanf(" %10s", data);
+                int dia = data_para_dias(data);
+                if (dia <= 0) {
+                    printf("Data inválida.\n");
+                    break;
+                }
+                iniciar_escrita(clinica);
+                int registrada = 0;
+                paciente = revalidar_paciente(registro, paciente, nome_atual);
+                if (paciente == NULL) {
+                    // Removido por outro processo: o menu termina na próxima volta
+                } else if (registro->motor == MOTOR_COMPARTILHADO || registro->motor == MOTOR_DISCO) {
+                    // O segmento e a árvore em disco não guardam o histórico: só uma consulta mais recente
+                    // muda o cadastro
+                    registrada = dia > data_para_dias(paciente->ultima_consulta);
+                    if (registrada) {
+                        dias_para_data(dia, alterado.ultima_consulta);
+                        paciente = registro_atualizar(registro, paciente, alterado);
+                    } else {
+                        printf("O cadastro %s guarda só a última consulta, e esta data não é posterior a ela.\n",
+                               registro->motor == MOTOR_DISCO ? "em disco" : "compartilhado");
+                    }
+                } else if (registro->motor == MOTOR_PERSISTENTE) {
+                    // As versões anteriores continuam apontando para o histórico atual: a consulta vai para uma cópia
+                    alterado.historico = copiar_historico(paciente->historico);
+                    registrada = registrar_consulta(&alterado, dia);
+                    if (registrada) paciente = registro_atualizar(registro, paciente, alterado);
+                    liberar_historico(alterado.historico);
+                } else {
+                    registrada = registrar_consulta(paciente, dia);
+                }
+                terminar_escrita(clinica);
+                if (registrada) resultado = paciente;
+                else if (paciente != NULL && registro->motor != MOTOR_COMPARTILHADO && registro->motor != MOTOR_DISCO) {
+                    printf("Consulta já registrada nesta data.\n");
+                }
+                break;
+            }
+            case 5:
+                printf("Voltando ao menu principal.\n");
+                break;
+            default:
+                printf("Opção inválida.\n");
+        }
+        if (resultado != NULL) {
+            // O evento leva o nome com que o paciente foi aberto, mesmo se ele acabou de ser trocado
+            auditar(clinica->auditoria, menu == 4 ? EVENTO_CONSULTA : EVENTO_ALTERACAO, registro->medico, nome_atual);
+            paciente = resultado;
+            nome_atual = registro->motor == MOTOR_DISCO ? guardar_nome(paciente->nome) : paciente->nome;
+            printf("Registro do paciente alterado com sucesso.\n");
+        }
+    } while (menu != 5);
+}
+
+// Função de tarefa: salva os pacientes de um médico no seu próprio arquivo
+// O arquivo de um cadastro em disco é a própria árvore: basta gravar as páginas alteradas
+void tarefa_salvar_registro(void* argumento) {
+    TarefaSalvamento* tarefa = (TarefaSalvamento*)argumento;
+    if (tarefa->registro->motor == MOTOR_DISCO) {
+        tarefa->sucesso = gravar_arvore_disco(tarefa->registro->disco);
+        return;
+    }
+    FILE* arquivo = fopen(tarefa->registro->arquivo, "w");
+    tarefa->sucesso = arquivo != NULL;
+    if (arquivo != NULL) {
+        registro_salvar(tarefa->registro, arquivo);
+        fclose(arquivo);
+    }
+}
+
+// Função de tarefa: formata os pacientes de um médico em um buffer na memória
+void tarefa_formatar_registro(void* argumento) {
+    TarefaSalvamento* tarefa = (TarefaSalvamento*)argumento;
+    FILE* memoria = open_memstream(&tarefa->texto, &tarefa->tamanho);
+    tarefa->sucesso = memoria != NULL;
+    if (memoria != NULL) {
+        registro_salvar(tarefa->registro, memoria);
+        fclose(memoria);
+    }
+}
+
+// Função para salvar todos os pacientes ao fechar o programa: um arquivo por médico, em paralelo
+void salvar_pacientes(Clinica* clinica) {
+    materializar_clinica(clinica);
+    TarefaSalvamento* tarefas = (TarefaSalvamento*)calloc(clinica->quantidade, sizeof(TarefaSalvamento));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para o salvamento.\n");
+        return;
+    }
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        tarefas[i].registro = &clinica->registros[i];
+        pool_submeter(clinica->pool, tarefa_salvar_registro, &tarefas[i]);
+    }
+    pool_aguardar(clinica->pool);
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        ArvoreDisco* arvore = clinica->registros[i].disco;
+        if (tarefas[i].sucesso) {
+            printf("Pacientes de %s salvos em %s.\n", clinica->registros[i].medico, clinica->registros[i].arquivo);
+            if (arvore != NULL) {
+                unsigned long acessos = arvore->acertos + arvore->leituras;
+                printf("  Árvore com %u páginas; buffer de %d páginas: %lu lidas, %lu gravadas, %.1f%% dos acessos no buffer.\n",
+                       arvore->meta.paginas, arvore->num_quadros, arvore->leituras, arvore->gravacoes,
+                       acessos > 0 ? 100.0 * arvore->acertos / acessos : 100.0);
+            }
+        } else if (arvore != NULL) {
+            printf("Erro ao gravar a árvore de %s em %s.\n", clinica->registros[i].medico, clinica->registros[i].arquivo);
+        } else {
+            printf("Erro ao abrir o arquivo para salvar os pacientes de %s.\n", clinica->registros[i].medico);
+        }
+    }
+    free(tarefas);
+}
+
+// Função para salvar todos os pacientes em um único arquivo, médico após médico
+// Cada cadastro é formatado em paralelo na memória e os buffers são gravados em ordem; os cadastros
+// em disco vão direto para o arquivo, lidos da árvore, sem passar por um buffer do tamanho deles
+// (na próxima carga eles atualizam os pacientes que já estão na árvore, ver inserir_lote_disco)
+void salvar_pacientes_original(Clinica* clinica, char* nome_arquivo){
+    materializar_clinica(clinica);
+    FILE* arquivo = fopen(nome_arquivo, "w");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo para escrita.\n");
+        return;
+    }
+
+    TarefaSalvamento* tarefas = (TarefaSalvamento*)calloc(clinica->quantidade, sizeof(TarefaSalvamento));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para o salvamento.\n");
+        fclose(arquivo);
+        return;
+    }
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        tarefas[i].registro = &clinica->registros[i];
+        if (clinica->registros[i].motor == MOTOR_DISCO) continue;
+        pool_submeter(clinica->pool, tarefa_formatar_registro, &tarefas[i]);
+    }
+    pool_aguardar(clinica->pool);
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor != MOTOR_DISCO && tarefas[i].sucesso) {
+            fwrite(tarefas[i].texto, 1, tarefas[i].tamanho, arquivo);
+        } else {
+            // Cadastro em disco, ou sem memória para o buffer: grava direto, sem paralelismo
+            registro_salvar(tarefas[i].registro, arquivo);
+        }
+        free(tarefas[i].texto);
+    }
+    free(tarefas);
+
+    fclose(arquivo);
+    printf("Pacientes salvos com sucesso no arquivo %s.\n", nome_arquivo);
+}
+
+// Função para gravar um inteiro sem sinal em 7 bits por byte (o bit mais alto indica continuação)
+void escrever_varint(FILE* arquivo, uint64_t valor) {
+    while (valor >= 0x80) {
+        putc((int)(valor & 0x7F) | 0x80, arquivo);
+        valor >>= 7;
+    }
+    putc((int)valor, arquivo);
+}
+
+// Função para ler um inteiro gravado por escrever_varint; retorna 0 no fim do arquivo
+int ler_varint(FILE* arquivo, uint64_t* valor) {
+    *valor = 0;
+    for (int deslocamento = 0; deslocamento < 64; deslocamento += 7) {
+        int byte = getc(arquivo);
+        if (byte == EOF) return 0;
+        *valor |= (uint64_t)(byte & 0x7F) << deslocamento;
+        if ((byte & 0x80) == 0) return 1;
+    }
+    return 0;
+}
+
+// Função para identificar a assinatura de um arquivo compacto (4 bytes)
+// Retorna a versão do formato, ou 0 se não for um arquivo compacto
+int assinatura_compacta(const char* assinatura) {
+    if (memcmp(assinatura, ASSINATURA_COMPACTO, 4) == 0) return 2;
+    if (memcmp(assinatura, ASSINATURA_COMPACTO_V1, 4) == 0) return 1;
+    return 0;
+}
+
+// Função para saber se um arquivo existente está no formato compacto
+int formato_compacto(const char* nome_arquivo) {
+    FILE* arquivo = fopen(nome_arquivo, "rb");
+    if (arquivo == NULL) return 0;
+    char assinatura[4];
+    int compacto = fread(assinatura, 1, 4, arquivo) == 4 && assinatura_compacta(assinatura) > 0;
+    fclose(arquivo);
+    return compacto;
+}
+
+// Função para gravar uma data no formato compacto: a diferença em dias para a última data
+// convertida (zigzag, com o bit mais baixo em 0) e a data passa a ser a anterior
+// Um texto que não volta igual da conversão para dias (31/02/2020, "nunca", 1/2/2020) é gravado
+// como está, depois de um 1, e não muda a anterior
+void escrever_data_compacta(FILE* arquivo, const char* data, char* anterior) {
+    int dias = data_para_dias(data);
+    char convertida[11];
+    dias_para_data(dias, convertida);
+    if (strcmp(convertida, data) != 0) {
+        size_t tamanho = strlen(data);
+        escrever_varint(arquivo, 1);
+        escrever_varint(arquivo, tamanho);
+        fwrite(data, 1, tamanho, arquivo);
+        return;
+    }
+
+    int64_t diferenca = dias - data_para_dias(anterior);
+    escrever_varint(arquivo, (((uint64_t)diferenca << 1) ^ (uint64_t)(diferenca >> 63)) << 1);
+    strcpy(anterior, data);
+}
+
+// Função para ler uma data gravada por escrever_data_compacta (ou só a diferença, na versão 1)
+// 'dias' guarda a última data convertida; retorna 0 se o arquivo acabar ou estiver corrompido
+int ler_data_compacta(FILE* arquivo, int escapes, int64_t* dias, char* data) {
+    uint64_t valor;
+    if (!ler_varint(arquivo, &valor)) return 0;
+    if (escapes) {
+        if (valor & 1) {
+            uint64_t tamanho;
+            if (!ler_varint(arquivo, &tamanho) || tamanho > 10 || fread(data, 1, tamanho, arquivo) != tamanho) return 0;
+            data[tamanho] = '\0';
+            return 1;
+        }
+        valor >>= 1;
+    }
+    *dias += (int64_t)(valor >> 1) ^ -(int64_t)(valor & 1);
+    dias_para_data((int)*dias, data);
+    return 1;
+}
+
+// Função para gravar um paciente no formato compacto em relação ao paciente anterior:
+// prefixo comum do nome, sufixo, sexo e as datas (escrever_data_compacta)
+// O anterior passa a ter o nome do paciente gravado e as últimas datas convertidas
+void escrever_paciente_compacto(FILE* arquivo, const Paciente* paciente, Paciente* anterior) {
+    size_t comum = 0;
+    while (anterior->nome[comum] != '\0' && anterior->nome[comum] == paciente->nome[comum]) comum++;
+    size_t sufixo = strlen(paciente->nome + comum);
+
+    escrever_varint(arquivo, comum);
+    escrever_varint(arquivo, sufixo);
+    fwrite(paciente->nome + comum, 1, sufixo, arquivo);
+    putc(paciente->sexo, arquivo);
+    escrever_data_compacta(arquivo, paciente->nascimento, anterior->nascimento);
+    escrever_data_compacta(arquivo, paciente->ultima_consulta, anterior->ultima_consulta);
+    anterior->nome = paciente->nome;
+}
+
+// Função para salvar todos os pacientes no formato compacto, em uma única sequência A-Z
+// Os cadastros de todos os médicos são intercalados por nome para aproveitar os prefixos comuns
+void salvar_pacientes_compacto(Clinica* clinica, const char* nome_arquivo) {
+    FILE* arquivo = fopen(nome_arquivo, "wb");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo %s para escrita.\n", nome_arquivo);
+        return;
+    }
+    setvbuf(arquivo, NULL, _IOFBF, 1 << 16);
+
+    // O total vai no cabeçalho: o iterador passa uma vez para contar e outra para gravar
+    IteradorClinica iterador;
+    int total = 0;
+    for (Paciente* paciente = iniciar_iterador(&iterador, clinica); paciente != NULL; paciente = iterador_proximo(&iterador)) total++;
+
+    fwrite(ASSINATURA_COMPACTO, 1, 4, arquivo);
+    escrever_varint(arquivo, (uint64_t)total);
+
+    Paciente anterior;
+    memset(&anterior, 0, sizeof(Paciente));
+    anterior.nome = "";
+    for (Paciente* paciente = iterador_posicionar(&iterador, ""); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+        escrever_paciente_compacto(arquivo, paciente, &anterior);
+    }
+
+    liberar_iterador(&iterador);
+    fclose(arquivo);
+    printf("%d pacientes salvos no formato compacto em %s.\n", total, nome_arquivo);
+}
+
+// Função para ler um nome gravado com prefixo comum: o tamanho do prefixo que ele divide com o
+// nome anterior (que está em *nome), o tamanho do sufixo e o sufixo; *nome cresce quando preciso
+// Retorna 0 se o arquivo acabar ou estiver corrompido
+int ler_nome_prefixado(FILE* arquivo, char** nome, size_t* capacidade) {
+    uint64_t comum, sufixo;
+    if (!ler_varint(arquivo, &comum) || !ler_varint(arquivo, &sufixo)) return 0;
+    if (comum > (*nome != NULL ? strlen(*nome) : 0) || sufixo > MAIOR_NOME_COMPACTO || comum + sufixo > MAIOR_NOME_COMPACTO) return 0;
+
+    if (comum + sufixo + 1 > *capacidade) {
+        *capacidade = comum + sufixo + 1 > 128 ? comum + sufixo + 1 : 128;
+        *nome = (char*)realloc(*nome, *capacidade);
+        if (*nome == NULL) {
+            printf("Erro ao alocar memória para os nomes.\n");
+            exit(1);
+        }
+    }
+    if (fread(*nome + comum, 1, sufixo, arquivo) != sufixo) return 0;
+    (*nome)[comum + sufixo] = '\0';
+    return 1;
+}
+
+// Função para decodificar um arquivo compacto (já posicionado depois da assinatura) para um lote
+// Os pacientes saem em ordem A-Z, prontos para a inserção em lote; retorna 0 se o arquivo estiver corrompido
+// 'escapes' indica a versão 2, em que as datas podem vir como texto
+int ler_pacientes_compacto(FILE* arquivo, LotePacientes* lote, int escapes) {
+    uint64_t total;
+    if (!ler_varint(arquivo, &total)) return 0;
+
+    Paciente paciente;
+    memset(&paciente, 0, sizeof(Paciente));
+    int64_t dias_nascimento = 0, dias_consulta = 0;
+    char* nome = NULL;
+    size_t capacidade = 0;
+
+    int valido = 1;
+    for (uint64_t i = 0; i < total; i++) {
+        int sexo = EOF;
+        if (!ler_nome_prefixado(arquivo, &nome, &capacidade) || (sexo = getc(arquivo)) == EOF ||
+            !ler_data_compacta(arquivo, escapes, &dias_nascimento, paciente.nascimento) ||
+            !ler_data_compacta(arquivo, escapes, &dias_consulta, paciente.ultima_consulta)) {
+            valido = 0;
+            break;
+        }
+        paciente.nome = guardar_nome(nome);
+        paciente.sexo = (char)sexo;
+
+        adicionar_lote(lote, paciente);
+    }
+    free(nome);
+    return valido;
+}
+
+// Função para salvar o histórico de consultas dos pacientes que têm um
+// Os nomes seguem em ordem A-Z com prefixo comum (como no arquivo compacto) e as datas de
+// cada paciente como a primeira em dias e depois as diferenças, que são sempre positivas
+void salvar_historicos(Clinica* clinica, const char* nome_arquivo) {
+    IteradorClinica iterador;
+    int com_historico = 0;
+    for (Paciente* paciente = iniciar_iterador(&iterador, clinica); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+        com_historico += paciente->historico != NULL;
+    }
+    if (com_historico == 0) {
+        liberar_iterador(&iterador);
+        return;
+    }
+
+    FILE* arquivo = fopen(nome_arquivo, "wb");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo %s para escrita.\n", nome_arquivo);
+        liberar_iterador(&iterador);
+        return;
+    }
+    setvbuf(arquivo, NULL, _IOFBF, 1 << 16);
+
+    fwrite(ASSINATURA_HISTORICO, 1, 4, arquivo);
+    escrever_varint(arquivo, (uint64_t)com_historico);
+    const char* anterior = "";
+    for (Paciente* paciente = iterador_posicionar(&iterador, ""); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+        HistoricoConsultas* historico = paciente->historico;
+        if (historico == NULL) continue;
+
+        const char* nome = paciente->nome;
+        size_t comum = 0;
+        while (anterior[comum] != '\0' && anterior[comum] == nome[comum]) comum++;
+        size_t sufixo = strlen(nome + comum);
+        escrever_varint(arquivo, comum);
+        escrever_varint(arquivo, sufixo);
+        fwrite(nome + comum, 1, sufixo, arquivo);
+        anterior = nome;
+
+        escrever_varint(arquivo, (uint64_t)historico->total);
+        int dia_anterior = 0;
+        for (BlocoConsultas* bloco = historico->primeiro; bloco != NULL; bloco = bloco->proximo) {
+            for (int j = 0; j < bloco->quantidade; j++) {
+                escrever_varint(arquivo, (uint64_t)(bloco->datas[j] - dia_anterior));
+                dia_anterior = bloco->datas[j];
+            }
+        }
+    }
+
+    liberar_iterador(&iterador);
+    fclose(arquivo);
+    printf("Histórico de consultas de %d pacientes salvo em %s.\n", com_historico, nome_arquivo);
+}
+
+// Função para carregar o histórico de consultas e ligá-lo aos pacientes já carregados
+// Pacientes que não existem mais são ignorados; a última consulta do cadastro também entra no histórico
+void carregar_historicos(Clinica* clinica, const char* nome_arquivo) {
+    FILE* arquivo = fopen(nome_arquivo, "rb");
+    if (arquivo == NULL) return; // Ainda não há histórico
+
+    char assinatura[4];
+    uint64_t total, quantidade, diferenca;
+    if (fread(assinatura, 1, 4, arquivo) != 4 || memcmp(assinatura, ASSINATURA_HISTORICO, 4) != 0 ||
+        !ler_varint(arquivo, &total)) {
+        printf("Erro: arquivo de histórico %s inválido.\n", nome_arquivo);
+        fclose(arquivo);
+        return;
+    }
+
+    char* nome = NULL;
+    size_t capacidade = 0;
+    int carregados = 0;
+    RelatorioConflitos adiantados = {NULL, 0, 0};
+    for (uint64_t i = 0; i < total; i++) {
+        if (!ler_nome_prefixado(arquivo, &nome, &capacidade) || !ler_varint(arquivo, &quantidade)) {
+            printf("Erro: arquivo de histórico %s corrompido.\n", nome_arquivo);
+            break;
+        }
+
+        // Os cadastros compartilhado e em disco não guardam o histórico (ponteiros não valem em outro
+        // processo nem no arquivo da árvore)
+        Registro* registro = NULL;
+        Paciente* paciente = buscar_clinica(clinica, nome, &registro);
+        if (paciente != NULL && strcmp(paciente->nome, nome) != 0) paciente = NULL;
+        if (paciente != NULL && (registro->motor == MOTOR_COMPARTILHADO || registro->motor == MOTOR_DISCO)) paciente = NULL;
+        if (paciente != NULL && paciente->historico == NULL) {
+            paciente->historico = criar_historico();
+            carregados++;
+        }
+
+        int dia = 0;
+        for (uint64_t j = 0; j < quantidade && ler_varint(arquivo, &diferenca); j++) {
+            dia += (int)diferenca;
+            if (paciente != NULL) adicionar_data_historico(paciente->historico, dia);
+        }
+        if (paciente != NULL && paciente->historico->ultimo != NULL) {
+            // A última consulta pode ter sido alterada direto no arquivo de pacientes: ela entra no
+            // histórico como está, e só é adiantada (com aviso) se o histórico tiver uma mais recente
+            int ultima = data_para_dias(paciente->ultima_consulta);
+            if (ultima > 0) adicionar_data_historico(paciente->historico, ultima);
+            BlocoConsultas* ultimo = paciente->historico->ultimo;
+            int recente = ultimo->datas[ultimo->quantidade - 1];
+            if (ultima > 0 && recente > ultima) {
+                registrar_conflito(&adiantados, paciente->nome);
+                dias_para_data(recente, paciente->ultima_consulta);
+            }
+        }
+    }
+    free(nome);
+    fclose(arquivo);
+    if (carregados > 0) printf("Histórico de consultas carregado para %d pacientes.\n", carregados);
+    if (adiantados.quantidade > 0) {
+        printf("Aviso: %d paciente(s) tinham no arquivo uma última consulta anterior à do histórico; vale a do histórico:\n",
+               adiantados.quantidade);
+        for (int i = 0; i < adiantados.quantidade; i++) {
+            printf("  %s\n", adiantados.nomes[i]);
+            free(adiantados.nomes[i]);
+        }
+    }
+    free(adiantados.nomes);
+}
+
+// Função executada por cada thread do pool: retira tarefas da fila até o pool ser encerrado
+void* trabalhador_pool(void* argumento) {
+    PoolThreads* pool = (PoolThreads*)argumento;
+
+    pthread_mutex_lock(&pool->trava);
+    while (1) {
+        while (pool->quantidade == 0 && !pool->encerrando) {
+            pthread_cond_wait(&pool->tem_tarefa, &pool->trava);
+        }
+        if (pool->quantidade == 0) break; // Encerrando e sem tarefas
+
+        TarefaPool tarefa = pool->fila[pool->inicio];
+        pool->inicio = (pool->inicio + 1) % pool->capacidade;
+        pool->quantidade--;
+
+        pthread_mutex_unlock(&pool->trava);
+        tarefa.funcao(tarefa.argumento);
+        pthread_mutex_lock(&pool->trava);
+
+        if (--pool->pendentes == 0) pthread_cond_broadcast(&pool->concluido);
+    }
+    pthread_mutex_unlock(&pool->trava);
+    return NULL;
+}
+
+// Função para criar um pool com o número de threads indicado (0 = uma por processador)
+PoolThreads* criar_pool(int num_threads) {
+    if (num_threads <= 0) {
+        long processadores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = processadores > 0 ? (int)processadores : 1;
+    }
+
+    PoolThreads* pool = (PoolThreads*)calloc(1, sizeof(PoolThreads));
+    if (pool == NULL) {
+        printf("Erro ao alocar memória para o pool de threads.\n");
+        exit(1);
+    }
+    pool->capacidade = 16;
+    pool->fila = (TarefaPool*)malloc(pool->capacidade * sizeof(TarefaPool));
+    pool->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    if (pool->fila == NULL || pool->threads == NULL) {
+        printf("Erro ao alocar memória para o pool de threads.\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->trava, NULL);
+    pthread_cond_init(&pool->tem_tarefa, NULL);
+    pthread_cond_init(&pool->concluido, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, trabalhador_pool, pool) != 0) break;
+        pool->num_threads++;
+    }
+    if (pool->num_threads == 0) {
+        printf("Erro ao criar as threads do pool.\n");
+        exit(1);
+    }
+    return pool;
+}
+
+// Função para enviar uma tarefa ao pool
+void pool_submeter(PoolThreads* pool, void (*funcao)(void*), void* argumento) {
+    pthread_mutex_lock(&pool->trava);
+    if (pool->quantidade == pool->capacidade) {
+        // Fila cheia: dobra a capacidade, desenrolando a fila circular
+        TarefaPool* fila = (TarefaPool*)malloc(2 * pool->capacidade * sizeof(TarefaPool));
+        if (fila == NULL) {
+            printf("Erro ao alocar memória para a fila do pool.\n");
+            exit(1);
+        }
+        for (int i = 0; i < pool->quantidade; i++) {
+            fila[i] = pool->fila[(pool->inicio + i) % pool->capacidade];
+        }
+        free(pool->fila);
+        pool->fila = fila;
+        pool->inicio = 0;
+        pool->capacidade *= 2;
+    }
+    pool->fila[(pool->inicio + pool->quantidade) % pool->capacidade] = (TarefaPool){funcao, argumento};
+    pool->quantidade++;
+    pool->pendentes++;
+    pthread_cond_signal(&pool->tem_tarefa);
+    pthread_mutex_unlock(&pool->trava);
+}
+
+// Função para esperar até todas as tarefas enviadas terem terminado
+void pool_aguardar(PoolThreads* pool) {
+    pthread_mutex_lock(&pool->trava);
+    while (pool->pendentes > 0) {
+        pthread_cond_wait(&pool->concluido, &pool->trava);
+    }
+    pthread_mutex_unlock(&pool->trava);
+}
+
+// Função para encerrar as threads (depois de terminar a fila) e liberar o pool
+void destruir_pool(PoolThreads* pool) {
+    pthread_mutex_lock(&pool->trava);
+    pool->encerrando = 1;
+    pthread_cond_broadcast(&pool->tem_tarefa);
+    pthread_mutex_unlock(&pool->trava);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->trava);
+    pthread_cond_destroy(&pool->tem_tarefa);
+    pthread_cond_destroy(&pool->concluido);
+    free(pool->threads);
+    free(pool->fila);
+    free(pool);
+}
+
+// Função para criar uma clínica vazia, sem médicos
+Clinica* criar_clinica(int num_threads) {
+    Clinica* clinica = (Clinica*)calloc(1, sizeof(Clinica));
+    if (clinica == NULL) {
+        printf("Erro ao alocar memória para a clínica.\n");
+        exit(1);
+    }
+    clinica->regra = ROTA_SEXO;
+    clinica->pool = criar_pool(num_threads);
+    pthread_mutex_init(&clinica->trava, NULL);
+    return clinica;
+}
+
+// Funções para delimitar uma escrita nos cadastros: travam a clínica para que o salvamento
+// automático não copie um estado pela metade, e registram a nova versão ao final
+// Cada cadastro que a escrita mudou guarda essa versão (a mais antiga é descartada quando o limite
+// é atingido); nos persistentes a raiz do início fica retida e vira a versão para desfazer
+// Nos cadastros compartilhados a trava de escrita do segmento afasta os outros processos,
+// e as mudanças que eles fizeram antes são aplicadas ao cache, ao filtro e ao índice
+void iniciar_escrita(Clinica* clinica) {
+    pthread_mutex_lock(&clinica->trava);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_PERSISTENTE) registro->raiz_escrita = reter_no(registro->raiz);
+        if (registro->motor == MOTOR_COMPARTILHADO) {
+            travar_escrita_segmento(registro->compartilhado);
+            registro->compartilhado->em_escrita = 1;
+            sincronizar_compartilhado(registro);
+        }
+    }
+}
+
+void terminar_escrita(Clinica* clinica) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_COMPARTILHADO) {
+            registro->compartilhado->em_escrita = 0;
+            destravar_escrita_segmento(registro->compartilhado);
+        }
+        int persistente = registro->motor == MOTOR_PERSISTENTE;
+        if (persistente ? registro->raiz == registro->raiz_escrita : !registro->alterado) {
+            if (persistente) liberar_no(registro->raiz_escrita);
+        } else {
+            if (registro->num_escritas == LIMITE_DESFAZER) {
+                if (persistente) {
+                    liberar_no(registro->versoes[0]);
+                    memmove(registro->versoes, registro->versoes + 1, (LIMITE_DESFAZER - 1) * sizeof(NoAVL*));
+                }
+                memmove(registro->escritas, registro->escritas + 1, (LIMITE_DESFAZER - 1) * sizeof(unsigned long));
+                registro->num_escritas--;
+            }
+            if (persistente) registro->versoes[registro->num_escritas] = registro->raiz_escrita;
+            registro->escritas[registro->num_escritas++] = clinica->versao + 1;
+        }
+        registro->raiz_escrita = NULL;
+        registro->alterado = 0;
+    }
+    clinica->versao++;
+    pthread_mutex_unlock(&clinica->trava);
+}
+
+// Função para montar o nome do arquivo de um médico: "pacientes_" + nome sem acentos em minúsculas
+void gerar_arquivo_medico(const char* medico, char* arquivo, size_t tamanho) {
+    const unsigned char* p = (const unsigned char*)medico;
+    size_t j = (size_t)snprintf(arquivo, tamanho, "pacientes_");
+    int c;
+
+    while ((c = dobrar_caractere(&p)) != 0 && j + 5 < tamanho) {
+        if (c >= 'A' && c <= 'Z') arquivo[j++] = (char)(c - 'A' + 'a');
+        else if (c >= '0' && c <= '9') arquivo[j++] = (char)c;
+        else if (c == ' ' || c == '-') arquivo[j++] = '_';
+    }
+    snprintf(arquivo + j, tamanho - j, ".txt");
+}
+
+// Função para acrescentar um médico à clínica
+// O critério depende da regra: sexo ("M", "F" ou "*"), faixa de iniciais ("A-M") ou nada (hash)
+// Retorna 0 se o motor ou o critério forem inválidos
+int adicionar_medico(Clinica* clinica, const char* medico, const char* motor, const char* criterio) {
+    Registro registro;
+    memset(&registro, 0, sizeof(Registro));
+    snprintf(registro.medico, sizeof(registro.medico), "%s", medico);
+    gerar_arquivo_medico(medico, registro.arquivo, sizeof(registro.arquivo));
+
+    if (strcmp(motor, "lista") == 0) {
+        registro.motor = MOTOR_LISTA;
+    } else if (strcmp(motor, "blocos") == 0) {
+        registro.motor = MOTOR_BLOCOS;
+    } else if (strcmp(motor, "avl") == 0) {
+        registro.motor = MOTOR_AVL;
+    } else if (strcmp(motor, "persistente") == 0) {
+        registro.motor = MOTOR_PERSISTENTE;
+    } else if (strcmp(motor, "compartilhado") == 0) {
+        registro.motor = MOTOR_COMPARTILHADO;
+    } else if (strcmp(motor, "disco") == 0) {
+        registro.motor = MOTOR_DISCO;
+    } else {
+        printf("Erro: estrutura '%s' desconhecida para %s (use lista, blocos, avl, persistente, compartilhado ou disco).\n", motor, medico);
+        return 0;
+    }
+
+    if (clinica->regra == ROTA_SEXO) {
+        registro.sexo = criterio[0];
+        if (registro.sexo != 'M' && registro.sexo != 'F' && registro.sexo != '*') {
+            printf("Erro: critério de sexo '%s' inválido para %s (use M, F ou *).\n", criterio, medico);
+            return 0;
+        }
+    } else if (clinica->regra == ROTA_INICIAL) {
+        // As iniciais guardadas são de um byte: caracteres acima de U+00FF não formam faixa
+        const unsigned char* p = (const unsigned char*)criterio;
+        int de = dobrar_caractere(&p);
+        int separador = dobrar_caractere(&p);
+        int ate = dobrar_caractere(&p);
+        if (separador != '-' || de > 0xFF || ate > 0xFF) {
+            printf("Erro: faixa de iniciais '%s' inválida para %s (use, por exemplo, A-M).\n", criterio, medico);
+            return 0;
+        }
+        registro.inicial_de = (char)de;
+        registro.inicial_ate = (char)ate;
+    }
+
+    if (registro.motor == MOTOR_COMPARTILHADO) {
+        // Segmento "/clinica_pacientes_<médico>": todo processo com o mesmo médico usa o mesmo
+        char nome_segmento[160];
+        snprintf(nome_segmento, sizeof(nome_segmento), "/clinica_%.*s", (int)strcspn(registro.arquivo, "."), registro.arquivo);
+        registro.compartilhado = anexar_segmento(nome_segmento);
+        if (registro.compartilhado == NULL) return 0;
+    }
+    if (registro.motor == MOTOR_DISCO) {
+        // Árvore em "pacientes_<médico>.bpt", que passa a ser o arquivo do médico
+        size_t ponto = strcspn(registro.arquivo, ".");
+        snprintf(registro.arquivo + ponto, sizeof(registro.arquivo) - ponto, ".bpt");
+        registro.disco = abrir_arvore_disco(registro.arquivo);
+        if (registro.disco == NULL) return 0;
+    }
+
+    if (registro.motor == MOTOR_LISTA) registro.lista = criar_lista();
+    if (registro.motor == MOTOR_BLOCOS) registro.blocos = criar_lista_blocos();
+    registro.cache = criar_cache_buscas();
+    registro.filtro = criar_filtro(0);
+    registro.termos = criar_indice_termos();
+
+    if (clinica->quantidade == clinica->capacidade) {
+        clinica->capacidade = clinica->capacidade > 0 ? clinica->capacidade * 2 : 4;
+        clinica->registros = (Registro*)realloc(clinica->registros, clinica->capacidade * sizeof(Registro));
+        if (clinica->registros == NULL) {
+            printf("Erro ao alocar memória para os médicos.\n");
+            exit(1);
+        }
+    }
+    clinica->registros[clinica->quantidade++] = registro;
+    return 1;
+}
+
+// Função para repartir a memória dos buffers (em MB) entre os cadastros em disco, em partes iguais
+void dividir_memoria_disco(Clinica* clinica, int megabytes) {
+    int arvores = 0;
+    for (int i = 0; i < clinica->quantidade; i++) arvores += clinica->registros[i].motor == MOTOR_DISCO;
+    if (arvores == 0) return;
+    long quadros = (long)megabytes * 1024 * 1024 / TAMANHO_PAGINA_DISCO / arvores;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) dimensionar_buffer_disco(clinica->registros[i].disco, (int)quadros);
+    }
+}
+
+// Função para configurar a clínica original: Moisés (lista, homens) e Liz (árvore, mulheres)
+void configurar_clinica_padrao(Clinica* clinica) {
+    clinica->regra = ROTA_SEXO;
+    adicionar_medico(clinica, "Moisés", "lista", "M");
+    adicionar_medico(clinica, "Liz", "avl", "F");
+}
+
+// Função para ler os médicos de um arquivo de configuração. Formato:
+//   regra=sexo|inicial|hash
+//   Nome do médico, lista|blocos|avl|persistente|compartilhado|disco, critério
+// Linhas vazias e começando com # são ignoradas; retorna 0 em caso de erro
+int carregar_configuracao_medicos(Clinica* clinica, const char* nome_arquivo) {
+    FILE* arquivo = fopen(nome_arquivo, "r");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo de médicos %s.\n", nome_arquivo);
+        return 0;
+    }
+
+    char linha[256];
+    int sucesso = 1;
+    while (sucesso && fgets(linha, sizeof(linha), arquivo)) {
+        linha[strcspn(linha, "\r\n")] = '\0';
+        if (linha[0] == '\0' || linha[0] == '#') continue;
+
+        char medico[50], motor[16], criterio[16] = "";
+        if (strncmp(linha, "regra=", 6) == 0) {
+            if (strcmp(linha + 6, "sexo") == 0) clinica->regra = ROTA_SEXO;
+            else if (strcmp(linha + 6, "inicial") == 0) clinica->regra = ROTA_INICIAL;
+            else if (strcmp(linha + 6, "hash") == 0) clinica->regra = ROTA_HASH;
+            else {
+                printf("Erro: regra '%s' desconhecida.\n", linha + 6);
+                sucesso = 0;
+            }
+        } else if (sscanf(linha, " %49[^,], %15[^, ] , %15s", medico, motor, criterio) >= 2) {
+            sucesso = adicionar_medico(clinica, medico, motor, criterio);
+        } else {
+            printf("Erro ao processar a linha: %s\n", linha);
+            sucesso = 0;
+        }
+    }
+    fclose(arquivo);
+
+    if (sucesso && clinica->quantidade == 0) {
+        printf("Erro: nenhum médico em %s.\n", nome_arquivo);
+        sucesso = 0;
+    }
+    return sucesso;
+}
+
+// Função para saber se a regra da clínica manda o paciente para o médico de 'indice'
+int medico_atende(Clinica* clinica, int indice, const Paciente* paciente) {
+    Registro* registro = &clinica->registros[indice];
+    if (clinica->regra == ROTA_HASH) {
+        // Hash do nome dobrado, para grafias com e sem acento irem ao mesmo médico
+        return hash_nome_dobrado(paciente->nome) % (uint64_t)clinica->quantidade == (uint64_t)indice;
+    }
+    if (clinica->regra == ROTA_SEXO) return registro->sexo == '*' || registro->sexo == paciente->sexo;
+    const unsigned char* p = (const unsigned char*)paciente->nome;
+    int inicial = dobrar_caractere(&p);
+    return inicial >= (unsigned char)registro->inicial_de && inicial <= (unsigned char)registro->inicial_ate;
+}
+
+// Função para decidir qual médico atende o paciente, conforme a regra da clínica
+// Um nome que não cabe na árvore em disco vai para o primeiro cadastro em memória que a regra aceite
+// ou, sem nenhum, para o próximo cadastro em memória na ordem da configuração: assim ele continua
+// sendo salvo no arquivo de pacientes
+// Retorna o índice do médico ou -1 se nenhum se encaixar
+int rotear_paciente(Clinica* clinica, const Paciente* paciente) {
+    int indice = -1;
+    if (clinica->regra == ROTA_HASH) indice = (int)(hash_nome_dobrado(paciente->nome) % (uint64_t)clinica->quantidade);
+    for (int i = 0; i < clinica->quantidade && indice < 0; i++) {
+        if (medico_atende(clinica, i, paciente)) indice = i;
+    }
+    if (indice < 0 || clinica->registros[indice].motor != MOTOR_DISCO || strlen(paciente->nome) <= MAIOR_NOME_DISCO) {
+        return indice;
+    }
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor != MOTOR_DISCO && medico_atende(clinica, i, paciente)) return i;
+    }
+    for (int i = 1; i < clinica->quantidade; i++) {
+        int outro = (indice + i) % clinica->quantidade;
+        if (clinica->registros[outro].motor != MOTOR_DISCO) return outro;
+    }
+    return -1;
+}
+
+// Função para criar o cache de buscas de um médico, vazio
+CacheBuscas* criar_cache_buscas() {
+    CacheBuscas* cache = (CacheBuscas*)calloc(1, sizeof(CacheBuscas));
+    if (cache == NULL) {
+        printf("Erro ao alocar memória para o cache de buscas.\n");
+        exit(1);
+    }
+    return cache;
+}
+
+// Função para esvaziar o cache em O(1): a tabela só é reiniciada quando a próxima busca for guardada
+// (os contadores de acertos e falhas continuam)
+void limpar_cache_buscas(CacheBuscas* cache) {
+    cache->quantidade = 0;
+}
+
+// Funções para tirar uma entrada da ordem de uso e para recolocá-la como a mais recente
+void desligar_uso_cache(CacheBuscas* cache, int indice) {
+    EntradaCache* entrada = &cache->entradas[indice];
+    if (entrada->anterior >= 0) cache->entradas[entrada->anterior].posterior = entrada->posterior;
+    else cache->mais_recente = entrada->posterior;
+    if (entrada->posterior >= 0) cache->entradas[entrada->posterior].anterior = entrada->anterior;
+    else cache->menos_recente = entrada->anterior;
+}
+
+void ligar_uso_cache(CacheBuscas* cache, int indice) {
+    EntradaCache* entrada = &cache->entradas[indice];
+    entrada->anterior = -1;
+    entrada->posterior = cache->mais_recente;
+    if (cache->mais_recente >= 0) cache->entradas[cache->mais_recente].anterior = indice;
+    else cache->menos_recente = indice;
+    cache->mais_recente = indice;
+}
+
+// Função para procurar um nome (grafia exata) no cache; um acerto passa a ser a entrada mais recente
+Paciente* buscar_cache(CacheBuscas* cache, const char* nome, uint64_t hash) {
+    if (cache->quantidade > 0) {
+        int indice = cache->baldes[hash & (BALDES_CACHE_BUSCAS - 1)];
+        while (indice >= 0) {
+            EntradaCache* entrada = &cache->entradas[indice];
+            if (entrada->hash == hash && strcmp(entrada->nome, nome) == 0) {
+                if (cache->mais_recente != indice) {
+                    desligar_uso_cache(cache, indice);
+                    ligar_uso_cache(cache, indice);
+                }
+                cache->acertos++;
+                return entrada->paciente;
+            }
+            indice = entrada->proximo_balde;
+        }
+    }
+    cache->falhas++;
+    return NULL;
+}
+
+// Função para guardar o resultado de uma busca; com o cache cheio, sai a entrada menos recente
+void guardar_cache(CacheBuscas* cache, const char* nome, uint64_t hash, Paciente* paciente) {
+    // Um nome que não cabe na entrada seria guardado truncado: essas buscas raras seguem pela estrutura
+    if (strlen(nome) >= sizeof(cache->entradas[0].nome)) return;
+
+    if (cache->quantidade == 0) {
+        // Cache vazio ou recém-limpo: descarta o que sobrou na tabela
+        memset(cache->baldes, -1, sizeof(cache->baldes));
+        cache->mais_recente = -1;
+        cache->menos_recente = -1;
+    }
+
+    int indice;
+    if (cache->quantidade < TAMANHO_CACHE_BUSCAS) {
+        indice = cache->quantidade++;
+    } else {
+        indice = cache->menos_recente;
+        desligar_uso_cache(cache, indice);
+        int* elo = &cache->baldes[cache->entradas[indice].hash & (BALDES_CACHE_BUSCAS - 1)];
+        while (*elo != indice) elo = &cache->entradas[*elo].proximo_balde;
+        *elo = cache->entradas[indice].proximo_balde;
+    }
+
+    EntradaCache* entrada = &cache->entradas[indice];
+    snprintf(entrada->nome, sizeof(entrada->nome), "%s", nome);
+    entrada->hash = hash;
+    entrada->paciente = paciente;
+    int* balde = &cache->baldes[hash & (BALDES_CACHE_BUSCAS - 1)];
+    entrada->proximo_balde = *balde;
+    *balde = indice;
+    ligar_uso_cache(cache, indice);
+}
+
+// Função para criar um filtro de nomes vazio, dimensionado para 'capacidade' nomes
+FiltroNomes* criar_filtro(size_t capacidade) {
+    FiltroNomes* filtro = (FiltroNomes*)calloc(1, sizeof(FiltroNomes));
+    if (filtro == NULL) {
+        printf("Erro ao alocar memória para o filtro de nomes.\n");
+        exit(1);
+    }
+    filtro->tamanho = TAMANHO_MINIMO_FILTRO;
+    while (filtro->tamanho < capacidade * CONTADORES_POR_NOME) filtro->tamanho *= 2;
+    filtro->limite = filtro->tamanho / CONTADORES_POR_NOME;
+    filtro->contadores = (uint8_t*)calloc(filtro->tamanho, sizeof(uint8_t));
+    if (filtro->contadores == NULL) {
+        printf("Erro ao alocar memória para o filtro de nomes.\n");
+        exit(1);
+    }
+    return filtro;
+}
+
+void liberar_filtro(FiltroNomes* filtro) {
+    if (filtro == NULL) return;
+    free(filtro->contadores);
+    free(filtro);
+}
+
+// Funções para contar e descontar um nome: as sondas saem do hash de 64 bits dividido em
+// duas metades (hash duplo), sem calcular outro hash
+void filtro_adicionar(FiltroNomes* filtro, uint64_t hash) {
+    uint32_t passo = (uint32_t)(hash >> 32) | 1;
+    size_t posicao = (uint32_t)hash;
+    for (int i = 0; i < SONDAS_FILTRO; i++, posicao += passo) {
+        uint8_t* contador = &filtro->contadores[posicao & (filtro->tamanho - 1)];
+        if (*contador < UINT8_MAX) (*contador)++;
+    }
+    filtro->elementos++;
+}
+
+void filtro_remover(FiltroNomes* filtro, uint64_t hash) {
+    uint32_t passo = (uint32_t)(hash >> 32) | 1;
+    size_t posicao = (uint32_t)hash;
+    for (int i = 0; i < SONDAS_FILTRO; i++, posicao += passo) {
+        uint8_t* contador = &filtro->contadores[posicao & (filtro->tamanho - 1)];
+        if (*contador > 0 && *contador < UINT8_MAX) (*contador)--;
+    }
+    if (filtro->elementos > 0) filtro->elementos--;
+}
+
+// Função para testar um nome: 0 quando ele com certeza não está no cadastro
+int filtro_pode_conter(const FiltroNomes* filtro, uint64_t hash) {
+    uint32_t passo = (uint32_t)(hash >> 32) | 1;
+    size_t posicao = (uint32_t)hash;
+    for (int i = 0; i < SONDAS_FILTRO; i++, posicao += passo) {
+        if (filtro->contadores[posicao & (filtro->tamanho - 1)] == 0) return 0;
+    }
+    return 1;
+}
+
+// Função auxiliar que conta um paciente no filtro (usada com registro_percorrer)
+void adicionar_paciente_filtro(Paciente* paciente, void* contexto) {
+    filtro_adicionar((FiltroNomes*)contexto, hash_nome_dobrado(paciente->nome));
+}
+
+// Função para refazer o filtro de um médico a partir do cadastro, com folga para o dobro de nomes
+// Usada quando o filtro satura e quando o cadastro inteiro é trocado (desfazer)
+void refazer_filtro(Registro* registro) {
+    unsigned long descartes = registro->filtro != NULL ? registro->filtro->descartes : 0;
+    liberar_filtro(registro->filtro);
+    registro->filtro = criar_filtro((size_t)registro_contar(registro) * 2);
+    registro->filtro->descartes = descartes;
+    registro_percorrer(registro, adicionar_paciente_filtro, registro->filtro);
+}
+
+// Função para contar um nome recém-inserido no filtro do médico, refazendo o filtro se ele saturar
+void registro_contar_nome(Registro* registro, const char* nome) {
+    filtro_adicionar(registro->filtro, hash_nome_dobrado(nome));
+    if (registro->filtro->elementos > registro->filtro->limite) refazer_filtro(registro);
+}
+
+// Função para consultar o filtro de um médico; conta as buscas que ele descarta
+// A árvore em disco não tem filtro: ele precisaria de todos os nomes, lidos do arquivo a cada abertura
+int registro_pode_conter(Registro* registro, uint64_t hash) {
+    if (registro->motor == MOTOR_DISCO) return 1;
+    sincronizar_compartilhado(registro);
+    if (filtro_pode_conter(registro->filtro, hash)) return 1;
+    registro->filtro->descartes++;
+    return 0;
+}
+
+// Função para criar um índice de termos vazio
+IndiceTermos* criar_indice_termos() {
+    IndiceTermos* indice = (IndiceTermos*)calloc(1, sizeof(IndiceTermos));
+    if (indice == NULL) {
+        printf("Erro ao alocar memória para o índice de termos.\n");
+        exit(1);
+    }
+    indice->capacidade_termos = 256;
+    indice->termos = (EntradaTermo*)calloc(indice->capacidade_termos, sizeof(EntradaTermo));
+    indice->capacidade_ids = 256;
+    indice->ids = (EntradaIdNome*)malloc(indice->capacidade_ids * sizeof(EntradaIdNome));
+    if (indice->termos == NULL || indice->ids == NULL) {
+        printf("Erro ao alocar memória para o índice de termos.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < indice->capacidade_ids; i++) indice->ids[i].id = UINT32_MAX;
+    return indice;
+}
+
+void liberar_indice_termos(IndiceTermos* indice) {
+    if (indice == NULL) return;
+    for (size_t i = 0; i < indice->capacidade_termos; i++) {
+        if (indice->termos[i].termo == NULL) continue;
+        free(indice->termos[i].termo);
+        free(indice->termos[i].postagens.dados);
+        free(indice->termos[i].postagens.saltos);
+    }
+    free(indice->termos);
+    free(indice->nomes);
+    free(indice->ids);
+    free(indice);
+}
+
+// Função para ler o próximo termo de um nome: letras e dígitos já sem acento e em maiúsculas
+// Retorna o tamanho do termo (0 quando o nome acabou); termos longos demais são cortados
+int proximo_termo(const unsigned char** p, char* termo, size_t tamanho) {
+    size_t j = 0;
+    int c;
+    while ((c = dobrar_caractere(p)) != 0) {
+        int parte = (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (parte && j + 1 < tamanho) termo[j++] = (char)c;
+        else if (!parte && j > 0) break;
+    }
+    termo[j] = '\0';
+    return (int)j;
+}
+
+// Função para achar um termo na tabela; com 'criar', um termo novo recebe uma lista vazia
+// Retorna NULL se o termo não existir e não for para criar
+EntradaTermo* localizar_termo(IndiceTermos* indice, const char* termo, uint64_t hash, int criar) {
+    if (criar && (indice->num_termos + 1) * 10 > indice->capacidade_termos * 7) {
+        // Tabela com mais de 70% ocupada: dobra e reposiciona os termos
+        size_t capacidade = indice->capacidade_termos * 2;
+        EntradaTermo* termos = (EntradaTermo*)calloc(capacidade, sizeof(EntradaTermo));
+        if (termos == NULL) {
+            printf("Erro ao alocar memória para o índice de termos.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < indice->capacidade_termos; i++) {
+            if (indice->termos[i].termo == NULL) continue;
+            size_t posicao = indice->termos[i].hash & (capacidade - 1);
+            while (termos[posicao].termo != NULL) posicao = (posicao + 1) & (capacidade - 1);
+            termos[posicao] = indice->termos[i];
+        }
+        free(indice->termos);
+        indice->termos = termos;
+        indice->capacidade_termos = capacidade;
+    }
+
+    size_t posicao = hash & (indice->capacidade_termos - 1);
+    while (indice->termos[posicao].termo != NULL) {
+        EntradaTermo* entrada = &indice->termos[posicao];
+        if (entrada->hash == hash && strcmp(entrada->termo, termo) == 0) return entrada;
+        posicao = (posicao + 1) & (indice->capacidade_termos - 1);
+    }
+    if (!criar) return NULL;
+
+    EntradaTermo* entrada = &indice->termos[posicao];
+    size_t tamanho = strlen(termo) + 1;
+    entrada->termo = (char*)malloc(tamanho);
+    if (entrada->termo == NULL) {
+        printf("Erro ao alocar memória para o índice de termos.\n");
+        exit(1);
+    }
+    memcpy(entrada->termo, termo, tamanho);
+    entrada->hash = hash;
+    indice->num_termos++;
+    return entrada;
+}
+
+// Função para achar a posição de um nome na tabela nome -> id
+// Retorna a posição do nome, ou a posição vazia onde ele entraria
+size_t localizar_id_nome(IndiceTermos* indice, const char* nome, uint64_t hash) {
+    size_t posicao = hash & (indice->capacidade_ids - 1);
+    while (indice->ids[posicao].id != UINT32_MAX) {
+        EntradaIdNome* entrada = &indice->ids[posicao];
+        if (entrada->hash == hash && strcmp(indice->nomes[entrada->id], nome) == 0) break;
+        posicao = (posicao + 1) & (indice->capacidade_ids - 1);
+    }
+    return posicao;
+}
+
+// Função para acrescentar um id (maior que todos da lista) ao fim de uma lista de postagens
+void acrescentar_postagem(ListaPostagens* lista, uint32_t id) {
+    if (lista->quantidade > 0 && id <= lista->ultimo) return; // O nome repete o termo
+    if (lista->tamanho + 5 > lista->capacidade) {
+        lista->capacidade = lista->capacidade > 0 ? lista->capacidade * 2 : 8;
+        lista->dados = (uint8_t*)realloc(lista->dados, lista->capacidade);
+        if (lista->dados == NULL) {
+            printf("Erro ao alocar memória para o índice de termos.\n");
+            exit(1);
+        }
+    }
+
+    uint32_t diferenca = lista->quantidade > 0 ? id - lista->ultimo : id;
+    while (diferenca >= 0x80) {
+        lista->dados[lista->tamanho++] = (uint8_t)((diferenca & 0x7F) | 0x80);
+        diferenca >>= 7;
+    }
+    lista->dados[lista->tamanho++] = (uint8_t)diferenca;
+
+    if (lista->quantidade > 0 && lista->quantidade % IDS_POR_SALTO == 0) {
+        if (lista->num_saltos == lista->capacidade_saltos) {
+            lista->capacidade_saltos = lista->capacidade_saltos > 0 ? lista->capacidade_saltos * 2 : 4;
+            lista->saltos = (SaltoPostagens*)realloc(lista->saltos, lista->capacidade_saltos * sizeof(SaltoPostagens));
+            if (lista->saltos == NULL) {
+                printf("Erro ao alocar memória para o índice de termos.\n");
+                exit(1);
+            }
+        }
+        lista->saltos[lista->num_saltos].id = id;
+        lista->saltos[lista->num_saltos].deslocamento = lista->tamanho;
+        lista->num_saltos++;
+    }
+    lista->ultimo = id;
+    lista->quantidade++;
+}
+
+// Função para tirar de uma lista de postagens os ids cujo nome já saiu do índice
+// A lista é gravada de novo no próprio vetor: a diferença entre dois ids que ficam nunca ocupa
+// mais bytes que as diferenças que ela junta, então a escrita não alcança a leitura
+void compactar_postagens(const IndiceTermos* indice, ListaPostagens* lista) {
+    uint32_t quantidade = lista->quantidade, leitura = 0, id = 0;
+    lista->tamanho = 0;
+    lista->quantidade = 0;
+    lista->removidos = 0;
+    lista->num_saltos = 0;
+    for (uint32_t i = 0; i < quantidade; i++) {
+        uint32_t diferenca = 0;
+        for (int deslocamento = 0;; deslocamento += 7) {
+            uint8_t byte = lista->dados[leitura++];
+            diferenca |= (uint32_t)(byte & 0x7F) << deslocamento;
+            if ((byte & 0x80) == 0) break;
+        }
+        id = i == 0 ? diferenca : id + diferenca;
+        if (indice->nomes[id] != NULL) acrescentar_postagem(lista, id);
+    }
+}
+
+// Função para marcar a saída de um id de uma lista de postagens (o nome dele já é NULL no índice)
+// A lista só é compactada quando mais da metade dos seus ids saiu, o que dá custo constante
+// amortizado por remoção; um nome que repete o termo conta duas vezes e só adianta a compactação
+void remover_postagem(const IndiceTermos* indice, ListaPostagens* lista) {
+    lista->removidos++;
+    if (lista->removidos * 2 > lista->quantidade) compactar_postagens(indice, lista);
+}
+
+// Função para indexar o nome de um paciente; retorna 0 se o nome já estava no índice
+// O nome precisa ser o guardado no paciente (arena ou segmento): o índice aponta para ele sem copiar
+int indice_adicionar_nome(IndiceTermos* indice, const char* nome) {
+    if ((indice->pacientes + 1) * 10 > indice->capacidade_ids * 7) {
+        size_t capacidade = indice->capacidade_ids * 2;
+        EntradaIdNome* ids = (EntradaIdNome*)malloc(capacidade * sizeof(EntradaIdNome));
+        if (ids == NULL) {
+            printf("Erro ao alocar memória para o índice de termos.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < capacidade; i++) ids[i].id = UINT32_MAX;
+        for (size_t i = 0; i < indice->capacidade_ids; i++) {
+            if (indice->ids[i].id == UINT32_MAX) continue;
+            size_t posicao = indice->ids[i].hash & (capacidade - 1);
+            while (ids[posicao].id != UINT32_MAX) posicao = (posicao + 1) & (capacidade - 1);
+            ids[posicao] = indice->ids[i];
+        }
+        free(indice->ids);
+        indice->ids = ids;
+        indice->capacidade_ids = capacidade;
+    }
+
+    uint64_t hash = hash_nome_dobrado(nome);
+    size_t posicao = localizar_id_nome(indice, nome, hash);
+    if (indice->ids[posicao].id != UINT32_MAX) return 0;
+
+    if (indice->num_ids == indice->capacidade_nomes) {
+        indice->capacidade_nomes = indice->capacidade_nomes > 0 ? indice->capacidade_nomes * 2 : 64;
+        indice->nomes = (const char**)realloc(indice->nomes, indice->capacidade_nomes * sizeof(const char*));
+        if (indice->nomes == NULL) {
+            printf("Erro ao alocar memória para o índice de termos.\n");
+            exit(1);
+        }
+    }
+    uint32_t id = indice->num_ids++;
+    indice->nomes[id] = nome;
+    indice->ids[posicao].hash = hash;
+    indice->ids[posicao].id = id;
+    indice->pacientes++;
+
+    const unsigned char* p = (const unsigned char*)nome;
+    char termo[100];
+    while (proximo_termo(&p, termo, sizeof(termo)) > 0) {
+        acrescentar_postagem(&localizar_termo(indice, termo, hash_nome_dobrado(termo), 1)->postagens, id);
+    }
+    return 1;
+}
+
+// Função para tirar o nome de um paciente do índice
+void indice_remover_nome(IndiceTermos* indice, const char* nome) {
+    size_t posicao = localizar_id_nome(indice, nome, hash_nome_dobrado(nome));
+    uint32_t id = indice->ids[posicao].id;
+    if (id == UINT32_MAX) return;
+
+    indice->nomes[id] = NULL;
+    indice->pacientes--;
+    const unsigned char* p = (const unsigned char*)nome;
+    char termo[100];
+    while (proximo_termo(&p, termo, sizeof(termo)) > 0) {
+        EntradaTermo* entrada = localizar_termo(indice, termo, hash_nome_dobrado(termo), 0);
+        if (entrada != NULL) remover_postagem(indice, &entrada->postagens);
+    }
+
+    // Remoção com deslocamento para trás: puxa as posições seguintes que pertencem antes do buraco
+    size_t mascara = indice->capacidade_ids - 1;
+    size_t buraco = posicao;
+    for (size_t atual = (posicao + 1) & mascara; indice->ids[atual].id != UINT32_MAX; atual = (atual + 1) & mascara) {
+        size_t ideal = indice->ids[atual].hash & mascara;
+        if (((atual - ideal) & mascara) >= ((atual - buraco) & mascara)) {
+            indice->ids[buraco] = indice->ids[atual];
+            buraco = atual;
+        }
+    }
+    indice->ids[buraco].id = UINT32_MAX;
+}
+
+// Função auxiliar que indexa um paciente (usada com registro_percorrer)
+void adicionar_paciente_indice(Paciente* paciente, void* contexto) {
+    indice_adicionar_nome((IndiceTermos*)contexto, paciente->nome);
+}
+
+// Função para refazer o índice de termos de um médico a partir do cadastro (usada ao desfazer)
+void refazer_indice_termos(Registro* registro) {
+    liberar_indice_termos(registro->termos);
+    registro->termos = criar_indice_termos();
+    registro_percorrer(registro, adicionar_paciente_indice, registro->termos);
+}
+
+// Funções para ler uma lista de postagens em ordem: iniciar no primeiro id, avançar um id
+// e saltar até o primeiro id maior ou igual a um alvo
+void iniciar_cursor(CursorPostagens* cursor, const ListaPostagens* lista) {
+    cursor->lista = lista;
+    cursor->indice = 0;
+    cursor->deslocamento = 0;
+    cursor->atual = 0;
+    cursor->fim = lista->quantidade == 0;
+    if (!cursor->fim) {
+        cursor->indice = UINT32_MAX; // O primeiro avanço leva ao índice 0
+        avancar_cursor(cursor);
+    }
+}
+
+void avancar_cursor(CursorPostagens* cursor) {
+    const ListaPostagens* lista = cursor->lista;
+    if (++cursor->indice >= lista->quantidade) {
+        cursor->fim = 1;
+        return;
+    }
+    uint32_t diferenca = 0;
+    for (int deslocamento = 0;; deslocamento += 7) {
+        uint8_t byte = lista->dados[cursor->deslocamento++];
+        diferenca |= (uint32_t)(byte & 0x7F) << deslocamento;
+        if ((byte & 0x80) == 0) break;
+    }
+    cursor->atual = cursor->indice == 0 ? diferenca : cursor->atual + diferenca;
+}
+
+// O salto galopa pelos saltos da lista (passos 1, 2, 4, ...) e termina com uma busca binária,
+// então uma lista longa é atravessada em O(log n) até o bloco certo, decodificado por último
+void saltar_cursor(CursorPostagens* cursor, uint32_t alvo) {
+    if (cursor->fim || cursor->atual >= alvo) return;
+
+    // Blocos numerados de 0 a num_saltos; o bloco k >= 1 começa no salto saltos[k - 1]
+    const ListaPostagens* lista = cursor->lista;
+    uint32_t bloco = cursor->indice / IDS_POR_SALTO;
+    uint32_t passo = 1, baixo = bloco, alto = bloco + 1;
+    while (alto <= lista->num_saltos && lista->saltos[alto - 1].id <= alvo) {
+        baixo = alto;
+        passo *= 2;
+        alto = bloco + passo;
+    }
+    if (alto > lista->num_saltos + 1) alto = lista->num_saltos + 1;
+    while (alto - baixo > 1) {
+        uint32_t meio = baixo + (alto - baixo) / 2;
+        if (lista->saltos[meio - 1].id <= alvo) baixo = meio;
+        else alto = meio;
+    }
+    if (baixo > bloco) {
+        cursor->indice = baixo * IDS_POR_SALTO;
+        cursor->atual = lista->saltos[baixo - 1].id;
+        cursor->deslocamento = lista->saltos[baixo - 1].deslocamento;
+    }
+    while (!cursor->fim && cursor->atual < alvo) avancar_cursor(cursor);
+}
+
+// Função de comparação para ordenar os cursores da lista mais curta para a mais longa
+int comparar_cursores(const void* a, const void* b) {
+    uint32_t x = ((const CursorPostagens*)a)->lista->quantidade;
+    uint32_t y = ((const CursorPostagens*)b)->lista->quantidade;
+    return (x > y) - (x < y);
+}
+
+// Função para achar os ids dos pacientes de um médico que têm todos os termos da consulta
+// A lista mais curta guia a interseção e as outras só saltam até o candidato
+// Retorna um vetor (a liberar) com 'quantidade' ids em ordem crescente
+uint32_t* buscar_termos_registro(IndiceTermos* indice, const char* consulta, int* quantidade) {
+    CursorPostagens cursores[MAXIMO_TERMOS_BUSCA];
+    int num_cursores = 0;
+    const unsigned char* p = (const unsigned char*)consulta;
+    char termo[100];
+    *quantidade = 0;
+    while (num_cursores < MAXIMO_TERMOS_BUSCA && proximo_termo(&p, termo, sizeof(termo)) > 0) {
+        EntradaTermo* entrada = localizar_termo(indice, termo, hash_nome_dobrado(termo), 0);
+        if (entrada == NULL || entrada->postagens.quantidade == 0) return NULL;
+        iniciar_cursor(&cursores[num_cursores++], &entrada->postagens);
+    }
+    if (num_cursores == 0) return NULL;
+    qsort(cursores, num_cursores, sizeof(CursorPostagens), comparar_cursores);
+
+    uint32_t* ids = (uint32_t*)malloc(cursores[0].lista->quantidade * sizeof(uint32_t));
+    if (ids == NULL) {
+        printf("Erro ao alocar memória para a busca.\n");
+        exit(1);
+    }
+    while (!cursores[0].fim) {
+        uint32_t candidato = cursores[0].atual;
+        int i = 1;
+        for (; i < num_cursores; i++) {
+            saltar_cursor(&cursores[i], candidato);
+            if (cursores[i].fim) break;
+            if (cursores[i].atual != candidato) break;
+        }
+        if (i < num_cursores && cursores[i].fim) break;
+        if (i == num_cursores) {
+            if (indice->nomes[candidato] != NULL) ids[(*quantidade)++] = candidato; // Removido, ainda na lista
+            avancar_cursor(&cursores[0]);
+        } else {
+            saltar_cursor(&cursores[0], cursores[i].atual);
+        }
+    }
+    return ids;
+}
+
+// Função auxiliar que seleciona um paciente com todos os termos da busca (usada com registro_percorrer)
+void selecionar_termos_disco(Paciente* paciente, void* contexto) {
+    BuscaTermosDisco* busca = (BuscaTermosDisco*)contexto;
+    int achados = 0; // Um bit por termo da busca
+    const unsigned char* p = (const unsigned char*)paciente->nome;
+    char termo[100];
+    while (proximo_termo(&p, termo, sizeof(termo)) > 0) {
+        for (int i = 0; i < busca->num_termos; i++) {
+            if (strcmp(termo, busca->termos[i]) == 0) achados |= 1 << i;
+        }
+    }
+    if (achados != (1 << busca->num_termos) - 1) return;
+
+    if (busca->quantidade == busca->capacidade) {
+        busca->capacidade = busca->capacidade > 0 ? busca->capacidade * 2 : 64;
+        busca->encontrados = (Paciente**)realloc(busca->encontrados, busca->capacidade * sizeof(Paciente*));
+        if (busca->encontrados == NULL) {
+            printf("Erro ao alocar memória para a busca.\n");
+            exit(1);
+        }
+    }
+    busca->encontrados[busca->quantidade++] = copiar_paciente_disco(busca->registro->disco, paciente);
+}
+
+// Função para achar os pacientes de um cadastro em disco que têm todos os termos da consulta
+// Sem índice de termos, o cadastro inteiro é percorrido (página a página, pelo buffer)
+// Retorna um vetor (a liberar) com 'quantidade' cópias em ordem A-Z, ou NULL se não houver nenhuma
+Paciente** buscar_termos_disco(Registro* registro, const char* consulta, int* quantidade) {
+    BuscaTermosDisco busca;
+    memset(&busca, 0, sizeof(BuscaTermosDisco));
+    busca.registro = registro;
+    const unsigned char* p = (const unsigned char*)consulta;
+    while (busca.num_termos < MAXIMO_TERMOS_BUSCA && proximo_termo(&p, busca.termos[busca.num_termos], sizeof(busca.termos[0])) > 0) {
+        busca.num_termos++;
+    }
+    *quantidade = 0;
+    if (busca.num_termos == 0) return NULL;
+    descartar_copias_disco(registro->disco);
+    registro_percorrer(registro, selecionar_termos_disco, &busca);
+    *quantidade = busca.quantidade;
+    return busca.encontrados;
+}
+
+// Função para contar os bits 1 no fim de um número (a descida do índice congelado sobe por eles)
+int uns_finais(uint64_t valor) {
+#ifdef __GNUC__
+    return __builtin_ctzll(~valor);
+#else
+    int uns = 0;
+    while (valor & 1) {
+        valor >>= 1;
+        uns++;
+    }
+    return uns;
+#endif
+}
+
+// Função para preencher o índice congelado: percorre as posições de Eytzinger em ordem (esquerda,
+// posição, direita), que recebem os pacientes em ordem A-Z; retorna o próximo paciente a colocar
+int preencher_congelado(IndiceCongelado* indice, int i, size_t k) {
+    if (k > (size_t)indice->quantidade) return i;
+    i = preencher_congelado(indice, i, 2 * k);
+    indice->prefixos[k] = indice->ordem[i];
+    indice->entradas[k].paciente = indice->pacientes[i];
+    indice->entradas[k].posicao = (uint32_t)i;
+    return preencher_congelado(indice, i + 1, 2 * k + 1);
+}
+
+// Função para congelar o cadastro de um médico (ou refazer o seu índice congelado)
+// O cadastro compartilhado não pode ser congelado: outros processos o alteram sem avisar este;
+// nem o cadastro em disco, cujos pacientes não precisam caber na memória
+int congelar_registro(Registro* registro) {
+    if (registro->motor == MOTOR_COMPARTILHADO || registro->motor == MOTOR_DISCO) return 0;
+    liberar_congelado(registro->congelado);
+
+    IndiceCongelado* indice = (IndiceCongelado*)calloc(1, sizeof(IndiceCongelado));
+    if (indice == NULL) {
+        printf("Erro ao alocar memória para o índice congelado.\n");
+        exit(1);
+    }
+    indice->pacientes = coletar_registro(registro, &indice->quantidade);
+
+    // Os prefixos começam em uma linha de cache, para os bisnetos de cada posição ficarem juntos
+    size_t bytes = ((size_t)indice->quantidade + 1) * sizeof(PrefixoNome);
+    indice->prefixos = (PrefixoNome*)aligned_alloc(64, (bytes + 63) / 64 * 64);
+    indice->entradas = (EntradaCongelada*)malloc(((size_t)indice->quantidade + 1) * sizeof(EntradaCongelada));
+    indice->ordem = (PrefixoNome*)malloc(bytes);
+    if (indice->prefixos == NULL || indice->entradas == NULL || indice->ordem == NULL) {
+        printf("Erro ao alocar memória para o índice congelado.\n");
+        exit(1);
+    }
+    for (int i = 0; i < indice->quantidade; i++) {
+        indice->ordem[i].chave = indice->pacientes[i]->chave;
+        indice->ordem[i].resto = calcular_resto_chave(indice->pacientes[i]->nome);
+    }
+    preencher_congelado(indice, 0, 1);
+    registro->congelado = indice;
+    return 1;
+}
+
+void liberar_congelado(IndiceCongelado* indice) {
+    if (indice == NULL) return;
+    free(indice->prefixos);
+    free(indice->entradas);
+    free(indice->ordem);
+    free(indice->pacientes);
+    free(indice);
+}
+
+// Função chamada a cada escrita no cadastro: o índice congelado passa a ser refeito só quando preciso
+void invalidar_congelado(Registro* registro) {
+    if (registro->congelado == NULL) return;
+    registro->congelado->desatualizado = 1;
+    registro->congelado->buscas_desatualizado = 0;
+}
+
+// Função para saber se a busca pode usar o índice congelado; um índice desatualizado é refeito
+// depois de BUSCAS_PARA_RECONGELAR buscas sem escritas no meio
+int congelado_em_dia(Registro* registro) {
+    IndiceCongelado* indice = registro->congelado;
+    if (!indice->desatualizado) return 1;
+    if (++indice->buscas_desatualizado < BUSCAS_PARA_RECONGELAR) return 0;
+    return congelar_registro(registro);
+}
+
+// Função para calcular os caracteres 9 a 16 do nome dobrado, que seguem os da chave
+uint64_t calcular_resto_chave(const char* nome) {
+    const unsigned char* p = (const unsigned char*)nome;
+    int cheio = 0;
+    juntar_dobrados(&p, &cheio);
+    return juntar_dobrados(&p, &cheio);
+}
+
+// Função para comparar dois prefixos sem desvios: 1 se a vem antes de b
+int prefixo_menor(PrefixoNome a, PrefixoNome b) {
+    return (a.chave < b.chave) | ((a.chave == b.chave) & (a.resto < b.resto));
+}
+
+// Função para achar a posição de Eytzinger do primeiro prefixo maior ou igual ao buscado (0 se não houver)
+// A descida não tem desvios: cada nível só soma a comparação ao dobro da posição. No fim, os bits 1
+// finais são os passos para a direita depois do último passo para a esquerda, onde está a resposta
+size_t limite_congelado(const IndiceCongelado* indice, PrefixoNome alvo) {
+    const PrefixoNome* prefixos = indice->prefixos;
+    size_t quantidade = (size_t)indice->quantidade;
+    size_t k = 1;
+    while (k <= quantidade) {
+        PREFETCH(prefixos + 8 * k);
+        PREFETCH(prefixos + 8 * k + 4);
+        k = 2 * k + prefixo_menor(prefixos[k], alvo);
+    }
+    return k >> (uns_finais(k) + 1);
+}
+
+// Função para buscar um paciente no índice congelado
+// Ignora acentos e caixa; se houver um nome idêntico byte a byte, ele tem preferência
+Paciente* buscar_congelado(const IndiceCongelado* indice, const char* nome) {
+    PrefixoNome alvo = {calcular_chave(nome), calcular_resto_chave(nome)};
+    size_t k = limite_congelado(indice, alvo);
+    if (k == 0 || prefixo_menor(alvo, indice->prefixos[k])) return NULL; // Nenhum nome com este prefixo
+
+    // Caso comum: o primeiro nome com o prefixo é o buscado
+    EntradaCongelada entrada = indice->entradas[k];
+    if (strcmp(entrada.paciente->nome, nome) == 0) return entrada.paciente;
+    int inicio = (int)entrada.posicao;
+
+    // Nomes com os mesmos 16 primeiros caracteres (em geral um só): o fim deles é achado a saltos
+    // no vetor de prefixos em ordem, e o resto do nome é comparado por busca binária só entre eles
+    int base = inicio, fim = inicio, passo = 1;
+    while (fim < indice->quantidade && !prefixo_menor(alvo, indice->ordem[fim])) {
+        base = fim + 1;
+        fim += passo;
+        passo *= 2;
+    }
+    if (fim > indice->quantidade) fim = indice->quantidade;
+    while (base < fim) {
+        int meio = base + (fim - base) / 2;
+        if (prefixo_menor(alvo, indice->ordem[meio])) fim = meio;
+        else base = meio + 1;
+    }
+
+    int esquerda = inicio, direita = fim;
+    while (esquerda < direita) {
+        int meio = esquerda + (direita - esquerda) / 2;
+        if (comparar_dobrado(nome, indice->pacientes[meio]->nome) > 0) esquerda = meio + 1;
+        else direita = meio;
+    }
+
+    Paciente* aproximado = NULL;
+    for (int i = esquerda; i < fim && comparar_dobrado(nome, indice->pacientes[i]->nome) == 0; i++) {
+        if (strcmp(indice->pacientes[i]->nome, nome) == 0) return indice->pacientes[i];
+        if (aproximado == NULL) aproximado = indice->pacientes[i];
+    }
+    return aproximado;
+}
+
+// Função para congelar os cadastros de todos os médicos, para uma sessão de consultas
+void congelar_clinica(Clinica* clinica) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        double inicio = milissegundos_agora();
+        if (congelar_registro(registro)) {
+            printf("Cadastro de %s congelado: %d pacientes em %.1f ms.\n", registro->medico,
+                   registro->congelado->quantidade, milissegundos_agora() - inicio);
+        } else {
+            printf("O cadastro de %s é %s e não pode ser congelado.\n", registro->medico,
+                   registro->motor == MOTOR_DISCO ? "em disco" : "compartilhado");
+        }
+    }
+}
+
+// Função para aplicar ao cache, ao filtro e ao índice deste processo as inserções e remoções que
+// outros processos fizeram no cadastro compartilhado; se elas já saíram do registro de mudanças
+// (ou logo depois de anexar), filtro e índice são refeitos a partir da árvore
+void sincronizar_compartilhado(Registro* registro) {
+    SegmentoCompartilhado* segmento = registro->compartilhado;
+    if (segmento == NULL) return;
+
+    travar_leitura_segmento(segmento);
+    CabecalhoCompartilhado* cabecalho = segmento->cabecalho;
+    unsigned long geracao = cabecalho->geracao;
+    if (geracao != segmento->geracao_vista) {
+        limpar_cache_buscas(registro->cache);
+        if (geracao - segmento->geracao_vista > MUDANCAS_COMPARTILHADAS) {
+            refazer_filtro(registro);
+            refazer_indice_termos(registro);
+        } else {
+            for (unsigned long g = segmento->geracao_vista + 1; g != geracao + 1; g++) {
+                MudancaCompartilhada* mudanca = &cabecalho->mudancas[g % MUDANCAS_COMPARTILHADAS];
+                const char* nome = nome_compartilhado(segmento, mudanca->nome);
+                if (mudanca->removido) {
+                    filtro_remover(registro->filtro, hash_nome_dobrado(nome));
+                    indice_remover_nome(registro->termos, nome);
+                } else {
+                    registro_contar_nome(registro, nome);
+                    indice_adicionar_nome(registro->termos, nome);
+                }
+            }
+        }
+        segmento->geracao_vista = geracao;
+    }
+    destravar_segmento(segmento);
+}
+
+// Funções para manter a trava de leitura de todos os cadastros compartilhados durante uma operação
+// que conta os pacientes e depois os percorre (nenhum outro processo muda o total entre os dois passos)
+void iniciar_leitura_compartilhada(Clinica* clinica) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_COMPARTILHADO) travar_leitura_segmento(clinica->registros[i].compartilhado);
+    }
+}
+
+void terminar_leitura_compartilhada(Clinica* clinica) {
+    for (int i = clinica->quantidade - 1; i >= 0; i--) {
+        if (clinica->registros[i].motor == MOTOR_COMPARTILHADO) destravar_segmento(clinica->registros[i].compartilhado);
+    }
+}
+
+// Função para saber se todos os cadastros estão em memória compartilhada criada por outro processo,
+// que carrega os arquivos: nesse caso não há o que ler e a clínica só se anexa aos segmentos
+int compartilhados_carregados(Clinica* clinica) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor != MOTOR_COMPARTILHADO || !registro->compartilhado->ja_carregado) return 0;
+    }
+    return clinica->quantidade > 0;
+}
+
+// Função para esperar que os processos que criaram os segmentos compartilhados terminem de carregar
+// os arquivos neles, para que um processo recém-anexado não veja os cadastros pela metade
+// Se quem carrega morreu, ou passou ESPERA_CARGA_SEGMENTO segundos sem pôr nada no segmento, o segmento
+// é descartado e anexado de novo: este processo (ou outro que esperava) o cria e carrega os arquivos
+void aguardar_carga_compartilhada(Clinica* clinica) {
+    int avisado = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor != MOTOR_COMPARTILHADO) continue;
+        uint64_t usado = 0;
+        double avanco = milissegundos_agora();
+        while (registro->compartilhado->ja_carregado && !atomic_load(&registro->compartilhado->cabecalho->carregado)) {
+            SegmentoCompartilhado* segmento = registro->compartilhado;
+            int criador = segmento->cabecalho->criador;
+            if (segmento->cabecalho->usado != usado) {
+                usado = segmento->cabecalho->usado;
+                avanco = milissegundos_agora();
+            }
+            int parado = milissegundos_agora() - avanco > ESPERA_CARGA_SEGMENTO * 1000.0;
+            if (parado || !processo_vivo(criador)) {
+                printf("O processo %d, que carregava os pacientes de %s, %s; a memória compartilhada será recriada.\n",
+                       criador, registro->medico, parado ? "parou de avançar" : "terminou");
+                char nome[sizeof(segmento->nome)];
+                snprintf(nome, sizeof(nome), "%s", segmento->nome);
+                // Sem tomar a trava: quem carrega a tem durante toda a carga
+                descartar_segmento(nome, segmento->descritor);
+                atomic_store(&segmento->vaga->pid, 0);
+                fechar_segmento(segmento);
+                registro->compartilhado = anexar_segmento(nome);
+                if (registro->compartilhado == NULL) exit(1);
+                usado = 0;
+                avanco = milissegundos_agora();
+                continue;
+            }
+            if (!avisado) printf("Aguardando outro processo terminar de carregar os pacientes...\n");
+            avisado = 1;
+            usleep(10000);
+        }
+    }
+}
+
+// Função para procurar de novo, pelo nome, um paciente antes de alterá-lo: no cadastro compartilhado
+// outro processo pode tê-lo removido ou movido na árvore, e no cadastro em disco o residente pode ter
+// saído da tabela (nos outros motores nada muda)
+// Retorna NULL se o paciente não existir mais
+Paciente* revalidar_paciente(Registro* registro, Paciente* paciente, const char* nome) {
+    if (registro->motor != MOTOR_COMPARTILHADO && registro->motor != MOTOR_DISCO) return paciente;
+    Paciente* atual = registro_buscar(registro, nome);
+    if (atual != NULL && strcmp(atual->nome, nome) == 0) return atual;
+    printf("Paciente não encontrado: ele foi alterado ou removido por outro processo.\n");
+    return NULL;
+}
+
+// Função para buscar um paciente no cadastro de um médico
+// O filtro descarta a maioria dos nomes ausentes; os demais seguem para o cache e a estrutura
+Paciente* registro_buscar(Registro* registro, const char* nome) {
+    uint64_t hash = hash_nome_dobrado(nome);
+    if (!registro_pode_conter(registro, hash)) return NULL;
+    return registro_buscar_candidato(registro, nome, hash);
+}
+
+// Função para buscar um nome que passou pelo filtro
+// Uma busca repetida sai do cache; as demais percorrem a estrutura e o resultado é guardado
+Paciente* registro_buscar_candidato(Registro* registro, const char* nome, uint64_t hash) {
+    // A árvore em disco dispensa o cache: as páginas mais usadas já ficam no buffer
+    if (registro->motor == MOTOR_DISCO) return buscar_disco(registro->disco, nome);
+    if (registro->motor == MOTOR_COMPARTILHADO) {
+        // O cache só vale depois de aplicadas as mudanças dos outros processos
+        travar_leitura_segmento(registro->compartilhado);
+        sincronizar_compartilhado(registro);
+        // A vista guardada no cache é refeita: outro processo pode ter alterado o paciente
+        SegmentoCompartilhado* segmento = registro->compartilhado;
+        Paciente* paciente = buscar_cache(registro->cache, nome, hash);
+        if (paciente != NULL) {
+            paciente = paciente_compartilhado(segmento, deslocamento_vista(segmento, paciente));
+        } else {
+            paciente = buscar_compartilhado(segmento, nome);
+            if (paciente != NULL) guardar_cache(registro->cache, nome, hash, paciente);
+        }
+        destravar_segmento(registro->compartilhado);
+        return paciente;
+    }
+
+    Paciente* paciente = buscar_cache(registro->cache, nome, hash);
+    if (paciente != NULL) return paciente;
+
+    if (registro->congelado != NULL && congelado_em_dia(registro)) paciente = buscar_congelado(registro->congelado, nome);
+    else if (registro->motor == MOTOR_LISTA) paciente = buscar_lista(registro->lista, nome);
+    else if (registro->motor == MOTOR_BLOCOS) paciente = buscar_blocos(registro->blocos, nome);
+    else paciente = buscar_avl(registro->raiz, nome);
+    if (paciente != NULL) guardar_cache(registro->cache, nome, hash, paciente);
+    return paciente;
+}
+
+// Função para cadastrar um paciente com um médico; retorna 0 se o nome já existir
+int registro_inserir(Registro* registro, Paciente paciente) {
+    Paciente* existente = registro_buscar(registro, paciente.nome);
+    if (existente != NULL && strcmp(existente->nome, paciente.nome) == 0) {
+        printf("Erro: Já existe um paciente com o nome %s.\n", paciente.nome);
+        return 0;
+    }
+    if (registro->motor == MOTOR_DISCO) {
+        // Sem filtro nem índice de termos; como no segmento compartilhado, o histórico não vai para o arquivo
+        if (!nome_cabe_disco(paciente.nome)) return 0;
+        inserir_disco(registro->disco, &paciente);
+        registro->alterado = 1;
+        return 1;
+    }
+    registro->alterado = 1;
+
+    // Um nome novo pode passar a ser a resposta preferida de buscas já guardadas (grafia exata)
+    limpar_cache_buscas(registro->cache);
+    invalidar_congelado(registro);
+    if (registro->motor == MOTOR_PERSISTENTE) {
+        int inserido;
+        paciente.chave = calcular_chave(paciente.nome);
+        registro->raiz = inserir_persistente(registro->raiz, &paciente, &inserido);
+    } else if (registro->motor == MOTOR_COMPARTILHADO) {
+        // O segmento não guarda o histórico: um paciente transferido para cá fica só com a última consulta
+        uint64_t inserido;
+        SegmentoCompartilhado* segmento = registro->compartilhado;
+        paciente.chave = calcular_chave(paciente.nome);
+        segmento->cabecalho->raiz = inserir_compartilhado(segmento, segmento->cabecalho->raiz, &paciente, &inserido);
+        segmento->cabecalho->pacientes++;
+        registrar_mudanca(segmento, 0, inserido);
+    } else {
+        if (registro->motor == MOTOR_LISTA) inserir_ordenado(registro->lista, paciente);
+        else if (registro->motor == MOTOR_BLOCOS) inserir_blocos(registro->blocos, paciente);
+        else registro->raiz = inserir_avl(registro->raiz, paciente);
+        reter_historico(paciente.historico);
+    }
+    registro_contar_nome(registro, paciente.nome);
+    indice_adicionar_nome(registro->termos, paciente.nome);
+    return 1;
+}
+
+// Função para remover um paciente (ponteiro devolvido por registro_buscar) do cadastro de um médico
+void registro_remover(Registro* registro, Paciente* paciente) {
+    registro->alterado = 1;
+    if (registro->motor == MOTOR_DISCO) {
+        remover_disco(registro->disco, paciente->nome);
+        return;
+    }
+    limpar_cache_buscas(registro->cache);
+    invalidar_congelado(registro);
+    filtro_remover(registro->filtro, hash_nome_dobrado(paciente->nome));
+    indice_remover_nome(registro->termos, paciente->nome);
+    if (registro->motor == MOTOR_PERSISTENTE) {
+        registro->raiz = remover_persistente(registro->raiz, paciente);
+        return;
+    }
+    if (registro->motor == MOTOR_COMPARTILHADO) {
+        SegmentoCompartilhado* segmento = registro->compartilhado;
+        registrar_mudanca(segmento, 1, deslocamento_vista(segmento, paciente));
+        segmento->cabecalho->raiz = remover_compartilhado(segmento, segmento->cabecalho->raiz, paciente);
+        segmento->cabecalho->pacientes--;
+        return;
+    }
+    HistoricoConsultas* historico = paciente->historico;
+    if (registro->motor == MOTOR_LISTA) remover_lista(registro->lista, paciente);
+    else if (registro->motor == MOTOR_BLOCOS) remover_blocos(registro->blocos, paciente);
+    else registro->raiz = remover_avl(registro->raiz, paciente);
+    liberar_historico(historico);
+}
+
+// Função para inserir vários pacientes de uma vez no cadastro de um médico
+// A árvore persistente recebe um paciente por vez: a união da AVL reaproveitaria nós de outras versões
+void registro_inserir_lote(Registro* registro, Paciente* pacientes, int quantidade, RelatorioConflitos* conflitos) {
+    // O processo que criou o segmento compartilhado carrega os arquivos nele; os outros não repetem a carga
+    if (registro->motor == MOTOR_COMPARTILHADO && registro->compartilhado->ja_carregado) return;
+    registro->alterado = 1;
+    if (registro->motor == MOTOR_DISCO) {
+        inserir_lote_disco(registro->disco, pacientes, quantidade, conflitos);
+        return;
+    }
+
+    limpar_cache_buscas(registro->cache);
+    invalidar_congelado(registro);
+    if (registro->motor == MOTOR_COMPARTILHADO) {
+        SegmentoCompartilhado* segmento = registro->compartilhado;
+        for (int i = 0; i < quantidade; i++) {
+            uint64_t inserido;
+            pacientes[i].chave = calcular_chave(pacientes[i].nome);
+            segmento->cabecalho->raiz = inserir_compartilhado(segmento, segmento->cabecalho->raiz, &pacientes[i], &inserido);
+            if (inserido == 0) {
+                registrar_conflito(conflitos, pacientes[i].nome);
+                continue;
+            }
+            segmento->cabecalho->pacientes++;
+            registrar_mudanca(segmento, 0, inserido);
+        }
+    } else if (registro->motor == MOTOR_PERSISTENTE) {
+        for (int i = 0; i < quantidade; i++) {
+            int inserido;
+            pacientes[i].chave = calcular_chave(pacientes[i].nome);
+            registro->raiz = inserir_persistente(registro->raiz, &pacientes[i], &inserido);
+            if (!inserido) registrar_conflito(conflitos, pacientes[i].nome);
+        }
+    } else if (registro->motor == MOTOR_LISTA) {
+        inserir_lote_lista(registro->lista, pacientes, quantidade, conflitos);
+    } else if (registro->motor == MOTOR_BLOCOS) {
+        inserir_lote_blocos(registro->blocos, pacientes, quantidade, conflitos);
+    } else {
+        registro->raiz = inserir_lote_avl(registro->raiz, pacientes, quantidade, conflitos);
+    }
+
+    // Um lote que satura o filtro (como o carregamento dos arquivos) o refaz de uma vez;
+    // nomes recusados por conflito ficam contados a mais, o que só custa falsos positivos
+    if (registro->filtro->elementos + (size_t)quantidade > registro->filtro->limite) {
+        refazer_filtro(registro);
+    } else {
+        for (int i = 0; i < quantidade; i++) filtro_adicionar(registro->filtro, hash_nome_dobrado(pacientes[i].nome));
+    }
+    // Nomes recusados por conflito já estão no índice e não ganham outro id
+    for (int i = 0; i < quantidade; i++) indice_adicionar_nome(registro->termos, pacientes[i].nome);
+}
+
+// Função para trocar os dados de um paciente que continua na mesma posição (mesmo nome)
+// Retorna o novo endereço do paciente: no motor persistente a alteração gera uma cópia do nó
+Paciente* registro_atualizar(Registro* registro, Paciente* paciente, Paciente alterado) {
+    alterado.nome = paciente->nome;
+    alterado.chave = paciente->chave;
+    registro->alterado = 1;
+    if (registro->motor == MOTOR_DISCO) return atualizar_disco(registro->disco, paciente, alterado);
+    if (registro->motor == MOTOR_PERSISTENTE) {
+        // O caminho até o paciente foi copiado: o cache e o índice congelado ainda apontam para os nós
+        // da versão anterior
+        limpar_cache_buscas(registro->cache);
+        invalidar_congelado(registro);
+        Paciente* resultado = NULL;
+        registro->raiz = substituir_persistente(registro->raiz, paciente, alterado, &resultado);
+        return resultado;
+    }
+    if (registro->motor == MOTOR_COMPARTILHADO) return atualizar_compartilhado(registro->compartilhado, paciente, alterado);
+    // Nos demais o paciente continua no lugar (o nome não muda, então nem na lista desenrolada ele se move)
+    *paciente = alterado;
+    return paciente;
+}
+
+// Função para saber se uma escrita (versão da clínica) mudou um cadastro
+// Retorna 1 se mudou, 0 se não mudou e -1 se ela é mais antiga que as escritas que ele ainda guarda
+int escrita_alterou(const Registro* registro, unsigned long escrita) {
+    for (int i = 0; i < registro->num_escritas; i++) {
+        if (registro->escritas[i] == escrita) return 1;
+    }
+    if (registro->num_escritas == LIMITE_DESFAZER && registro->escritas[0] > escrita) return -1;
+    return 0;
+}
+
+// Função para voltar o cadastro persistente de um médico à versão anterior à sua última escrita
+// Os outros cadastros alterados pela mesma escrita (uma transferência) voltam junto; se algum deles
+// não puder voltar exatamente para antes dela (outro motor, ou já mudou depois), nada é desfeito
+// e esse cadastro vai em 'impedimento'
+// Retorna 1 se desfez, 0 se não houver o que desfazer e -1 se a escrita não puder ser desfeita
+int registro_desfazer(Clinica* clinica, Registro* registro, Registro** impedimento) {
+    pthread_mutex_lock(&clinica->trava);
+    int desfeito = registro->num_escritas > 0;
+    unsigned long escrita = desfeito ? registro->escritas[registro->num_escritas - 1] : 0;
+    for (int i = 0; desfeito == 1 && i < clinica->quantidade; i++) {
+        Registro* outro = &clinica->registros[i];
+        int alterou = escrita_alterou(outro, escrita);
+        if (alterou == 0) continue;
+        if (alterou < 0 || outro->motor != MOTOR_PERSISTENTE || outro->escritas[outro->num_escritas - 1] != escrita) {
+            *impedimento = outro;
+            desfeito = -1;
+        }
+    }
+    if (desfeito == 1) {
+        for (int i = 0; i < clinica->quantidade; i++) {
+            Registro* outro = &clinica->registros[i];
+            if (outro->num_escritas == 0 || outro->escritas[outro->num_escritas - 1] != escrita) continue;
+            liberar_no(outro->raiz);
+            outro->raiz = outro->versoes[--outro->num_escritas];
+            limpar_cache_buscas(outro->cache);
+            invalidar_congelado(outro);
+            refazer_filtro(outro);
+            refazer_indice_termos(outro);
+        }
+        clinica->versao++;
+    }
+    pthread_mutex_unlock(&clinica->trava);
+    return desfeito;
+}
+
+// Função chamada ao fim do carregamento dos arquivos: ele não pode ser desfeito, então as
+// versões guardadas são esquecidas, e as buscas feitas nele não contam para o cache
+void concluir_carregamento(Clinica* clinica) {
+    pthread_mutex_lock(&clinica->trava);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_PERSISTENTE) {
+            while (registro->num_escritas > 0) liberar_no(registro->versoes[--registro->num_escritas]);
+        }
+        registro->num_escritas = 0;
+        registro->alterado = 0;
+        registro->cache->acertos = 0;
+        registro->cache->falhas = 0;
+        registro->filtro->descartes = 0;
+        // Daqui em diante um lote em um cadastro compartilhado é uma importação, que sempre é inserida,
+        // e em um cadastro em disco os nomes que já estão na árvore voltam a ser conflitos
+        if (registro->motor == MOTOR_COMPARTILHADO) {
+            atomic_store(&registro->compartilhado->cabecalho->carregado, 1);
+            registro->compartilhado->ja_carregado = 0;
+        }
+        if (registro->motor == MOTOR_DISCO) registro->disco->em_carga = 0;
+    }
+    pthread_mutex_unlock(&clinica->trava);
+}
+
+// Função para obter o nome de um motor, como escrito no arquivo de médicos
+const char* nome_motor(MotorRegistro motor) {
+    if (motor == MOTOR_LISTA) return "lista";
+    if (motor == MOTOR_BLOCOS) return "blocos";
+    if (motor == MOTOR_AVL) return "avl";
+    if (motor == MOTOR_PERSISTENTE) return "persistente";
+    if (motor == MOTOR_COMPARTILHADO) return "compartilhado";
+    return "disco";
+}
+
+// Função para saber se o motor guarda os pacientes em ordem Z-A (as duas listas)
+int motor_decrescente(MotorRegistro motor) {
+    return motor == MOTOR_LISTA || motor == MOTOR_BLOCOS;
+}
+
+// Função para abrir um cursor sobre o cadastro de um médico (fora dos pacientes até ser posicionado)
+void cursor_registro(CursorRegistro* cursor, Registro* registro) {
+    cursor->motor = registro->motor;
+    cursor->lista = registro->lista;
+    cursor->blocos = registro->blocos;
+    cursor->compartilhado = registro->compartilhado;
+    cursor->disco = registro->disco;
+    if (registro->motor == MOTOR_COMPARTILHADO) cursor->raiz = registro->compartilhado->cabecalho->raiz;
+    else cursor->raiz = (uint64_t)(uintptr_t)registro->raiz;
+    cursor->profundidade = 0;
+    cursor->no = NULL;
+    cursor->bloco = NULL;
+    cursor->posicao_disco.folha = 0;
+}
+
+// Função para abrir um cursor sobre uma árvore avulsa (como a versão retida pelo salvamento automático)
+void cursor_arvore(CursorRegistro* cursor, NoAVL* raiz) {
+    cursor->motor = MOTOR_AVL;
+    cursor->lista = NULL;
+    cursor->blocos = NULL;
+    cursor->compartilhado = NULL;
+    cursor->disco = NULL;
+    cursor->raiz = (uint64_t)(uintptr_t)raiz;
+    cursor->profundidade = 0;
+    cursor->no = NULL;
+    cursor->bloco = NULL;
+    cursor->posicao_disco.folha = 0;
+}
+
+// Função para obter o filho esquerdo (direita = 0) ou direito de um nó da árvore do cursor (0 se não houver)
+uint64_t cursor_filho(const CursorRegistro* cursor, uint64_t no, int direita) {
+    if (cursor->motor == MOTOR_COMPARTILHADO) {
+        NoCompartilhado* compartilhado = no_compartilhado(cursor->compartilhado, no);
+        return direita ? compartilhado->direita : compartilhado->esquerda;
+    }
+    NoAVL* avl = (NoAVL*)(uintptr_t)no;
+    return (uint64_t)(uintptr_t)(direita ? avl->direita : avl->esquerda);
+}
+
+// Função para obter o paciente atual do cursor (NULL fora dos pacientes)
+Paciente* cursor_atual(CursorRegistro* cursor) {
+    if (cursor->motor == MOTOR_LISTA) return cursor->no != NULL ? &cursor->no->paciente : NULL;
+    if (cursor->motor == MOTOR_BLOCOS) return cursor->bloco != NULL ? &cursor->bloco->pacientes[cursor->posicao] : NULL;
+    if (cursor->motor == MOTOR_DISCO) return cursor->posicao_disco.folha != 0 ? &cursor->copia : NULL;
+    if (cursor->profundidade == 0) return NULL;
+    uint64_t no = cursor->caminho[cursor->profundidade - 1];
+    if (cursor->motor == MOTOR_COMPARTILHADO) return paciente_compartilhado(cursor->compartilhado, no);
+    return &((NoAVL*)(uintptr_t)no)->paciente;
+}
+
+// Função para descer a partir de um nó até o paciente mais à esquerda (direita = 0) ou mais à direita,
+// acrescentando o trajeto ao caminho do cursor
+Paciente* cursor_extremo(CursorRegistro* cursor, uint64_t no, int direita) {
+    while (no != 0) {
+        cursor->caminho[cursor->profundidade++] = no;
+        no = cursor_filho(cursor, no, direita);
+    }
+    return cursor_atual(cursor);
+}
+
+// Funções para posicionar o cursor no primeiro (A) ou no último (Z) paciente
+Paciente* cursor_primeiro(CursorRegistro* cursor) {
+    if (cursor->motor == MOTOR_LISTA) {
+        cursor->no = cursor->lista->fim;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_BLOCOS) {
+        cursor->bloco = cursor->blocos->fim;
+        if (cursor->bloco != NULL) cursor->posicao = cursor->bloco->quantidade - 1;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_DISCO) {
+        pthread_mutex_lock(&cursor->disco->trava);
+        cursor->posicao_disco = extremo_disco(cursor->disco, 0);
+        Paciente* paciente = cursor_copiar_disco(cursor);
+        pthread_mutex_unlock(&cursor->disco->trava);
+        return paciente;
+    }
+    cursor->profundidade = 0;
+    return cursor_extremo(cursor, cursor->raiz, 0);
+}
+
+Paciente* cursor_ultimo(CursorRegistro* cursor) {
+    if (cursor->motor == MOTOR_LISTA) {
+        cursor->no = cursor->lista->inicio;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_BLOCOS) {
+        cursor->bloco = cursor->blocos->inicio;
+        cursor->posicao = 0;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_DISCO) {
+        pthread_mutex_lock(&cursor->disco->trava);
+        cursor->posicao_disco = extremo_disco(cursor->disco, 1);
+        Paciente* paciente = cursor_copiar_disco(cursor);
+        pthread_mutex_unlock(&cursor->disco->trava);
+        return paciente;
+    }
+    cursor->profundidade = 0;
+    return cursor_extremo(cursor, cursor->raiz, 1);
+}
+
+// Função para ler o paciente da posição do cursor na árvore em disco para a cópia do cursor
+// (com a trava da árvore já tomada)
+Paciente* cursor_copiar_disco(CursorRegistro* cursor) {
+    if (cursor->posicao_disco.folha != 0) {
+        ler_posicao_disco(cursor->disco, cursor->posicao_disco, &cursor->copia, cursor->nome_copia);
+    }
+    cursor->modificacoes = cursor->disco->modificacoes;
+    return cursor_atual(cursor);
+}
+
+// Função para mover o cursor para o paciente seguinte (direita = 1) ou o anterior na ordem A-Z
+// Na árvore: se há subárvore do lado do movimento, o vizinho é o extremo oposto dela; se não, o cursor
+// sobe até chegar de um filho do lado contrário. Fora dos pacientes, o cursor continua fora
+Paciente* cursor_andar(CursorRegistro* cursor, int direita) {
+    if (cursor->motor == MOTOR_LISTA) {
+        if (cursor->no != NULL) cursor->no = direita ? cursor->no->anterior : cursor->no->proximo;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_BLOCOS) {
+        if (cursor->bloco == NULL) return NULL;
+        if (direita && --cursor->posicao < 0) {
+            cursor->bloco = cursor->bloco->anterior;
+            if (cursor->bloco != NULL) cursor->posicao = cursor->bloco->quantidade - 1;
+        } else if (!direita && ++cursor->posicao == cursor->bloco->quantidade) {
+            cursor->bloco = cursor->bloco->proximo;
+            cursor->posicao = 0;
+        }
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_DISCO) {
+        if (cursor->posicao_disco.folha == 0) return NULL;
+        ArvoreDisco* arvore = cursor->disco;
+        pthread_mutex_lock(&arvore->trava);
+        if (cursor->modificacoes == arvore->modificacoes) {
+            andar_posicao_disco(arvore, &cursor->posicao_disco, direita);
+        } else {
+            // A árvore mudou desde a leitura da cópia: o vizinho é achado pelo nome dela
+            Paciente* atual = &cursor->copia;
+            PosicaoDisco posicao = localizar_disco(arvore, atual->chave, atual->nome, 1);
+            if (direita) {
+                if (posicao.folha != 0 && comparar_posicao_disco(arvore, posicao, atual->chave, atual->nome, 1) == 0) {
+                    andar_posicao_disco(arvore, &posicao, 1);
+                }
+            } else if (posicao.folha != 0) {
+                andar_posicao_disco(arvore, &posicao, 0);
+            } else {
+                posicao = extremo_disco(arvore, 1);
+            }
+            cursor->posicao_disco = posicao;
+        }
+        Paciente* paciente = cursor_copiar_disco(cursor);
+        pthread_mutex_unlock(&arvore->trava);
+        return paciente;
+    }
+    if (cursor->profundidade == 0) return NULL;
+
+    uint64_t filho = cursor_filho(cursor, cursor->caminho[cursor->profundidade - 1], direita);
+    if (filho != 0) {
+        cursor->caminho[cursor->profundidade++] = filho;
+        return cursor_extremo(cursor, cursor_filho(cursor, filho, !direita), !direita);
+    }
+    uint64_t vindo;
+    do {
+        vindo = cursor->caminho[--cursor->profundidade];
+    } while (cursor->profundidade > 0 && cursor_filho(cursor, cursor->caminho[cursor->profundidade - 1], direita) == vindo);
+    return cursor_atual(cursor);
+}
+
+Paciente* cursor_proximo(CursorRegistro* cursor) {
+    return cursor_andar(cursor, 1);
+}
+
+Paciente* cursor_anterior(CursorRegistro* cursor) {
+    return cursor_andar(cursor, 0);
+}
+
+// Função para posicionar o cursor no primeiro paciente cujo nome não vem antes do buscado
+// (ignorando acentos e caixa); fica fora dos pacientes se todos vierem antes
+Paciente* cursor_posicionar(CursorRegistro* cursor, const char* nome) {
+    uint64_t chave = calcular_chave(nome);
+    if (cursor->motor == MOTOR_LISTA) {
+        // A lista está em ordem Z-A: o caminho A-Z começa no fim
+        NoLista* no = cursor->lista->fim;
+        while (no != NULL && comparar_busca(chave, nome, &no->paciente) > 0) no = no->anterior;
+        cursor->no = no;
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_BLOCOS) {
+        // Volta a partir do último bloco até um cujo maior nome (o primeiro) não vem antes do buscado
+        BlocoPacientes* bloco = cursor->blocos->fim;
+        while (bloco != NULL && comparar_busca(chave, nome, &bloco->pacientes[0]) > 0) bloco = bloco->anterior;
+        cursor->bloco = bloco;
+        if (bloco != NULL) {
+            int posicao = bloco->quantidade - 1;
+            while (comparar_busca(chave, nome, &bloco->pacientes[posicao]) > 0) posicao--;
+            cursor->posicao = posicao;
+        }
+        return cursor_atual(cursor);
+    }
+    if (cursor->motor == MOTOR_DISCO) {
+        pthread_mutex_lock(&cursor->disco->trava);
+        cursor->posicao_disco = localizar_disco(cursor->disco, chave, nome, 0);
+        Paciente* paciente = cursor_copiar_disco(cursor);
+        pthread_mutex_unlock(&cursor->disco->trava);
+        return paciente;
+    }
+
+    // Desce como uma busca; a resposta é o último nó onde a descida foi para a esquerda
+    int resposta = 0;
+    cursor->profundidade = 0;
+    uint64_t no = cursor->raiz;
+    while (no != 0) {
+        cursor->caminho[cursor->profundidade++] = no;
+        Paciente* paciente = cursor_atual(cursor);
+        int direita = comparar_busca(chave, nome, paciente) > 0;
+        if (!direita) resposta = cursor->profundidade;
+        no = cursor_filho(cursor, no, direita);
+    }
+    cursor->profundidade = resposta;
+    return cursor_atual(cursor);
+}
+
+// Função para escolher o médico com o menor paciente atual entre os cursores do iterador
+void escolher_menor_iterador(IteradorClinica* iterador) {
+    iterador->atual = -1;
+    Paciente* menor = NULL;
+    for (int i = 0; i < iterador->clinica->quantidade; i++) {
+        Paciente* paciente = cursor_atual(&iterador->cursores[i]);
+        if (paciente != NULL && (menor == NULL || comparar_pacientes(paciente, menor) < 0)) {
+            menor = paciente;
+            iterador->atual = i;
+        }
+    }
+}
+
+// Função para abrir o iterador de todos os médicos, já no primeiro paciente em ordem A-Z
+// Os cadastros compartilhados ficam com a trava de leitura até liberar_iterador
+Paciente* iniciar_iterador(IteradorClinica* iterador, Clinica* clinica) {
+    materializar_clinica(clinica);
+    iterador->clinica = clinica;
+    iterador->cursores = (CursorRegistro*)malloc(clinica->quantidade * sizeof(CursorRegistro));
+    if (iterador->cursores == NULL) {
+        printf("Erro ao alocar memória para o iterador.\n");
+        exit(1);
+    }
+    iniciar_leitura_compartilhada(clinica);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        cursor_registro(&iterador->cursores[i], &clinica->registros[i]);
+        cursor_primeiro(&iterador->cursores[i]);
+    }
+    escolher_menor_iterador(iterador);
+    return iterador_atual(iterador);
+}
+
+// Função para posicionar o iterador no primeiro paciente, entre todos os médicos, que não vem antes do nome
+Paciente* iterador_posicionar(IteradorClinica* iterador, const char* nome) {
+    for (int i = 0; i < iterador->clinica->quantidade; i++) cursor_posicionar(&iterador->cursores[i], nome);
+    escolher_menor_iterador(iterador);
+    return iterador_atual(iterador);
+}
+
+Paciente* iterador_atual(const IteradorClinica* iterador) {
+    return iterador->atual < 0 ? NULL : cursor_atual(&iterador->cursores[iterador->atual]);
+}
+
+Paciente* iterador_proximo(IteradorClinica* iterador) {
+    if (iterador->atual < 0) return NULL;
+    cursor_proximo(&iterador->cursores[iterador->atual]);
+    escolher_menor_iterador(iterador);
+    return iterador_atual(iterador);
+}
+
+void liberar_iterador(IteradorClinica* iterador) {
+    terminar_leitura_compartilhada(iterador->clinica);
+    free(iterador->cursores);
+    iterador->cursores = NULL;
+}
+
+// Função para saber se um nome já passou do limite de um intervalo (ignorando acentos e caixa)
+// Nomes que começam com o limite ainda estão dentro: "Lima" vai até "Lima Zuleica"
+int passou_do_limite(const char* limite, const char* nome) {
+    const unsigned char* pl = (const unsigned char*)limite;
+    const unsigned char* pn = (const unsigned char*)nome;
+    int cl, cn;
+    do {
+        cl = dobrar_caractere(&pl);
+        cn = dobrar_caractere(&pn);
+    } while (cl == cn && cl != 0);
+    return cl != 0 && cn > cl;
+}
+
+// Função para listar os pacientes de todos os médicos com nome entre de e ate, em ordem A-Z
+void listar_intervalo(Clinica* clinica, const char* de, const char* ate) {
+    IteradorClinica iterador;
+    iniciar_iterador(&iterador, clinica);
+    int encontrados = 0;
+    for (Paciente* paciente = iterador_posicionar(&iterador, de); paciente != NULL && !passou_do_limite(ate, paciente->nome);
+         paciente = iterador_proximo(&iterador)) {
+        printf("Médico: %s\n", clinica->registros[iterador.atual].medico);
+        exibir_paciente(paciente);
+        printf("\n");
+        auditar(clinica->auditoria, EVENTO_LEITURA, clinica->registros[iterador.atual].medico, paciente->nome);
+        encontrados++;
+    }
+    liberar_iterador(&iterador);
+    if (encontrados == 0) printf("Nenhum paciente entre %s e %s.\n", de, ate);
+    else printf("%d paciente(s) entre %s e %s.\n", encontrados, de, ate);
+}
+
+// Função para percorrer os pacientes de um médico na ordem da sua estrutura
+// (Z-A nas listas, que o cursor anda de trás para a frente, e A-Z nas árvores)
+void registro_percorrer(Registro* registro, void (*visitar)(Paciente*, void*), void* contexto) {
+    if (registro->motor == MOTOR_COMPARTILHADO) travar_leitura_segmento(registro->compartilhado);
+    CursorRegistro cursor;
+    cursor_registro(&cursor, registro);
+    if (motor_decrescente(registro->motor)) {
+        for (Paciente* paciente = cursor_ultimo(&cursor); paciente != NULL; paciente = cursor_anterior(&cursor)) {
+            visitar(paciente, contexto);
+        }
+    } else {
+        for (Paciente* paciente = cursor_primeiro(&cursor); paciente != NULL; paciente = cursor_proximo(&cursor)) {
+            visitar(paciente, contexto);
+        }
+    }
+    if (registro->motor == MOTOR_COMPARTILHADO) destravar_segmento(registro->compartilhado);
+}
+
+// Função auxiliar de contagem usada com registro_percorrer
+void contar_paciente(Paciente* paciente, void* contexto) {
+    (void)paciente;
+    (*(int*)contexto)++;
+}
+
+// Funções auxiliares para listar e gravar pacientes (usadas com registro_percorrer)
+void exibir_paciente_visitado(Paciente* paciente, void* contexto) {
+    (void)contexto;
+    exibir_paciente(paciente);
+    printf("\n");
+}
+
+void gravar_paciente_visitado(Paciente* paciente, void* contexto) {
+    fprintf((FILE*)contexto, "%s, %c, %s, %s\n", paciente->nome, paciente->sexo, paciente->nascimento, paciente->ultima_consulta);
+}
+
+// Função para contar os pacientes de um médico
+// A árvore em disco guarda a contagem, para não ler o arquivo inteiro
+int registro_contar(Registro* registro) {
+    if (registro->motor == MOTOR_DISCO) return (int)registro->disco->meta.pacientes;
+    int quantidade = 0;
+    registro_percorrer(registro, contar_paciente, &quantidade);
+    return quantidade;
+}
+
+// Função para listar os pacientes de um médico, na ordem da sua estrutura
+void registro_listar(Registro* registro) {
+    printf("\n--- Lista de Pacientes (%s) ---\n", registro->medico);
+    if (registro->motor == MOTOR_COMPARTILHADO) travar_leitura_segmento(registro->compartilhado);
+    CursorRegistro cursor;
+    cursor_registro(&cursor, registro);
+    if (cursor_primeiro(&cursor) == NULL) printf("Nenhum paciente cadastrado.\n");
+    registro_percorrer(registro, exibir_paciente_visitado, NULL);
+    if (registro->motor == MOTOR_COMPARTILHADO) destravar_segmento(registro->compartilhado);
+}
+
+// Função para gravar os pacientes de um médico em um arquivo já aberto, na ordem da estrutura
+void registro_salvar(Registro* registro, FILE* arquivo) {
+    registro_percorrer(registro, gravar_paciente_visitado, arquivo);
+}
+
+// Função para liberar a estrutura de um médico
+void registro_destruir(Registro* registro) {
+    if (registro->motor == MOTOR_PERSISTENTE) {
+        liberar_no(registro->raiz);
+        while (registro->num_escritas > 0) liberar_no(registro->versoes[--registro->num_escritas]);
+    } else if (registro->motor == MOTOR_LISTA) {
+        destruir_lista(registro->lista);
+    } else if (registro->motor == MOTOR_BLOCOS) {
+        destruir_lista_blocos(registro->blocos);
+    } else if (registro->motor == MOTOR_COMPARTILHADO) {
+        desanexar_segmento(registro->compartilhado);
+        registro->compartilhado = NULL;
+    } else if (registro->motor == MOTOR_DISCO) {
+        fechar_arvore_disco(registro->disco);
+        registro->disco = NULL;
+    } else {
+        destruir_avl(registro->raiz);
+    }
+    free(registro->cache);
+    liberar_filtro(registro->filtro);
+    liberar_indice_termos(registro->termos);
+    liberar_congelado(registro->congelado);
+    registro->congelado = NULL;
+    registro->cache = NULL;
+    registro->filtro = NULL;
+    registro->termos = NULL;
+    registro->lista = NULL;
+    registro->blocos = NULL;
+    registro->raiz = NULL;
+}
+
+// Função de tarefa: busca o nome no cadastro de um médico
+void tarefa_buscar_registro(void* argumento) {
+    TarefaBusca* tarefa = (TarefaBusca*)argumento;
+    tarefa->resultado = registro_buscar_candidato(tarefa->registro, tarefa->nome, tarefa->hash);
+}
+
+// Função para buscar um paciente em todos os médicos ao mesmo tempo
+// Um nome idêntico tem preferência sobre um que só difere por acento ou caixa
+// Em *registro fica o médico onde o paciente foi encontrado
+Paciente* buscar_clinica(Clinica* clinica, const char* nome, Registro** registro) {
+    // Modo preguiçoso: consulta o índice e descobre o médico pela regra de roteamento
+    if (clinica->preguicoso != NULL) {
+        Paciente* paciente = buscar_preguicoso(clinica->preguicoso, nome);
+        int indice = paciente != NULL ? rotear_paciente(clinica, paciente) : -1;
+        if (indice < 0) return NULL;
+        if (registro != NULL) *registro = &clinica->registros[indice];
+        return paciente;
+    }
+
+    TarefaBusca* tarefas = (TarefaBusca*)calloc(clinica->quantidade, sizeof(TarefaBusca));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para a busca.\n");
+        exit(1);
+    }
+
+    // Os filtros decidem, sem sair desta thread, quais médicos podem ter o nome;
+    // só esses são consultados, e um único candidato dispensa o pool
+    uint64_t hash = hash_nome_dobrado(nome);
+    int candidatos = 0, ultimo = -1;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        tarefas[i].registro = &clinica->registros[i];
+        tarefas[i].nome = nome;
+        tarefas[i].hash = hash;
+        if (registro_pode_conter(&clinica->registros[i], hash)) {
+            candidatos++;
+            ultimo = i;
+        } else {
+            tarefas[i].registro = NULL;
+        }
+    }
+    if (candidatos == 1) {
+        tarefa_buscar_registro(&tarefas[ultimo]);
+    } else if (candidatos > 1) {
+        for (int i = 0; i < clinica->quantidade; i++) {
+            if (tarefas[i].registro != NULL) pool_submeter(clinica->pool, tarefa_buscar_registro, &tarefas[i]);
+        }
+        pool_aguardar(clinica->pool);
+    }
+
+    Paciente* resultado = NULL;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (tarefas[i].resultado == NULL) continue;
+        if (resultado == NULL || (strcmp(resultado->nome, nome) != 0 && strcmp(tarefas[i].resultado->nome, nome) == 0)) {
+            resultado = tarefas[i].resultado;
+            if (registro != NULL) *registro = tarefas[i].registro;
+        }
+    }
+    free(tarefas);
+    return resultado;
+}
+
+// Função para buscar por partes do nome (um sobrenome, um nome do meio...) em todos os médicos
+// Cada termo precisa aparecer inteiro no nome, em qualquer posição, ignorando acentos e caixa
+void buscar_por_termos(Clinica* clinica, const char* consulta) {
+    materializar_clinica(clinica);
+    double inicio = milissegundos_agora();
+    uint32_t** ids = (uint32_t**)calloc(clinica->quantidade, sizeof(uint32_t*));
+    Paciente*** encontrados = (Paciente***)calloc(clinica->quantidade, sizeof(Paciente**)); // Cadastros em disco
+    int* quantidades = (int*)calloc(clinica->quantidade, sizeof(int));
+    if (ids == NULL || encontrados == NULL || quantidades == NULL) {
+        printf("Erro ao alocar memória para a busca.\n");
+        exit(1);
+    }
+    int total = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) {
+            encontrados[i] = buscar_termos_disco(&clinica->registros[i], consulta, &quantidades[i]);
+        } else {
+            sincronizar_compartilhado(&clinica->registros[i]);
+            ids[i] = buscar_termos_registro(clinica->registros[i].termos, consulta, &quantidades[i]);
+        }
+        total += quantidades[i];
+    }
+    double tempo_us = (milissegundos_agora() - inicio) * 1000.0;
+
+    printf("\n--- Pacientes com \"%s\" no nome ---\n", consulta);
+    int exibidos = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        for (int j = 0; j < quantidades[i] && exibidos < MAXIMO_RESULTADOS_EXIBIDOS; j++, exibidos++) {
+            const char* nome = encontrados[i] != NULL ? encontrados[i][j]->nome : clinica->registros[i].termos->nomes[ids[i][j]];
+            printf("%s (%s)\n", nome, clinica->registros[i].medico);
+        }
+        free(ids[i]);
+        free(encontrados[i]);
+    }
+    if (total > exibidos) printf("... e mais %d pacientes.\n", total - exibidos);
+    printf("%d paciente(s) encontrado(s) em %.0f µs.\n", total, tempo_us);
+    free(ids);
+    free(encontrados);
+    free(quantidades);
+}
+
+// Função para zerar um resumo e alocar o seu histograma de dias
+void iniciar_resumo(ResumoEstatistico* resumo) {
+    memset(resumo, 0, sizeof(ResumoEstatistico));
+    resumo->dias = (int*)calloc(LIMITE_DIAS_CONSULTA + 1, sizeof(int));
+    if (resumo->dias == NULL) {
+        printf("Erro ao alocar memória para as estatísticas.\n");
+        exit(1);
+    }
+}
+
+// Função para acumular um resumo em outro
+void somar_resumo(ResumoEstatistico* destino, const ResumoEstatistico* origem) {
+    destino->pacientes += origem->pacientes;
+    destino->homens += origem->homens;
+    destino->mulheres += origem->mulheres;
+    for (int i = 0; i < FAIXAS_IDADE; i++) destino->faixas_idade[i] += origem->faixas_idade[i];
+    destino->sem_nascimento += origem->sem_nascimento;
+    destino->com_consulta += origem->com_consulta;
+    destino->soma_dias += origem->soma_dias;
+    for (int i = 0; i <= LIMITE_DIAS_CONSULTA; i++) destino->dias[i] += origem->dias[i];
+}
+
+// Função para obter um percentil (0 a 100) dos dias desde a última consulta a partir do histograma
+int percentil_dias(const ResumoEstatistico* resumo, double percentil) {
+    if (resumo->com_consulta == 0) return 0;
+    long long alvo = (long long)ceil(percentil / 100.0 * resumo->com_consulta);
+    if (alvo < 1) alvo = 1;
+    long long acumulado = 0;
+    for (int i = 0; i <= LIMITE_DIAS_CONSULTA; i++) {
+        acumulado += resumo->dias[i];
+        if (acumulado >= alvo) return i;
+    }
+    return LIMITE_DIAS_CONSULTA;
+}
+
+// Função para somar ao resumo os agregados de um bloco de pacientes e esvaziá-lo
+// As contagens são feitas em laços simples sobre os vetores do bloco, que o compilador consegue vetorizar
+void resumir_bloco_estatistica(ResumoEstatistico* resumo, BlocoEstatistica* bloco, int hoje) {
+    int quantidade = bloco->quantidade;
+    int* nascimentos = bloco->nascimentos;
+    int* consultas = bloco->consultas;
+    char* sexos = bloco->sexos;
+
+    // Contagens sem desvios
+    long long homens = 0, mulheres = 0, sem_nascimento = 0, com_consulta = 0, soma_dias = 0;
+    for (int i = 0; i < quantidade; i++) {
+        homens += sexos[i] == 'M';
+        mulheres += sexos[i] == 'F';
+        sem_nascimento += nascimentos[i] == 0;
+    }
+    for (int i = 0; i < quantidade; i++) {
+        int valida = consultas[i] > 0;
+        int dias = hoje - consultas[i];
+        dias = dias > 0 ? dias : 0; // Consulta marcada no futuro conta como hoje
+        com_consulta += valida;
+        soma_dias += valida ? dias : 0;
+        consultas[i] = valida ? (dias < LIMITE_DIAS_CONSULTA ? dias : LIMITE_DIAS_CONSULTA) : -1;
+    }
+    for (int i = 0; i < quantidade; i++) {
+        // Idade em anos completos pelo calendário
+        int idade = nascimentos[i] > 0 ? idade_em_anos(nascimentos[i], hoje) : 0;
+        int faixa = idade / 10;
+        faixa = faixa < 0 ? 0 : (faixa < FAIXAS_IDADE - 1 ? faixa : FAIXAS_IDADE - 1);
+        nascimentos[i] = nascimentos[i] > 0 ? faixa : -1;
+    }
+
+    // Histogramas (acessos indiretos, fora dos laços vetorizados)
+    for (int i = 0; i < quantidade; i++) {
+        if (nascimentos[i] >= 0) resumo->faixas_idade[nascimentos[i]]++;
+        if (consultas[i] >= 0) resumo->dias[consultas[i]]++;
+    }
+
+    resumo->pacientes += quantidade;
+    resumo->homens += homens;
+    resumo->mulheres += mulheres;
+    resumo->sem_nascimento += sem_nascimento;
+    resumo->com_consulta += com_consulta;
+    resumo->soma_dias += soma_dias;
+    bloco->quantidade = 0;
+}
+
+// Função auxiliar que converte as datas de um paciente para o bloco da tarefa (usada com
+// registro_percorrer nos cadastros em disco); o bloco cheio é somado ao resumo
+void acumular_estatistica_visitado(Paciente* paciente, void* contexto) {
+    TarefaEstatistica* tarefa = (TarefaEstatistica*)contexto;
+    BlocoEstatistica* bloco = &tarefa->bloco;
+    bloco->sexos[bloco->quantidade] = paciente->sexo;
+    bloco->nascimentos[bloco->quantidade] = data_para_dias(paciente->nascimento);
+    bloco->consultas[bloco->quantidade] = data_para_dias(paciente->ultima_consulta);
+    if (++bloco->quantidade == BLOCO_ESTATISTICA) resumir_bloco_estatistica(&tarefa->resumo, bloco, tarefa->hoje);
+}
+
+// Função de tarefa: calcula os agregados de um pedaço do vetor de pacientes (ou de um cadastro em disco)
+// As datas de cada bloco de pacientes são convertidas para vetores de inteiros antes das contagens
+void tarefa_estatisticas(void* argumento) {
+    TarefaEstatistica* tarefa = (TarefaEstatistica*)argumento;
+    BlocoEstatistica* bloco = &tarefa->bloco;
+    bloco->quantidade = 0;
+    if (tarefa->registro != NULL) {
+        registro_percorrer(tarefa->registro, acumular_estatistica_visitado, tarefa);
+        resumir_bloco_estatistica(&tarefa->resumo, bloco, tarefa->hoje);
+        return;
+    }
+
+    for (int base = tarefa->inicio; base < tarefa->fim; base += BLOCO_ESTATISTICA) {
+        int quantidade = tarefa->fim - base < BLOCO_ESTATISTICA ? tarefa->fim - base : BLOCO_ESTATISTICA;
+
+        // Conversão dos campos de texto para os vetores
+        for (int i = 0; i < quantidade; i++) {
+            if (i + 8 < quantidade) PREFETCH(tarefa->pacientes[base + i + 8]);
+            const Paciente* paciente = tarefa->pacientes[base + i];
+            bloco->sexos[i] = paciente->sexo;
+            bloco->nascimentos[i] = data_para_dias(paciente->nascimento);
+            bloco->consultas[i] = data_para_dias(paciente->ultima_consulta);
+        }
+        bloco->quantidade = quantidade;
+        resumir_bloco_estatistica(&tarefa->resumo, bloco, tarefa->hoje);
+    }
+}
+
+// Função para decidir em quantas partes dividir um cadastro entre as threads:
+// uma parte a cada PEDACO_MINIMO_PARALELO pacientes, no máximo uma por thread
+int partes_paralelas(Clinica* clinica, int tamanho) {
+    int partes = (tamanho + PEDACO_MINIMO_PARALELO - 1) / PEDACO_MINIMO_PARALELO;
+    if (partes < 1) return 1;
+    return partes > clinica->pool->num_threads ? clinica->pool->num_threads : partes;
+}
+
+// Função para calcular o relatório de estatísticas de todos os médicos
+// Os pacientes de cada médico são reunidos em um vetor e divididos em pedaços entre as threads;
+// cada pedaço tem o seu resumo, somado depois no do médico e no da clínica. Um cadastro em disco não
+// vai para o vetor: uma tarefa o percorre pelo cursor
+RelatorioEstatisticas* calcular_relatorio(Clinica* clinica) {
+    double inicio = milissegundos_agora();
+    int* inicios = (int*)malloc((clinica->quantidade + 1) * sizeof(int));
+    RelatorioEstatisticas* relatorio = (RelatorioEstatisticas*)calloc(1, sizeof(RelatorioEstatisticas));
+    if (inicios == NULL || relatorio == NULL) {
+        printf("Erro ao alocar memória para as estatísticas.\n");
+        exit(1);
+    }
+    Paciente** pacientes = coletar_pacientes_medicos(clinica, inicios);
+
+    obter_data_atual(relatorio->data);
+    int hoje = data_para_dias(relatorio->data);
+
+    // Cadastros grandes são divididos em até uma parte por thread
+    int total_tarefas = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) total_tarefas++;
+        else total_tarefas += partes_paralelas(clinica, inicios[i + 1] - inicios[i]);
+    }
+    TarefaEstatistica* tarefas = (TarefaEstatistica*)calloc(total_tarefas, sizeof(TarefaEstatistica));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para as estatísticas.\n");
+        exit(1);
+    }
+
+    int t = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        int tamanho = inicios[i + 1] - inicios[i];
+        int disco = clinica->registros[i].motor == MOTOR_DISCO;
+        int partes = disco ? 1 : partes_paralelas(clinica, tamanho);
+        for (int p = 0; p < partes; p++, t++) {
+            tarefas[t].pacientes = pacientes;
+            tarefas[t].inicio = inicios[i] + (int)((long long)tamanho * p / partes);
+            tarefas[t].fim = inicios[i] + (int)((long long)tamanho * (p + 1) / partes);
+            tarefas[t].registro = disco ? &clinica->registros[i] : NULL;
+            tarefas[t].medico = i;
+            tarefas[t].hoje = hoje;
+            iniciar_resumo(&tarefas[t].resumo);
+            pool_submeter(clinica->pool, tarefa_estatisticas, &tarefas[t]);
+        }
+    }
+    pool_aguardar(clinica->pool);
+
+    relatorio->medicos = clinica->quantidade;
+    relatorio->por_medico = (ResumoEstatistico*)malloc(clinica->quantidade * sizeof(ResumoEstatistico));
+    if (relatorio->por_medico == NULL) {
+        printf("Erro ao alocar memória para as estatísticas.\n");
+        exit(1);
+    }
+    for (int i = 0; i < clinica->quantidade; i++) iniciar_resumo(&relatorio->por_medico[i]);
+    iniciar_resumo(&relatorio->total);
+    for (t = 0; t < total_tarefas; t++) {
+        somar_resumo(&relatorio->por_medico[tarefas[t].medico], &tarefas[t].resumo);
+        free(tarefas[t].resumo.dias);
+    }
+    for (int i = 0; i < clinica->quantidade; i++) somar_resumo(&relatorio->total, &relatorio->por_medico[i]);
+
+    free(tarefas);
+    free(pacientes);
+    free(inicios);
+    relatorio->tempo_ms = milissegundos_agora() - inicio;
+    return relatorio;
+}
+
+// Função para liberar o relatório de estatísticas
+void liberar_relatorio(RelatorioEstatisticas* relatorio) {
+    for (int i = 0; i < relatorio->medicos; i++) free(relatorio->por_medico[i].dias);
+    free(relatorio->por_medico);
+    free(relatorio->total.dias);
+    free(relatorio);
+}
+
+// Função para exibir um resumo em texto
+void exibir_resumo(const char* titulo, const ResumoEstatistico* resumo) {
+    printf("\n%s: %lld pacientes (%lld homens, %lld mulheres)\n", titulo, resumo->pacientes, resumo->homens, resumo->mulheres);
+    if (resumo->com_consulta > 0) {
+        printf("Dias desde a última consulta: média %.1f, mediana %d, p90 %d, p99 %d\n",
+               (double)resumo->soma_dias / resumo->com_consulta, percentil_dias(resumo, 50),
+               percentil_dias(resumo, 90), percentil_dias(resumo, 99));
+    }
+    printf("Idades:");
+    for (int i = 0; i < FAIXAS_IDADE; i++) {
+        if (i < FAIXAS_IDADE - 1) printf(" %d-%d: %lld", i * 10, i * 10 + 9, resumo->faixas_idade[i]);
+        else printf(" %d+: %lld", i * 10, resumo->faixas_idade[i]);
+        printf(i < FAIXAS_IDADE - 1 ? ";" : "\n");
+    }
+    if (resumo->sem_nascimento > 0) printf("Sem data de nascimento válida: %lld\n", resumo->sem_nascimento);
+}
+
+// Função para exibir o relatório de estatísticas em texto
+void exibir_relatorio(Clinica* clinica, RelatorioEstatisticas* relatorio) {
+    printf("\n--- Estatísticas da Clínica (%s) ---\n", relatorio->data);
+    exibir_resumo("Total", &relatorio->total);
+    for (int i = 0; i < relatorio->medicos; i++) {
+        char titulo[80];
+        snprintf(titulo, sizeof(titulo), "%s (%s)", clinica->registros[i].medico,
+                 nome_motor(clinica->registros[i].motor));
+        exibir_resumo(titulo, &relatorio->por_medico[i]);
+        CacheBuscas* cache = clinica->registros[i].cache;
+        unsigned long buscas = cache->acertos + cache->falhas;
+        printf("  Cache de buscas: %lu acertos e %lu falhas (%.1f%% de acertos)\n", cache->acertos, cache->falhas,
+               buscas > 0 ? 100.0 * cache->acertos / buscas : 0.0);
+        FiltroNomes* filtro = clinica->registros[i].filtro;
+        printf("  Filtro de nomes: %lu buscas descartadas sem percorrer o cadastro (%zu KB)\n",
+               filtro->descartes, filtro->tamanho / 1024);
+    }
+    printf("\nRelatório calculado em %.1f ms.\n", relatorio->tempo_ms);
+}
+
+// Função para gravar um texto entre aspas no formato JSON
+void escrever_texto_json(FILE* arquivo, const char* texto) {
+    putc('"', arquivo);
+    for (const unsigned char* p = (const unsigned char*)texto; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') fprintf(arquivo, "\\%c", *p);
+        else if (*p < 0x20) fprintf(arquivo, "\\u%04x", *p);
+        else putc(*p, arquivo);
+    }
+    putc('"', arquivo);
+}
+
+// Função para gravar os campos de um resumo no formato JSON (sem as chaves do objeto)
+void escrever_resumo_json(FILE* arquivo, const ResumoEstatistico* resumo) {
+    fprintf(arquivo, "\"pacientes\": %lld, \"homens\": %lld, \"mulheres\": %lld, ",
+            resumo->pacientes, resumo->homens, resumo->mulheres);
+    fprintf(arquivo, "\"faixas_idade\": {");
+    for (int i = 0; i < FAIXAS_IDADE; i++) {
+        if (i < FAIXAS_IDADE - 1) fprintf(arquivo, "\"%d-%d\": %lld, ", i * 10, i * 10 + 9, resumo->faixas_idade[i]);
+        else fprintf(arquivo, "\"%d+\": %lld}, ", i * 10, resumo->faixas_idade[i]);
+    }
+    fprintf(arquivo, "\"sem_nascimento\": %lld, ", resumo->sem_nascimento);
+    fprintf(arquivo, "\"dias_desde_ultima_consulta\": {\"pacientes\": %lld, \"media\": %.2f, \"p50\": %d, \"p90\": %d, \"p99\": %d}",
+            resumo->com_consulta, resumo->com_consulta > 0 ? (double)resumo->soma_dias / resumo->com_consulta : 0.0,
+            percentil_dias(resumo, 50), percentil_dias(resumo, 90), percentil_dias(resumo, 99));
+}
+
+// Função para gravar o relatório de estatísticas no formato JSON
+void escrever_relatorio_json(Clinica* clinica, RelatorioEstatisticas* relatorio, FILE* arquivo) {
+    fprintf(arquivo, "{\"data\": \"%s\", ", relatorio->data);
+    escrever_resumo_json(arquivo, &relatorio->total);
+    fprintf(arquivo, ",\n \"medicos\": [");
+    for (int i = 0; i < relatorio->medicos; i++) {
+        fprintf(arquivo, "%s\n  {\"nome\": ", i > 0 ? "," : "");
+        escrever_texto_json(arquivo, clinica->registros[i].medico);
+        fprintf(arquivo, ", \"motor\": \"%s\", ", nome_motor(clinica->registros[i].motor));
+        escrever_resumo_json(arquivo, &relatorio->por_medico[i]);
+        fprintf(arquivo, ", \"cache\": {\"acertos\": %lu, \"falhas\": %lu}",
+                clinica->registros[i].cache->acertos, clinica->registros[i].cache->falhas);
+        fprintf(arquivo, ", \"filtro\": {\"descartes\": %lu, \"contadores\": %zu}}",
+                clinica->registros[i].filtro->descartes, clinica->registros[i].filtro->tamanho);
+    }
+    fprintf(arquivo, "\n ],\n \"tempo_ms\": %.1f}\n", relatorio->tempo_ms);
+}
+
+// Função para gerar o relatório de estatísticas em JSON ("-" grava na saída padrão)
+// Retorna 0 se o arquivo não puder ser aberto
+int gerar_relatorio_json(Clinica* clinica, const char* nome_arquivo) {
+    FILE* arquivo = strcmp(nome_arquivo, "-") == 0 ? stdout : fopen(nome_arquivo, "w");
+    if (arquivo == NULL) {
+        printf("Erro ao abrir o arquivo %s para escrita.\n", nome_arquivo);
+        return 0;
+    }
+    RelatorioEstatisticas* relatorio = calcular_relatorio(clinica);
+    escrever_relatorio_json(clinica, relatorio, arquivo);
+    liberar_relatorio(relatorio);
+    if (arquivo != stdout) {
+        fclose(arquivo);
+        printf("Estatísticas salvas em %s.\n", nome_arquivo);
+    }
+    return 1;
+}
+
+// Função para exibir as estatísticas da clínica e de cada médico e gravá-las também em JSON
+void exibir_estatisticas_medicos(Clinica* clinica) {
+    RelatorioEstatisticas* relatorio = calcular_relatorio(clinica);
+    exibir_relatorio(clinica, relatorio);
+
+    FILE* arquivo = fopen("estatisticas.json", "w");
+    if (arquivo != NULL) {
+        escrever_relatorio_json(clinica, relatorio, arquivo);
+        fclose(arquivo);
+        printf("Versão em JSON salva em estatisticas.json.\n");
+    }
+    liberar_relatorio(relatorio);
+}
+
+// Função para comparar dois pacientes pelo atraso: a consulta mais antiga vem antes
+// e, na mesma data, a ordem alfabética desempata
+int comparar_atrasados(const PacienteAtrasado* a, const PacienteAtrasado* b) {
+    if (a->consulta != b->consulta) return a->consulta < b->consulta ? -1 : 1;
+    return comparar_pacientes(a->paciente, b->paciente);
+}
+
+// Função para criar um heap vazio com espaço para 'limite' pacientes
+void iniciar_heap_atrasados(HeapAtrasados* heap, int limite) {
+    heap->itens = (PacienteAtrasado*)malloc((limite > 0 ? limite : 1) * sizeof(PacienteAtrasado));
+    if (heap->itens == NULL) {
+        printf("Erro ao alocar memória para a busca dos atrasados.\n");
+        exit(1);
+    }
+    heap->quantidade = 0;
+    heap->limite = limite;
+}
+
+// Função para descer um item no heap de máximo até a sua posição
+void descer_heap_atrasados(HeapAtrasados* heap, int i) {
+    while (1) {
+        int maior = i;
+        int esquerda = 2 * i + 1, direita = 2 * i + 2;
+        if (esquerda < heap->quantidade && comparar_atrasados(&heap->itens[esquerda], &heap->itens[maior]) > 0) maior = esquerda;
+        if (direita < heap->quantidade && comparar_atrasados(&heap->itens[direita], &heap->itens[maior]) > 0) maior = direita;
+        if (maior == i) return;
+        PacienteAtrasado temporario = heap->itens[i];
+        heap->itens[i] = heap->itens[maior];
+        heap->itens[maior] = temporario;
+        i = maior;
+    }
+}
+
+// Função para oferecer um paciente ao heap limitado, em O(log K)
+// Com o heap cheio, o paciente só entra se for mais atrasado que a raiz, que então sai
+void oferecer_atrasado(HeapAtrasados* heap, PacienteAtrasado item) {
+    if (heap->limite == 0) return;
+    if (heap->quantidade < heap->limite) {
+        // Sobe o novo item até a sua posição
+        int i = heap->quantidade++;
+        while (i > 0 && comparar_atrasados(&item, &heap->itens[(i - 1) / 2]) > 0) {
+            heap->itens[i] = heap->itens[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap->itens[i] = item;
+    } else if (comparar_atrasados(&item, &heap->itens[0]) < 0) {
+        heap->itens[0] = item;
+        descer_heap_atrasados(heap, 0);
+    }
+}
+
+// Função auxiliar que oferece um paciente de um cadastro em disco ao heap da tarefa (usada com
+// registro_percorrer): o paciente do cursor muda a cada passo, então só uma cópia entra no heap, e a
+// cópia que sai é liberada
+void oferecer_atrasado_visitado(Paciente* paciente, void* contexto) {
+    TarefaAtrasados* tarefa = (TarefaAtrasados*)contexto;
+    HeapAtrasados* heap = &tarefa->heap;
+    PacienteAtrasado item;
+    item.consulta = data_para_dias(paciente->ultima_consulta);
+    item.medico = tarefa->medico;
+    item.paciente = paciente;
+    if (item.consulta <= 0 || heap->limite == 0) return;
+    if (heap->quantidade == heap->limite && comparar_atrasados(&item, &heap->itens[0]) >= 0) return;
+
+    Paciente* saiu = heap->quantidade == heap->limite ? heap->itens[0].paciente : NULL;
+    item.paciente = duplicar_paciente(paciente);
+    oferecer_atrasado(heap, item);
+    free(saiu);
+}
+
+// Função de tarefa: guarda no heap do pedaço os K pacientes mais atrasados
+// Pacientes sem data de última consulta válida ficam de fora
+void tarefa_atrasados(void* argumento) {
+    TarefaAtrasados* tarefa = (TarefaAtrasados*)argumento;
+    if (tarefa->registro != NULL) {
+        registro_percorrer(tarefa->registro, oferecer_atrasado_visitado, tarefa);
+        return;
+    }
+    for (int i = tarefa->inicio; i < tarefa->fim; i++) {
+        if (i + 8 < tarefa->fim) PREFETCH(tarefa->pacientes[i + 8]);
+        PacienteAtrasado item;
+        item.consulta = data_para_dias(tarefa->pacientes[i]->ultima_consulta);
+        if (item.consulta <= 0) continue;
+        // Atalho: com o heap cheio, uma consulta mais recente que a da raiz não entra
+        if (tarefa->heap.quantidade == tarefa->heap.limite && tarefa->heap.limite > 0 &&
+            item.consulta > tarefa->heap.itens[0].consulta) continue;
+        item.medico = tarefa->medico;
+        item.paciente = tarefa->pacientes[i];
+        oferecer_atrasado(&tarefa->heap, item);
+    }
+}
+
+// Função para ordenar o heap do mais atrasado para o menos atrasado (heapsort no próprio vetor)
+// Retorna a quantidade de itens; o heap deixa de ser um heap válido
+int ordenar_heap_atrasados(HeapAtrasados* heap) {
+    int quantidade = heap->quantidade;
+    while (heap->quantidade > 1) {
+        PacienteAtrasado temporario = heap->itens[0];
+        heap->itens[0] = heap->itens[heap->quantidade - 1];
+        heap->itens[heap->quantidade - 1] = temporario;
+        heap->quantidade--;
+        descer_heap_atrasados(heap, 0);
+    }
+    heap->quantidade = quantidade;
+    return quantidade;
+}
+
+// Função para exibir os K pacientes há mais tempo sem consulta, da clínica toda ou de cada médico
+// Cada pedaço dos cadastros monta o seu heap em paralelo (O(n log K)) e os heaps parciais são
+// intercalados no final, sem ordenar nem percorrer os cadastros de novo; um cadastro em disco não vai
+// para o vetor, e a sua tarefa o percorre pelo cursor guardando cópias só dos K que entram no heap
+// Nenhum heap reserva mais posições que a quantidade de pacientes que ele pode receber
+void exibir_atrasados(Clinica* clinica, int k, int por_medico) {
+    if (k <= 0) {
+        printf("Informe um K maior que zero.\n");
+        return;
+    }
+    int* inicios = (int*)malloc((clinica->quantidade + 1) * sizeof(int));
+    if (inicios == NULL) {
+        printf("Erro ao alocar memória para a busca dos atrasados.\n");
+        exit(1);
+    }
+    Paciente** pacientes = coletar_pacientes_medicos(clinica, inicios);
+
+    // A contagem de um cadastro em disco vem da árvore, pois a sua faixa no vetor fica vazia
+    int* tamanhos = (int*)malloc(clinica->quantidade * sizeof(int));
+    if (tamanhos == NULL) {
+        printf("Erro ao alocar memória para a busca dos atrasados.\n");
+        exit(1);
+    }
+    int total_pacientes = 0, total_tarefas = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        int disco = clinica->registros[i].motor == MOTOR_DISCO;
+        tamanhos[i] = disco ? registro_contar(&clinica->registros[i]) : inicios[i + 1] - inicios[i];
+        total_pacientes += tamanhos[i];
+        total_tarefas += disco ? 1 : partes_paralelas(clinica, tamanhos[i]);
+    }
+    TarefaAtrasados* tarefas = (TarefaAtrasados*)calloc(total_tarefas, sizeof(TarefaAtrasados));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para a busca dos atrasados.\n");
+        exit(1);
+    }
+
+    int t = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        int tamanho = inicios[i + 1] - inicios[i];
+        int disco = clinica->registros[i].motor == MOTOR_DISCO;
+        int partes = disco ? 1 : partes_paralelas(clinica, tamanho);
+        for (int p = 0; p < partes; p++, t++) {
+            tarefas[t].pacientes = pacientes;
+            tarefas[t].inicio = inicios[i] + (int)((long long)tamanho * p / partes);
+            tarefas[t].fim = inicios[i] + (int)((long long)tamanho * (p + 1) / partes);
+            tarefas[t].registro = disco ? &clinica->registros[i] : NULL;
+            tarefas[t].medico = i;
+            int pedaco = disco ? tamanhos[i] : tarefas[t].fim - tarefas[t].inicio;
+            iniciar_heap_atrasados(&tarefas[t].heap, k < pedaco ? k : pedaco);
+            pool_submeter(clinica->pool, tarefa_atrasados, &tarefas[t]);
+        }
+    }
+    pool_aguardar(clinica->pool);
+
+    // Intercalação dos heaps parciais: um heap por médico ou um só para a clínica
+    int grupos = por_medico ? clinica->quantidade : 1;
+    HeapAtrasados* resultados = (HeapAtrasados*)malloc(grupos * sizeof(HeapAtrasados));
+    if (resultados == NULL) {
+        printf("Erro ao alocar memória para a busca dos atrasados.\n");
+        exit(1);
+    }
+    for (int g = 0; g < grupos; g++) {
+        int tamanho = por_medico ? tamanhos[g] : total_pacientes;
+        iniciar_heap_atrasados(&resultados[g], k < tamanho ? k : tamanho);
+    }
+    // Os heaps parciais ficam até o fim: os resultados apontam para as cópias dos cadastros em disco
+    for (t = 0; t < total_tarefas; t++) {
+        HeapAtrasados* destino = &resultados[por_medico ? tarefas[t].medico : 0];
+        for (int i = 0; i < tarefas[t].heap.quantidade; i++) oferecer_atrasado(destino, tarefas[t].heap.itens[i]);
+    }
+
+    char data_atual[11];
+    obter_data_atual(data_atual);
+    int hoje = data_para_dias(data_atual);
+    for (int g = 0; g < grupos; g++) {
+        int quantidade = ordenar_heap_atrasados(&resultados[g]);
+        int limite = resultados[g].limite;
+        if (por_medico) printf("\n--- %d pacientes mais atrasados de %s ---\n", limite, clinica->registros[g].medico);
+        else printf("\n--- %d pacientes mais atrasados da clínica ---\n", limite);
+        for (int i = 0; i < quantidade; i++) {
+            PacienteAtrasado* item = &resultados[g].itens[i];
+            printf("%d. %s (%s): última consulta em %s, há %d dias\n", i + 1, item->paciente->nome,
+                   clinica->registros[item->medico].medico, item->paciente->ultima_consulta, hoje - item->consulta);
+        }
+        if (quantidade == 0) printf("Nenhum paciente com data de consulta válida.\n");
+        free(resultados[g].itens);
+    }
+
+    for (t = 0; t < total_tarefas; t++) {
+        if (tarefas[t].registro != NULL) {
+            for (int i = 0; i < tarefas[t].heap.quantidade; i++) free(tarefas[t].heap.itens[i].paciente);
+        }
+        free(tarefas[t].heap.itens);
+    }
+    free(resultados);
+    free(tarefas);
+    free(tamanhos);
+    free(pacientes);
+    free(inicios);
+}
+
+// Função auxiliar que seleciona um paciente com o mínimo de consultas no período (usada com registro_percorrer)
+void selecionar_frequente(Paciente* paciente, void* contexto) {
+    TarefaFrequentes* tarefa = (TarefaFrequentes*)contexto;
+    if (contar_consultas_periodo(paciente, tarefa->de, tarefa->ate) < tarefa->minimo) return;
+
+    if (tarefa->quantidade == tarefa->capacidade) {
+        tarefa->capacidade = tarefa->capacidade > 0 ? tarefa->capacidade * 2 : 64;
+        tarefa->encontrados = (Paciente**)realloc(tarefa->encontrados, tarefa->capacidade * sizeof(Paciente*));
+        if (tarefa->encontrados == NULL) {
+            printf("Erro ao alocar memória para a busca de consultas.\n");
+            exit(1);
+        }
+    }
+    // O paciente de um cursor na árvore em disco muda a cada passo: o vetor recebe uma cópia
+    if (tarefa->registro->motor == MOTOR_DISCO) paciente = copiar_paciente_disco(tarefa->registro->disco, paciente);
+    tarefa->encontrados[tarefa->quantidade++] = paciente;
+}
+
+// Função de tarefa: seleciona os pacientes frequentes de um médico
+void tarefa_frequentes_registro(void* argumento) {
+    TarefaFrequentes* tarefa = (TarefaFrequentes*)argumento;
+    if (tarefa->registro->motor == MOTOR_DISCO) descartar_copias_disco(tarefa->registro->disco);
+    registro_percorrer(tarefa->registro, selecionar_frequente, tarefa);
+}
+
+// Função para exibir os pacientes com mais de 'minimo' consultas no ano, médico por médico
+// Cada médico é percorrido em paralelo e a contagem usa o histórico ordenado de cada paciente
+void exibir_pacientes_frequentes(Clinica* clinica, int ano, int minimo) {
+    materializar_clinica(clinica);
+    TarefaFrequentes* tarefas = (TarefaFrequentes*)calloc(clinica->quantidade, sizeof(TarefaFrequentes));
+    if (tarefas == NULL) {
+        printf("Erro ao alocar memória para a busca de consultas.\n");
+        return;
+    }
+
+    char inicio[11], fim[11];
+    snprintf(inicio, sizeof(inicio), "01/01/%04d", ano);
+    snprintf(fim, sizeof(fim), "31/12/%04d", ano);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        tarefas[i].registro = &clinica->registros[i];
+        tarefas[i].de = data_para_dias(inicio);
+        tarefas[i].ate = data_para_dias(fim);
+        tarefas[i].minimo = minimo + 1;
+        pool_submeter(clinica->pool, tarefa_frequentes_registro, &tarefas[i]);
+    }
+    pool_aguardar(clinica->pool);
+
+    int total = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        TarefaFrequentes* tarefa = &tarefas[i];
+        printf("\n%s: %d paciente(s)\n", tarefa->registro->medico, tarefa->quantidade);
+        for (int j = 0; j < tarefa->quantidade; j++) {
+            printf("  %s: %d consultas\n", tarefa->encontrados[j]->nome,
+                   contar_consultas_periodo(tarefa->encontrados[j], tarefa->de, tarefa->ate));
+        }
+        total += tarefa->quantidade;
+        free(tarefa->encontrados);
+    }
+    printf("Total: %d pacientes com mais de %d consultas em %d.\n", total, minimo, ano);
+    free(tarefas);
+}
+
+// Função auxiliar que guarda o endereço de cada paciente visitado a partir de coleta->destino
+// (usada com registro_percorrer)
+void coletar_paciente(Paciente* paciente, void* contexto) {
+    TarefaColeta* coleta = (TarefaColeta*)contexto;
+    *coleta->destino++ = paciente;
+}
+
+// Função para reunir os endereços dos pacientes de um médico em um vetor em ordem A-Z
+// (a lista Z-A é invertida). Não vale para o cadastro em disco, cujos pacientes não ficam na memória
+Paciente** coletar_registro(Registro* registro, int* quantidade) {
+    int total = registro_contar(registro);
+    Paciente** pacientes = (Paciente**)malloc((total > 0 ? total : 1) * sizeof(Paciente*));
+    if (pacientes == NULL) {
+        printf("Erro ao alocar memória para a coleta dos pacientes.\n");
+        exit(1);
+    }
+    TarefaColeta coleta = {registro, pacientes};
+    tarefa_coletar_registro(&coleta);
+    if (motor_decrescente(registro->motor)) {
+        for (int a = 0, b = total - 1; a < b; a++, b--) {
+            Paciente* temporario = pacientes[a];
+            pacientes[a] = pacientes[b];
+            pacientes[b] = temporario;
+        }
+    }
+    *quantidade = total;
+    return pacientes;
+}
+
+// Função de tarefa: guarda os endereços dos pacientes de um médico a partir de tarefa->destino
+void tarefa_coletar_registro(void* argumento) {
+    TarefaColeta* tarefa = (TarefaColeta*)argumento;
+    registro_percorrer(tarefa->registro, coletar_paciente, tarefa);
+}
+
+// Função para reunir os endereços dos pacientes de todos os médicos em um único vetor,
+// percorrendo os cadastros em paralelo; cada médico i ocupa [inicios[i], inicios[i + 1])
+// na ordem do seu cadastro (inicios deve ter espaço para quantidade + 1 posições)
+// A faixa de um cadastro em disco fica vazia: quem precisa dos seus pacientes o percorre pelo cursor
+Paciente** coletar_pacientes_medicos(Clinica* clinica, int* inicios) {
+    materializar_clinica(clinica);
+    iniciar_leitura_compartilhada(clinica);
+    int total = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        inicios[i] = total;
+        if (clinica->registros[i].motor != MOTOR_DISCO) total += registro_contar(&clinica->registros[i]);
+    }
+    inicios[clinica->quantidade] = total;
+
+    Paciente** pacientes = (Paciente**)malloc((total > 0 ? total : 1) * sizeof(Paciente*));
+    TarefaColeta* tarefas = (TarefaColeta*)malloc(clinica->quantidade * sizeof(TarefaColeta));
+    if (pacientes == NULL || tarefas == NULL) {
+        printf("Erro ao alocar memória para a coleta dos pacientes.\n");
+        exit(1);
+    }
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) continue;
+        tarefas[i].registro = &clinica->registros[i];
+        tarefas[i].destino = pacientes + inicios[i];
+        pool_submeter(clinica->pool, tarefa_coletar_registro, &tarefas[i]);
+    }
+    pool_aguardar(clinica->pool);
+    terminar_leitura_compartilhada(clinica);
+    free(tarefas);
+    return pacientes;
+}
+
+// Função para reunir os pacientes de todos os médicos em um vetor em ordem A-Z, pelo iterador da clínica
+// Só para clínicas sem cadastro em disco (ver percorrer_por_campo e a janela da busca interativa)
+Paciente** coletar_pacientes_ordenados(Clinica* clinica, int* quantidade) {
+    IteradorClinica iterador;
+    int total = 0;
+    for (Paciente* paciente = iniciar_iterador(&iterador, clinica); paciente != NULL; paciente = iterador_proximo(&iterador)) total++;
+
+    Paciente** resultado = (Paciente**)malloc((total > 0 ? total : 1) * sizeof(Paciente*));
+    if (resultado == NULL) {
+        printf("Erro ao alocar memória para a coleta dos pacientes.\n");
+        exit(1);
+    }
+    int k = 0;
+    for (Paciente* paciente = iterador_posicionar(&iterador, ""); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+        resultado[k++] = paciente;
+    }
+    liberar_iterador(&iterador);
+    *quantidade = total;
+    return resultado;
+}
+
+// Função para interpretar o nome de um campo de ordenação; retorna -1 se ele não existir
+int interpretar_campo_ordenacao(const char* texto) {
+    if (strcmp(texto, "nome") == 0) return ORDEM_NOME;
+    if (strcmp(texto, "nascimento") == 0) return ORDEM_NASCIMENTO;
+    if (strcmp(texto, "consulta") == 0) return ORDEM_CONSULTA;
+    if (strcmp(texto, "idade") == 0) return ORDEM_IDADE;
+    return -1;
+}
+
+const char* nome_campo_ordenacao(CampoOrdenacao campo) {
+    switch (campo) {
+        case ORDEM_NASCIMENTO: return "data de nascimento";
+        case ORDEM_CONSULTA: return "última consulta";
+        case ORDEM_IDADE: return "idade";
+        default: return "nome";
+    }
+}
+
+// Função para calcular a chave inteira de um paciente no campo de ordenação
+// Datas inválidas recebem CHAVE_ORDENACAO_INVALIDA e ficam no fim
+uint32_t chave_ordenacao(const Paciente* paciente, CampoOrdenacao campo, int hoje) {
+    int dias = data_para_dias(campo == ORDEM_CONSULTA ? paciente->ultima_consulta : paciente->nascimento);
+    if (dias <= 0) return CHAVE_ORDENACAO_INVALIDA;
+    if (campo != ORDEM_IDADE) return (uint32_t)dias;
+
+    // Idade em anos completos pelo calendário, como no relatório de estatísticas
+    int idade = idade_em_anos(dias, hoje);
+    return idade > 0 ? (uint32_t)idade : 0;
+}
+
+// Função de tarefa: monta as chaves de um pedaço do vetor de pacientes
+void tarefa_chaves_radix(void* argumento) {
+    TarefaRadix* tarefa = (TarefaRadix*)argumento;
+    for (int i = tarefa->inicio; i < tarefa->fim; i++) {
+        if (i + 8 < tarefa->fim) PREFETCH(tarefa->pacientes[i + 8]);
+        uint64_t chave = chave_ordenacao(tarefa->pacientes[i], tarefa->campo, tarefa->hoje);
+        tarefa->entrada[i] = chave << 32 | (uint32_t)i;
+    }
+}
+
+// Função de tarefa: conta quantas chaves do pedaço caem em cada balde do dígito da passada
+void tarefa_contar_radix(void* argumento) {
+    TarefaRadix* tarefa = (TarefaRadix*)argumento;
+    memset(tarefa->contagem, 0, sizeof(tarefa->contagem));
+    for (int i = tarefa->inicio; i < tarefa->fim; i++) {
+        tarefa->contagem[(tarefa->entrada[i] >> tarefa->deslocamento) & (BALDES_RADIX - 1)]++;
+    }
+}
+
+// Função de tarefa: copia as chaves do pedaço para as posições do seu balde na saída
+// Cada pedaço escreve em faixas só suas, e na ordem em que as chaves estão: a passada é estável
+void tarefa_espalhar_radix(void* argumento) {
+    TarefaRadix* tarefa = (TarefaRadix*)argumento;
+    for (int i = tarefa->inicio; i < tarefa->fim; i++) {
+        uint64_t chave = tarefa->entrada[i];
+        tarefa->saida[tarefa->contagem[(chave >> tarefa->deslocamento) & (BALDES_RADIX - 1)]++] = chave;
+    }
+}
+
+// Função para ordenar um vetor de pacientes por um campo, mantendo a ordem atual entre os empates
+// (em um vetor A-Z, os pacientes com a mesma data ficam em ordem de nome)
+// As chaves são montadas uma vez e ordenadas por radix LSD; cada passada divide o vetor entre as
+// threads, que contam os seus pedaços e depois espalham as chaves em paralelo
+void ordenar_pacientes_campo(Clinica* clinica, Paciente** pacientes, int quantidade, CampoOrdenacao campo) {
+    if (campo == ORDEM_NOME || quantidade < 2) return;
+
+    char data_atual[11];
+    obter_data_atual(data_atual);
+    int partes = partes_paralelas(clinica, quantidade);
+    uint64_t* entrada = (uint64_t*)malloc(quantidade * sizeof(uint64_t));
+    uint64_t* saida = (uint64_t*)malloc(quantidade * sizeof(uint64_t));
+    Paciente** copia = (Paciente**)malloc(quantidade * sizeof(Paciente*));
+    TarefaRadix* tarefas = (TarefaRadix*)malloc(partes * sizeof(TarefaRadix));
+    if (entrada == NULL || saida == NULL || copia == NULL || tarefas == NULL) {
+        printf("Erro ao alocar memória para a ordenação.\n");
+        exit(1);
+    }
+
+    for (int t = 0; t < partes; t++) {
+        tarefas[t].pacientes = pacientes;
+        tarefas[t].entrada = entrada;
+        tarefas[t].inicio = (int)((long long)quantidade * t / partes);
+        tarefas[t].fim = (int)((long long)quantidade * (t + 1) / partes);
+        tarefas[t].campo = campo;
+        tarefas[t].hoje = data_para_dias(data_atual);
+        pool_submeter(clinica->pool, tarefa_chaves_radix, &tarefas[t]);
+    }
+    pool_aguardar(clinica->pool);
+
+    for (int passada = 0; passada < PASSADAS_RADIX; passada++) {
+        for (int t = 0; t < partes; t++) {
+            tarefas[t].entrada = entrada;
+            tarefas[t].saida = saida;
+            tarefas[t].deslocamento = 32 + passada * BITS_DIGITO_RADIX;
+            pool_submeter(clinica->pool, tarefa_contar_radix, &tarefas[t]);
+        }
+        pool_aguardar(clinica->pool);
+
+        // Posições de escrita: os baldes em ordem e, dentro de cada balde, os pedaços em ordem
+        // Se todas as chaves caem no mesmo balde a passada não muda nada e é pulada
+        size_t total = 0;
+        int unico = 0;
+        for (int b = 0; b < BALDES_RADIX; b++) {
+            size_t no_balde = 0;
+            for (int t = 0; t < partes; t++) {
+                size_t contagem = tarefas[t].contagem[b];
+                tarefas[t].contagem[b] = total;
+                total += contagem;
+                no_balde += contagem;
+            }
+            if (no_balde == (size_t)quantidade) unico = 1;
+        }
+        if (unico) continue;
+
+        for (int t = 0; t < partes; t++) pool_submeter(clinica->pool, tarefa_espalhar_radix, &tarefas[t]);
+        pool_aguardar(clinica->pool);
+        uint64_t* temporario = entrada;
+        entrada = saida;
+        saida = temporario;
+    }
+
+    memcpy(copia, pacientes, quantidade * sizeof(Paciente*));
+    for (int i = 0; i < quantidade; i++) pacientes[i] = copia[(uint32_t)entrada[i]];
+
+    free(tarefas);
+    free(copia);
+    free(saida);
+    free(entrada);
+}
+
+// Função para comparar duas entradas da ordenação externa pela chave (usada com qsort)
+int comparar_entradas_ordenacao(const void* a, const void* b) {
+    uint64_t x = ((const EntradaOrdenacao*)a)->chave, y = ((const EntradaOrdenacao*)b)->chave;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Função para ordenar as entradas que estão na memória e gravá-las como uma sequência em um
+// arquivo temporário, liberando a memória para as próximas
+// Cada paciente vai como chave, sexo, datas, tamanho do nome (varint) e nome
+void gravar_sequencia_ordenada(OrdenacaoExterna* ordenacao) {
+    qsort(ordenacao->entradas, ordenacao->quantidade, sizeof(EntradaOrdenacao), comparar_entradas_ordenacao);
+    FILE* arquivo = ordenacao->falhou ? NULL : tmpfile();
+    if (arquivo != NULL) {
+        for (int i = 0; i < ordenacao->quantidade; i++) {
+            const Paciente* paciente = ordenacao->entradas[i].paciente;
+            size_t tamanho_nome = strlen(paciente->nome);
+            fwrite(&ordenacao->entradas[i].chave, sizeof(uint64_t), 1, arquivo);
+            putc(paciente->sexo, arquivo);
+            fwrite(paciente->nascimento, 1, sizeof(paciente->nascimento), arquivo);
+            fwrite(paciente->ultima_consulta, 1, sizeof(paciente->ultima_consulta), arquivo);
+            escrever_varint(arquivo, tamanho_nome);
+            fwrite(paciente->nome, 1, tamanho_nome, arquivo);
+        }
+        if (fflush(arquivo) != 0 || ferror(arquivo)) {
+            fclose(arquivo);
+            arquivo = NULL;
+        }
+    }
+    if (arquivo == NULL) {
+        if (!ordenacao->falhou) printf("Erro ao gravar o arquivo temporário da ordenação.\n");
+        ordenacao->falhou = 1;
+    } else {
+        SequenciaOrdenada* sequencias = (SequenciaOrdenada*)realloc(ordenacao->sequencias,
+                                                                      (ordenacao->num_sequencias + 1) * sizeof(SequenciaOrdenada));
+        if (sequencias == NULL) {
+            printf("Erro ao alocar memória para a ordenação.\n");
+            exit(1);
+        }
+        ordenacao->sequencias = sequencias;
+        SequenciaOrdenada* sequencia = &sequencias[ordenacao->num_sequencias++];
+        memset(sequencia, 0, sizeof(SequenciaOrdenada));
+        sequencia->arquivo = arquivo;
+        sequencia->restantes = (uint64_t)ordenacao->quantidade;
+    }
+    liberar_pedacos(&ordenacao->copias);
+    ordenacao->quantidade = 0;
+    ordenacao->bytes = 0;
+}
+
+// Função auxiliar que recebe um paciente na ordenação externa (usada com registro_percorrer)
+// O paciente é copiado, pois o do cursor muda a cada passo
+void receber_ordenacao(Paciente* paciente, void* contexto) {
+    OrdenacaoExterna* ordenacao = (OrdenacaoExterna*)contexto;
+    if (ordenacao->falhou) return;
+    size_t bytes = sizeof(EntradaOrdenacao) + sizeof(Paciente) + strlen(paciente->nome) + 8;
+    if (ordenacao->quantidade > 0 && ordenacao->bytes + bytes > ordenacao->limite) {
+        gravar_sequencia_ordenada(ordenacao);
+        if (ordenacao->falhou) return;
+    }
+    if (ordenacao->quantidade == ordenacao->capacidade) {
+        ordenacao->capacidade = ordenacao->capacidade > 0 ? ordenacao->capacidade * 2 : 1024;
+        ordenacao->entradas = (EntradaOrdenacao*)realloc(ordenacao->entradas, ordenacao->capacidade * sizeof(EntradaOrdenacao));
+        if (ordenacao->entradas == NULL) {
+            printf("Erro ao alocar memória para a ordenação.\n");
+            exit(1);
+        }
+    }
+    EntradaOrdenacao* entrada = &ordenacao->entradas[ordenacao->quantidade++];
+    entrada->chave = (uint64_t)chave_ordenacao(paciente, ordenacao->campo, ordenacao->hoje) << 32 | ordenacao->recebidos++;
+    entrada->paciente = copiar_paciente_pedacos(&ordenacao->copias, paciente);
+    ordenacao->bytes += bytes;
+}
+
+// Função para ler o próximo paciente de uma sequência gravada; retorna 0 no fim dela
+int ler_sequencia_ordenada(SequenciaOrdenada* sequencia) {
+    if (sequencia->restantes == 0) return 0;
+    sequencia->restantes--;
+    FILE* arquivo = sequencia->arquivo;
+    Paciente* paciente = &sequencia->paciente;
+    uint64_t tamanho_nome;
+    int sexo;
+    if (fread(&sequencia->chave, sizeof(uint64_t), 1, arquivo) != 1 || (sexo = getc(arquivo)) == EOF ||
+        fread(paciente->nascimento, 1, sizeof(paciente->nascimento), arquivo) != sizeof(paciente->nascimento) ||
+        fread(paciente->ultima_consulta, 1, sizeof(paciente->ultima_consulta), arquivo) != sizeof(paciente->ultima_consulta) ||
+        !ler_varint(arquivo, &tamanho_nome) || tamanho_nome > MAIOR_NOME_COMPACTO) {
+        return 0;
+    }
+    if (tamanho_nome + 1 > sequencia->capacidade) {
+        sequencia->capacidade = tamanho_nome + 1 > 128 ? tamanho_nome + 1 : 128;
+        sequencia->nome = (char*)realloc(sequencia->nome, sequencia->capacidade);
+        if (sequencia->nome == NULL) {
+            printf("Erro ao alocar memória para a ordenação.\n");
+            exit(1);
+        }
+    }
+    if (fread(sequencia->nome, 1, tamanho_nome, arquivo) != tamanho_nome) return 0;
+    sequencia->nome[tamanho_nome] = '\0';
+    paciente->sexo = (char)sexo;
+    paciente->nome = sequencia->nome;
+    paciente->historico = NULL;
+    return 1;
+}
+
+// Função para descer uma sequência no heap de mínimo da intercalação (pela chave do seu paciente atual)
+void descer_heap_sequencias(SequenciaOrdenada* sequencias, int* heap, int quantidade, int i) {
+    while (1) {
+        int menor = i;
+        int esquerda = 2 * i + 1, direita = 2 * i + 2;
+        if (esquerda < quantidade && sequencias[heap[esquerda]].chave < sequencias[heap[menor]].chave) menor = esquerda;
+        if (direita < quantidade && sequencias[heap[direita]].chave < sequencias[heap[menor]].chave) menor = direita;
+        if (menor == i) return;
+        int temporario = heap[i];
+        heap[i] = heap[menor];
+        heap[menor] = temporario;
+        i = menor;
+    }
+}
+
+// Função para terminar a ordenação externa, visitando os pacientes na ordem do campo
+// Se tudo coube na memória, as entradas são ordenadas e visitadas direto; senão as sequências
+// gravadas são intercaladas por um heap de mínimo, lendo um paciente de cada vez de cada uma
+// Retorna a quantidade de pacientes visitados, ou -1 se a ordenação falhou
+int terminar_ordenacao(OrdenacaoExterna* ordenacao, void (*visitar)(Paciente*, void*), void* contexto) {
+    int visitados = 0;
+    if (ordenacao->num_sequencias == 0 && !ordenacao->falhou) {
+        qsort(ordenacao->entradas, ordenacao->quantidade, sizeof(EntradaOrdenacao), comparar_entradas_ordenacao);
+        for (int i = 0; i < ordenacao->quantidade; i++) visitar(ordenacao->entradas[i].paciente, contexto);
+        visitados = ordenacao->quantidade;
+    } else {
+        if (ordenacao->quantidade > 0) gravar_sequencia_ordenada(ordenacao);
+        int* heap = (int*)malloc((ordenacao->num_sequencias > 0 ? ordenacao->num_sequencias : 1) * sizeof(int));
+        if (heap == NULL) {
+            printf("Erro ao alocar memória para a ordenação.\n");
+            exit(1);
+        }
+        int no_heap = 0;
+        for (int i = 0; i < ordenacao->num_sequencias && !ordenacao->falhou; i++) {
+            rewind(ordenacao->sequencias[i].arquivo);
+            if (ler_sequencia_ordenada(&ordenacao->sequencias[i])) heap[no_heap++] = i;
+        }
+        for (int i = no_heap / 2 - 1; i >= 0; i--) descer_heap_sequencias(ordenacao->sequencias, heap, no_heap, i);
+        while (no_heap > 0 && !ordenacao->falhou) {
+            SequenciaOrdenada* sequencia = &ordenacao->sequencias[heap[0]];
+            visitar(&sequencia->paciente, contexto);
+            visitados++;
+            if (!ler_sequencia_ordenada(sequencia)) {
+                if (sequencia->restantes > 0) {
+                    printf("Erro ao ler o arquivo temporário da ordenação.\n");
+                    ordenacao->falhou = 1;
+                }
+                heap[0] = heap[--no_heap];
+            }
+            descer_heap_sequencias(ordenacao->sequencias, heap, no_heap, 0);
+        }
+        free(heap);
+    }
+
+    for (int i = 0; i < ordenacao->num_sequencias; i++) {
+        fclose(ordenacao->sequencias[i].arquivo);
+        free(ordenacao->sequencias[i].nome);
+    }
+    free(ordenacao->sequencias);
+    free(ordenacao->entradas);
+    liberar_pedacos(&ordenacao->copias);
+    return ordenacao->falhou ? -1 : visitados;
+}
+
+// Função para saber se algum médico da clínica tem o cadastro em disco
+int clinica_tem_disco(Clinica* clinica) {
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) return 1;
+    }
+    return 0;
+}
+
+// Função para visitar os pacientes de um cadastro em disco (ou da clínica inteira, com registro NULL)
+// ordenados por um campo, com o nome desempatando, sem reunir todos eles na memória
+// A memória da ordenação é a mesma dos buffers das árvores em disco (--memoria-disco)
+// Retorna a quantidade de pacientes visitados, ou -1 se a ordenação falhou
+int percorrer_por_campo(Clinica* clinica, Registro* registro, CampoOrdenacao campo,
+                        void (*visitar)(Paciente*, void*), void* contexto) {
+    OrdenacaoExterna ordenacao;
+    memset(&ordenacao, 0, sizeof(OrdenacaoExterna));
+    char data_atual[11];
+    obter_data_atual(data_atual);
+    ordenacao.campo = campo;
+    ordenacao.hoje = data_para_dias(data_atual);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        ArvoreDisco* arvore = clinica->registros[i].disco;
+        if (clinica->registros[i].motor == MOTOR_DISCO) ordenacao.limite += (size_t)arvore->num_quadros * TAMANHO_PAGINA_DISCO;
+    }
+
+    // Os pacientes chegam em ordem A-Z, e a ordem de chegada desempata a chave
+    if (registro != NULL) {
+        registro_percorrer(registro, receber_ordenacao, &ordenacao);
+    } else {
+        IteradorClinica iterador;
+        for (Paciente* paciente = iniciar_iterador(&iterador, clinica); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+            receber_ordenacao(paciente, &ordenacao);
+        }
+        liberar_iterador(&iterador);
+    }
+    return terminar_ordenacao(&ordenacao, visitar, contexto);
+}
+
+// Função para listar os pacientes de um médico ordenados por um campo (o nome desempata)
+// O cadastro em disco passa pela ordenação externa; os demais são reunidos em um vetor
+void listar_registro_ordenado(Clinica* clinica, Registro* registro, CampoOrdenacao campo) {
+    if (campo == ORDEM_NOME) {
+        registro_listar(registro);
+        return;
+    }
+    if (registro->motor == MOTOR_DISCO) {
+        printf("\n--- Lista de Pacientes (%s, por %s) ---\n", registro->medico, nome_campo_ordenacao(campo));
+        if (percorrer_por_campo(clinica, registro, campo, exibir_paciente_visitado, NULL) == 0) {
+            printf("Nenhum paciente cadastrado.\n");
+        }
+        return;
+    }
+
+    // A trava de leitura fica com o processo até o fim da listagem: os pacientes não podem mudar de lugar
+    iniciar_leitura_compartilhada(clinica);
+    int quantidade;
+    Paciente** pacientes = coletar_registro(registro, &quantidade);
+    ordenar_pacientes_campo(clinica, pacientes, quantidade, campo);
+
+    printf("\n--- Lista de Pacientes (%s, por %s) ---\n", registro->medico, nome_campo_ordenacao(campo));
+    if (quantidade == 0) printf("Nenhum paciente cadastrado.\n");
+    for (int i = 0; i < quantidade; i++) {
+        exibir_paciente(pacientes[i]);
+        printf("\n");
+    }
+    terminar_leitura_compartilhada(clinica);
+    free(pacientes);
+}
+
+// Função para exportar os pacientes de todos os médicos em um único arquivo de texto,
+// no formato de pacientes.txt, ordenados pelo campo pedido (o nome desempata)
+void exportar_pacientes(Clinica* clinica, const char* nome_arquivo, CampoOrdenacao campo) {
+    FILE* arquivo = fopen(nome_arquivo, "w");
+    if (arquivo == NULL) {
+        printf("Erro ao criar o arquivo %s.\n", nome_arquivo);
+        return;
+    }
+
+    // Por nome, os pacientes já saem do iterador na ordem certa, sem vetor nem ordenação
+    if (campo == ORDEM_NOME) {
+        IteradorClinica iterador;
+        int quantidade = 0;
+        for (Paciente* paciente = iniciar_iterador(&iterador, clinica); paciente != NULL; paciente = iterador_proximo(&iterador)) {
+            gravar_paciente_visitado(paciente, arquivo);
+            quantidade++;
+        }
+        liberar_iterador(&iterador);
+        fclose(arquivo);
+        printf("%d pacientes exportados para %s, por %s.\n", quantidade, nome_arquivo, nome_campo_ordenacao(campo));
+        return;
+    }
+
+    // Com um cadastro em disco os pacientes não cabem todos na memória: ordenação externa
+    if (clinica_tem_disco(clinica)) {
+        double inicio = milissegundos_agora();
+        int quantidade = percorrer_por_campo(clinica, NULL, campo, gravar_paciente_visitado, arquivo);
+        double tempo = milissegundos_agora() - inicio;
+        fclose(arquivo);
+        if (quantidade < 0) {
+            printf("A exportação para %s ficou incompleta.\n", nome_arquivo);
+            return;
+        }
+        printf("%d pacientes exportados para %s, por %s (ordenação externa em %.1f ms).\n",
+               quantidade, nome_arquivo, nome_campo_ordenacao(campo), tempo);
+        return;
+    }
+
+    int quantidade;
+    Paciente** pacientes = coletar_pacientes_ordenados(clinica, &quantidade);
+    double inicio = milissegundos_agora();
+    ordenar_pacientes_campo(clinica, pacientes, quantidade, campo);
+    double tempo = milissegundos_agora() - inicio;
+
+    for (int i = 0; i < quantidade; i++) gravar_paciente_visitado(pacientes[i], arquivo);
+    fclose(arquivo);
+    free(pacientes);
+    printf("%d pacientes exportados para %s, por %s (ordenação em %.1f ms).\n",
+           quantidade, nome_arquivo, nome_campo_ordenacao(campo), tempo);
+}
+
+// Função para medir quantas buscas por segundo um cadastro responde, pela estrutura do motor
+// (buscar_lista, buscar_blocos ou buscar_avl) ou pelo índice congelado, sem passar pelo filtro e pelo cache
+// As buscas param depois de meio segundo, para a lista não levar minutos
+double medir_vazao_buscas(Registro* registro, const char** nomes, int quantidade, int congelado) {
+    double inicio = milissegundos_agora();
+    double decorrido = 0;
+    int feitas = 0, encontrados = 0;
+    while (feitas < quantidade) {
+        int fim = feitas + 64 < quantidade ? feitas + 64 : quantidade;
+        for (; feitas < fim; feitas++) {
+            Paciente* paciente;
+            if (congelado) paciente = buscar_congelado(registro->congelado, nomes[feitas]);
+            else if (registro->motor == MOTOR_LISTA) paciente = buscar_lista(registro->lista, nomes[feitas]);
+            else if (registro->motor == MOTOR_BLOCOS) paciente = buscar_blocos(registro->blocos, nomes[feitas]);
+            else paciente = buscar_avl(registro->raiz, nomes[feitas]);
+            encontrados += paciente != NULL;
+        }
+        decorrido = milissegundos_agora() - inicio;
+        if (decorrido > 500) break;
+    }
+    if (encontrados != feitas) printf("Aviso: %d de %d nomes não encontrados em %s.\n", feitas - encontrados, feitas, registro->medico);
+    return decorrido > 0 ? feitas / (decorrido / 1000.0) : 0;
+}
+
+// Função para comparar a vazão das buscas na estrutura de cada médico com a do índice congelado
+// Os nomes buscados são pacientes do próprio cadastro, sorteados com semente fixa
+void medir_buscas(Clinica* clinica, int quantidade) {
+    materializar_clinica(clinica);
+    const char** nomes = (const char**)malloc((size_t)quantidade * sizeof(const char*));
+    if (nomes == NULL) {
+        printf("Erro ao alocar memória para a medição das buscas.\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_COMPARTILHADO) {
+            printf("%s: cadastro compartilhado, sem índice congelado para comparar.\n", registro->medico);
+            continue;
+        }
+        if (registro->motor == MOTOR_DISCO) {
+            printf("%s: cadastro em disco, sem índice congelado para comparar.\n", registro->medico);
+            continue;
+        }
+        if (registro->congelado == NULL || registro->congelado->desatualizado) congelar_registro(registro);
+        IndiceCongelado* indice = registro->congelado;
+        if (indice->quantidade == 0) {
+            printf("%s: nenhum paciente cadastrado.\n", registro->medico);
+            continue;
+        }
+
+        uint64_t sorteio = 88172645463325252ULL;
+        for (int j = 0; j < quantidade; j++) {
+            sorteio ^= sorteio << 13;
+            sorteio ^= sorteio >> 7;
+            sorteio ^= sorteio << 17;
+            nomes[j] = indice->pacientes[sorteio % (uint64_t)indice->quantidade]->nome;
+        }
+
+        double estrutura = medir_vazao_buscas(registro, nomes, quantidade, 0);
+        double congelado = medir_vazao_buscas(registro, nomes, quantidade, 1);
+        printf("%s (%s, %d pacientes): %s %.0f buscas/s, índice congelado %.0f buscas/s (%.1fx).\n",
+               registro->medico, nome_motor(registro->motor), indice->quantidade,
+               registro->motor == MOTOR_LISTA ? "buscar_lista" : registro->motor == MOTOR_BLOCOS ? "buscar_blocos" : "buscar_avl",
+               estrutura, congelado, estrutura > 0 ? congelado / estrutura : 0);
+    }
+    free(nomes);
+}
+
+// Função para liberar os cadastros de todos os médicos e a própria clínica
+void destruir_clinica(Clinica* clinica) {
+    if (clinica->salvamento != NULL) parar_salvamento_automatico(clinica);
+    if (clinica->recarga != NULL) parar_recarga(clinica);
+    if (clinica->auditoria != NULL) parar_auditoria(clinica);
+    if (clinica->preguicoso != NULL) liberar_preguicoso(clinica->preguicoso);
+    for (int i = 0; i < clinica->quantidade; i++) {
+        registro_destruir(&clinica->registros[i]);
+    }
+    destruir_pool(clinica->pool);
+    pthread_mutex_destroy(&clinica->trava);
+    free(clinica->registros);
+    free(clinica);
+}
+
+// Função para medir intervalos em milissegundos com o relógio monotônico
+double milissegundos_agora() {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec * 1000.0 + agora.tv_nsec / 1e6;
+}
+
+// Função auxiliar que copia um paciente para a arena do salvamento (usada com registro_percorrer)
+void copiar_paciente(Paciente* paciente, void* contexto) {
+    Paciente** destino = (Paciente**)contexto;
+    *(*destino)++ = *paciente;
+}
+
+// Função para tirar uma cópia de todos os cadastros na arena, na ordem de salvar_pacientes_original
+// Roda com a clínica travada; é só uma cópia de memória, bem mais rápida que formatar o texto
+// Um cadastro persistente não é copiado: basta reter a raiz atual, que nenhuma escrita altera;
+// um cadastro em disco também não, pois a gravação o lê direto da árvore (ver gravar_copia)
+int copiar_cadastros(SalvamentoAutomatico* salvamento) {
+    Clinica* clinica = salvamento->clinica;
+    if (salvamento->copiados == NULL) {
+        salvamento->copiados = (int*)calloc(clinica->quantidade, sizeof(int));
+        salvamento->instantaneos = (NoAVL**)calloc(clinica->quantidade, sizeof(NoAVL*));
+        if (salvamento->copiados == NULL || salvamento->instantaneos == NULL) return -1;
+    }
+
+    iniciar_leitura_compartilhada(clinica);
+    int total = 0;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        int copiado = registro->motor != MOTOR_PERSISTENTE && registro->motor != MOTOR_DISCO;
+        salvamento->copiados[i] = copiado ? registro_contar(registro) : 0;
+        total += salvamento->copiados[i];
+    }
+
+    if (total > salvamento->capacidade_copia) {
+        Paciente* copia = (Paciente*)realloc(salvamento->copia, total * sizeof(Paciente));
+        if (copia == NULL) {
+            terminar_leitura_compartilhada(clinica);
+            return -1;
+        }
+        salvamento->copia = copia;
+        salvamento->capacidade_copia = total;
+    }
+
+    Paciente* destino = salvamento->copia;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        Registro* registro = &clinica->registros[i];
+        if (registro->motor == MOTOR_PERSISTENTE) salvamento->instantaneos[i] = reter_no(registro->raiz);
+        else if (registro->motor != MOTOR_DISCO) registro_percorrer(registro, copiar_paciente, &destino);
+    }
+    terminar_leitura_compartilhada(clinica);
+    return total;
+}
+
+// Função para gravar a cópia no arquivo: escreve em um temporário e renomeia,
+// para um salvamento interrompido nunca deixar o arquivo pela metade
+// As versões retidas dos cadastros persistentes são devolvidas ao final, e as árvores dos cadastros em
+// disco gravam as suas páginas alteradas e são percorridas com um cursor; elas não ficaram na cópia,
+// então o que vai para o arquivo é o estado delas na hora da gravação
+// Retorna o número de pacientes gravados, ou -1 em caso de erro
+int gravar_copia(SalvamentoAutomatico* salvamento) {
+    Clinica* clinica = salvamento->clinica;
+    char temporario[270];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", salvamento->arquivo);
+
+    // Gravando o arquivo que a recarga acompanha, as linhas gravadas são entregues a ela
+    TabelaLinhas* linhas = NULL;
+    AssinaturaArquivo gravado, acompanhado;
+    if (clinica->recarga != NULL && ler_assinatura(salvamento->arquivo, &gravado) &&
+        ler_assinatura(clinica->recarga->arquivo, &acompanhado) &&
+        gravado.dispositivo == acompanhado.dispositivo && gravado.inode == acompanhado.inode) {
+        linhas = (TabelaLinhas*)calloc(1, sizeof(TabelaLinhas));
+        if (linhas == NULL) return -1;
+        iniciar_tabela_linhas(linhas, 0);
+        linhas->texto = 1;
+    }
+
+    FILE* arquivo = fopen(temporario, "w");
+    if (arquivo != NULL) setvbuf(arquivo, NULL, _IOFBF, 1 << 16);
+    int total = 0;
+    Paciente* paciente = salvamento->copia;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_DISCO) {
+            gravar_arvore_disco(clinica->registros[i].disco);
+            CursorRegistro cursor;
+            cursor_registro(&cursor, &clinica->registros[i]);
+            for (Paciente* lido = cursor_primeiro(&cursor); lido != NULL; lido = cursor_proximo(&cursor)) {
+                if (arquivo != NULL) gravar_paciente_visitado(lido, arquivo);
+                if (linhas != NULL) {
+                    // A linha guarda o nome, e a cópia do cursor é refeita a cada passo: ele vai para a arena
+                    uint64_t hash = hash_linha_paciente(lido);
+                    adicionar_linha(linhas, hash, hash, guardar_nome(lido->nome));
+                }
+                total++;
+            }
+        }
+        NoAVL* instantaneo = salvamento->instantaneos[i];
+        if (instantaneo != NULL) {
+            CursorRegistro cursor;
+            cursor_arvore(&cursor, instantaneo);
+            for (Paciente* versao = cursor_primeiro(&cursor); versao != NULL; versao = cursor_proximo(&cursor)) {
+                if (arquivo != NULL) gravar_paciente_visitado(versao, arquivo);
+                if (linhas != NULL) {
+                    uint64_t hash = hash_linha_paciente(versao);
+                    adicionar_linha(linhas, hash, hash, versao->nome);
+                }
+                total++;
+            }
+            liberar_no(instantaneo);
+            salvamento->instantaneos[i] = NULL;
+        }
+        for (int j = 0; j < salvamento->copiados[i]; j++, paciente++) {
+            if (arquivo != NULL) {
+                fprintf(arquivo, "%s, %c, %s, %s\n", paciente->nome, paciente->sexo, paciente->nascimento, paciente->ultima_consulta);
+            }
+            if (linhas != NULL) {
+                uint64_t hash = hash_linha_paciente(paciente);
+                adicionar_linha(linhas, hash, hash, paciente->nome);
+            }
+        }
+        total += salvamento->copiados[i];
+    }
+    if (arquivo == NULL || fclose(arquivo) != 0) {
+        if (linhas != NULL) {
+            liberar_tabela_linhas(linhas);
+            free(linhas);
+        }
+        return -1;
+    }
+    if (linhas != NULL) return entregar_linhas_salvas(clinica->recarga, temporario, linhas) ? total : -1;
+    return rename(temporario, salvamento->arquivo) == 0 ? total : -1;
+}
+
+// Função executada pela thread de salvamento automático
+void* thread_salvamento_automatico(void* argumento) {
+    SalvamentoAutomatico* salvamento = (SalvamentoAutomatico*)argumento;
+    Clinica* clinica = salvamento->clinica;
+
+    pthread_mutex_lock(&salvamento->trava);
+    while (!salvamento->encerrando) {
+        struct timespec prazo;
+        clock_gettime(CLOCK_REALTIME, &prazo);
+        prazo.tv_sec += salvamento->intervalo;
+        pthread_cond_timedwait(&salvamento->acordar, &salvamento->trava, &prazo);
+        if (salvamento->encerrando) break;
+        pthread_mutex_unlock(&salvamento->trava);
+
+        // Cópia: a única etapa que trava os cadastros (só se algo mudou desde o último salvamento)
+        double inicio = milissegundos_agora();
+        pthread_mutex_lock(&clinica->trava);
+        unsigned long versao = clinica->versao;
+        int copiados = versao != salvamento->versao_salva ? copiar_cadastros(salvamento) : -1;
+        pthread_mutex_unlock(&clinica->trava);
+        double copiado = milissegundos_agora();
+
+        // Gravação: a partir da cópia, com o menu livre para continuar atendendo
+        int total = copiados >= 0 ? gravar_copia(salvamento) : -1;
+        int sucesso = total >= 0;
+        double gravado = milissegundos_agora();
+
+        pthread_mutex_lock(&salvamento->trava);
+        if (sucesso) {
+            salvamento->versao_salva = versao;
+            salvamento->salvamentos++;
+            salvamento->ultimos_pacientes = total;
+            salvamento->ultima_copia_ms = copiado - inicio;
+            salvamento->ultima_gravacao_ms = gravado - copiado;
+            salvamento->ultimo_horario = time(NULL);
+        }
+    }
+    pthread_mutex_unlock(&salvamento->trava);
+    return NULL;
+}
+
+// Função para ligar o salvamento automático a cada 'intervalo' segundos no arquivo indicado
+void iniciar_salvamento_automatico(Clinica* clinica, int intervalo, const char* nome_arquivo) {
+    if (strlen(nome_arquivo) >= sizeof(((SalvamentoAutomatico*)NULL)->arquivo)) {
+        printf("Erro: o caminho %s é longo demais para o salvamento automático, que ficará desligado.\n", nome_arquivo);
+        return;
+    }
+    SalvamentoAutomatico* salvamento = (SalvamentoAutomatico*)calloc(1, sizeof(SalvamentoAutomatico));
+    if (salvamento == NULL) {
+        printf("Erro ao alocar memória para o salvamento automático.\n");
+        return;
+    }
+    salvamento->clinica = clinica;
+    salvamento->intervalo = intervalo;
+    salvamento->versao_salva = clinica->versao; // O que acabou de ser carregado já está no disco
+    snprintf(salvamento->arquivo, sizeof(salvamento->arquivo), "%s", nome_arquivo);
+    pthread_mutex_init(&salvamento->trava, NULL);
+    pthread_cond_init(&salvamento->acordar, NULL);
+
+    if (pthread_create(&salvamento->thread, NULL, thread_salvamento_automatico, salvamento) != 0) {
+        printf("Erro ao criar a thread de salvamento automático.\n");
+        pthread_mutex_destroy(&salvamento->trava);
+        pthread_cond_destroy(&salvamento->acordar);
+        free(salvamento);
+        return;
+    }
+    clinica->salvamento = salvamento;
+}
+
+// Função para desligar o salvamento automático, esperando um salvamento em andamento terminar
+void parar_salvamento_automatico(Clinica* clinica) {
+    SalvamentoAutomatico* salvamento = clinica->salvamento;
+
+    pthread_mutex_lock(&salvamento->trava);
+    salvamento->encerrando = 1;
+    pthread_cond_signal(&salvamento->acordar);
+    pthread_mutex_unlock(&salvamento->trava);
+    pthread_join(salvamento->thread, NULL);
+
+    pthread_mutex_destroy(&salvamento->trava);
+    pthread_cond_destroy(&salvamento->acordar);
+    free(salvamento->copia);
+    free(salvamento->copiados);
+    free(salvamento->instantaneos);
+    free(salvamento);
+    clinica->salvamento = NULL;
+}
+
+// Função para exibir a situação do salvamento automático
+void exibir_salvamento_automatico(Clinica* clinica) {
+    SalvamentoAutomatico* salvamento = clinica->salvamento;
+    if (salvamento == NULL) {
+        printf("Salvamento automático desligado (use --autosalvar <segundos>).\n");
+        return;
+    }
+
+    pthread_mutex_lock(&salvamento->trava);
+    printf("Salvamento automático em %s a cada %d segundos.\n", salvamento->arquivo, salvamento->intervalo);
+    if (salvamento->salvamentos == 0) {
+        printf("Nenhum salvamento feito ainda (só salva quando há alterações).\n");
+    } else {
+        char horario[16];
+        strftime(horario, sizeof(horario), "%H:%M:%S", localtime(&salvamento->ultimo_horario));
+        printf("%d salvamento(s). Último às %s: %d pacientes, cópia em %.2f ms, gravação em %.2f ms.\n",
+               salvamento->salvamentos, horario, salvamento->ultimos_pacientes,
+               salvamento->ultima_copia_ms, salvamento->ultima_gravacao_ms);
+    }
+    pthread_mutex_unlock(&salvamento->trava);
+}
+
+// Função para criar a tabela de linhas com espaço para 'previsao' linhas sem crescer
+void iniciar_tabela_linhas(TabelaLinhas* tabela, size_t previsao) {
+    size_t capacidade = 1024;
+    while (capacidade * 3 < previsao * 4) capacidade *= 2;
+    tabela->linhas = (LinhaCarregada*)calloc(capacidade, sizeof(LinhaCarregada));
+    tabela->vistas = (uint64_t*)calloc(capacidade / 64, sizeof(uint64_t));
+    if (tabela->linhas == NULL || tabela->vistas == NULL) {
+        printf("Erro ao alocar memória para a tabela de linhas.\n");
+        exit(1);
+    }
+    tabela->capacidade = capacidade;
+    tabela->quantidade = 0;
+}
+
+void liberar_tabela_linhas(TabelaLinhas* tabela) {
+    free(tabela->linhas);
+    free(tabela->vistas);
+    tabela->linhas = NULL;
+    tabela->vistas = NULL;
+    tabela->capacidade = 0;
+    tabela->quantidade = 0;
+}
+
+// Função para achar a posição de uma linha na tabela, ou a posição livre onde ela entraria
+size_t posicao_linha(const TabelaLinhas* tabela, uint64_t hash) {
+    size_t posicao = hash & (tabela->capacidade - 1);
+    while (tabela->linhas[posicao].hash != 0 && tabela->linhas[posicao].hash != hash) {
+        posicao = (posicao + 1) & (tabela->capacidade - 1);
+    }
+    return posicao;
+}
+
+// Função para marcar como vista uma linha já conhecida; retorna 0 se a linha não está na tabela
+int marcar_linha(TabelaLinhas* tabela, uint64_t hash) {
+    size_t posicao = posicao_linha(tabela, hash);
+    if (tabela->linhas[posicao].hash == 0) return 0;
+    tabela->vistas[posicao / 64] |= 1ULL << (posicao % 64);
+    return 1;
+}
+
+// Função para guardar uma linha (já vista) na tabela, dobrando-a quando passa de 3/4 ocupada
+void adicionar_linha(TabelaLinhas* tabela, uint64_t hash, uint64_t conteudo, const char* nome) {
+    if ((tabela->quantidade + 1) * 4 > tabela->capacidade * 3) {
+        TabelaLinhas maior;
+        iniciar_tabela_linhas(&maior, tabela->capacidade);
+        for (size_t i = 0; i < tabela->capacidade; i++) {
+            if (tabela->linhas[i].hash == 0) continue;
+            size_t posicao = posicao_linha(&maior, tabela->linhas[i].hash);
+            maior.linhas[posicao] = tabela->linhas[i];
+            if (tabela->vistas[i / 64] & (1ULL << (i % 64))) maior.vistas[posicao / 64] |= 1ULL << (posicao % 64);
+        }
+        maior.quantidade = tabela->quantidade;
+        maior.texto = tabela->texto;
+        liberar_tabela_linhas(tabela);
+        *tabela = maior;
+    }
+
+    size_t posicao = posicao_linha(tabela, hash);
+    if (tabela->linhas[posicao].hash == 0) {
+        tabela->linhas[posicao] = (LinhaCarregada){hash, conteudo, nome};
+        tabela->quantidade++;
+    }
+    tabela->vistas[posicao / 64] |= 1ULL << (posicao % 64);
+}
+
+// Função para tirar uma linha da tabela: as seguintes do mesmo grupo recuam para não deixar buracos na sondagem
+void remover_linha(TabelaLinhas* tabela, uint64_t hash) {
+    size_t mascara = tabela->capacidade - 1;
+    size_t livre = posicao_linha(tabela, hash);
+    if (tabela->linhas[livre].hash == 0) return;
+    tabela->quantidade--;
+
+    size_t atual = livre;
+    while (1) {
+        tabela->linhas[livre].hash = 0;
+        tabela->vistas[livre / 64] &= ~(1ULL << (livre % 64));
+        // Procura a próxima linha que pode ocupar a posição livre (a sua posição ideal não está entre as duas)
+        while (1) {
+            atual = (atual + 1) & mascara;
+            if (tabela->linhas[atual].hash == 0) return;
+            size_t ideal = tabela->linhas[atual].hash & mascara;
+            if (((atual - ideal) & mascara) >= ((atual - livre) & mascara)) break;
+        }
+        tabela->linhas[livre] = tabela->linhas[atual];
+        if (tabela->vistas[atual / 64] & (1ULL << (atual % 64))) tabela->vistas[livre / 64] |= 1ULL << (livre % 64);
+        livre = atual;
+    }
+}
+
+// Função para ler a assinatura atual de um arquivo; retorna 0 se ele não existir
+int ler_assinatura(const char* nome_arquivo, AssinaturaArquivo* assinatura) {
+    struct stat informacoes;
+    if (stat(nome_arquivo, &informacoes) != 0) return 0;
+    assinatura->dispositivo = informacoes.st_dev;
+    assinatura->inode = informacoes.st_ino;
+    assinatura->tamanho = informacoes.st_size;
+    assinatura->modificacao = informacoes.st_mtim;
+    return 1;
+}
+
+int mesma_assinatura(const AssinaturaArquivo* a, const AssinaturaArquivo* b) {
+    return a->dispositivo == b->dispositivo && a->inode == b->inode && a->tamanho == b->tamanho &&
+           a->modificacao.tv_sec == b->modificacao.tv_sec && a->modificacao.tv_nsec == b->modificacao.tv_nsec;
+}
+
+// Função chamada pelo salvamento automático quando ele grava o próprio arquivo acompanhado pela recarga:
+// o temporário é renomeado com a recarga travada e as linhas gravadas viram a nova versão de referência,
+// para a thread não tomar o salvamento por uma mudança feita fora do programa
+// Retorna 0 se o arquivo não pôde ser renomeado
+int entregar_linhas_salvas(RecargaArquivo* recarga, const char* temporario, TabelaLinhas* linhas) {
+    pthread_mutex_lock(&recarga->trava);
+    int sucesso = rename(temporario, recarga->arquivo) == 0 && ler_assinatura(recarga->arquivo, &recarga->assinatura_salva);
+    if (sucesso) {
+        if (recarga->base_salva != NULL) {
+            liberar_tabela_linhas(recarga->base_salva);
+            free(recarga->base_salva);
+        }
+        recarga->base_salva = linhas;
+    }
+    pthread_mutex_unlock(&recarga->trava);
+
+    if (!sucesso) {
+        liberar_tabela_linhas(linhas);
+        free(linhas);
+    }
+    return sucesso;
+}
+
+// Função da thread de recarga que compara a versão atual do arquivo com a base
+// O arquivo é lido em sequência e cada linha só é interpretada se o seu hash não estiver na base;
+// as linhas da base que não foram vistas saíram do arquivo. As diferenças vão para a fila do menu
+void comparar_arquivo_recarga(RecargaArquivo* recarga, const AssinaturaArquivo* assinatura) {
+    double inicio = milissegundos_agora();
+    TabelaLinhas* base = &recarga->base;
+    memset(base->vistas, 0, base->capacidade / 64 * sizeof(uint64_t));
+
+    MudancasRecarga* mudancas = (MudancasRecarga*)calloc(1, sizeof(MudancasRecarga));
+    if (mudancas == NULL) {
+        printf("Erro ao alocar memória para a recarga.\n");
+        exit(1);
+    }
+    mudancas->novos.linhas = base;
+    if (!ler_pacientes_arquivo(recarga->arquivo, &mudancas->novos) || !base->texto) {
+        // Sumiu entre o stat e a leitura, ou virou um arquivo compacto: fica para a próxima mudança
+        liberar_lote(&mudancas->novos);
+        free(mudancas);
+        return;
+    }
+    mudancas->novos.linhas = NULL;
+
+    int nao_vistas = 0;
+    for (size_t i = 0; i < base->capacidade; i++) {
+        if (base->linhas[i].hash != 0 && !(base->vistas[i / 64] & (1ULL << (i % 64)))) nao_vistas++;
+    }
+    if (nao_vistas > 0) {
+        mudancas->removidas = (LinhaCarregada*)malloc(nao_vistas * sizeof(LinhaCarregada));
+        if (mudancas->removidas == NULL) {
+            printf("Erro ao alocar memória para a recarga.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < base->capacidade; i++) {
+            if (base->linhas[i].hash != 0 && !(base->vistas[i / 64] & (1ULL << (i % 64)))) {
+                mudancas->removidas[mudancas->num_removidas++] = base->linhas[i];
+            }
+        }
+        for (int i = 0; i < mudancas->num_removidas; i++) remover_linha(base, mudancas->removidas[i].hash);
+    }
+    recarga->assinatura = *assinatura;
+
+    pthread_mutex_lock(&recarga->trava);
+    recarga->recargas++;
+    recarga->ultima_comparacao_ms = milissegundos_agora() - inicio;
+    if (mudancas->novos.quantidade == 0 && mudancas->num_removidas == 0) {
+        pthread_mutex_unlock(&recarga->trava);
+        free(mudancas->removidas);
+        free(mudancas);
+        return;
+    }
+    if (recarga->fim_fila != NULL) recarga->fim_fila->proxima = mudancas;
+    else recarga->fila = mudancas;
+    recarga->fim_fila = mudancas;
+    pthread_mutex_unlock(&recarga->trava);
+
+    char sinal = 1;
+    if (write(recarga->aviso[1], &sinal, 1) < 0) {
+        // Pipe cheio: já há um aviso pendente
+    }
+}
+
+// Função executada pela thread de recarga
+// Com inotify, a thread dorme até o arquivo ser fechado após uma escrita ou substituído por um rename
+// (vigia-se o diretório, porque quem troca o arquivo por rename cria um inode novo); sem inotify, o
+// stat é consultado a cada INTERVALO_RECARGA_MS e o arquivo só é lido depois de uma volta sem mudar,
+// para não pegar uma gravação pela metade
+void* thread_recarga(void* argumento) {
+    RecargaArquivo* recarga = (RecargaArquivo*)argumento;
+
+    char diretorio[256];
+    const char* barra = strrchr(recarga->arquivo, '/');
+    const char* nome = barra != NULL ? barra + 1 : recarga->arquivo;
+    if (barra == NULL) snprintf(diretorio, sizeof(diretorio), ".");
+    else snprintf(diretorio, sizeof(diretorio), "%.*s", barra == recarga->arquivo ? 1 : (int)(barra - recarga->arquivo), recarga->arquivo);
+
+    int vigia = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (vigia >= 0 && inotify_add_watch(vigia, diretorio, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(vigia);
+        vigia = -1;
+    }
+
+    AssinaturaArquivo candidata;
+    memset(&candidata, 0, sizeof(AssinaturaArquivo));
+    while (1) {
+        struct pollfd eventos[2] = {{recarga->encerrar[0], POLLIN, 0}, {vigia, POLLIN, 0}};
+        if (poll(eventos, 2, vigia >= 0 ? -1 : INTERVALO_RECARGA_MS) < 0 && errno != EINTR) break;
+        if (eventos[0].revents != 0) break;
+
+        if (vigia >= 0) {
+            if (eventos[1].revents == 0) continue;
+            int relevante = 0;
+            char eventos_lidos[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t lidos;
+            while ((lidos = read(vigia, eventos_lidos, sizeof(eventos_lidos))) > 0) {
+                for (char* p = eventos_lidos; p < eventos_lidos + lidos;) {
+                    struct inotify_event* evento = (struct inotify_event*)p;
+                    if (evento->len > 0 && strcmp(evento->name, nome) == 0) relevante = 1;
+                    p += sizeof(struct inotify_event) + evento->len;
+                }
+            }
+            if (!relevante) continue;
+        }
+
+        // Um salvamento automático no próprio arquivo traz a sua versão de referência
+        pthread_mutex_lock(&recarga->trava);
+        if (recarga->base_salva != NULL) {
+            liberar_tabela_linhas(&recarga->base);
+            recarga->base = *recarga->base_salva;
+            recarga->assinatura = recarga->assinatura_salva;
+            free(recarga->base_salva);
+            recarga->base_salva = NULL;
+        }
+        pthread_mutex_unlock(&recarga->trava);
+
+        AssinaturaArquivo atual;
+        if (!ler_assinatura(recarga->arquivo, &atual) || mesma_assinatura(&atual, &recarga->assinatura)) continue;
+        if (vigia < 0 && !mesma_assinatura(&atual, &candidata)) {
+            candidata = atual;
+            continue;
+        }
+        comparar_arquivo_recarga(recarga, &atual);
+    }
+
+    if (vigia >= 0) close(vigia);
+    return NULL;
+}
+
+// Função para ligar a recarga antes da carga: as linhas lidas do arquivo formam a primeira base
+void preparar_recarga(Clinica* clinica, const char* nome_arquivo) {
+    RecargaArquivo* recarga = (RecargaArquivo*)calloc(1, sizeof(RecargaArquivo));
+    if (recarga == NULL) {
+        printf("Erro ao alocar memória para a recarga automática.\n");
+        exit(1);
+    }
+    recarga->clinica = clinica;
+    snprintf(recarga->arquivo, sizeof(recarga->arquivo), "%s", nome_arquivo);
+    recarga->encerrar[0] = recarga->encerrar[1] = -1;
+    recarga->aviso[0] = recarga->aviso[1] = -1;
+    pthread_mutex_init(&recarga->trava, NULL);
+    iniciar_tabela_linhas(&recarga->base, 0);
+    clinica->recarga = recarga;
+}
+
+// Função para começar a vigiar o arquivo depois da carga
+// A assinatura é lida antes da thread: uma mudança feita a partir daqui já é percebida
+void iniciar_recarga(Clinica* clinica) {
+    RecargaArquivo* recarga = clinica->recarga;
+    if (!recarga->base.texto || !ler_assinatura(recarga->arquivo, &recarga->assinatura)) {
+        printf("A recarga automática precisa ler %s como arquivo de texto; ela ficará desligada.\n", recarga->arquivo);
+        parar_recarga(clinica);
+        return;
+    }
+    if (pipe2(recarga->encerrar, O_CLOEXEC) != 0 || pipe2(recarga->aviso, O_CLOEXEC | O_NONBLOCK) != 0 ||
+        pthread_create(&recarga->thread, NULL, thread_recarga, recarga) != 0) {
+        printf("Erro ao criar a thread de recarga automática.\n");
+        parar_recarga(clinica);
+        return;
+    }
+    recarga->vigiando = 1;
+    printf("Acompanhando mudanças em %s.\n", recarga->arquivo);
+}
+
+// Função para desligar a recarga; mudanças que ainda estão na fila são descartadas
+void parar_recarga(Clinica* clinica) {
+    RecargaArquivo* recarga = clinica->recarga;
+    if (recarga->vigiando) {
+        char sinal = 1;
+        if (write(recarga->encerrar[1], &sinal, 1) == 1) pthread_join(recarga->thread, NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (recarga->encerrar[i] >= 0) close(recarga->encerrar[i]);
+        if (recarga->aviso[i] >= 0) close(recarga->aviso[i]);
+    }
+
+    while (recarga->fila != NULL) {
+        MudancasRecarga* mudancas = recarga->fila;
+        recarga->fila = mudancas->proxima;
+        liberar_lote(&mudancas->novos);
+        free(mudancas->removidas);
+        free(mudancas);
+    }
+    if (recarga->base_salva != NULL) {
+        liberar_tabela_linhas(recarga->base_salva);
+        free(recarga->base_salva);
+    }
+    liberar_tabela_linhas(&recarga->base);
+    pthread_mutex_destroy(&recarga->trava);
+    free(recarga);
+    clinica->recarga = NULL;
 }
 
-// Função para carregar os pacientes do arquivo TXT
-void carregar_pacientes(ListaDupla* lista_m, NoAVL** raiz_l, char* nome_arquivo) {
-    FILE* arquivo = fopen(nome_arquivo, "r");
-    if (arquivo == NULL) {
-        printf("Erro ao abrir o arquivo.\n");
-        return;
-    }
+int comparar_nomes_recarga(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
 
-    char linha[256];
-    int primeira_linha = 1; // Flag para verificar se é a primeira linha
+// Função para aplicar nos cadastros as mudanças do arquivo que estão na fila (chamada pelo menu)
+// Linha nova com o nome de um paciente existente é uma alteração; linha que saiu do arquivo remove o
+// paciente, a não ser que outra linha nova traga o mesmo nome ou que ele tenha sido alterado pelo menu
+// depois da carga (os dados dele não batem mais com a linha)
+void aplicar_recarga(Clinica* clinica, int exibir) {
+    RecargaArquivo* recarga = clinica->recarga;
+    if (recarga == NULL) return;
+    pthread_mutex_lock(&recarga->trava);
+    MudancasRecarga* fila = recarga->fila;
+    recarga->fila = recarga->fim_fila = NULL;
+    pthread_mutex_unlock(&recarga->trava);
+    char sinais[64];
+    while (read(recarga->aviso[0], sinais, sizeof(sinais)) > 0) {}
+    if (fila == NULL) return;
 
-    while (fgets(linha, sizeof(linha), arquivo)) {
-        // Remove o caractere de nova linha (\n) do final da linha, se existir
-        linha[strcspn(linha, "\n")] = '\0';
+    double inicio = milissegundos_agora();
+    int incluidos = 0, alterados = 0, removidos = 0;
+    iniciar_escrita(clinica);
+    while (fila != NULL) {
+        MudancasRecarga* mudancas = fila;
+        fila = mudancas->proxima;
 
-        // Verifica se a linha está vazia ou mal formatada
-        if (linha[0] == '\0' || linha[0] == '\r') {
-            continue; // Ignora linhas vazias ou com apenas um carriage return
+        const char** nomes = (const char**)malloc((mudancas->novos.quantidade > 0 ? mudancas->novos.quantidade : 1) * sizeof(char*));
+        if (nomes == NULL) {
+            printf("Erro ao alocar memória para a recarga.\n");
+            exit(1);
         }
+        for (int i = 0; i < mudancas->novos.quantidade; i++) {
+            Paciente* novo = &mudancas->novos.pacientes[i];
+            nomes[i] = novo->nome;
 
-        // Remove o BOM (Byte Order Mark) se presente na primeira linha
-        if (primeira_linha && (unsigned char)linha[0] == 0xEF && (unsigned char)linha[1] == 0xBB && (unsigned char)linha[2] == 0xBF) {
-            memmove(linha, linha + 3, strlen(linha) - 2); // Remove os 3 primeiros bytes (BOM)
+            Registro* registro;
+            Paciente* atual = buscar_clinica(clinica, novo->nome, &registro);
+            if (atual != NULL && strcmp(atual->nome, novo->nome) == 0) {
+                if (atual->sexo == novo->sexo && strcmp(atual->nascimento, novo->nascimento) == 0 &&
+                    strcmp(atual->ultima_consulta, novo->ultima_consulta) == 0) continue;
+                Paciente alterado = *atual;
+                alterado.sexo = novo->sexo;
+                memcpy(alterado.nascimento, novo->nascimento, sizeof(alterado.nascimento));
+                memcpy(alterado.ultima_consulta, novo->ultima_consulta, sizeof(alterado.ultima_consulta));
+                if (aplicar_alteracao(clinica, &registro, atual, alterado) != NULL) alterados++;
+            } else {
+                int indice = rotear_paciente(clinica, novo);
+                if (indice >= 0 && registro_inserir(&clinica->registros[indice], *novo)) incluidos++;
+            }
         }
-        primeira_linha = 0; // Marca que a primeira linha já foi processada
+        qsort(nomes, mudancas->novos.quantidade, sizeof(char*), comparar_nomes_recarga);
 
-        // Limpa caracteres indesejados (aspas e < >)
-        limpar_string(linha);
+        for (int i = 0; i < mudancas->num_removidas; i++) {
+            LinhaCarregada* linha = &mudancas->removidas[i];
+            if (linha->nome == NULL) continue;
+            if (bsearch(&linha->nome, nomes, mudancas->novos.quantidade, sizeof(char*), comparar_nomes_recarga) != NULL) continue;
 
-        // Processa a linha para extrair os dados do paciente
-        Paciente paciente;
-        if (sscanf(linha, "%[^,], %c, %[^,], %s", paciente.nome, &paciente.sexo, paciente.nascimento, paciente.ultima_consulta) == 4) {
-            if (paciente.sexo == 'M') {
-                inserir_ordenado(lista_m, paciente);
-            } else if (paciente.sexo == 'F') {
-                *raiz_l = inserir_avl(*raiz_l, paciente);
+            Registro* registro;
+            Paciente* atual = buscar_clinica(clinica, linha->nome, &registro);
+            if (atual != NULL && strcmp(atual->nome, linha->nome) == 0 && hash_linha_paciente(atual) == linha->conteudo) {
+                registro_remover(registro, atual);
+                removidos++;
             }
-        } else {
-            printf("Erro ao processar a linha: %s\n", linha);
         }
+
+        free(nomes);
+        liberar_lote(&mudancas->novos);
+        free(mudancas->removidas);
+        free(mudancas);
     }
+    terminar_escrita(clinica);
+    auditar(clinica->auditoria, EVENTO_IMPORTACAO, "", recarga->arquivo);
 
-    fclose(arquivo);
+    if (exibir) {
+        printf("%s mudou no disco: %d paciente(s) incluído(s), %d alterado(s) e %d removido(s) em %.2f ms ",
+               recarga->arquivo, incluidos, alterados, removidos, milissegundos_agora() - inicio);
+        pthread_mutex_lock(&recarga->trava);
+        printf("(comparação do arquivo em %.2f ms).\n", recarga->ultima_comparacao_ms);
+        pthread_mutex_unlock(&recarga->trava);
+    }
 }
 
-// Função para criar um paciente 
-void cadastrar_paciente(ListaDupla* lista_m, NoAVL** raiz_l) {
-    Paciente paciente;
-    char sexo;
-
-    printf("Digite o nome do paciente: ");
-    scanf(" %[^\n]", paciente.nome);
-
-    printf("Digite o sexo do paciente (M/F): ");
-    scanf(" %c", &sexo);
-    paciente.sexo = sexo;
+// Função para obter o nome de um tipo de evento, como gravado no arquivo de auditoria
+const char* nome_evento(TipoEvento tipo) {
+    switch (tipo) {
+        case EVENTO_LEITURA: return "leitura";
+        case EVENTO_LISTAGEM: return "listagem";
+        case EVENTO_CADASTRO: return "cadastro";
+        case EVENTO_ALTERACAO: return "alteracao";
+        case EVENTO_CONSULTA: return "consulta";
+        case EVENTO_DESFAZER: return "desfazer";
+        default: return "importacao";
+    }
+}
 
-    printf("Digite a data de nascimento (dd/mm/aaaa): ");
-    scanf(" %s", paciente.nascimento);
+// Função para copiar um texto cortando no tamanho do destino (sem o custo de formatar do snprintf)
+void copiar_texto(char* destino, size_t tamanho, const char* origem) {
+    size_t comprimento = strnlen(origem, tamanho - 1);
+    memcpy(destino, origem, comprimento);
+    destino[comprimento] = '\0';
+}
 
-    printf("Digite a data da última consulta (dd/mm/aaaa): ");
-    scanf(" %s", paciente.ultima_consulta);
-
-    if (sexo == 'M') {
-        inserir_ordenado(lista_m, paciente);
-        printf("Paciente cadastrado na lista do Moises.\n");
-    } else if (sexo == 'F') {
-        *raiz_l = inserir_avl(*raiz_l, paciente);
-        printf("Paciente cadastrado na arvore da Liz.\n");
-    } else {
-        printf("Sexo inválido. Use 'M' para masculino ou 'F' para feminino.\n");
+// Função para pôr um evento na fila sem travas; retorna 0 se a fila estiver cheia
+// Quem registra reserva a posição com uma troca atômica e publica a vaga ao avançar a sua sequência
+int enfileirar_evento(Auditoria* auditoria, const EventoAuditoria* evento) {
+    size_t posicao = atomic_load_explicit(&auditoria->escrita, memory_order_relaxed);
+    for (;;) {
+        VagaAuditoria* vaga = &auditoria->vagas[posicao & (TAMANHO_FILA_AUDITORIA - 1)];
+        size_t sequencia = atomic_load_explicit(&vaga->sequencia, memory_order_acquire);
+        intptr_t diferenca = (intptr_t)sequencia - (intptr_t)posicao;
+        if (diferenca == 0) {
+            if (atomic_compare_exchange_weak_explicit(&auditoria->escrita, &posicao, posicao + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                vaga->evento = *evento;
+                atomic_store_explicit(&vaga->sequencia, posicao + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diferenca < 0) {
+            return 0; // A vaga ainda guarda um evento de uma volta anterior: fila cheia
+        } else {
+            posicao = atomic_load_explicit(&auditoria->escrita, memory_order_relaxed);
+        }
     }
 }
 
-// Função para alterar um registro de paciente
-// Função para alterar um registro de paciente
-void alterar_registro(ListaDupla* lista_m, NoAVL* raiz_l) {
-    char nome[100];
-    int menu;
+// Função para registrar um evento na auditoria (não faz nada se ela estiver desligada)
+// Só copia o evento para a fila: a formatação e a escrita no arquivo ficam com a thread de gravação
+void auditar(Auditoria* auditoria, TipoEvento tipo, const char* medico, const char* paciente) {
+    if (auditoria == NULL) return;
 
-    printf("Digite o nome do paciente que deseja alterar: ");
-    scanf(" %[^\n]", nome);
+    unsigned long numero = atomic_fetch_add_explicit(&auditoria->registrados, 1, memory_order_relaxed);
+    int medir = numero % AMOSTRAGEM_AUDITORIA == 0;
+    struct timespec inicio, fim;
+    if (medir) clock_gettime(CLOCK_MONOTONIC, &inicio);
 
-    // Busca na lista do Moisés
-    Paciente* paciente = buscar_lista(lista_m, nome);
-    if (paciente != NULL) {
-        printf("Paciente encontrado na lista do Moises.\n");
-    } else {
-        // Busca na árvore da Liz
-        paciente = buscar_avl(raiz_l, nome);
-        if (paciente != NULL) {
-            printf("Paciente encontrado na arvore da Liz.\n");
-        } else {
-            printf("Paciente não encontrado.\n");
-            return;
+    EventoAuditoria evento;
+    clock_gettime(CLOCK_REALTIME, &evento.instante);
+    evento.tipo = tipo;
+    copiar_texto(evento.medico, sizeof(evento.medico), medico);
+    copiar_texto(evento.paciente, sizeof(evento.paciente), paciente);
+    evento.paciente_longo = NULL;
+    if (strnlen(paciente, sizeof(evento.paciente)) == sizeof(evento.paciente)) {
+        // Nome longo (raro): a cópia inteira evita que dois nomes com o mesmo começo se confundam no registro
+        evento.paciente_longo = strdup(paciente);
+        if (evento.paciente_longo == NULL) {
+            printf("Erro ao alocar memória para a auditoria.\n");
+            exit(1);
         }
     }
 
-    do {
-        printf("\nO que deseja alterar?\n");
-        printf("1. Nome\n");
-        printf("2. Sexo\n");
-        printf("3. Data de Nascimento\n");
-        printf("4. Data da Última Consulta\n");
-        printf("5. Voltar\n");
-        printf("Sua escolha: ");
-        scanf("%d", &menu);
-        setbuf(stdin, NULL);
-        switch(menu) {
-            case 1:
-                printf("Digite o novo nome: ");
-                char novo_nome[100];
-                scanf(" %[^\n]", novo_nome);
-                strcpy(paciente->nome, novo_nome);
-                printf("Registro do paciente alterado com sucesso.\n");
-                break;
-            case 2:
-                printf("Digite o novo sexo (M/F): ");
-                char novo_sexo;
-                scanf(" %c", &novo_sexo);
-                if (novo_sexo == 'M' || novo_sexo == 'F') {
-                    paciente->sexo = novo_sexo;
-                    printf("Registro do paciente alterado com sucesso.\n");
-                } else {
-                    printf("Sexo inválido. Use 'M' para masculino ou 'F' para feminino.\n");
-                }
-                break;
-            case 3:
-                printf("Digite a nova data de nascimento (dd/mm/aaaa): ");
-                char nova_nascimento[11];
-                scanf(" %s", nova_nascimento);
-                strcpy(paciente->nascimento, nova_nascimento);
-                printf("Registro do paciente alterado com sucesso.\n");
-                break;
-            case 4:
-                printf("Digite a nova data da última consulta (dd/mm/aaaa): ");
-                char nova_consulta[11];
-                scanf(" %s", nova_consulta);
-                strcpy(paciente->ultima_consulta, nova_consulta);
-                printf("Registro do paciente alterado com sucesso.\n");
-                break;
-            case 5:
-                printf("Voltando ao menu principal.\n");
-                break;
-            default:
-                printf("Opção inválida.\n");
+    if (!enfileirar_evento(auditoria, &evento)) {
+        if (auditoria->politica == AUDITORIA_DESCARTAR) {
+            free(evento.paciente_longo);
+            atomic_fetch_add_explicit(&auditoria->descartados, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&auditoria->esperas, 1, memory_order_relaxed);
+            while (!enfileirar_evento(auditoria, &evento)) sched_yield();
         }
-    } while (menu != 5);
-}
-
-// Função para salvar os pacientes da lista do Moisés em um arquivo
-void salvar_pacientes_moises(ListaDupla* lista, const char* nome_arquivo) {
-    FILE* arquivo = fopen(nome_arquivo, "w");
-    if (arquivo == NULL) {
-        printf("Erro ao abrir o arquivo para salvar os pacientes do Moisés.\n");
-        return;
     }
 
-    NoLista* atual = lista->inicio;
-    while (atual != NULL) {
-        fprintf(arquivo, "%s, %c, %s, %s\n", atual->paciente.nome, atual->paciente.sexo, atual->paciente.nascimento, atual->paciente.ultima_consulta);
-        atual = atual->proximo;
+    if (medir) {
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        long custo = (fim.tv_sec - inicio.tv_sec) * 1000000000L + (fim.tv_nsec - inicio.tv_nsec);
+        atomic_fetch_add_explicit(&auditoria->nanossegundos, (unsigned long)custo, memory_order_relaxed);
+        atomic_fetch_add_explicit(&auditoria->amostras, 1, memory_order_relaxed);
     }
-
-    fclose(arquivo);
-    printf("Pacientes do Moisés salvos em %s.\n", nome_arquivo);
 }
 
-// Função para salvar os pacientes da árvore da Liz em um arquivo
-void salvar_pacientes_liz(NoAVL* raiz, FILE* arquivo) {
-    if (raiz == NULL) return;
+// Função da thread de gravação: escreve os eventos já publicados, uma linha por evento
+// (data e hora, processo, operador, tipo, médico e paciente, separados por tabulação)
+// Retorna quantos eventos foram escritos
+int gravar_eventos_auditoria(Auditoria* auditoria) {
+    int gravados = 0;
+    for (;;) {
+        VagaAuditoria* vaga = &auditoria->vagas[auditoria->leitura & (TAMANHO_FILA_AUDITORIA - 1)];
+        if (atomic_load_explicit(&vaga->sequencia, memory_order_acquire) != auditoria->leitura + 1) break;
 
-    salvar_pacientes_liz(raiz->esquerda, arquivo);
-    fprintf(arquivo, "%s, %c, %s, %s\n", raiz->paciente.nome, raiz->paciente.sexo, raiz->paciente.nascimento, raiz->paciente.ultima_consulta);
-    salvar_pacientes_liz(raiz->direita, arquivo);
-}
+        EventoAuditoria* evento = &vaga->evento;
+        struct tm data;
+        localtime_r(&evento->instante.tv_sec, &data);
+        fprintf(auditoria->arquivo, "%04d-%02d-%02d %02d:%02d:%02d.%06ld\t%d\t%s\t%s\t%s\t%s\n",
+                data.tm_year + 1900, data.tm_mon + 1, data.tm_mday, data.tm_hour, data.tm_min, data.tm_sec,
+                evento->instante.tv_nsec / 1000, auditoria->pid, auditoria->operador,
+                nome_evento(evento->tipo), evento->medico,
+                evento->paciente_longo != NULL ? evento->paciente_longo : evento->paciente);
+        free(evento->paciente_longo);
 
-// Função para salvar os pacientes da árvore da Liz em um arquivo
-void salvar_pacientes_liz_arquivo(NoAVL* raiz, const char* nome_arquivo) {
-    FILE* arquivo = fopen(nome_arquivo, "w");
-    if (arquivo == NULL) {
-        printf("Erro ao abrir o arquivo para salvar os pacientes da Liz.\n");
-        return;
+        // Devolve a vaga para a próxima volta da fila
+        atomic_store_explicit(&vaga->sequencia, auditoria->leitura + TAMANHO_FILA_AUDITORIA, memory_order_release);
+        auditoria->leitura++;
+        gravados++;
     }
-
-    salvar_pacientes_liz(raiz, arquivo);
-    fclose(arquivo);
-    printf("Pacientes da Liz salvos em %s.\n", nome_arquivo);
+    auditoria->gravados += gravados;
+    return gravados;
 }
 
-// Função para salvar todos os pacientes ao fechar o programa
-void salvar_pacientes(ListaDupla* lista_m, NoAVL* raiz_l) {
-    salvar_pacientes_moises(lista_m, "pacientes_moises.txt");
-    salvar_pacientes_liz_arquivo(raiz_l, "pacientes_liz.txt");
+// Função executada pela thread de gravação da auditoria: um fflush por lote de eventos
+// Ao encerrar, esvazia a fila antes de sair
+void* thread_auditoria(void* argumento) {
+    Auditoria* auditoria = (Auditoria*)argumento;
+    struct timespec pausa = {0, INTERVALO_AUDITORIA_MS * 1000000L};
+    for (;;) {
+        int encerrando = atomic_load(&auditoria->encerrando);
+        if (gravar_eventos_auditoria(auditoria) > 0) fflush(auditoria->arquivo);
+        else if (encerrando) break;
+        else nanosleep(&pausa, NULL);
+    }
+    return NULL;
 }
 
-void salvar_pacientes_original(ListaDupla* lista_m, NoAVL* raiz_l, char* nome_arquivo){
-    FILE* arquivo = fopen(nome_arquivo, "w");
-    if (arquivo == NULL) {
-        printf("Erro ao abrir o arquivo para escrita.\n");
+// Função para ligar a auditoria, acrescentando os eventos ao arquivo indicado
+void iniciar_auditoria(Clinica* clinica, const char* nome_arquivo, PoliticaAuditoria politica, const char* operador) {
+    Auditoria* auditoria = (Auditoria*)calloc(1, sizeof(Auditoria));
+    VagaAuditoria* vagas = (VagaAuditoria*)malloc(TAMANHO_FILA_AUDITORIA * sizeof(VagaAuditoria));
+    if (auditoria == NULL || vagas == NULL) {
+        printf("Erro ao alocar memória para a auditoria.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < TAMANHO_FILA_AUDITORIA; i++) atomic_init(&vagas[i].sequencia, i);
+    auditoria->vagas = vagas;
+    auditoria->politica = politica;
+    auditoria->pid = (int)getpid();
+    snprintf(auditoria->nome_arquivo, sizeof(auditoria->nome_arquivo), "%s", nome_arquivo);
+    snprintf(auditoria->operador, sizeof(auditoria->operador), "%s", operador);
+
+    auditoria->arquivo = fopen(nome_arquivo, "a");
+    if (auditoria->arquivo == NULL) {
+        printf("Erro ao abrir o arquivo de auditoria %s.\n", nome_arquivo);
+        free(vagas);
+        free(auditoria);
         return;
     }
+    setvbuf(auditoria->arquivo, NULL, _IOFBF, 1 << 16);
 
-    // Salvar pacientes da lista duplamente encadeada (homens)
-    NoLista* atual = lista_m->inicio;
-    while (atual != NULL) {
-        fprintf(arquivo, "%s, %c, %s, %s\n", atual->paciente.nome, atual->paciente.sexo, atual->paciente.nascimento, atual->paciente.ultima_consulta);
-        atual = atual->proximo;
+    if (pthread_create(&auditoria->thread, NULL, thread_auditoria, auditoria) != 0) {
+        printf("Erro ao criar a thread de auditoria.\n");
+        fclose(auditoria->arquivo);
+        free(vagas);
+        free(auditoria);
+        return;
     }
+    clinica->auditoria = auditoria;
+}
 
-    // Salvar pacientes da árvore AVL (mulheres)
-    salvar_avl_em_arquivo(raiz_l, arquivo);
+// Função para desligar a auditoria: a thread grava o que ainda está na fila antes de terminar
+void parar_auditoria(Clinica* clinica) {
+    Auditoria* auditoria = clinica->auditoria;
+    atomic_store(&auditoria->encerrando, 1);
+    pthread_join(auditoria->thread, NULL);
+    fclose(auditoria->arquivo);
 
-    fclose(arquivo);
-    printf("Pacientes salvos com sucesso no arquivo %s.\n", nome_arquivo);
+    unsigned long amostras = atomic_load(&auditoria->amostras);
+    printf("Auditoria: %lu evento(s) gravado(s) em %s, %lu descartado(s), %lu espera(s) por espaço na fila.\n",
+           auditoria->gravados, auditoria->nome_arquivo, atomic_load(&auditoria->descartados), atomic_load(&auditoria->esperas));
+    if (amostras > 0) {
+        printf("Custo médio de registrar um evento: %.0f ns (%lu amostra(s)).\n",
+               (double)atomic_load(&auditoria->nanossegundos) / amostras, amostras);
+    }
+    free(auditoria->vagas);
+    free(auditoria);
+    clinica->auditoria = NULL;
 }
 
-// Função auxiliar para percorrer a árvore AVL e salvar os pacientes no arquivo
-void salvar_avl_em_arquivo(NoAVL* raiz, FILE* arquivo) {
-    if (raiz == NULL) {
+// Função para exibir as consultas de um paciente do médico em um período
+void consultar_historico(Clinica* clinica, Registro* registro) {
+    materializar_clinica(clinica);
+    char de[11], ate[11];
+    printf("Digite o nome do paciente: ");
+    char* nome = ler_texto_digitado();
+    Paciente* paciente = registro_buscar(registro, nome);
+    free(nome);
+    if (paciente == NULL) {
+        printf("Paciente não encontrado.\n");
+        return;
+    }
+
+    printf("Digite o início do período (dd/mm/aaaa): ");
+    scanf(" %10s", de);
+    printf("Digite o fim do período (dd/mm/aaaa): ");
+    scanf(" %10s", ate);
+    int dia_de = data_para_dias(de), dia_ate = data_para_dias(ate);
+    if (dia_de <= 0 || dia_ate <= 0) {
+        printf("Data inválida.\n");
         return;
     }
 
-    // Percorrer a árvore em ordem (esquerda, raiz, direita)
-    salvar_avl_em_arquivo(raiz->esquerda, arquivo);
-    fprintf(arquivo, "%s, %c, %s, %s\n", raiz->paciente.nome, raiz->paciente.sexo, raiz->paciente.nascimento, raiz->paciente.ultima_consulta);
-    salvar_avl_em_arquivo(raiz->direita, arquivo);
+    auditar(clinica->auditoria, EVENTO_LEITURA, registro->medico, paciente->nome);
+    printf("Consultas de %s entre %s e %s:\n", paciente->nome, de, ate);
+    listar_consultas_periodo(paciente, dia_de, dia_ate);
+    printf("Total: %d consulta(s).\n", contar_consultas_periodo(paciente, dia_de, dia_ate));
 }
 
-// Função para exibir o menu de pacientes do Moisés
-void menu_moises(ListaDupla* lista) {
+// Função para exibir o menu de pacientes de um médico
+void menu_registro(Clinica* clinica, Registro* registro) {
     int opcao;
-    char nome[100];
 
     setbuf(stdin, NULL);
 
     do {
-        printf("\n--- Pacientes do Moises ---\n");
+        printf("\n--- Pacientes de %s ---\n", registro->medico);
         printf("1. Consultar paciente\n");
         printf("2. Listar todos os pacientes\n");
         printf("3. Cadastrar paciente\n");
         printf("4. Alterar cadastro do paciente\n");
-        printf("5. Voltar\n");
+        printf("5. Consultas do paciente em um período\n");
+        printf("6. Desfazer a última alteração\n");
+        printf("7. Voltar\n");
         printf("Sua escolha: ");
-        scanf("%d", &opcao);
+        if (scanf("%d", &opcao) == EOF) opcao = 7; // Fim da entrada
+        aplicar_recarga(clinica, 1); // Mudanças do arquivo no disco entram antes da operação escolhida
 
         switch (opcao) {
             case 1:
                 limpar_tela();
                 printf("Digite o nome do paciente: ");
-                scanf(" %[^\n]", nome);
-                Paciente* paciente = buscar_lista(lista, nome);
+                char* nome = ler_texto_digitado();
+                Paciente* paciente;
+                if (clinica->preguicoso != NULL) {
+                    // Modo preguiçoso: só vale se o paciente for deste médico
+                    paciente = buscar_preguicoso(clinica->preguicoso, nome);
+                    if (paciente != NULL && rotear_paciente(clinica, paciente) != (int)(registro - clinica->registros)) paciente = NULL;
+                } else {
+                    paciente = registro_buscar(registro, nome);
+                }
+                free(nome);
                 setbuf(stdin, NULL);
+                if (paciente != NULL) auditar(clinica->auditoria, EVENTO_LEITURA, registro->medico, paciente->nome);
                 exibir_paciente(paciente);
                 break;
-            case 2:
+            case 2: {
+                int campo;
+                printf("Ordenar por: 1. Nome  2. Data de nascimento  3. Última consulta  4. Idade\n");
+                printf("Sua escolha: ");
+                if (scanf("%d", &campo) != 1 || campo < 1 || campo > 4) campo = 1;
                 limpar_tela();
                 setbuf(stdin, NULL);
-                listar_pacientes_lista(lista);
+                materializar_clinica(clinica);
+                auditar(clinica->auditoria, EVENTO_LISTAGEM, registro->medico, "");
+                listar_registro_ordenado(clinica, registro, (CampoOrdenacao)(campo - 1));
                 break;
+            }
             case 3:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                cadastrar_paciente(lista, NULL);
+                cadastrar_paciente(clinica);
                 break;
             case 4:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                alterar_registro(lista, NULL);
+                alterar_registro(clinica);
                 break;
             case 5:
+                limpar_tela();
+                setbuf(stdin, NULL);
+                consultar_historico(clinica, registro);
+                break;
+            case 6:
+                setbuf(stdin, NULL);
+                if (registro->motor != MOTOR_PERSISTENTE) {
+                    printf("Só cadastros com o motor persistente guardam versões para desfazer.\n");
+                } else {
+                    Registro* impedimento = NULL;
+                    int desfeito = registro_desfazer(clinica, registro, &impedimento);
+                    if (desfeito > 0) {
+                        auditar(clinica->auditoria, EVENTO_DESFAZER, registro->medico, "");
+                        printf("Última alteração desfeita (%d ainda podem ser desfeitas).\n", registro->num_escritas);
+                    } else if (desfeito < 0) {
+                        printf("A última alteração também mudou o cadastro de %s, que não pode voltar para antes dela; "
+                               "nada foi desfeito.\n", impedimento->medico);
+                    } else {
+                        printf("Nada para desfazer.\n");
+                    }
+                }
+                break;
+            case 7:
+                setbuf(stdin, NULL);
                 printf("Voltando ao menu principal.\n");
                 limpar_tela();
                 break;
             default:
                 printf("Opção inválida.\n");
         }
-    } while (opcao != 5);
+    } while (opcao != 7);
 }
 
-// Função para exibir o menu de pacientes da Liz
-void menu_liz(NoAVL* raiz) {
+// Função para exibir o menu principal
+// As primeiras opções são os médicos; as demais vêm na ordem de OpcaoMenuPrincipal
+void menu_principal(Clinica* clinica) {
     int opcao;
-    char nome[100];
+    int medicos = clinica->quantidade;
 
     setbuf(stdin, NULL);
 
     do {
-        printf("\n--- Pacientes da Liz ---\n");
-        printf("1. Consultar paciente\n");
-        printf("2. Listar todos os pacientes\n");
-        printf("3. Cadastrar paciente\n");
-        printf("4. Alterar cadastro do paciente\n");
-        printf("5. Voltar\n");
+        printf("\n--- Menu Principal ---\n");
+        for (int i = 0; i < medicos; i++) {
+            printf("%d. Pacientes de %s\n", i + 1, clinica->registros[i].medico);
+        }
+        printf("%d. Buscar paciente em todos os médicos\n", medicos + OPCAO_BUSCAR);
+        printf("%d. Buscar por sobrenome ou partes do nome\n", medicos + OPCAO_BUSCAR_TERMOS);
+        printf("%d. Listar pacientes de todos os médicos entre dois nomes\n", medicos + OPCAO_INTERVALO);
+        printf("%d. Busca interativa (resultados enquanto digita)\n", medicos + OPCAO_BUSCA_INTERATIVA);
+        printf("%d. Estatísticas da clínica e por médico\n", medicos + OPCAO_ESTATISTICAS);
+        printf("%d. Pacientes com mais de N consultas no ano\n", medicos + OPCAO_FREQUENTES);
+        printf("%d. Pacientes há mais tempo sem consulta\n", medicos + OPCAO_ATRASADOS);
+        printf("%d. Conciliar lista de nomes\n", medicos + OPCAO_CONCILIAR);
+        printf("%d. Importar lote de pacientes\n", medicos + OPCAO_IMPORTAR);
+        printf("%d. Exportar arquivo compacto\n", medicos + OPCAO_EXPORTAR);
+        printf("%d. Salvamento automático\n", medicos + OPCAO_AUTOSALVAMENTO);
+        printf("%d. Finalizar programa\n", medicos + OPCAO_FINALIZAR);
         printf("Sua escolha: ");
-        scanf("%d", &opcao);
-       
+        if (scanf("%d", &opcao) == EOF) opcao = medicos + OPCAO_FINALIZAR; // Fim da entrada
+        aplicar_recarga(clinica, 1); // Mudanças do arquivo no disco entram antes da operação escolhida
 
-        switch (opcao) {
-            case 1:
+        if (opcao >= 1 && opcao <= medicos) {
+            limpar_tela();
+            setbuf(stdin, NULL);
+            menu_registro(clinica, &clinica->registros[opcao - 1]);
+            continue;
+        }
+
+        switch (opcao - medicos) {
+            case OPCAO_BUSCAR:
                 limpar_tela();
-                printf("Digite o nome do paciente: ");
-                scanf(" %[^\n]", nome);
-                Paciente* paciente = buscar_avl(raiz, nome);
                 setbuf(stdin, NULL);
+                printf("Digite o nome do paciente: ");
+                char* nome = ler_texto_digitado();
+                Registro* registro;
+                Paciente* paciente = buscar_clinica(clinica, nome, &registro);
+                free(nome);
+                if (paciente != NULL) {
+                    printf("Paciente encontrado no cadastro de %s.\n", registro->medico);
+                    auditar(clinica->auditoria, EVENTO_LEITURA, registro->medico, paciente->nome);
+                }
                 exibir_paciente(paciente);
                 break;
-            case 2:
+            case OPCAO_BUSCAR_TERMOS:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                printf("\n--- Lista de Pacientes (Liz) ---\n");
-                listar_pacientes_avl(raiz);
+                printf("Digite o sobrenome ou as partes do nome: ");
+                char* termos = ler_texto_digitado();
+                buscar_por_termos(clinica, termos);
+                free(termos);
                 break;
-            case 3:
+            case OPCAO_INTERVALO:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                cadastrar_paciente(NULL, &raiz);
+                printf("Digite o nome inicial: ");
+                char* de = ler_texto_digitado();
+                printf("Digite o nome final: ");
+                char* ate = ler_texto_digitado();
+                listar_intervalo(clinica, de, ate);
+                free(de);
+                free(ate);
                 break;
-            case 4:
+            case OPCAO_BUSCA_INTERATIVA:
+                setbuf(stdin, NULL);
+                busca_interativa(clinica);
+                break;
+            case OPCAO_ESTATISTICAS:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                alterar_registro(NULL, raiz);
+                exibir_estatisticas_medicos(clinica);
                 break;
-            case 5:
+            case OPCAO_FREQUENTES:
+                limpar_tela();
                 setbuf(stdin, NULL);
-                printf("Voltando ao menu principal.\n");
+                int ano, minimo;
+                printf("Digite o ano: ");
+                if (scanf("%d", &ano) != 1) break;
+                printf("Digite o número mínimo de consultas (N): ");
+                if (scanf("%d", &minimo) != 1) break;
+                exibir_pacientes_frequentes(clinica, ano, minimo);
+                break;
+            case OPCAO_ATRASADOS:
                 limpar_tela();
+                setbuf(stdin, NULL);
+                int k;
+                char por_medico;
+                printf("Quantos pacientes (K)? ");
+                if (scanf("%d", &k) != 1) break;
+                printf("Separar por médico (S/N)? ");
+                if (scanf(" %c", &por_medico) != 1) break;
+                exibir_atrasados(clinica, k, por_medico == 'S' || por_medico == 's');
                 break;
-            default:
-                printf("Opção inválida.\n");
-        }
-    } while (opcao != 5);
-}
-
-// Função para exibir o menu principal
-void menu_principal(ListaDupla* lista_m, NoAVL* raiz_l) {
-    int opcao;
-
-    setbuf(stdin, NULL);
-
-    do {
-        printf("\n--- Menu Principal ---\n");
-        printf("1. Pacientes do Moises\n");
-        printf("2. Pacientes da Liz\n");
-        printf("3. Finalizar programa\n");
-        printf("Sua escolha: ");
-        scanf("%d", &opcao);
-
-        switch (opcao) {
-            case 1:
+            case OPCAO_CONCILIAR:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                menu_moises(lista_m);
+                char arquivo_nomes[256];
+                printf("Digite o arquivo com os nomes: ");
+                scanf(" %255[^\n]", arquivo_nomes);
+                conciliar_arquivo(clinica, arquivo_nomes);
                 break;
-            case 2:
+            case OPCAO_IMPORTAR:
                 limpar_tela();
                 setbuf(stdin, NULL);
-                menu_liz(raiz_l);
+                char arquivo_lote[256];
+                printf("Digite o arquivo com os pacientes: ");
+                scanf(" %255[^\n]", arquivo_lote);
+                importar_pacientes(clinica, arquivo_lote);
                 break;
-            case 3:
+            case OPCAO_EXPORTAR:
+                limpar_tela();
+                setbuf(stdin, NULL);
+                char arquivo_compacto[256];
+                printf("Digite o nome do arquivo compacto (ex.: pacientes.pcz): ");
+                scanf(" %255[^\n]", arquivo_compacto);
+                salvar_pacientes_compacto(clinica, arquivo_compacto);
+                break;
+            case OPCAO_AUTOSALVAMENTO:
+                limpar_tela();
+                setbuf(stdin, NULL);
+                exibir_salvamento_automatico(clinica);
+                break;
+            case OPCAO_FINALIZAR:
                 printf("Finalizando programa.\n");
                 break;
             default:
                 printf("Opção inválida.\n");
                 limpar_tela();
         }
-    } while (opcao != 3);
+    } while (opcao != medicos + OPCAO_FINALIZAR);
 }
 
-//função para limpar a tela, dependendo do sistema operacional
+// Função para limpar a tela com sequências ANSI (cursor no início, tela e rolagem apagadas),
+// sem abrir um shell para o comando clear
 void limpar_tela(){
-    #ifdef _WIN32
-        system("cls"); 
-    #else
-        system("clear"); 
-    #endif
+    fputs("\033[H\033[2J\033[3J", stdout);
+}
+
+// Função para obter um número que muda a cada escrita em qualquer cadastro, feita por este
+// processo ou, nos cadastros compartilhados, por outro (com a trava de leitura dos compartilhados)
+unsigned long geracao_cadastros(Clinica* clinica) {
+    unsigned long geracao = clinica->versao;
+    for (int i = 0; i < clinica->quantidade; i++) {
+        if (clinica->registros[i].motor == MOTOR_COMPARTILHADO) geracao += clinica->registros[i].compartilhado->cabecalho->geracao;
+    }
+    return geracao;
+}
+
+// Função para comparar um texto digitado com o início do nome de um paciente, ignorando acentos e caixa
+// Retorna 0 se o nome começa com o texto; senão, o sinal indica a ordem entre os dois (como comparar_busca)
+int comparar_prefixo(const char* prefixo, const Paciente* paciente) {
+    const unsigned char* p = (const unsigned char*)prefixo;
+    const unsigned char* q = (const unsigned char*)paciente->nome;
+    int c;
+    while ((c = dobrar_caractere(&p)) != 0) {
+        int d = dobrar_caractere(&q);
+        if (c != d) return c - d;
+    }
+    return 0;
+}
+
+// Função para achar a faixa dos pacientes cujo nome começa com a consulta: na ordem A-Z eles
+// são vizinhos, então bastam duas buscas binárias (o primeiro que não vem antes e o primeiro depois)
+void atualizar_faixa_interativa(BuscaInterativa* busca) {
+    int esquerda = 0, direita = busca->quantidade;
+    while (esquerda < direita) {
+        int meio = esquerda + (direita - esquerda) / 2;
+        if (comparar_prefixo(busca->consulta, busca->pacientes[meio]) > 0) esquerda = meio + 1;
+        else direita = meio;
+    }
+    busca->inicio = esquerda;
+
+    direita = busca->quantidade;
+    while (esquerda < direita) {
+        int meio = esquerda + (direita - esquerda) / 2;
+        if (comparar_prefixo(busca->consulta, busca->pacientes[meio]) >= 0) esquerda = meio + 1;
+        else direita = meio;
+    }
+    busca->fim = esquerda;
+}
+
+// Função para percorrer, no modo janela, os pacientes cujo nome começa com a consulta: a faixa é
+// contada até o fim, e só os que caem nas linhas visíveis (de topo em diante) são copiados
+void percorrer_janela_interativa(BuscaInterativa* busca) {
+    liberar_pedacos(&busca->copias);
+    busca->janela = (Paciente**)realloc(busca->janela, (busca->visiveis > 0 ? busca->visiveis : 1) * sizeof(Paciente*));
+    if (busca->janela == NULL) {
+        printf("Erro ao alocar memória para a busca interativa.\n");
+        exit(1);
+    }
+
+    IteradorClinica iterador;
+    int total = 0;
+    iniciar_iterador(&iterador, busca->clinica);
+    for (Paciente* paciente = iterador_posicionar(&iterador, busca->consulta);
+         paciente != NULL && comparar_prefixo(busca->consulta, paciente) == 0; paciente = iterador_proximo(&iterador)) {
+        if (total >= busca->topo && total < busca->topo + busca->visiveis) {
+            busca->janela[total - busca->topo] = copiar_paciente_pedacos(&busca->copias, paciente);
+        }
+        total++;
+    }
+    liberar_iterador(&iterador);
+    busca->inicio = 0;
+    busca->fim = total;
+}
+
+// Função para obter o paciente de uma posição da faixa (no modo janela, só das linhas visíveis)
+Paciente* paciente_interativa(BuscaInterativa* busca, int posicao) {
+    if (!busca->em_janela) return busca->pacientes[busca->inicio + posicao];
+    if (posicao < busca->topo || posicao >= busca->topo + busca->visiveis || posicao >= busca->fim) return NULL;
+    return busca->janela[posicao - busca->topo];
+}
+
+// Função para escrever um texto UTF-8 ocupando no máximo 'colunas' colunas do terminal (uma por
+// caractere), completando com espaços se preencher for 1; retorna as colunas ocupadas
+int escrever_colunas(FILE* saida, const char* texto, int colunas, int preencher) {
+    int usadas = 0;
+    size_t bytes = 0;
+    while (texto[bytes] != '\0') {
+        if (((unsigned char)texto[bytes] & 0xC0) != 0x80) {
+            if (usadas == colunas) break;
+            usadas++;
+        }
+        bytes++;
+    }
+    fwrite(texto, 1, bytes, saida);
+    for (; preencher && usadas < colunas; usadas++) putc(' ', saida);
+    return usadas;
+}
+
+// Função para redesenhar a busca interativa: a tela inteira é montada na memória e enviada ao
+// terminal de uma vez, com sequências ANSI; só as linhas visíveis da faixa são formatadas
+void desenhar_busca_interativa(BuscaInterativa* busca) {
+    double inicio = milissegundos_agora();
+    int linhas = 24, colunas = 80;
+    struct winsize janela;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &janela) == 0 && janela.ws_row > 0 && janela.ws_col > 0) {
+        linhas = janela.ws_row;
+        colunas = janela.ws_col;
+    }
+    busca->visiveis = linhas > LINHAS_FIXAS_INTERATIVA ? linhas - LINHAS_FIXAS_INTERATIVA : 1;
+
+    Clinica* clinica = busca->clinica;
+    iniciar_leitura_compartilhada(clinica);
+    int total;
+    if (busca->em_janela) {
+        // A janela segue a linha destacada; se ela passou do fim da faixa, a faixa é percorrida de novo
+        // com a janela no lugar certo
+        busca->quantidade = 0;
+        for (int i = 0; i < clinica->quantidade; i++) busca->quantidade += registro_contar(&clinica->registros[i]);
+        if (busca->selecionado < busca->topo) busca->topo = busca->selecionado;
+        if (busca->selecionado >= busca->topo + busca->visiveis) busca->topo = busca->selecionado - busca->visiveis + 1;
+        percorrer_janela_interativa(busca);
+        total = busca->fim;
+        if (busca->selecionado >= total) {
+            busca->selecionado = total > 0 ? total - 1 : 0;
+            if (busca->selecionado < busca->topo) {
+                busca->topo = busca->selecionado - busca->visiveis + 1 > 0 ? busca->selecionado - busca->visiveis + 1 : 0;
+                percorrer_janela_interativa(busca);
+            }
+        }
+    } else {
+        // Algum cadastro mudou desde a coleta: os pacientes são coletados de novo
+        unsigned long geracao = geracao_cadastros(clinica);
+        if (busca->pacientes == NULL || geracao != busca->geracao) {
+            free(busca->pacientes);
+            busca->pacientes = coletar_pacientes_ordenados(clinica, &busca->quantidade);
+            busca->geracao = geracao;
+        }
+        atualizar_faixa_interativa(busca);
+
+        total = busca->fim - busca->inicio;
+        if (busca->selecionado >= total) busca->selecionado = total > 0 ? total - 1 : 0;
+        if (busca->selecionado < busca->topo) busca->topo = busca->selecionado;
+        if (busca->selecionado >= busca->topo + busca->visiveis) busca->topo = busca->selecionado - busca->visiveis + 1;
+    }
+
+    char* texto = NULL;
+    size_t tamanho = 0;
+    FILE* tela = open_memstream(&texto, &tamanho);
+    if (tela == NULL) {
+        terminar_leitura_compartilhada(clinica);
+        return;
+    }
+
+    // Cursor escondido durante o desenho; cada linha apaga o que sobrou da tela anterior
+    int largura = colunas - 1; // A última coluna fica livre para o terminal não quebrar a linha
+    int largura_nome = largura - 44 > 10 ? largura - 44 : 10;
+    fputs("\033[?25l\033[H", tela);
+    int coluna_cursor = 1 + escrever_colunas(tela, "Busca: ", largura, 0);
+    coluna_cursor += escrever_colunas(tela, busca->consulta, largura - coluna_cursor, 0);
+    fputs("\033[K\r\n\033[2m", tela);
+    int restante = largura - escrever_colunas(tela, "Nome", largura_nome < largura ? largura_nome : largura, 1);
+    escrever_colunas(tela, "  Sexo  Nascimento  Consulta    Médico", restante, 0);
+    fputs("\033[0m\033[K\r\n", tela);
+
+    for (int i = 0; i < busca->visiveis; i++) {
+        int posicao = busca->topo + i;
+        if (posicao < total) {
+            Paciente* paciente = paciente_interativa(busca, posicao);
+            int medico = rotear_paciente(clinica, paciente);
+            char resto[160];
+            snprintf(resto, sizeof(resto), "  %c     %-10s  %-10s  %s", paciente->sexo, paciente->nascimento,
+                     paciente->ultima_consulta, medico >= 0 ? clinica->registros[medico].medico : "");
+            if (posicao == busca->selecionado) fputs("\033[7m", tela);
+            restante = largura - escrever_colunas(tela, paciente->nome, largura_nome < largura ? largura_nome : largura, 1);
+            escrever_colunas(tela, resto, restante, 0);
+            if (posicao == busca->selecionado) fputs("\033[0m", tela);
+        }
+        fputs("\033[K\r\n", tela);
+    }
+
+    char situacao[256];
+    snprintf(situacao, sizeof(situacao),
+             "%d de %d paciente(s) | tela em %.0f µs | ↑↓ PgUp PgDn Home End: mover  Enter: detalhes  Esc: sair",
+             total, busca->quantidade, (milissegundos_agora() - inicio) * 1000.0);
+    fputs("\033[7m", tela);
+    escrever_colunas(tela, situacao, largura, 1);
+    fprintf(tela, "\033[0m\033[K\033[1;%dH\033[?25h", coluna_cursor);
+    terminar_leitura_compartilhada(clinica);
+    fclose(tela);
+
+    for (size_t enviado = 0; enviado < tamanho;) {
+        ssize_t escritos = write(STDOUT_FILENO, texto + enviado, tamanho - enviado);
+        if (escritos <= 0) break;
+        enviado += (size_t)escritos;
+    }
+    free(texto);
+}
+
+// Função para exibir todos os dados do paciente destacado até o usuário apertar uma tecla
+void exibir_detalhes_interativa(BuscaInterativa* busca) {
+    if (busca->selecionado >= busca->fim - busca->inicio) return;
+    Clinica* clinica = busca->clinica;
+
+    iniciar_leitura_compartilhada(clinica);
+    Paciente* paciente = paciente_interativa(busca, busca->selecionado);
+    if (paciente == NULL) {
+        // Modo janela: as teclas levaram a linha destacada para fora da janela desde a última tela
+        busca->topo = busca->selecionado;
+        percorrer_janela_interativa(busca);
+        paciente = paciente_interativa(busca, busca->selecionado);
+    }
+    if (paciente == NULL) {
+        terminar_leitura_compartilhada(clinica);
+        return;
+    }
+    int medico = rotear_paciente(clinica, paciente);
+    limpar_tela();
+    if (medico >= 0) {
+        printf("Paciente do cadastro de %s.\n", clinica->registros[medico].medico);
+        auditar(clinica->auditoria, EVENTO_LEITURA, clinica->registros[medico].medico, paciente->nome);
+    }
+    exibir_paciente(paciente);
+    terminar_leitura_compartilhada(clinica);
+    printf("\nPressione qualquer tecla para voltar à busca.");
+    fflush(stdout);
+
+    unsigned char tecla[16];
+    if (read(STDIN_FILENO, tecla, sizeof(tecla)) < 0) return;
+}
+
+// Função para aplicar as teclas lidas de uma vez do terminal (uma tecla, uma sequência de
+// escape ou um trecho colado); retorna 0 quando o usuário sai da busca
+int tratar_teclas_interativa(BuscaInterativa* busca, const unsigned char* teclas, size_t quantidade) {
+    // Esc sozinho sai; as setas e as demais teclas especiais chegam como Esc [ ... (ou Esc O ...)
+    if (quantidade == 1 && teclas[0] == 0x1B) return 0;
+
+    size_t i = 0;
+    while (i < quantidade) {
+        unsigned char c = teclas[i++];
+        if (c == 0x1B && i < quantidade && (teclas[i] == '[' || teclas[i] == 'O')) {
+            i++;
+            char codigo = 0, final = 0;
+            while (i < quantidade) {
+                unsigned char parte = teclas[i++];
+                if (parte >= '0' && parte <= '9') {
+                    if (codigo == 0) codigo = (char)parte;
+                    continue;
+                }
+                final = (char)parte;
+                break;
+            }
+            if (final == 'A') busca->selecionado--;
+            else if (final == 'B') busca->selecionado++;
+            else if (final == '~' && codigo == '5') busca->selecionado -= busca->visiveis;
+            else if (final == '~' && codigo == '6') busca->selecionado += busca->visiveis;
+            else if (final == 'H' || (final == '~' && codigo == '1')) busca->selecionado = 0;
+            else if (final == 'F' || (final == '~' && codigo == '4')) busca->selecionado = busca->fim - busca->inicio - 1;
+            if (busca->selecionado < 0) busca->selecionado = 0;
+        } else if (c == 3 || c == 4) {
+            return 0; // Ctrl-C ou Ctrl-D
+        } else if (c == '\r' || c == '\n') {
+            exibir_detalhes_interativa(busca);
+        } else if (c == 0x7F || c == 0x08) {
+            // Apaga o último caractere inteiro, com os bytes de continuação do UTF-8
+            while (busca->tamanho_consulta > 0 && ((unsigned char)busca->consulta[busca->tamanho_consulta - 1] & 0xC0) == 0x80) {
+                busca->tamanho_consulta--;
+            }
+            if (busca->tamanho_consulta > 0) busca->tamanho_consulta--;
+            busca->consulta[busca->tamanho_consulta] = '\0';
+            busca->selecionado = 0;
+        } else if (c == 0x15) {
+            busca->tamanho_consulta = 0; // Ctrl-U apaga a consulta
+            busca->consulta[0] = '\0';
+            busca->selecionado = 0;
+        } else if (c >= 0x20 && busca->tamanho_consulta + 1 < sizeof(busca->consulta)) {
+            busca->consulta[busca->tamanho_consulta++] = (char)c;
+            busca->consulta[busca->tamanho_consulta] = '\0';
+            busca->selecionado = 0;
+        }
+    }
+    return 1;
+}
+
+// Função para colocar o terminal em modo bruto: cada tecla chega na hora, sem eco e sem que
+// Ctrl-C encerre o programa; a configuração anterior fica em *original
+// Retorna 0 se a entrada ou a saída não forem um terminal
+int entrar_modo_bruto(struct termios* original) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) || tcgetattr(STDIN_FILENO, original) != 0) return 0;
+    struct termios bruto = *original;
+    bruto.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    bruto.c_iflag &= ~(IXON | ICRNL);
+    bruto.c_cc[VMIN] = 1;
+    bruto.c_cc[VTIME] = 0;
+    return tcsetattr(STDIN_FILENO, TCSAFLUSH, &bruto) == 0;
+}
+
+// Função da busca interativa: os resultados são atualizados a cada tecla, na tela alternativa do
+// terminal, que volta ao que era quando a busca termina
+void busca_interativa(Clinica* clinica) {
+    struct termios original;
+    materializar_clinica(clinica);
+    fflush(stdout);
+    if (!entrar_modo_bruto(&original)) {
+        printf("A busca interativa precisa de um terminal.\n");
+        return;
+    }
+    auditar(clinica->auditoria, EVENTO_LISTAGEM, "", "");
+    fputs("\033[?1049h", stdout);
+    fflush(stdout);
+
+    BuscaInterativa busca;
+    memset(&busca, 0, sizeof(BuscaInterativa));
+    busca.clinica = clinica;
+    busca.em_janela = clinica_tem_disco(clinica);
+    while (1) {
+        aplicar_recarga(clinica, 0);
+        desenhar_busca_interativa(&busca);
+
+        // Com a recarga ligada, mudanças no arquivo redesenham a tela sem esperar uma tecla
+        if (clinica->recarga != NULL) {
+            struct pollfd eventos[2] = {{STDIN_FILENO, POLLIN, 0}, {clinica->recarga->aviso[0], POLLIN, 0}};
+            if (poll(eventos, 2, -1) > 0 && eventos[0].revents == 0) continue;
+        }
+        unsigned char teclas[256];
+        ssize_t lidos = read(STDIN_FILENO, teclas, sizeof(teclas));
+        if (lidos <= 0 || !tratar_teclas_interativa(&busca, teclas, (size_t)lidos)) break;
+    }
+
+    free(busca.pacientes);
+    free(busca.janela);
+    liberar_pedacos(&busca.copias);
+    fputs("\033[?1049l", stdout);
+    fflush(stdout);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
 }
 
 // Função para liberar a memória da lista duplamente encadeada
@@ -742,12 +10645,25 @@ void destruir_lista(ListaDupla* lista) {
     NoLista* atual = lista->inicio;
     while (atual != NULL) {
         NoLista* proximo = atual->proximo;
+        liberar_historico(atual->paciente.historico);
         free(atual); // Libera o nó atual
         atual = proximo;
     }
     free(lista); // Libera a estrutura da lista
 }
 
+// Função para liberar a memória da lista desenrolada
+void destruir_lista_blocos(ListaBlocos* lista) {
+    BlocoPacientes* bloco = lista->inicio;
+    while (bloco != NULL) {
+        BlocoPacientes* proximo = bloco->proximo;
+        for (int i = 0; i < bloco->quantidade; i++) liberar_historico(bloco->pacientes[i].historico);
+        free(bloco);
+        bloco = proximo;
+    }
+    free(lista);
+}
+
 // Função para liberar a memória da árvore AVL
 void destruir_avl(NoAVL* raiz) {
     if (raiz == NULL) return;
@@ -756,6 +10672,7 @@ void destruir_avl(NoAVL* raiz) {
     destruir_avl(raiz->esquerda);
     destruir_avl(raiz->direita);
 
-    // Libera o nó atual
+    // Libera o nó atual e o histórico do paciente
+    liberar_historico(raiz->paciente.historico);
     free(raiz);
 }